@@ -6,6 +6,20 @@
 #include <uart2.h>
 #include <string.h>
 #include <math.h>
+#include "servo.h"
+#include "logexport.h"
+#include "telemetry.h"
+#include "journal.h"
+#include "packlog.h"
+#include "dircache.h"
+#include "format.h"
+#include "config.h"
+#include "sampler.h"
+#include "pulses.h"
+#include "pulselog.h"
+#include "timebase.h"
+#include "snapshot.h"
+#include "bustrace.h"
 
 // I2C Functions -------------------------------------------------------------------
 
@@ -45,6 +59,8 @@ Boolean i2c_start(void)
   // Wait for start command to be complete
   while(I2C2CONbits.SEN);
   while((!IFS3bits.MI2C2IF) * x--);
+  if(!IFS3bits.MI2C2IF) TRACE(TRACE_TIMEOUT, TRACE_START);
+  TRACE(TRACE_START, 0);
 
 //  if(!I2C2CONbits.S)  // If no slave detects start, fail
 //    return 0;
@@ -67,6 +83,8 @@ int i2c_restart(void)
   // Wait for restart command to be complete
   while(I2C2CONbits.RSEN);
   while((!IFS3bits.MI2C2IF) * x--);
+  if(!IFS3bits.MI2C2IF) TRACE(TRACE_TIMEOUT, TRACE_RESTART);
+  TRACE(TRACE_RESTART, 0);
 
 //  if(!I2C2CONbits.S)  // If no slave detects start, fail
 //    return 0;
@@ -86,6 +104,7 @@ int send_byte(char byte)
 
   // Send byte
   I2C2TRN = byte; 
+  TRACE(TRACE_WRITE, byte);
 
   // Collision control
   while(I2C2STATbits.IWCOL)
@@ -95,7 +114,10 @@ int send_byte(char byte)
     I2C2TRN = byte;
     x++;
     if(x == 3)
-     return 2;
+    {
+      TRACE(TRACE_ACK, 2);
+      return 2;
+    }
   }
 
   // Wait until done sending
@@ -107,6 +129,7 @@ int send_byte(char byte)
 
   // Wait for ack/nack from slave
   while((!IFS3bits.MI2C2IF) * x--);
+  TRACE(TRACE_ACK, ackStat);
 
   return ackStat; // return ack/nack from slave
 }
@@ -130,6 +153,8 @@ void send_ack(Boolean ack)
   while(I2C2CONbits.ACKEN * x--);
   x = 3;
   while((!IFS3bits.MI2C2IF) * x--);
+  if(I2C2CONbits.ACKEN) TRACE(TRACE_TIMEOUT, TRACE_ACKOUT);
+  TRACE(TRACE_ACKOUT, ack);
 }
 
 // reads byte of incoming data 
@@ -155,7 +180,11 @@ char read_data(void)
 
   // ONLY IMPLEMENT if slave packet will never = 0xff
   if(x==0)                // if transfer did not finish
+  {
+    TRACE(TRACE_TIMEOUT, TRACE_READ);
     return 0xff;          // return 0xff
+  }
+  TRACE(TRACE_READ, dataRead);
 
   // clear flag
   I2C2STATbits.I2COV = 0;
@@ -171,6 +200,8 @@ void i2c_stop(void)
   IFS3bits.MI2C2IF = 0; // clear flag
   I2C2CONbits.PEN = 1;  // initiate stop
   while(!IFS3bits.MI2C2IF * x--); // wait for completion
+  if(!IFS3bits.MI2C2IF) TRACE(TRACE_TIMEOUT, TRACE_STOP);
+  TRACE(TRACE_STOP, 0);
 }
 
 // convert a date/time variable from decimal to Binary Coded Decimal
@@ -326,102 +357,252 @@ Boolean set_time(DateAndTime now)
   return 1; // success
 }
 
+// turns on the RTC's SQW/OUT at 1 Hz for timebase, returns 1 if it answered
+Boolean rtc_squareWave(void)
+{
+  // initiate communication
+  i2c_start();
+  delay_us(5);
+
+  // address in write mode, the control register, SQWE with RS = 1 Hz
+  if(send_byte(0xD0) || send_byte(0x07) || send_byte(0x10))
+  {
+      I2C2CONbits.PEN = 1;  // failed to communicate
+      return 0;             // return fail
+  }
+  delay_us(5);
+
+  // end communication
+  i2c_stop();
+
+  return 1; // success
+}
+
+// reads length bytes of the RTC from register address on, the RAM is 8-63;
+// returns 1 if success, 0 if not
+Boolean rtc_ram_read(unsigned char address, unsigned char *data, int length)
+{
+  // initiate communication
+  i2c_start();
+  delay_us(5);
+
+  // address in write mode, then the register to start from
+  if(send_byte(0xD0) || send_byte(address))
+  {
+      I2C2CONbits.PEN = 1;  // failed to communicate
+      return 0;             // return fail
+  }
+  delay_us(5);
+
+  // restart bus in read mode
+  i2c_restart();
+  delay_us(5);
+  if(send_byte(0xD1))
+  {
+      I2C2CONbits.PEN = 1;  // failed to communicate
+      return 0;             // return fail
+  }
+  delay_us(5);
+
+  // the RTC moves on a register per byte, NACK the last
+  while(length--)
+  {
+    *data++ = read_data();
+    delay_us(1);
+    send_ack(length == 0);
+    delay_us(5);
+  }
+
+  // end communication
+  i2c_stop();
+
+  return 1; // success
+}
+
+// writes length bytes to the RTC from register address on, returns 1 if
+// success, 0 if not
+Boolean rtc_ram_write(unsigned char address, unsigned char *data, int length)
+{
+  // initiate communication
+  i2c_start();
+  delay_us(5);
+
+  // address in write mode, then the register to start from
+  if(send_byte(0xD0) || send_byte(address))
+  {
+      I2C2CONbits.PEN = 1;  // failed to communicate
+      return 0;             // return fail
+  }
+  delay_us(5);
+
+  while(length--)
+  {
+    send_byte(*data++);
+    delay_us(5);
+  }
+
+  // end communication
+  i2c_stop();
+
+  return 1; // success
+}
+
 // Geiger Counter function --------------------------------------------------
 
+// the '1's in the next config.window characters, scaled to 60 of them;
+// characters past the window stay queued for the next call
 int getCount (void)
 {
-  int x = 10000, cpm = 0, size = 0;
+  int x, cpm = 0, size = config.window;
   char data[60];
 
-  while(size < 30) size = uart2.size();
- 
-  uart2.receive(data,size);
+  while(uart2.size() < size);
+  uart2.receive(data, size);
+  TRACE(TRACE_RX, size);
 
-  for(x = 0; x < 30; x++)
+  for(x = 0; x < size; x++)
     if(data[x] == '1') cpm++;
 
-  return (cpm*(60/size));
+  return cpm*60/size;
 }
 
 //SERVO Functions ------------------------------------------------------------
 
-void Servo_init()
+// the four shield servos share two signal lines and the power driver picks
+// which servo of a pair moves:  servo1 A/R, servo2 B/B, servo3 B/R, servo4 A/B
+#define LINE_R 0            // OC1, the old ledR pin
+#define LINE_B 1            // OC2, the old ledB pin
+
+// position feedback: servo n's potentiometer wiper is read on RSQn and
+// reads linearly from FB_1000 at 1000 us to FB_2000 at 2000 us
+#define FB_1000 205         // 0.66 V
+#define FB_2000 818         // 2.64 V
+#define FB_TOLERANCE 8      // ADC counts, about 13 us or 1.2 degrees
+#define FB_SAMPLE 20        // ms between feedback checks, one servo frame
+
+Line *logBegin(void);
+void logEnd(void);
+void keepProgress(void);
+
+// the last time stamped, shared by the log records and TIME.TXT so each
+// sample only rewrites the digits that changed
+Stamp timeStamp;
+
+// the old ledR/ledB dutycycle percentages as 1000-2000 us servo pulses
+#define PERCENT_US(p) (1000 + 10*(p))
+
+// last pulse width sent to each servo, centered until the first move
+unsigned int servoPos[4] = {1500, 1500, 1500, 1500};
+
+// read servo num's position feedback, 10 bit ADC counts
+int servoFeedback(int num)
 {
-    //disable for configuring
-    OC1CON1 = 0x1C08;
-    OC2CON1 = 0x1C08;
+    switch(num)
+    {
+      case 1:  return resistiveSensors.getQ1(4,1);
+      case 2:  return resistiveSensors.getQ2(4,1);
+      case 3:  return resistiveSensors.getQ3(4,1);
+      default: return resistiveSensors.getQ4(4,1);
+    }
+}
 
+#if PULSE_FRONT == PULSE_CAPTURE
+// move the pulse times out of the ring before it fills, with config.times;
+// motor -2 while a servo moves
+void keepStamps(int motor)
+{
+  unsigned long stamps[32];
+  unsigned int n, i, lost;
 
-    //reset the pwm period to 50 Hz
-    OC1RS = FCY/50 - 1;
-    OC2RS = FCY/50 - 1;
-    //enable
-    OC1CON1 |= 0x6;
-    OC2CON1 |= 0x6;
+  if(!config.times) return;
+  do
+  {
+    n = pulses.times(stamps, 32, &lost);
+    for(i = 0; i < n; i++) pulseLog.add(stamps[i], motor);
+    if(lost) pulseLog.lost(lost);
+  } while(n == 32);
+}
+#else
+#define keepStamps(motor)
+#endif
+
+// power servo num (1-4) and ramp it to us, the pulses come from OC1/OC2.
+// Power stays on until the feedback shows the servo within tolerance of us
+// or config.servoHold runs out; the settle time is logged either way.
+void moveServo(int num, unsigned int us)
+{
+    int line = (num == 1 || num == 3) ? LINE_R : LINE_B;
+    Boolean driverA = (num == 1 || num == 4);
+    int expected = FB_1000 + (long)((int)us - 1000)*(FB_2000 - FB_1000)/1000;
+    int error = 0;
+    unsigned int settle;
+    Line *rec;
+
+    // keep the other line quiet or its servo on the same driver moves too
+    servo.release(!line);
+
+    // start from where this servo was left, the ramp runs in hardware
+    servo.pulse(line, servoPos[num-1]);
+    if(driverA) powerDriverA.on(); else powerDriverB.on();
+    servo.moveTo(line, us, config.servoRamp);
+
+    // verify, the ramp has to finish before the servo can be on target
+    for(settle = 0; settle < config.servoHold; settle += FB_SAMPLE)
+    {
+      wait(FB_SAMPLE);
+      keepStamps(-2);
+      if(servo.isMoving(line)) continue;
+      error = servoFeedback(num) - expected;
+      if(error >= -FB_TOLERANCE && error <= FB_TOLERANCE) break;
+    }
+    if(driverA) powerDriverA.off(); else powerDriverB.off();
+
+    servoPos[num-1] = us;
+
+    rec = logBegin();
+    format.text(rec, "\nTime,");
+    format.update(&timeStamp, timebase.now());
+    format.text(rec, timeStamp.text);
+    format.text(rec, ",Servo,");
+    format.integer(rec, num);
+    format.text(rec, ",Pulse,");
+    format.number(rec, us);
+    if(settle < config.servoHold)
+    {
+      format.text(rec, ",Settle,");
+      format.number(rec, settle + FB_SAMPLE);
+    }
+    else
+    {
+      format.text(rec, ",Stalled,");
+      format.integer(rec, error);
+    }
+    format.character(rec, '\t');
+    logEnd();
 }
 
 void increment0(void)
 {
-    //servo1 out
-    powerDriverA.on();
-    ledR.dutycycle(80);
-    wait(3000);
-    powerDriverA.off();
-
-    //servo2 out
-    ledR.dutycycle(0);
-    powerDriverB.on();
-    ledB.dutycycle(50);
-    wait(3000);
-    powerDriverB.off();
-
-    //serv03 out
-    ledB.dutycycle(0);
-    powerDriverB.on();
-    ledR.dutycycle(70);
-    wait(3000);
-    powerDriverB.off();
-
-    //servo4 out
-    ledR.dutycycle(0);
-    powerDriverA.on();
-    ledB.dutycycle(50);
-    wait(3000);
-    powerDriverA.off();
+    moveServo(1, PERCENT_US(80));
+    moveServo(2, PERCENT_US(50));
+    moveServo(3, PERCENT_US(70));
+    moveServo(4, PERCENT_US(50));
 }
 void increment1(void)
 {
-    powerDriverA.on();
-    ledR.dutycycle(60);
-    wait(3000);
-    powerDriverA.off();
+    moveServo(1, PERCENT_US(60));
 }
 void increment2 (void)
 {
-    ledR.dutycycle(0);
-    powerDriverB.on();
-
-    ledB.dutycycle(80);
-    wait(3000);
-    powerDriverB.off();
+    moveServo(2, PERCENT_US(80));
 }
 void increment3 (void)
 {
-    ledB.dutycycle(0);
-    powerDriverB.on();
-
-    ledR.dutycycle(40);
-    wait(3000);
-    powerDriverB.off();
+    moveServo(3, PERCENT_US(40));
 }
 void increment4 (void)
 {
-    ledR.dutycycle(0);
-    powerDriverA.on();
-
-    ledB.dutycycle(70);
-    wait(3000);
-    powerDriverA.off();
+    moveServo(4, PERCENT_US(70));
 }
 
 // File functions ------------------------------------------------------------
@@ -429,10 +610,10 @@ void increment4 (void)
 DateAndTime getTimeFromFile(String filename)                  
 {                                         
   char fileTime[24] = {0};                          
-  FSFILE* timeFile = FSfopen(filename, "r");                  
+  FSFILE* timeFile = dirCache.open(filename, "r");                  
   if(!timeFile) return dateTime.new(0,0,0,0,0,0);               
   FSfread(fileTime, sizeof(char), 24, timeFile);                
-  FSfclose(timeFile);                             
+  dirCache.close(timeFile);                             
                     
   return dateTime.parseStamp(fileTime);                   
 }                                       
@@ -440,40 +621,306 @@ DateAndTime getTimeFromFile(String filename)
 //Put time stamp "Time" into file "filename"                  
 void putTimeToFile(String filename, DateAndTime Time)
 {                                         
-  FSFILE* timeFile = FSfopen(filename, "w");
+  format.update(&timeStamp, Time);    // before the card, the log uses it too
+  FSFILE* timeFile = dirCache.open(filename, "w");
   if(!timeFile) return;                           
-  FSfprintf(timeFile, "%s", dateTime.toStamp(Time));
-  FSfclose(timeFile);                               
+  FSfwrite(timeStamp.text, 1, strlen(timeStamp.text), timeFile);
+  dirCache.close(timeFile);                               
 }                                       
                   
 //Chech SD card for a file named filename                   
 Boolean checkForFile(String filename)                     
 {                                       
-  FSFILE* file = FSfopen(filename, "r");                                
-  if(!file) return 0; // no file could be read/found
-  FSfclose(file);
-  return 1;     // file found       
+  return dirCache.exists(filename);   // no card access once loaded
 }
 
-char dat[70];
+// the log survives power cuts mid-write, tools/jnlcat turns it back to text
+#define LOG_FILE "DATALOG.JNL"
+#define PACK_FILE "DATALOG.PKL"    // the same records compressed, with pack=1
+#define PULSE_FILE "PULSES.BIN"   // pulse times with times=1, see pulselog.h
+#define TIME_FILE "TIME.TXT"      // last time logged, for boots without RTC
+#define START_FILE "START.TXT"    // when the experiment started, 8.3 name
+#define CONFIG_FILE "SITE.CFG"    // optional settings, see config.h
+
+// a log record is formatted straight into the next journal block, which
+// with config.pack is only the scratch space packLog encodes it from
+Line logLine;
 
-void logdata(String str)
+Line *logBegin(void)
 {
-  FSFILE* timeFile = FSfopen("dataLog.txt", FS_APPEND);
-  if(!timeFile) return;                           
-  FSfprintf(timeFile, str);              
-  FSfclose(timeFile);  
+  format.begin(&logLine, journal.record(), JOURNAL_PAYLOAD);
+  return &logLine;
+}
+
+void logEnd(void)
+{
+  // the same record to anyone watching live, never waits on USB
+  telemetry.push(logLine.buffer);
+
+  if(config.pack)
+    packLog.append(logLine.buffer, logLine.length);
+  else
+    journal.commit(logLine.length);
+}
+
+// the time for a sample record, every config.checkpoint'th also goes to
+// TIME.TXT and every config.progress'th the progress to the RTC; moves
+// keep theirs at once, so that only refreshes the baseline and log size
+DateAndTime sampleTime(void)
+{
+  static unsigned int samples = 0, kept = 0;
+  DateAndTime now = timebase.now();
+
+  format.update(&timeStamp, now);
+  if(++samples >= config.checkpoint)
+  {
+    putTimeToFile(TIME_FILE, now);
+    samples = 0;
+  }
+  if(++kept >= config.progress)
+  {
+    keepProgress();
+    kept = 0;
+  }
+  return now;
+}
+
+// log what sampler.next() handed out
+void logSample(Sample *sample, int motor)
+{
+  Line *rec;
+  int i;
+
+  sampleTime();
+  rec = logBegin();
+  format.text(rec, "\nTime,");
+  format.text(rec, timeStamp.text);
+  switch(sample->kind)
+  {
+    case SAMPLE_SUMMARY:
+      format.text(rec, ",CPM,");
+      format.number(rec, ((unsigned long)sample->counts*60 + sample->seconds/2)/sample->seconds);
+      format.text(rec, ",Secs,");
+      format.number(rec, sample->seconds);
+      format.text(rec, ",Motor,");
+      format.integer(rec, motor);
+      break;
+
+    case SAMPLE_ONSET:
+      // the seconds that tripped it, oldest first
+      format.text(rec, ",Burst,");
+      for(i = 0; i < sample->historyLength; i++)
+      {
+        if(i) format.character(rec, ';');
+        format.number(rec, sample->history[i]);
+      }
+      break;
+
+    default:
+      format.text(rec, ",Counts,");
+      format.number(rec, sample->counts);
+      break;
+  }
+  format.character(rec, '\t');
+  logEnd();
+}
+
+// Boot functions ------------------------------------------------------------
+
+// SD work left after reset, done one step per main loop pass so the
+// Geiger UART is already capturing while the card is probed
+#define BOOT_SCAN    0    // one directory pass into dirCache
+#define BOOT_CONFIG  1    // site settings from SITE.CFG
+#define BOOT_TIME    2    // no RTC: take the time from TIME.TXT
+#define BOOT_START   3    // experiment start from START.TXT
+#define BOOT_JOURNAL 4    // find the end of the log
+#define BOOT_DONE    5
+
+int bootStage = BOOT_SCAN;
+Boolean rtcOk = 0;
+unsigned long captureMs = 0;
+int configTaken = -1;       // settings read from CONFIG_FILE, -1 for none
+Boolean snapshotFound = 0;  // snapshotRam.load() had one at boot
+Boolean snapshotReady = 0;  // snapshot is this experiment's, kept from now on
+
+void bootStep(DateAndTime *CurrentTime, DateAndTime *StartTime)
+{
+  Line *rec;
+
+  switch(bootStage)
+  {
+    case BOOT_SCAN:
+      dirCache.load();
+      bootStage = BOOT_CONFIG;
+      break;
+
+    case BOOT_CONFIG:
+      configTaken = configFile.load(CONFIG_FILE);
+      if(config.baud) uart2.baudrate(config.baud);
+      bootStage = rtcOk ? BOOT_START : BOOT_TIME;
+      break;
+
+    case BOOT_TIME:
+      if(checkForFile(TIME_FILE))
+        *CurrentTime = getTimeFromFile(TIME_FILE);
+      else
+        putTimeToFile(TIME_FILE, *CurrentTime);
+      dateTime.set(*CurrentTime);
+      bootStage = BOOT_START;
+      break;
+
+    case BOOT_START:
+      if(checkForFile(START_FILE))
+        *StartTime = getTimeFromFile(START_FILE);
+      else
+      {
+        putTimeToFile(START_FILE, *CurrentTime);
+        *StartTime = *CurrentTime;
+      }
+      bootStage = BOOT_JOURNAL;
+      break;
+
+    case BOOT_JOURNAL:
+      // skips a record torn by a power cut
+      if(config.pack)
+        packLog.open(PACK_FILE);
+      else
+        journal.open(LOG_FILE);
+#if PULSE_FRONT == PULSE_CAPTURE
+      if(config.times && pulseLog.open(PULSE_FILE) >= 0) pulses.stamp(1);
+#endif
+      bootStage = BOOT_DONE;
+      rec = logBegin();
+      format.text(rec, "\nBoot,");
+      format.update(&timeStamp, timebase.now());
+      format.text(rec, timeStamp.text);
+      format.text(rec, ",Capture,");
+      format.number(rec, captureMs);
+      format.text(rec, ",Ready,");
+      format.number(rec, timebase.millis());
+      format.text(rec, ",Log,");
+      format.number(rec, config.pack ? packLog.blocks() : journal.blocks());
+      format.text(rec, ",Config,");
+      format.integer(rec, configTaken);
+      format.character(rec, '\t');
+      logEnd();
+      break;
+  }
+}
+
+// the first pass after boot: a reset mid experiment carries on from the
+// snapshot found at boot if START.TXT shows the same experiment, the
+// servos are left where it says they are.  Returns 0 for a fresh start,
+// whose first moves still ramp from there.
+Boolean resumeProgress(DateAndTime start)
+{
+  Line *rec;
+
+  snapshotReady = 1;
+  if(snapshotFound) memcpy(servoPos, snapshot.servoPos, sizeof(servoPos));
+  if(!snapshotFound || !snapshotRam.of(start))
+  {
+    memset(&snapshot, 0, sizeof(snapshot));
+    snapshot.motor = -1;
+    snapshot.start = start;
+    return 0;
+  }
+  sampler.resume(snapshot.rate, snapshot.learned);
+
+  rec = logBegin();
+  format.text(rec, "\nResume,");
+  format.update(&timeStamp, timebase.now());
+  format.text(rec, timeStamp.text);
+  format.text(rec, ",Motor,");
+  format.integer(rec, snapshot.motor);
+  format.text(rec, ",Moves,");
+  format.number(rec, snapshot.moves);
+  format.text(rec, ",Logged,");
+  format.number(rec, snapshot.logged);
+  format.character(rec, '\t');
+  logEnd();
+  return 1;
+}
+
+// the experiment's progress to the RTC's RAM, on each move and every
+// config.progress samples
+void keepProgress(void)
+{
+  unsigned long learned;
+
+  if(!rtcOk || !snapshotReady) return;
+  memcpy(snapshot.servoPos, servoPos, sizeof(servoPos));
+  snapshot.logged = config.pack ? packLog.blocks() : journal.blocks();
+  sampler.baseline(&snapshot.rate, &learned);
+  snapshot.learned = learned > 65535 ? 65535 : learned;
+  snapshotRam.save(rtc_ram_write);
 }
 
+#if PULSE_FRONT != PULSE_UART
+// the tube counter read once a second into the sampler, or with adapt=0 a
+// record per config.window seconds like the old UART window
+void readPulses(int motor)
+{
+  static unsigned long lastMs = 0, windowCounts = 0;
+  static unsigned int windowSeconds = 0;
+  unsigned long ms = timebase.millis(), seconds = ms/1000 - lastMs/1000;
+  unsigned int counts, share;
+  Sample sample;
+  Line *rec;
+
+  keepStamps(motor);
+  if(!seconds) return;
+  counts = pulses.take(ms - lastMs);
+  lastMs = ms;
+
+  if(!config.adapt)
+  {
+    windowCounts += counts;
+    windowSeconds += seconds;
+    if(windowSeconds < config.window) return;
+    sampleTime();
+    rec = logBegin();
+    format.text(rec, "\nTime,");
+    format.text(rec, timeStamp.text);
+    format.text(rec, ",CPM,");
+    format.number(rec, windowCounts*60/windowSeconds);
+    format.text(rec, ",Motor,");
+    format.integer(rec, motor);
+    format.character(rec, '\t');
+    logEnd();
+    windowCounts = windowSeconds = 0;
+    return;
+  }
+
+  // a loop held up by a servo move shares the counts out over its seconds
+  for(; seconds; seconds--)
+  {
+    share = counts/seconds;
+    counts -= share;
+    sampler.second(share);
+    while(sampler.next(&sample)) logSample(&sample, motor);
+  }
+}
+#endif
+
 /*****************************  MAIN  *****************************/
 
 int main (void)
 {
-  //initialize NESI+ systems
+  //initialize NESI+ systems, Geiger capture first
   nesi.init();
-  i2c_init();
+  timebase.init();
+#if BUS_TRACE
+  busTrace.init();
+#endif
   uart2.init();
-  Servo_init();
+#if PULSE_FRONT != PULSE_UART
+  pulses.init(PULSE_RP);
+#endif
+  captureMs = timebase.millis();
+  i2c_init();
+  servo.init();
+  sampler.reset();
 
   DateAndTime StartTime, CurrentTime;
 
@@ -487,32 +934,16 @@ int main (void)
   
 //   set_time(CurrentTime);
 
-  // Read RTC
-  CurrentTime = read_time();
-
-  if(CurrentTime.year == NULL)
-  {
-    if(checkForFile("time.txt"))
-      CurrentTime = getTimeFromFile("time.txt");
-    else
-      putTimeToFile("time.txt",CurrentTime);
-
-  }
-
-  wait(1000);
-
-  if(!checkForFile("StartTime.txt"))
-  {
-    putTimeToFile("StartTime.txt",CurrentTime);
-    StartTime = CurrentTime;
-  }
-  else
-  {
-    StartTime = getTimeFromFile("StartTime.txt");
-  }
-
+  // Read RTC once, its 1 Hz edges keep the time from then on; the SD card
+  // is left to bootStep() in the main loop
+  rtcOk = rtc_squareWave() && timebase.sync(read_time, RTC_SQW_RP);
+  if(rtcOk) CurrentTime = timebase.now();
+  StartTime = CurrentTime;
   dateTime.set(CurrentTime);
 
+  // and its RAM, where the experiment was before a reset
+  snapshotFound = rtcOk && snapshotRam.load(rtc_ram_read);
+
   //servo movement and geiger readings
 //  dataLog.add("\n=============Finish Setup============",'=');
 
@@ -521,54 +952,111 @@ int main (void)
   Servo2 = 0,
   Servo3 = 0,
   Servo4 = 0,
-  CurServo = -1, // for initial motor position
-  CountsPerMin = 0;
+  CurServo = -1; // for initial motor position
+  Boolean buttonHeld = 0;
+  Line *rec;
+#if PULSE_FRONT == PULSE_UART
+  int CountsPerMin = 0;
+  char geiger[16];
+  int received, i;
+  Sample sample;
+#endif
   
   while(1)
   {
-    // allow access to sd for debugging
-//    if(button.isPressed())
-//    {
-//      wait(1000);
-//      usb.connect();
-//      while(!button.isPressed())
-//      {
-//        usb.process();
-//        // sprintf(message, "Time is: %s\r\n", dateTime.getStamp());
-//        // usb.print(message);
-//        // wait(1500);
-//      }
-//    usb.disconnect();
-//    }
+    // the button turns live telemetry (tools/telview) on and off, logging
+    // carries on either way
+    if(button.isPressed())
+    {
+      if(!buttonHeld)
+      {
+        if(telemetry.isRunning()) telemetry.stop();
+        else telemetry.start();
+      }
+      buttonHeld = 1;
+    }
+    else
+      buttonHeld = 0;
+
+    // telemetry and log exports (tools/logpull) share the USB: an export
+    // starts between two telemetry lines and holds telemetry back
+    if(telemetry.isRunning())
+    {
+      if(!logExport.isBusy()) telemetry.service();
+      if(logExport.isBusy() || telemetry.atLineEnd()) logExport.service();
+    }
+
+    // finish booting, the Geiger bytes wait in the UART buffer meanwhile
+    if(bootStage != BOOT_DONE)
+    {
+      bootStep(&CurrentTime, &StartTime);
+      continue;
+    }
+
+    // the moves done before a reset are not made again
+    if(!snapshotReady && resumeProgress(StartTime))
+    {
+      Servo1 = snapshot.moves >> 1 & 1;
+      Servo2 = snapshot.moves >> 2 & 1;
+      Servo3 = snapshot.moves >> 3 & 1;
+      Servo4 = snapshot.moves >> 4 & 1;
+      CurServo = snapshot.motor;
+    }
 
   //intialize variables for Servo movement verification and Referrence time
 
 
   DateAndTime MoveTime;
 
-  CurrentTime = dateTime.get();
+  CurrentTime = timebase.now();
 
-  //read geiger continuously
-  if(uart2.size() > 25)
+  //read geiger continuously, the sampler decides what gets logged
+#if PULSE_FRONT != PULSE_UART
+  readPulses(CurServo);
+#else
+  if(config.adapt)
+  {
+    // a few seconds of characters at a time, but the sampler keeps only
+    // 8 samples, so they are logged after every character, every second
+    if(uart2.size() > 0)
+    {
+      received = uart2.receive(geiger, sizeof(geiger));
+      TRACE(TRACE_RX, received);
+      for(i = 0; i < received; i++)
+      {
+        sampler.feed(&geiger[i], 1);
+        while(sampler.next(&sample)) logSample(&sample, CurServo);
+      }
+    }
+  }
+  // or the old way, a sample per config.window characters
+  else if(uart2.size() >= (int)config.window)
   {
     CountsPerMin = getCount();
-    CurrentTime = read_time();
-    sprintf(dat, "\nTime,%s,CPM,%d,Motor,%d\t",dateTime.toStamp(CurrentTime),CountsPerMin,CurServo);
-    putTimeToFile("time.txt",CurrentTime);
-    logdata(dat);
+    CurrentTime = sampleTime();
+    rec = logBegin();
+    format.text(rec, "\nTime,");
+    format.text(rec, timeStamp.text);
+    format.text(rec, ",CPM,");
+    format.integer(rec, CountsPerMin);
+    format.text(rec, ",Motor,");
+    format.integer(rec, CurServo);
+    format.character(rec, '\t');
+    logEnd();
   }
+#endif
 
   MoveTime.day = CurrentTime.day - StartTime.day;
   MoveTime.day += (CurrentTime.month - StartTime.month) * 30;
 
-  // Every 5 days move Servo
-  if(MoveTime.day < 5 && CurServo == -1)
+  // move the servos on the days of config.moveDay
+  if(MoveTime.day < config.moveDay[0] && CurServo == -1)
   {
     increment0();
     CurServo = 0;
   }
 
-  if(MoveTime.day >= 5 && !Servo1)// && Servo1 == 0)
+  if(MoveTime.day >= config.moveDay[0] && !Servo1)// && Servo1 == 0)
   {
     increment1();
 
@@ -576,7 +1064,7 @@ int main (void)
     CurServo = 1;
   }
 
-  if(MoveTime.day >= 10 && !Servo2)// && Servo2 == 0)
+  if(MoveTime.day >= config.moveDay[1] && !Servo2)// && Servo2 == 0)
   {
     increment2();
 
@@ -585,7 +1073,7 @@ int main (void)
   }
 
 
-  if(MoveTime.day >= 15 && !Servo3)// && Servo3 == 0)
+  if(MoveTime.day >= config.moveDay[2] && !Servo3)// && Servo3 == 0)
   {
     increment3();
 
@@ -593,21 +1081,41 @@ int main (void)
     CurServo = 3;
   }
 
-  if(MoveTime.day >= 20 && !Servo4)// && Servo4 ==0)
+  if(MoveTime.day >= config.moveDay[3] && !Servo4)// && Servo4 ==0)
   {
     increment4();
 
     Servo4 = 1;
     CurServo = 4;
   }
-  if (MoveTime.day >= 24)
+
+  // each move is kept at once, a reset right after does not repeat it
+  if(CurServo != snapshot.motor)
+  {
+    snapshot.motor = CurServo;
+    snapshot.moves = (CurServo >= 0) | Servo1 << 1 | Servo2 << 2 | Servo3 << 3 | Servo4 << 4;
+    keepProgress();
+  }
+  if (MoveTime.day >= config.endDay)
   {
     wait(5000);
+#if PULSE_FRONT == PULSE_CAPTURE
+    keepStamps(CurServo);
+    pulses.stamp(0);
+    pulseLog.flush();
+#endif
+    rec = logBegin();
+    format.text(rec, "\nEnd,");
+    format.update(&timeStamp, timebase.now());
+    format.text(rec, timeStamp.text);
+    format.character(rec, '\t');
+    logEnd();
+    // hand the logs to tools/logpull over USB instead of mass storage
+    if(telemetry.isRunning()) telemetry.stop();
     usb.connect();
-    dataLog.add("\n\nEnd Experiment!!!",NULL);
     while(1)
     {
-      usb.process();
+      logExport.service();
     }
   }
 
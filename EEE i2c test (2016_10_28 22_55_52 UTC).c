@@ -6,6 +6,7 @@
 #include <uart2.h>
 #include <string.h>
 #include <math.h>
+#include "format.h"
 
 // I2C Functions -------------------------------------------------------------------
 
@@ -179,6 +180,7 @@ void read_EthCont(void)
 {
   char stat[128] = {0};
   char temp = 0x00;
+  Line line;
   usb.printf("Start I2C\n\r");
 
   // Initiate start
@@ -209,8 +211,11 @@ void read_EthCont(void)
   // end communication
   i2c_stop();
 
-  sprintf(stat, temp);
-  usb.printf(stat);
+  // temp is the byte read, not a format string
+  format.begin(&line, stat, sizeof(stat));
+  format.number(&line, (unsigned char)temp);
+  format.text(&line, "\n\r");
+  usb.print(stat);
 }
 
 // sets the RTC to time and date now, returns 1 if success, 0 if not
@@ -256,7 +261,7 @@ void logdata(String str)
 {
   FSFILE* timeFile = FSfopen("dataLog.txt", FS_APPEND);
   if(!timeFile) return;                           
-  FSfprintf(timeFile, str);              
+  FSfwrite(str, 1, strlen(str), timeFile);   // str is data, not a format
   FSfclose(timeFile);  
 }
 
@@ -0,0 +1,123 @@
+//I2C2 and UART2 bus events in a ring, see bustrace.h
+
+#include <nesi.h>
+#include "bustrace.h"
+#include "bytes.h"
+
+#define MASK (BUS_TRACE_EVENTS - 1)
+
+typedef struct
+{
+  unsigned int time;
+  unsigned char kind, data;
+} Event;
+
+static Event ring[BUS_TRACE_EVENTS];
+static unsigned int head;                 // slot the next event goes in
+
+static volatile unsigned int periods;     // Timer1 periods since init(),
+static volatile unsigned int periodsHigh; // bits 0-15 and 16-31
+static unsigned int marked;               // periods at the last TRACE_PERIOD
+
+void __attribute__((interrupt, no_auto_psv)) _T1Interrupt(void)
+{
+  IFS0bits.T1IF = 0;
+  if(!++periods) periodsHigh++;
+}
+
+// Timer1 and its periods as they stand, a wrap not yet counted included
+static unsigned int timer1(unsigned int *low, unsigned int *high)
+{
+  unsigned int t;
+
+  do
+  {
+    *low = periods;
+    *high = periodsHigh;
+    t = TMR1;
+  } while(*low != periods);
+  if(IFS0bits.T1IF && t < 0x8000 && !++*low) ++*high;
+  return t;
+}
+
+static void init(void)
+{
+  unsigned int i;
+
+  for(i = 0; i < BUS_TRACE_EVENTS; i++) ring[i].kind = TRACE_NONE;
+  head = 0;
+  periods = 0;
+  periodsHigh = 0;
+  marked = 0;
+
+  // Timer1 free running: 1:8 prescale, interrupt on every wrap
+  T1CON = 0x0000;
+  TMR1 = 0;
+  PR1 = 0xFFFF;
+  IPC0bits.T1IP = 1;
+  IFS0bits.T1IF = 0;
+  IEC0bits.T1IE = 1;
+  T1CON = 0x8010;   // on, 1:8
+}
+
+// a new period since the last event, or one about to be counted: say which
+// before the event, and stamp it again against that
+static unsigned int mark(void)
+{
+  unsigned int low, high, t;
+
+  t = timer1(&low, &high);
+  if(low != marked)
+  {
+    ring[head].time = low;
+    ring[head].kind = TRACE_PERIOD;
+    ring[head].data = high & 0xFF;
+    head = (head + 1) & MASK;
+    marked = low;
+  }
+  return t;
+}
+
+static void put(unsigned char kind, unsigned char data)
+{
+  unsigned int t = TMR1;
+  Event *e;
+
+  if(periods != marked || IFS0bits.T1IF) t = mark();
+  e = &ring[head];
+  e->time = t;
+  e->kind = kind;
+  e->data = data;
+  head = (head + 1) & MASK;
+}
+
+static int dump(unsigned char *to)
+{
+  unsigned char *p = to + BUS_TRACE_HEADER;
+  unsigned int low, high, t, i, n = 0;
+  Event *e;
+
+  t = timer1(&low, &high);
+  for(i = 0; i < BUS_TRACE_EVENTS; i++)
+  {
+    e = &ring[(head + i) & MASK];
+    if(e->kind == TRACE_NONE) continue;
+    bytes.put16(p, e->time);
+    p += 2;
+    *p++ = e->kind;
+    *p++ = e->data;
+    n++;
+  }
+
+  to[0] = 'B';
+  to[1] = 'T';
+  to[2] = 'R';
+  to[3] = 'C';
+  bytes.put32(to + 4, FCY/8);
+  bytes.put32(to + 8, low | (unsigned long)high << 16);
+  bytes.put16(to + 12, t);
+  bytes.put16(to + 14, n);
+  return p - to;
+}
+
+const BusTrace busTrace = {init, put, dump};
@@ -0,0 +1,78 @@
+//I2C2 and UART2 bus events, timestamped into a ring in RAM
+//
+//Seeing how send_byte(), read_data() and send_ack() line up on the wire
+//took a logic analyzer.  BORON2 now marks every step of the I2C2 bus and
+//every UART2 burst with TRACE(), which puts one 4 byte event into a ring
+//of BUS_TRACE_EVENTS, overwriting the oldest:
+//
+//  time    16 bit Timer1 count, FCY/8 so 0.5 us on the 16 MHz NESI+ clock
+//  kind    one of the TRACE_ kinds below
+//  data    the byte, the ACK or the length, see each kind
+//
+//Timer1 wraps every 32.8 ms.  Its interrupt counts the periods, and the
+//first event of a new period is preceded by a TRACE_PERIOD event holding
+//the low 24 bits of the count; the dump has all 32, so only events over 6
+//days older than it are ambiguous.  The usual event costs a read of TMR1,
+//a compare and three stores; sim/tracebench measures it.
+//
+//logExport serves the ring as the file BUS.TRC, so tools/logpull -f BUS.TRC
+//fetches it and tools/trcvcd turns it into a VCD for GTKWave.  Built with
+//BUS_TRACE 0, TRACE() is nothing and Timer1 stays off.
+
+#ifndef BUSTRACE_H
+#define BUSTRACE_H
+
+#include <nesi.h>
+
+#ifndef BUS_TRACE
+#define BUS_TRACE 1
+#endif
+
+#define BUS_TRACE_EVENTS 256        // power of two
+#define BUS_TRACE_FILE   "BUS.TRC"
+#define BUS_TRACE_HEADER 16
+#define BUS_TRACE_DUMP   (BUS_TRACE_HEADER + 4*BUS_TRACE_EVENTS)
+
+// event kinds, data in brackets
+#define TRACE_NONE     0            // a slot never written
+#define TRACE_PERIOD   1            // time is Timer1 periods bits 0-15 (16-23)
+#define TRACE_START    2            // start condition done
+#define TRACE_RESTART  3            // repeated start done
+#define TRACE_WRITE    4            // byte handed to I2C2TRN (the byte)
+#define TRACE_ACK      5            // slave's answer to it (0 ACK, 1 NACK, 2 collision)
+#define TRACE_READ     6            // byte received (the byte)
+#define TRACE_ACKOUT   7            // master's answer sent (0 ACK, 1 NACK)
+#define TRACE_STOP     8            // stop condition done
+#define TRACE_TIMEOUT  9            // gave up waiting (kind of the step)
+#define TRACE_RX       10           // UART2 burst read (bytes, at most 255)
+#define TRACE_TX       11           // UART2 burst sent (bytes, at most 255)
+
+typedef struct
+{
+  // empty the ring and start Timer1
+  void (*init)(void);
+
+  // one event, stamped now
+  void (*put)(unsigned char kind, unsigned char data);
+
+  // the ring as BUS.TRC, oldest event first, into up to BUS_TRACE_DUMP
+  // bytes; returns the length.  Little endian throughout:
+  //
+  //  0  "BTRC"
+  //  4  Timer1 ticks a second, 32 bit
+  //  8  Timer1 periods now, 32 bit
+  //  12 Timer1 now, 16 bit
+  //  14 events that follow, 16 bit
+  //  16 events, 4 bytes each as above
+  int (*dump)(unsigned char *to);
+} BusTrace;
+
+extern const BusTrace busTrace;
+
+#if BUS_TRACE
+#define TRACE(kind, data) busTrace.put(kind, data)
+#else
+#define TRACE(kind, data) ((void)0)
+#endif
+
+#endif
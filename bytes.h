@@ -0,0 +1,32 @@
+//Byte level helpers for the binary formats on the card and in the RTC
+//
+//The journal, the packed and pulse logs, the RTC snapshot and the bus
+//trace all keep their fields little endian, and the card's blocks carry a
+//CRC-32 (IEEE).  The host tools that read those files back build this
+//module too, so it does without nesi.h and only counts on the low 32 bits
+//of an unsigned long.
+
+#ifndef BYTES_H
+#define BYTES_H
+
+// 1 for the CRC a byte at a time, a 1 KB table against 64 bytes for a
+// nibble at a time; the host tools that check whole logs build with it
+#ifndef BYTES_CRC_BYTEWISE
+#define BYTES_CRC_BYTEWISE 0
+#endif
+
+typedef struct
+{
+  // CRC-32 of length bytes, going on from crc; 0 to start
+  unsigned long (*crc32)(const unsigned char *data, int length, unsigned long crc);
+
+  // 16 and 32 bit fields at p, little endian
+  void (*put16)(unsigned char *p, unsigned int v);
+  void (*put32)(unsigned char *p, unsigned long v);
+  unsigned int (*get16)(const unsigned char *p);
+  unsigned long (*get32)(const unsigned char *p);
+} Bytes;
+
+extern const Bytes bytes;
+
+#endif
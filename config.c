@@ -0,0 +1,136 @@
+//Site settings, see config.h
+
+#include <nesi.h>
+#include <stddef.h>
+#include <string.h>
+#include "config.h"
+#include "dircache.h"
+
+Config config = {0, 30, 1, 60, 1000, 3000, 60, 600, 0, {5, 10, 15, 20}, 24, 1, 10, 50, 20, 30, 0, 0};
+
+typedef struct
+{
+  char key[11];
+  unsigned char offset;       // of the field in Config
+  unsigned char size;         // of one element
+  unsigned char count;        // elements, all given on one line
+  unsigned long low, high;    // accepted range
+} Setting;
+
+#define FIELD(member) offsetof(Config, member), sizeof(config.member)
+#define ARRAY(member) offsetof(Config, member), sizeof(config.member[0])
+
+static const Setting settings[] =
+{
+  {"baud",       FIELD(baud),       1, 300, 115200},
+  {"window",     FIELD(window),     1, 1, 60},
+  {"checkpoint", FIELD(checkpoint), 1, 1, 3600},
+  {"progress",   FIELD(progress),   1, 1, 3600},
+  {"ramp",       FIELD(servoRamp),  1, 0, 10000},
+  {"hold",       FIELD(servoHold),  1, 20, 60000},
+  {"moves",      ARRAY(moveDay),    4, 0, 255},
+  {"end",        FIELD(endDay),     1, 1, 255},
+  {"adapt",      FIELD(adapt),      1, 0, 1},
+  {"summary",    FIELD(summary),    1, 1, 3600},
+  {"baseline",   FIELD(baseline),   1, 10, 60000},
+  {"burstwin",   FIELD(burstWindow), 1, 1, 16},
+  {"sigma",      FIELD(sigma),      1, 10, 255},
+  {"calm",       FIELD(calm),       1, 0, 255},
+  {"settle",     FIELD(settle),     1, 1, 255},
+  {"pack",       FIELD(pack),       1, 0, 1},
+  {"dead",       FIELD(deadTime),   1, 0, 5000},
+  {"times",      FIELD(times),      1, 0, 1},
+};
+
+#define SETTINGS (sizeof(settings)/sizeof(settings[0]))
+
+// store value in element n of s's field
+static void store(const Setting *s, int n, unsigned long value)
+{
+  unsigned char *field = (unsigned char *)&config + s->offset + n*s->size;
+
+  if(s->size == sizeof(unsigned long))
+    *(unsigned long *)field = value;
+  else if(s->size == sizeof(unsigned int))
+    *(unsigned int *)field = value;
+  else
+    *field = value;
+}
+
+// one "key=value[,value...]" line, 1 if it was taken
+static Boolean parse(char *line)
+{
+  unsigned long values[4];
+  const Setting *s;
+  char *p = strchr(line, '=');
+  int n = 0, i;
+
+  if(!p) return 0;
+  *p++ = 0;
+  for(s = settings; s < settings + SETTINGS && strcmp(s->key, line); s++);
+  if(s == settings + SETTINGS) return 0;
+
+  // all the values or none of them
+  while(n < s->count)
+  {
+    if(*p < '0' || *p > '9') return 0;
+    values[n] = 0;
+    while(*p >= '0' && *p <= '9')
+    {
+      values[n] = values[n]*10 + (*p++ - '0');
+      if(values[n] > s->high) return 0;
+    }
+    if(values[n] < s->low) return 0;
+    n++;
+    if(*p == ',') p++;
+  }
+  if(*p) return 0;
+
+  for(i = 0; i < n; i++) store(s, i, values[i]);
+  return 1;
+}
+
+// drop blanks, CRs and any comment from line
+static void squeeze(char *line)
+{
+  char *out = line;
+
+  for(; *line && *line != '#'; line++)
+    if(*line != ' ' && *line != '\t' && *line != '\r') *out++ = *line;
+  *out = 0;
+}
+
+static int load(String filename)
+{
+  char text[CONFIG_TEXT + 1];
+  FSFILE *file;
+  int length, taken = 0;
+  char *line, *end;
+
+  file = dirCache.open(filename, FS_READ);
+  if(!file) return -1;
+  length = FSfread(text, 1, CONFIG_TEXT, file);
+  dirCache.close(file);
+  text[length] = 0;
+
+  for(line = text; *line; line = end)
+  {
+    end = line;
+    while(*end && *end != '\n') end++;
+    if(*end)
+      *end++ = 0;
+    else if(length == CONFIG_TEXT)
+      break;      // the last line was cut short by the limit
+
+    squeeze(line);
+    if(*line && parse(line)) taken++;
+  }
+
+  // a move can not settle before its ramp is done, nor a burst end while
+  // still beyond the threshold that started it
+  if(config.servoHold < config.servoRamp) config.servoHold = config.servoRamp;
+  if(config.calm > config.sigma) config.calm = config.sigma;
+  return taken;
+}
+
+const ConfigFile configFile = {load};
@@ -0,0 +1,77 @@
+//Site settings read from the SD card at boot
+//
+//BORON2's rates, servo timing and schedule used to be constants.  They
+//now live in config, which holds the defaults below until load() reads a
+//small text file of "key=value" lines over them, e.g.
+//
+//  # Awty roof, slower sampling to save the battery
+//  window=60
+//  checkpoint=10
+//  moves=5,10,15,20
+//
+//Unknown keys, values out of range and anything after CONFIG_TEXT bytes
+//are ignored, so a bad file still leaves a working setup.  The firmware
+//reads the fields of config directly.
+//
+//  key         field          default   meaning
+//  baud        baud           0         Geiger UART baud, 0 keeps NESI's
+//  window      window         30        UART characters per sample with adapt=0
+//  checkpoint  checkpoint     1         samples logged between TIME.TXT rewrites
+//  progress    progress       60        samples logged between RTC RAM snapshots
+//  ramp        servoRamp      1000      ms to ramp a servo between positions
+//  hold        servoHold      3000      ms before a servo counts as stalled
+//  moves       moveDay[4]     5,10,15,20  experiment days of servo moves 1-4
+//  end         endDay         24        experiment day logging stops
+//  adapt       adapt          1         1 for sampler.h, 0 for a sample per window
+//  summary     summary        60        seconds per quiet summary
+//  baseline    baseline       600       seconds the baseline rate averages
+//  burstwin    burstWindow    10        seconds compared to the baseline, up to 16
+//  sigma       sigma          50        tenths of a deviation that start a burst
+//  calm        calm           20        tenths of a deviation that count as calm
+//  settle      settle         30        calm seconds that end a burst
+//  pack        pack           0         1 to log to DATALOG.PKL, see packlog.h
+//  dead        deadTime       0         tube dead time in us, see pulses.h
+//  times       times          0         1 to log pulse times to PULSES.BIN, see pulselog.h
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <nesi.h>
+
+#define CONFIG_TEXT 256       // bytes of the file that are read
+
+// widest fields first, so packing never leaves one misaligned
+typedef struct __attribute__((packed))
+{
+  unsigned long baud;
+  unsigned int window;
+  unsigned int checkpoint;
+  unsigned int progress;
+  unsigned int servoRamp;
+  unsigned int servoHold;
+  unsigned int summary;
+  unsigned int baseline;
+  unsigned int deadTime;
+  unsigned char moveDay[4];
+  unsigned char endDay;
+  unsigned char adapt;
+  unsigned char burstWindow;
+  unsigned char sigma;
+  unsigned char calm;
+  unsigned char settle;
+  unsigned char pack;
+  unsigned char times;
+} Config;
+
+extern Config config;
+
+typedef struct
+{
+  // read filename over the defaults, returns the settings taken from it
+  // or -1 if there is no such file
+  int (*load)(String filename);
+} ConfigFile;
+
+extern const ConfigFile configFile;
+
+#endif
@@ -0,0 +1,141 @@
+//Root directory cache, see dircache.h
+
+#include <nesi.h>
+#include <string.h>
+#include "dircache.h"
+#include "fsentry.h"
+
+typedef struct
+{
+  char name[13];
+  unsigned int entry;       // directory entry, as FSFILE's entry has it
+  unsigned long cluster;    // first cluster, 0 until an open shows it
+  unsigned long size;
+} CachedFile;
+
+static CachedFile files[DIRCACHE_FILES];
+static int count;
+static Boolean complete;    // loaded, and every file in the root fit
+
+static char upper(char c)
+{
+  return c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c;
+}
+
+// compare two 8.3 names ignoring the case of letters
+static Boolean sameName(const char *a, const char *b)
+{
+  while(*a && upper(*a) == upper(*b)) { a++; b++; }
+  return !*a && !*b;
+}
+
+static CachedFile *find(const char *filename)
+{
+  int n;
+
+  for(n = 0; n < count; n++)
+    if(sameName(files[n].name, filename)) return &files[n];
+  return NULL;
+}
+
+static CachedFile *add(const char *filename, unsigned int entry, unsigned long size)
+{
+  CachedFile *f;
+
+  if(count == DIRCACHE_FILES)
+  {
+    complete = 0;
+    return NULL;
+  }
+  f = &files[count++];
+  strncpy(f->name, filename, sizeof(f->name));
+  f->name[sizeof(f->name) - 1] = 0;
+  f->entry = entry;
+  f->cluster = 0;           // SearchRec does not have it
+  f->size = size;
+  return f;
+}
+
+static int load(void)
+{
+  SearchRec rec;
+
+  count = 0;
+  complete = 1;
+  if(!FindFirst("*.*", ATTR_ARCHIVE, &rec))
+  {
+    do
+      add(rec.filename, rec.entry, rec.filesize);
+    while(!FindNext(&rec));
+  }
+  return count;
+}
+
+static Boolean exists(String filename)
+{
+  FSFILE *file;
+
+  if(find(filename)) return 1;
+  if(complete) return 0;
+
+  // the table overflowed, only the card knows
+  file = FSfopen(filename, FS_READ);
+  if(!file) return 0;
+  FSfclose(file);
+  return 1;
+}
+
+static long size(String filename)
+{
+  CachedFile *f = find(filename);
+
+  return f ? (long)f->size : -1;
+}
+
+static FSFILE* open(String filename, const char *mode)
+{
+  CachedFile *f = find(filename);
+  FSFILE *file;
+
+  // a name missing from a complete table can only be a new file, there is
+  // nothing on the card to read
+  if(!f && mode[0] == 'r' && complete) return NULL;
+
+  // straight to the file when its first cluster is known, FSfopen
+  // otherwise and to learn it
+  if(f && f->cluster && mode[0] == 'r')
+  {
+    file = FSfopenEntry(filename, f->entry, f->cluster, f->size, mode);
+    if(file) return file;
+  }
+  file = FSfopen(filename, mode);
+  if(!file) return NULL;
+  if(!f && complete) f = add(filename, file->entry, 0);
+  if(f)
+  {
+    f->entry = file->entry;
+    f->cluster = file->cluster;
+  }
+
+  // "w" truncates, "r+" and "a" only grow the file, see close()
+  if(f && mode[0] == 'w') f->size = 0;
+  return file;
+}
+
+static int close(FSFILE *file)
+{
+  unsigned int entry = file->entry;
+  long end = FSftell(file);
+  int n;
+
+  for(n = 0; n < count; n++)
+    if(files[n].entry == entry)
+    {
+      // an empty file gets its first cluster with its first write
+      files[n].cluster = file->cluster;
+      if(end > (long)files[n].size) files[n].size = end;
+    }
+  return FSfclose(file);
+}
+
+const DirCache dirCache = {load, exists, size, open, close};
@@ -0,0 +1,40 @@
+//Root directory of the SD card cached in RAM
+//
+//Every FSfopen scans the root directory from its first entry, 16 entries
+//per sector read, and checking for a file meant opening it.  load() reads
+//the directory once after the card is mounted; after that exists() and
+//size() answer from RAM, and open() of a file to read that is not there
+//fails without touching the card.  Once a file has been opened, its
+//entry, first cluster and size are kept, and later "r" and "r+" opens go
+//straight to it through FSfopenEntry (fsentry.h) with no directory read.
+//"w" and "a" still go through FSfopen, as MDD frees or walks the cluster
+//chain for them.  Files opened and closed through dirCache keep the table
+//current, matched by FSFILE's directory entry.  Files created some other
+//way (NESI's dataLog) are not in the table, and everything before load()
+//or once the root outgrows DIRCACHE_FILES is asked of the card.
+
+#ifndef DIRCACHE_H
+#define DIRCACHE_H
+
+#include <nesi.h>
+
+#define DIRCACHE_FILES 32    // two directory sectors, ~20 bytes of RAM each
+
+typedef struct
+{
+  // read the root directory, returns the number of files cached
+  int (*load)(void);
+
+  Boolean (*exists)(String filename);
+
+  // bytes in filename, -1 if it does not exist
+  long (*size)(String filename);
+
+  // FSfopen and FSfclose that keep the table current
+  FSFILE* (*open)(String filename, const char *mode);
+  int (*close)(FSFILE *file);
+} DirCache;
+
+extern const DirCache dirCache;
+
+#endif
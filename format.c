@@ -0,0 +1,199 @@
+//Bounded text formatting, see format.h
+
+#include <nesi.h>
+#include <string.h>
+#include "format.h"
+
+static const unsigned long powers[10] =
+{
+  1UL, 10UL, 100UL, 1000UL, 10000UL, 100000UL,
+  1000000UL, 10000000UL, 100000000UL, 1000000000UL
+};
+
+const char dayNames[7][4] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+const char monthNames[12][4] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+static void begin(Line *line, char *buffer, int size)
+{
+  line->buffer = buffer;
+  line->size = size;
+  line->length = 0;
+  line->cut = 0;
+  if(size > 0) buffer[0] = 0;
+}
+
+// reserve n characters, NULL if they do not fit
+static char *room(Line *line, int n)
+{
+  char *p;
+
+  if(line->length + n >= line->size)
+  {
+    line->cut = 1;
+    return NULL;
+  }
+  p = line->buffer + line->length;
+  line->length += n;
+  line->buffer[line->length] = 0;
+  return p;
+}
+
+static void text(Line *line, const char *str)
+{
+  while(*str && line->length + 1 < line->size)
+    line->buffer[line->length++] = *str++;
+  if(line->size > 0) line->buffer[line->length] = 0;
+  if(*str) line->cut = 1;
+}
+
+static void character(Line *line, char c)
+{
+  char *p = room(line, 1);
+
+  if(p) *p = c;
+}
+
+// value in at least width digits, padded in front with pad
+static void digits(Line *line, unsigned long value, int width, char pad)
+{
+  int n = 1;
+  unsigned int low;
+  char *p;
+
+  while(n < 10 && value >= powers[n]) n++;
+  if(width < n) width = n;
+  p = room(line, width);
+  if(!p) return;
+
+  // written from the last digit back, 32 bit division only while needed
+  p += width;
+  while(value > 0xFFFF)
+  {
+    *--p = '0' + value % 10;
+    value /= 10;
+    width--;
+  }
+  low = value;
+  do
+  {
+    *--p = '0' + low % 10;
+    low /= 10;
+    width--;
+  } while(low);
+  while(width--) *--p = pad;
+}
+
+// keep what was written since start only if all of it fit
+static void whole(Line *line, int start, Boolean wasCut)
+{
+  if(line->cut)
+  {
+    line->length = start;
+    line->buffer[start] = 0;
+  }
+  line->cut |= wasCut;
+}
+
+static void number(Line *line, unsigned long value)
+{
+  digits(line, value, 1, '0');
+}
+
+static void integer(Line *line, long value)
+{
+  int start = line->length;
+  Boolean wasCut = line->cut;
+
+  line->cut = 0;
+  if(value < 0)
+  {
+    character(line, '-');
+    digits(line, 0UL - (unsigned long)value, 1, '0');
+  }
+  else
+    digits(line, value, 1, '0');
+  whole(line, start, wasCut);
+}
+
+static void fixed(Line *line, long value, int decimals)
+{
+  unsigned long magnitude = value < 0 ? 0UL - (unsigned long)value : (unsigned long)value;
+  int start = line->length;
+  Boolean wasCut = line->cut;
+
+  if(decimals < 1 || decimals > 9)
+  {
+    integer(line, value);
+    return;
+  }
+  line->cut = 0;
+  if(value < 0) character(line, '-');
+  digits(line, magnitude / powers[decimals], 1, '0');
+  character(line, '.');
+  digits(line, magnitude % powers[decimals], decimals, '0');
+  whole(line, start, wasCut);
+}
+
+static void stamp(Line *line, DateAndTime time)
+{
+  int start = line->length;
+  Boolean wasCut = line->cut;
+
+  line->cut = 0;
+  text(line, dayNames[time.weekday % 7]);
+  character(line, ' ');
+  text(line, monthNames[time.month >= 1 && time.month <= 12 ? time.month - 1 : 0]);
+  character(line, ' ');
+  digits(line, time.day, 2, ' ');
+  character(line, ' ');
+  digits(line, time.hour, 2, '0');
+  character(line, ':');
+  digits(line, time.minute, 2, '0');
+  character(line, ':');
+  digits(line, time.second, 2, '0');
+  character(line, ' ');
+  digits(line, 2000 + time.year, 4, '0');
+  whole(line, start, wasCut);
+}
+
+// two digits at p, the first one pad below 10
+static void two(char *p, unsigned char value, char pad)
+{
+  p[0] = value >= 10 ? '0' + value/10 : pad;
+  p[1] = '0' + value%10;
+}
+
+static void update(Stamp *cached, DateAndTime time)
+{
+  Line line;
+  char *p = cached->text;
+  DateAndTime *last = &cached->time;
+
+  // out of range fields would change the length, render it all
+  if(!cached->valid || time.second > 99 || time.minute > 99 || time.hour > 99 || time.day > 99)
+  {
+    format.begin(&line, p, sizeof(cached->text));
+    stamp(&line, time);
+    cached->valid = line.length == STAMP_LENGTH;
+    *last = time;
+    return;
+  }
+
+  // "Www Mmm dd hh:mm:ss yyyy"
+  if(time.second != last->second) two(p + 17, time.second, '0');
+  if(time.minute != last->minute) two(p + 14, time.minute, '0');
+  if(time.hour != last->hour) two(p + 11, time.hour, '0');
+  if(time.day != last->day) two(p + 8, time.day, ' ');
+  if(time.weekday != last->weekday) memcpy(p, dayNames[time.weekday % 7], 3);
+  if(time.month != last->month)
+    memcpy(p + 4, monthNames[time.month >= 1 && time.month <= 12 ? time.month - 1 : 0], 3);
+  if(time.year != last->year)
+  {
+    two(p + 20, (2000 + time.year)/100, '0');
+    two(p + 22, (2000 + time.year)%100, '0');
+  }
+  *last = time;
+}
+
+const Format format = {begin, text, character, integer, number, fixed, stamp, update};
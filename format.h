@@ -0,0 +1,64 @@
+//Bounded text formatting without sprintf
+//
+//A Line is a caller's buffer being filled left to right: each call appends
+//one typed value, the text stays 0 terminated, and nothing is written past
+//size.  Text that does not fit is cut short; numbers and stamps are left
+//out whole so a full buffer never ends in half a number.  Either way cut
+//is set.  There is no format string to
+//parse or get wrong, and no varargs, so records can be built straight in
+//the buffer they are stored from (see journal.record()).
+//
+//  Line line;
+//  format.begin(&line, buffer, sizeof(buffer));
+//  format.text(&line, "\nCPM,");
+//  format.integer(&line, cpm);
+
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <nesi.h>
+
+typedef struct
+{
+  char *buffer;
+  int size;           // bytes in buffer, counting the terminating 0
+  int length;         // characters so far
+  Boolean cut;        // something was left out for lack of room
+} Line;
+
+#define STAMP_LENGTH 24
+
+// a stamp kept rendered between calls, see update()
+typedef struct
+{
+  char text[32];           // longer than STAMP_LENGTH for a garbled time
+  DateAndTime time;        // what text shows
+  Boolean valid;           // text is a well formed stamp of time
+} Stamp;
+
+typedef struct
+{
+  void (*begin)(Line *line, char *buffer, int size);
+  void (*text)(Line *line, const char *str);
+  void (*character)(Line *line, char c);
+  void (*integer)(Line *line, long value);
+  void (*number)(Line *line, unsigned long value);
+
+  // value/10^decimals with all the decimals, e.g. (-1234, 2) is -12.34
+  void (*fixed)(Line *line, long value, int decimals);
+
+  // the same text as dateTime.toStamp(), "Tue May 26 08:35:00 2015"
+  void (*stamp)(Line *line, DateAndTime time);
+
+  // bring stamp->text up to time rewriting only the fields that changed,
+  // between samples usually just the seconds
+  void (*update)(Stamp *stamp, DateAndTime time);
+} Format;
+
+extern const Format format;
+
+// the names stamp() writes, for code reading stamps back
+extern const char dayNames[7][4];
+extern const char monthNames[12][4];
+
+#endif
@@ -0,0 +1,78 @@
+//Open by directory entry on MDD, see fsentry.h
+
+#include <nesi.h>
+#include "fsentry.h"
+
+// FSIO.c's own, not declared in FSIO.h
+extern DISK gDiskData;
+extern FSFILE *cwdptr;
+extern FSFILE *gBufferOwner;
+#ifndef FS_DYNAMIC_MEM
+extern FSFILE gFileArray[FS_MAX_FILES_OPEN];
+extern BYTE gFileSlotOpen[FS_MAX_FILES_OPEN];
+#endif
+BYTE FormatFileName(const char *fileName, FILEOBJ fptr, BYTE mode);
+
+static FSFILE *slot(void)
+{
+#ifdef FS_DYNAMIC_MEM
+  return (FSFILE *)FS_malloc(sizeof(FSFILE));
+#else
+  int n;
+
+  for(n = 0; n < FS_MAX_FILES_OPEN; n++)
+    if(gFileSlotOpen[n])
+    {
+      gFileSlotOpen[n] = FALSE;
+      return &gFileArray[n];
+    }
+  return NULL;
+#endif
+}
+
+static void release(FSFILE *file)
+{
+#ifdef FS_DYNAMIC_MEM
+  FS_free((unsigned char *)file);
+#else
+  gFileSlotOpen[file - gFileArray] = TRUE;
+#endif
+}
+
+FSFILE *FSfopenEntry(const char *fileName, unsigned int entry, unsigned long cluster,
+                     unsigned long size, const char *mode)
+{
+  FSFILE *file;
+
+  if(mode[0] != 'r' || !cluster) return NULL;
+  file = slot();
+  if(!file) return NULL;
+  if(!FormatFileName(fileName, file, 0))
+  {
+    release(file);
+    return NULL;
+  }
+
+  // what FSfopen and FILEopen would have read from the directory entry
+  file->dsk = &gDiskData;
+  file->dirclus = cwdptr->dirclus;
+  file->dirccls = cwdptr->dirccls;
+  file->entry = entry;
+  file->attributes = ATTR_ARCHIVE;
+  file->cluster = cluster;
+  file->ccls = cluster;
+  file->size = size;
+  file->seek = 0;
+  file->sec = 0;
+  file->pos = 0;
+  file->time = 0;           // FSfclose stamps a file it wrote
+  file->date = 0;
+  file->flags.read = 1;
+  file->flags.write = mode[1] == '+';
+  file->flags.FileWriteEOF = FALSE;
+
+  // FILEopen leaves the first sector in the buffer; this slot's last file
+  // may own what is there now, make the first read fetch it
+  if(gBufferOwner == file) gBufferOwner = NULL;
+  return file;
+}
@@ -0,0 +1,23 @@
+//Open a file from the directory entry dirCache already knows
+//
+//MDD's FSfopen reads the root directory from its first entry up to the
+//file's, to learn where the file starts and how long it is.  dirCache
+//keeps both in RAM once an FSfopen has shown them, so FSfopenEntry() fills
+//the FSFILE from them instead and reads no directory sector at all.  It
+//does the part of FSfopen and FILEopen in MDD's FSIO.c that mode "r" and
+//"r+" need, using FSIO.c's globals; "w" and "a" free or walk the cluster
+//chain and stay with FSfopen.  The caller vouches for entry, cluster and
+//size: a file changed behind dirCache's back must be opened with FSfopen.
+//sim/nesi_sim.c has the simulator's own, and checks the caller against the
+//card.
+
+#ifndef FSENTRY_H
+#define FSENTRY_H
+
+#include <nesi.h>
+
+// NULL for any other mode or when no file slot is free
+FSFILE *FSfopenEntry(const char *fileName, unsigned int entry, unsigned long cluster,
+                     unsigned long size, const char *mode);
+
+#endif
@@ -0,0 +1,126 @@
+//Journaled log, see journal.h
+
+#include <nesi.h>
+#include <string.h>
+#include "journal.h"
+#include "dircache.h"
+#include "bytes.h"
+
+static char name[13];
+static unsigned long next;        // sequence number of the next block
+static unsigned int probeCount;
+static unsigned char block[JOURNAL_BLOCK];
+
+static unsigned long blockCrc(const unsigned char *b)
+{
+  return bytes.crc32(b + JOURNAL_HEADER, bytes.get16(b + 2), bytes.crc32(b, 8, 0));
+}
+
+// is block n present and intact
+static Boolean good(FSFILE *file, unsigned long n)
+{
+  int length;
+
+  probeCount++;
+  if(FSfseek(file, (long)n*JOURNAL_BLOCK, SEEK_SET)) return 0;
+  if(FSfread(block, 1, JOURNAL_BLOCK, file) != JOURNAL_BLOCK) return 0;
+
+  length = bytes.get16(block + 2);
+  return block[0] == 'J' && block[1] == 'L' && length <= JOURNAL_PAYLOAD &&
+         bytes.get32(block + 4) == n && bytes.get32(block + 8) == blockCrc(block);
+}
+
+static long open(String filename)
+{
+  FSFILE *file;
+  unsigned long low = 0, high, mid;
+  long size;
+
+  strncpy(name, filename, sizeof(name) - 1);
+  name[sizeof(name) - 1] = 0;
+  next = 0;
+  probeCount = 0;
+
+  file = dirCache.open(name, FS_READ);
+  if(!file)
+  {
+    file = dirCache.open(name, FS_WRITE);
+    if(!file) return -1;
+    dirCache.close(file);
+    return 0;
+  }
+
+  // blocks [0, low) are good, [high, end) are not
+  size = dirCache.size(name);
+  if(size < 0)
+  {
+    FSfseek(file, 0, SEEK_END);
+    size = FSftell(file);
+  }
+  high = (size + JOURNAL_BLOCK - 1)/JOURNAL_BLOCK;
+  while(low < high)
+  {
+    mid = low + (high - low)/2;
+    if(good(file, mid))
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  dirCache.close(file);
+
+  next = low;
+  return next;
+}
+
+static char* record(void)
+{
+  return (char *)block + JOURNAL_HEADER;
+}
+
+static Boolean commit(int length)
+{
+  FSFILE *file;
+  Boolean ok;
+
+  if(!name[0]) return 0;
+  if(length > JOURNAL_PAYLOAD) length = JOURNAL_PAYLOAD;
+
+  memset(block + JOURNAL_HEADER + length, 0, JOURNAL_PAYLOAD - length);
+  block[0] = 'J';
+  block[1] = 'L';
+  bytes.put16(block + 2, length);
+  bytes.put32(block + 4, next);
+  bytes.put32(block + 8, blockCrc(block));
+
+  // overwrite in place rather than append, a torn block may follow the
+  // last good one
+  file = dirCache.open(name, FS_READPLUS);
+  if(!file) return 0;
+  ok = !FSfseek(file, (long)next*JOURNAL_BLOCK, SEEK_SET) &&
+       FSfwrite(block, 1, JOURNAL_BLOCK, file) == JOURNAL_BLOCK;
+  dirCache.close(file);
+
+  if(ok) next++;
+  return ok;
+}
+
+static Boolean append(String text)
+{
+  int length = strlen(text);
+
+  if(length > JOURNAL_PAYLOAD) length = JOURNAL_PAYLOAD;
+  memmove(block + JOURNAL_HEADER, text, length);
+  return commit(length);
+}
+
+static unsigned long blocks(void)
+{
+  return next;
+}
+
+static unsigned int probes(void)
+{
+  return probeCount;
+}
+
+const Journal journal = {open, append, record, commit, blocks, probes};
@@ -0,0 +1,56 @@
+//Power-loss-safe journaled log on the SD card
+//
+//The log is a file of fixed JOURNAL_BLOCK byte blocks, one record each:
+//
+//  0  'J' 'L'        magic
+//  2  length         payload bytes, 16 bit little endian
+//  4  sequence       block number since the log was created, 32 bit
+//  8  crc            CRC-32 of bytes 0-7 and the payload, 32 bit
+//  12 payload        record text, zero padded
+//
+//Blocks are only ever appended, so a power cut can leave at most the last
+//block torn.  A block is good when its CRC matches and its sequence number
+//equals its position, which makes "good" true for a prefix of the file and
+//false after it.  open() binary searches for the end of that prefix, about
+//log2(blocks) reads even for months of data, and the next append
+//overwrites whatever torn block follows.  tools/jnlcat turns a log back
+//into text.
+//
+//The price is space: a CPM record is about 46 bytes of text, so its 128
+//byte block takes about 2.8 times what dataLog.txt did on the card:
+//5.5 MB rather than 2 MB a month at one record a minute.
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <nesi.h>
+
+#define JOURNAL_BLOCK    128      // divides the 512 byte sector
+#define JOURNAL_HEADER   12
+#define JOURNAL_PAYLOAD  (JOURNAL_BLOCK - JOURNAL_HEADER)
+
+typedef struct
+{
+  // find the end of the log filename after a reset, creating it if
+  // missing; returns the number of good blocks, -1 if the card failed
+  long (*open)(String filename);
+
+  // write record (cut to JOURNAL_PAYLOAD bytes) as the next block,
+  // returns 0 if the card write failed
+  Boolean (*append)(String record);
+
+  // or build the record in place: record() is the next block's payload,
+  // JOURNAL_PAYLOAD bytes, and commit() writes the first length of them
+  char* (*record)(void);
+  Boolean (*commit)(int length);
+
+  // good blocks in the log
+  unsigned long (*blocks)(void);
+
+  // blocks open() had to read to find the end
+  unsigned int (*probes)(void);
+} Journal;
+
+extern const Journal journal;
+
+#endif
@@ -0,0 +1,159 @@
+//USB log export, see logexport.h
+
+#include <nesi.h>
+#include <stdlib.h>
+#include <string.h>
+#include "logexport.h"
+#include "bustrace.h"
+
+#if BUS_TRACE_DUMP > 2*LOG_EXPORT_BUFFER
+#error BUS.TRC does not fit the export buffers
+#endif
+
+static char command[40];
+static int commandLength;
+
+static FSFILE *file;
+static Boolean busy;                    // file, or BUS.TRC out of the buffers
+static long position, remaining;        // next file byte to read, bytes left to read
+
+static char buffer[2][LOG_EXPORT_BUFFER];
+static unsigned int fill[2];            // bytes in each buffer
+static unsigned int sent;               // bytes of the active buffer handed to USB
+static int active;                      // buffer going out over USB
+
+static void finish(void)
+{
+  if(file) FSfclose(file);
+  file = NULL;
+  busy = 0;
+}
+
+#if BUS_TRACE
+// the bus trace as it stands, both buffers hold it and nothing is read
+static void trace(long offset)
+{
+  unsigned char *image = (unsigned char *)buffer;
+  long size = busTrace.dump(image);
+
+  if(offset < 0 || offset > size) offset = size;
+  memmove(image, image + offset, size - offset);
+  usb.printf("OK %ld %ld\n", offset, size);
+
+  size -= offset;
+  fill[0] = size < LOG_EXPORT_BUFFER ? size : LOG_EXPORT_BUFFER;
+  fill[1] = size - fill[0];
+  sent = 0;
+  active = 0;
+  remaining = 0;
+  busy = size > 0;
+}
+#endif
+
+// GET <name> <offset>
+static void start(void)
+{
+  char *name = command + 4, *space;
+  long offset = 0, size;
+
+  if(strncmp(command, "GET ", 4))
+  {
+    usb.print("ERR unknown command\n");
+    return;
+  }
+  space = strchr(name, ' ');
+  if(space)
+  {
+    *space = 0;
+    offset = atol(space + 1);
+  }
+#if BUS_TRACE
+  if(!strcmp(name, BUS_TRACE_FILE))
+  {
+    trace(offset);
+    return;
+  }
+#endif
+
+  file = FSfopen(name, FS_READ);
+  if(!file)
+  {
+    usb.print("ERR no such file\n");
+    return;
+  }
+
+  FSfseek(file, 0, SEEK_END);
+  size = FSftell(file);
+  if(offset < 0 || offset > size) offset = size;
+  FSfseek(file, offset, SEEK_SET);
+  usb.printf("OK %ld %ld\n", offset, size);
+
+  position = offset;
+  remaining = size - offset;
+  fill[0] = fill[1] = 0;
+  sent = 0;
+  active = 0;
+  busy = 1;
+  if(!remaining) finish();
+}
+
+static void service(void)
+{
+  int idle = !active, n;
+  char c;
+
+  usb.process();
+
+  if(!busy)
+  {
+    while(usb.read(&c, 1) == 1)
+    {
+      if(c == '\r') continue;
+      if(c != '\n')
+      {
+        if(commandLength < (int)sizeof(command) - 1) command[commandLength++] = c;
+        continue;
+      }
+      command[commandLength] = 0;
+      commandLength = 0;
+      start();
+      if(busy) break;
+    }
+    return;
+  }
+
+  // keep the endpoint fed, switching buffers as soon as one is drained
+  if(sent == fill[active] && fill[idle])
+  {
+    fill[active] = 0;
+    active = idle;
+    idle = !active;
+    sent = 0;
+  }
+  if(sent < fill[active])
+    sent += usb.write(buffer[active] + sent, fill[active] - sent);
+
+  // then top up the other buffer, one sector per call so the USB side is
+  // never left waiting behind a long read
+  if(remaining && fill[idle] < LOG_EXPORT_BUFFER)
+  {
+    n = 512 - position%512;
+    if(n > LOG_EXPORT_BUFFER - (int)fill[idle]) n = LOG_EXPORT_BUFFER - fill[idle];
+    if(n > remaining) n = remaining;
+    n = FSfread(buffer[idle] + fill[idle], 1, n, file);
+    if(!n) remaining = 0;     // card error, end the stream short
+    fill[idle] += n;
+    position += n;
+    remaining -= n;
+  }
+
+  if(!remaining && sent == fill[active] && !fill[idle])
+    finish();
+}
+
+static Boolean isBusy(void)
+{
+  return busy;
+}
+
+const LogExport logExport = {service, isBusy};
@@ -0,0 +1,40 @@
+//Streams a file from the SD card to a host over USB CDC, see tools/logpull.c
+//
+//The host asks for a file from an offset and gets the rest of it as one raw
+//stream, so an interrupted transfer is resumed by asking again from the
+//number of bytes already received:
+//
+//  host:    GET DATALOG.JNL 1048576\n
+//  device:  OK 1048576 13625984\n  followed by bytes 1048576..13625983
+//      or:  ERR <reason>\n
+//
+//Two buffers alternate: while one drains into the USB endpoint the other
+//is refilled from the card a sector at a time, so the SD and the USB keep
+//each other busy.  service() never blocks.  BORON2 calls it from the main
+//loop while live telemetry has the USB up, so the experiment keeps logging
+//while an export is running; telemetry holds its lines back until the
+//export is done.  After the End record it serves exports alone.
+//
+//BUS.TRC is not on the card: it is the bus trace ring as it stands when
+//asked for, see bustrace.h.
+
+#ifndef LOGEXPORT_H
+#define LOGEXPORT_H
+
+#include <nesi.h>
+
+#define LOG_EXPORT_BUFFER 1024    // bytes per buffer, two of them
+
+typedef struct
+{
+  // handle host commands and move the next piece of a transfer, needs
+  // usb.connect() first
+  void (*service)(void);
+
+  // true while a transfer is in progress
+  Boolean (*isBusy)(void);
+} LogExport;
+
+extern const LogExport logExport;
+
+#endif
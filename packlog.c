@@ -0,0 +1,438 @@
+//Compressed log, see packlog.h
+
+#include <nesi.h>
+#include <string.h>
+#include "packlog.h"
+#include "dircache.h"
+#include "format.h"
+#include "bytes.h"
+
+#define PACK_SHAPES  6        // shapes a block keeps, more are stored whole
+#define PACK_SHAPE   48       // characters of a shape
+#define PACK_FIELDS  16       // numbers and stamps in a shape
+
+#define PACK_NUMBER  0x01     // stand-ins for the values in a shape
+#define PACK_STAMP   0x02
+#define PACK_NEW     0x80     // head byte: a new shape follows
+#define PACK_WHOLE   0xFF     // head byte: the text follows as it is
+
+#define LZ_MIN       3
+#define LZ_MAX       (LZ_MIN + 63)
+#define LZ_REACH     1023
+
+typedef struct
+{
+  unsigned char length;
+  unsigned char fields;
+  char text[PACK_SHAPE];
+  unsigned long last[PACK_FIELDS];    // values in the last record of the shape
+} Shape;
+
+static char name[13];
+static unsigned long sequence;     // of the open block
+static unsigned long base;         // its slot, copies go to base and base+1
+static unsigned int version;       // copies of it written
+static unsigned int blockRecords;
+static unsigned long recordCount, textCount, rawCount;
+
+static unsigned char raw[PACK_RAW];
+static unsigned int rawLength;
+static unsigned char block[PACK_BLOCK];
+static unsigned int hashes[256];   // LZ: last position + 1 of each hash
+
+static Shape shapes[PACK_SHAPES];
+static unsigned char shapeCount;
+static unsigned long lastStamp;
+
+// the record being encoded
+static char shape[PACK_SHAPE];
+static unsigned long values[PACK_FIELDS];
+
+static const unsigned int monthStart[12] = {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
+
+// Encoding ------------------------------------------------------------------
+
+static Boolean digit(char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+// value of the two digits at p, pad allowed in place of a leading 0
+static int two(const char *p, char pad)
+{
+  if(!digit(p[1])) return -1;
+  if(p[0] == pad && pad != '0') return p[1] - '0';
+  if(!digit(p[0])) return -1;
+  return (p[0] - '0')*10 + p[1] - '0';
+}
+
+static int name3(const char *p, const char names[][4], int count)
+{
+  int i;
+
+  for(i = 0; i < count; i++)
+    if(!memcmp(p, names[i], 3)) return i;
+  return -1;
+}
+
+// a stamp as format.stamp() writes it at p, "Tue May 26 08:35:00 2015",
+// becomes seconds since 2000; only text that renders back the same way
+// counts, so the weekday has to agree with the date
+static Boolean stampAt(const char *p, int length, unsigned long *seconds)
+{
+  int weekday, month, day, hour, minute, second, year;
+  unsigned long days;
+
+  if(length < 24 || p[3] != ' ' || p[7] != ' ' || p[10] != ' ' || p[13] != ':' ||
+     p[16] != ':' || p[19] != ' ' || p[20] != '2' || p[21] != '0')
+    return 0;
+  weekday = name3(p, dayNames, 7);
+  month = name3(p + 4, monthNames, 12);
+  day = two(p + 8, ' ');
+  hour = two(p + 11, '0');
+  minute = two(p + 14, '0');
+  second = two(p + 17, '0');
+  year = two(p + 22, '0');
+  if(weekday < 0 || month < 0 || day < 1 || day > 31 || hour < 0 || hour > 23 ||
+     minute < 0 || minute > 59 || second < 0 || second > 59 || year < 0)
+    return 0;
+  if(day < 10 && p[8] != ' ') return 0;
+  if(day > (month == 11 ? 31 : (int)(monthStart[month + 1] - monthStart[month])) +
+           (month == 1 && year % 4 == 0))
+    return 0;
+
+  days = year*365UL + (year + 3)/4 + monthStart[month] + day - 1;
+  if(month > 1 && year % 4 == 0) days++;
+  if((days + 6) % 7 != (unsigned long)weekday) return 0;    // 1 Jan 2000 was a Saturday
+
+  *seconds = days*86400UL + hour*3600UL + minute*60UL + second;
+  return 1;
+}
+
+// split text into shape and values; returns the shape length and sets the
+// stamp bits, or -1 if the text has to be stored whole
+static int parse(const char *text, int length, unsigned int *stamps)
+{
+  int i = 0, n = 0, fields = 0, digits;
+  unsigned long value;
+  Boolean negative;
+
+  *stamps = 0;
+  while(i < length)
+  {
+    if(n == PACK_SHAPE) return -1;
+    if(text[i] == PACK_NUMBER || text[i] == PACK_STAMP) return -1;
+
+    // a number is "0" or starts 1-9, so printing it gives the same digits
+    negative = text[i] == '-' && i + 1 < length && text[i + 1] >= '1' && text[i + 1] <= '9';
+    if(stampAt(text + i, length - i, &value))
+    {
+      if(fields == PACK_FIELDS) return -1;
+      *stamps |= 1U << fields;
+      values[fields++] = value;
+      shape[n++] = PACK_STAMP;
+      i += 24;
+    }
+    else if(negative || (digit(text[i]) && (text[i] != '0' || i + 1 == length || !digit(text[i + 1]))))
+    {
+      if(fields == PACK_FIELDS) return -1;
+      if(negative) i++;
+      value = 0;
+      for(digits = 0; digits < 9 && i < length && digit(text[i]); digits++)
+        value = value*10 + text[i++] - '0';
+      values[fields++] = negative ? 0UL - value : value;
+      shape[n++] = PACK_NUMBER;
+    }
+    else
+      shape[n++] = text[i++];
+  }
+  return n;
+}
+
+static void varint(unsigned long v)
+{
+  while(v >= 0x80)
+  {
+    raw[rawLength++] = v | 0x80;
+    v >>= 7;
+  }
+  raw[rawLength++] = v;
+}
+
+// a 32 bit change, small either way of 0 in few bytes
+static void change(unsigned long from, unsigned long to)
+{
+  unsigned long d = (to - from) & 0xFFFFFFFFUL;
+
+  varint(((d << 1) ^ (d & 0x80000000UL ? 0xFFFFFFFFUL : 0)) & 0xFFFFFFFFUL);
+}
+
+// worst case bytes encode() adds for length bytes of text
+static unsigned int worst(int length)
+{
+  return 3 + length + 5*PACK_FIELDS;
+}
+
+static void encode(const char *text, int length)
+{
+  unsigned int stamps;
+  int n = parse(text, length, &stamps), k, j;
+  Shape *s;
+
+  for(k = 0; k < shapeCount; k++)
+    if(shapes[k].length == n && !memcmp(shapes[k].text, shape, n)) break;
+
+  if(n < 0 || (k == shapeCount && k == PACK_SHAPES))
+  {
+    raw[rawLength++] = PACK_WHOLE;
+    varint(length);
+    memcpy(raw + rawLength, text, length);
+    rawLength += length;
+    return;
+  }
+
+  s = &shapes[k];
+  if(k == shapeCount)
+  {
+    shapeCount++;
+    s->length = n;
+    memcpy(s->text, shape, n);
+    s->fields = 0;
+    for(j = 0; j < n; j++)
+      if(shape[j] == PACK_NUMBER || shape[j] == PACK_STAMP) s->last[s->fields++] = 0;
+    raw[rawLength++] = PACK_NEW | k;
+    varint(n);
+    memcpy(raw + rawLength, shape, n);
+    rawLength += n;
+  }
+  else
+    raw[rawLength++] = k;
+
+  for(j = 0; j < s->fields; j++)
+  {
+    if(stamps & 1U << j)
+    {
+      change(lastStamp, values[j]);
+      lastStamp = values[j];
+    }
+    else
+    {
+      change(s->last[j], values[j]);
+      s->last[j] = values[j];
+    }
+  }
+}
+
+// LZ pass over raw into the block payload, returns its length or -1 if it
+// does not fit
+static int squeeze(void)
+{
+  unsigned char *out = block + PACK_HEADER;
+  unsigned int i = 0, n = 0, control, h, from, length, reach, bit;
+
+  memset(hashes, 0, sizeof(hashes));
+  while(i < rawLength)
+  {
+    if(n + 1 > PACK_PAYLOAD) return -1;
+    control = n++;
+    out[control] = 0;
+    for(bit = 0; bit < 8 && i < rawLength; bit++)
+    {
+      if(n + 2 > PACK_PAYLOAD) return -1;
+      length = 0;
+      if(i + LZ_MIN <= rawLength)
+      {
+        h = (raw[i] << 5 ^ raw[i + 1] << 2 ^ raw[i + 2]) & 0xFF;
+        from = hashes[h];
+        hashes[h] = i + 1;
+        if(from && i + 1 - from <= LZ_REACH)
+        {
+          from--;
+          reach = rawLength - i < LZ_MAX ? rawLength - i : LZ_MAX;
+          while(length < reach && raw[from + length] == raw[i + length]) length++;
+        }
+      }
+      if(length >= LZ_MIN)
+      {
+        out[control] |= 1 << bit;
+        out[n++] = i - from;
+        out[n++] = (i - from) >> 8 | (length - LZ_MIN) << 2;
+        i += length;
+      }
+      else
+        out[n++] = raw[i++];
+    }
+  }
+  return n;
+}
+
+// Blocks ---------------------------------------------------------------------
+
+// the open block into the payload, 0 if it does not fit
+static Boolean pack(void)
+{
+  int length;
+
+  if(rawLength <= PACK_PAYLOAD)
+  {
+    memcpy(block + PACK_HEADER, raw, rawLength);
+    bytes.put16(block + 2, rawLength);
+    bytes.put16(block + 4, 0);
+    return 1;
+  }
+  length = squeeze();
+  if(length < 0) return 0;
+  bytes.put16(block + 2, length);
+  bytes.put16(block + 4, rawLength);
+  return 1;
+}
+
+// the next copy of the packed block, into base or base+1 by turns
+static Boolean store(void)
+{
+  FSFILE *file;
+  unsigned int length = bytes.get16(block + 2);
+  Boolean ok;
+
+  memset(block + PACK_HEADER + length, 0, PACK_PAYLOAD - length);
+  block[0] = 'P';
+  block[1] = 'K';
+  bytes.put16(block + 6, blockRecords);
+  bytes.put32(block + 8, sequence);
+  bytes.put16(block + 12, version);
+  bytes.put32(block + 14, bytes.crc32(block + PACK_HEADER, length, bytes.crc32(block, 14, 0)));
+
+  file = dirCache.open(name, FS_READPLUS);
+  if(!file) return 0;
+  ok = !FSfseek(file, (long)(base + (version & 1))*PACK_BLOCK, SEEK_SET) &&
+       FSfwrite(block, 1, PACK_BLOCK, file) == PACK_BLOCK;
+  dirCache.close(file);
+
+  version++;
+  return ok;
+}
+
+static void start(void)
+{
+  version = 0;
+  blockRecords = 0;
+  rawLength = 0;
+  shapeCount = 0;
+  lastStamp = 0;
+}
+
+// leave the newest copy of the full block in its own slot and move on
+static Boolean finish(void)
+{
+  Boolean ok = 1;
+
+  if(version && !(version & 1))
+    ok = pack() && store();
+  base++;
+  sequence++;
+  start();
+  return ok;
+}
+
+static Boolean good(FSFILE *file, unsigned long slot)
+{
+  unsigned int length;
+
+  if(FSfseek(file, (long)slot*PACK_BLOCK, SEEK_SET)) return 0;
+  if(FSfread(block, 1, PACK_BLOCK, file) != PACK_BLOCK) return 0;
+
+  length = bytes.get16(block + 2);
+  return block[0] == 'P' && block[1] == 'K' && length <= PACK_PAYLOAD &&
+         bytes.get32(block + 14) == bytes.crc32(block + PACK_HEADER, length, bytes.crc32(block, 14, 0));
+}
+
+static long open(String filename)
+{
+  FSFILE *file;
+  unsigned long slots;
+  long size;
+
+  strncpy(name, filename, sizeof(name) - 1);
+  name[sizeof(name) - 1] = 0;
+  base = sequence = 0;
+  recordCount = textCount = rawCount = 0;
+  start();
+
+  file = dirCache.open(name, FS_READ);
+  if(!file)
+  {
+    file = dirCache.open(name, FS_WRITE);
+    if(!file) return -1;
+    dirCache.close(file);
+    return 0;
+  }
+
+  size = dirCache.size(name);
+  if(size < 0)
+  {
+    FSfseek(file, 0, SEEK_END);
+    size = FSftell(file);
+  }
+  slots = (size + PACK_BLOCK - 1)/PACK_BLOCK;
+
+  // only the last slot can be torn, the new block takes its place
+  base = slots;
+  sequence = slots;
+  if(slots && good(file, slots - 1))
+    sequence = bytes.get32(block + 8) + 1;
+  else if(slots)
+  {
+    base = slots - 1;
+    if(slots > 1 && good(file, slots - 2)) sequence = bytes.get32(block + 8) + 1;
+  }
+  dirCache.close(file);
+  return base;
+}
+
+static Boolean append(const char *text, int length)
+{
+  unsigned int before;
+
+  if(!name[0]) return 0;
+  if(worst(length) > PACK_PAYLOAD) length = PACK_PAYLOAD - worst(0);
+  if(rawLength + worst(length) > PACK_RAW && !finish()) return 0;
+
+  before = rawLength;
+  encode(text, length);
+  if(!pack())
+  {
+    // the block is full without it: finish it as it was and start over
+    rawLength = before;
+    if(!finish()) return 0;
+    before = 0;
+    encode(text, length);
+    pack();
+  }
+  blockRecords++;
+  recordCount++;
+  textCount += length;
+  rawCount += rawLength - before;
+  return store();
+}
+
+static unsigned long blocks(void)
+{
+  return base + (blockRecords ? 1 : 0);
+}
+
+static unsigned long records(void)
+{
+  return recordCount;
+}
+
+static unsigned long textBytes(void)
+{
+  return textCount;
+}
+
+static unsigned long rawBytes(void)
+{
+  return rawCount;
+}
+
+const PackLog packLog = {open, append, blocks, records, textBytes, rawBytes};
@@ -0,0 +1,68 @@
+//Compressed log on the SD card, the journal's text in a fraction of the bytes
+//
+//Consecutive records differ in little more than a few digits: the same
+//"\nTime,...,CPM,...,Secs,...,Motor,..." shape, a stamp a minute on and a
+//count close to the last one.  Each record is split into its shape, with
+//the numbers and the stamp taken out, and those values:
+//
+//  - a shape seen before in the block is one index byte, a new one is
+//    stored once after it
+//  - each number is stored as its change since the same field of the last
+//    record of that shape, a stamp as seconds since the last stamp
+//  - changes are zigzag varints, so small steps either way take a byte
+//
+//and once that no longer fits a block, the block is squeezed further with
+//an LZ pass (8 flags per control byte, 2 byte matches reaching back 1023
+//bytes).  The log is a file of PACK_BLOCK byte blocks:
+//
+//  0  'P' 'K'        magic
+//  2  length         payload bytes, 16 bit little endian
+//  4  raw            encoded bytes before the LZ pass, 0 if there was none
+//  6  records        records in the block
+//  8  sequence       block number, 32 bit
+//  12 version        times the block was rewritten, 16 bit
+//  14 crc            CRC-32 of bytes 0-13 and the payload, 32 bit
+//  18 payload
+//
+//Shapes and last values start over in every block, so any good block
+//decodes alone.  The open block is rewritten after each record, turn
+//about into its own slot and the one after, and a power cut can tear only
+//the copy being written: the other still holds all records but the last.
+//When the block fills its newest copy ends up in its own slot and the next
+//block takes the slot after.  open() starts a new block past the last
+//good one.  All state is static, about 2.8 KB.  tools/pklcat turns a log
+//back into the journal's text.
+
+#ifndef PACKLOG_H
+#define PACKLOG_H
+
+#include <nesi.h>
+
+#define PACK_BLOCK       512      // one sector
+#define PACK_HEADER      18
+#define PACK_PAYLOAD     (PACK_BLOCK - PACK_HEADER)
+#define PACK_RAW         1024     // encoded bytes a block can take before LZ
+
+typedef struct
+{
+  // find the end of the log filename after a reset, creating it if
+  // missing; returns the number of blocks before the new one, -1 if the
+  // card failed
+  long (*open)(String filename);
+
+  // add length bytes of record text (cut to what an empty block takes)
+  // and rewrite the open block, returns 0 if the card write failed
+  Boolean (*append)(const char *text, int length);
+
+  // blocks in the log, counting the open one once it has a record
+  unsigned long (*blocks)(void);
+
+  // records appended and their text and encoded bytes since open()
+  unsigned long (*records)(void);
+  unsigned long (*textBytes)(void);
+  unsigned long (*rawBytes)(void);
+} PackLog;
+
+extern const PackLog packLog;
+
+#endif
@@ -0,0 +1,167 @@
+//Pulse times on the SD card, see pulselog.h
+
+#include <nesi.h>
+#include <string.h>
+#include "pulselog.h"
+#include "pulses.h"
+#include "dircache.h"
+#include "bytes.h"
+
+#define PULSE_VARINT 5            // longest varint of a 32 bit value
+
+static char name[13];
+static unsigned long sequence;     // of the open block, also its slot
+static unsigned long stampCount;
+static unsigned char block[PULSE_BLOCK];
+static unsigned int length;        // payload bytes in the open block
+static unsigned int count, lostBefore, lostHere;
+static unsigned long last;         // stamp added last
+static int blockMotor;
+
+static void varint(unsigned long v)
+{
+  unsigned char *out = block + PULSE_HEADER;
+
+  while(v >= 0x80)
+  {
+    out[length++] = v | 0x80;
+    v >>= 7;
+  }
+  out[length++] = v;
+}
+
+static void start(void)
+{
+  length = count = 0;
+}
+
+// the open block into its slot, whatever it holds
+static Boolean store(void)
+{
+  FSFILE *file;
+  Boolean ok;
+
+  memset(block + PULSE_HEADER + length, 0, PULSE_PAYLOAD - length);
+  block[0] = 'P';
+  block[1] = 'T';
+  bytes.put16(block + 2, length);
+  bytes.put32(block + 4, sequence);
+  bytes.put16(block + 12, count);
+  bytes.put16(block + 14, lostBefore);
+  block[16] = blockMotor;
+  block[17] = PULSE_TICK_US;
+  bytes.put32(block + 18, bytes.crc32(block + PULSE_HEADER, length, bytes.crc32(block, 18, 0)));
+
+  file = dirCache.open(name, FS_READPLUS);
+  if(!file) return 0;
+  ok = !FSfseek(file, (long)sequence*PULSE_BLOCK, SEEK_SET) &&
+       FSfwrite(block, 1, PULSE_BLOCK, file) == PULSE_BLOCK;
+  dirCache.close(file);
+
+  sequence++;
+  start();
+  return ok;
+}
+
+static Boolean good(FSFILE *file, unsigned long slot)
+{
+  unsigned int length;
+
+  if(FSfseek(file, (long)slot*PULSE_BLOCK, SEEK_SET)) return 0;
+  if(FSfread(block, 1, PULSE_BLOCK, file) != PULSE_BLOCK) return 0;
+
+  length = bytes.get16(block + 2);
+  return block[0] == 'P' && block[1] == 'T' && length <= PULSE_PAYLOAD &&
+         bytes.get32(block + 18) == bytes.crc32(block + PULSE_HEADER, length, bytes.crc32(block, 18, 0));
+}
+
+static long open(String filename)
+{
+  FSFILE *file;
+  long size;
+
+  strncpy(name, filename, sizeof(name) - 1);
+  name[sizeof(name) - 1] = 0;
+  sequence = stampCount = 0;
+  lostHere = 0;
+  start();
+
+  file = dirCache.open(name, FS_READ);
+  if(!file)
+  {
+    file = dirCache.open(name, FS_WRITE);
+    if(!file) return -1;
+    dirCache.close(file);
+    return 0;
+  }
+
+  size = dirCache.size(name);
+  if(size < 0)
+  {
+    FSfseek(file, 0, SEEK_END);
+    size = FSftell(file);
+  }
+
+  // only the last slot can be torn, the next block takes its place
+  sequence = (size + PULSE_BLOCK - 1)/PULSE_BLOCK;
+  if(sequence && !good(file, sequence - 1)) sequence--;
+  dirCache.close(file);
+  start();
+  return sequence;
+}
+
+static Boolean flush(void)
+{
+  if(!name[0] || !count) return 1;
+  return store();
+}
+
+static Boolean add(unsigned long stamp, int motor)
+{
+  Boolean ok = 1;
+
+  unsigned long ticks = (stamp - last) & 0xFFFFFFFFUL;
+
+  if(!name[0]) return 0;
+  if(count && (motor != blockMotor || length + 2*PULSE_VARINT > PULSE_PAYLOAD))
+    ok = store();
+
+  if(!count)
+  {
+    blockMotor = motor;
+    bytes.put32(block + 8, stamp);
+    lostBefore = lostHere > 0xFFFF ? 0xFFFF : lostHere;
+  }
+  else
+  {
+    if(lostHere)
+    {
+      varint(0);
+      varint(lostHere);
+    }
+    if(ticks == 0xFFFFFFFFUL) ticks--;    // 4.8 hours without a pulse
+    varint(ticks + 1);
+  }
+  lostHere = 0;
+  last = stamp;
+  count++;
+  stampCount++;
+  return ok;
+}
+
+static void lost(unsigned int n)
+{
+  lostHere += n;
+}
+
+static unsigned long blocks(void)
+{
+  return sequence;
+}
+
+static unsigned long stamps(void)
+{
+  return stampCount;
+}
+
+const PulseLog pulseLog = {open, add, lost, flush, blocks, stamps};
@@ -0,0 +1,61 @@
+//Pulse times on the SD card, for the inter-arrival times of the tube
+//
+//pulses.times() hands out each pulse's Timer5 stamp; kept here they show
+//whether the counts are Poisson, how much the tube's dead time cuts off
+//short intervals, and noise pulses the CPM averages hide.  Only the first
+//stamp of a block is stored whole, the rest as ticks since the one before
+//as varints, a byte each up to 508 us apart.  The log is a file of
+//PULSE_BLOCK byte blocks:
+//
+//  0  'P' 'T'        magic
+//  2  length         payload bytes, 16 bit little endian
+//  4  sequence       block number, 32 bit
+//  8  first          stamp of the first pulse, 32 bit
+//  12 count          stamps in the block, 16 bit
+//  14 lost           stamps the ring lost before the first, 16 bit
+//  16 motor          position while the stamps were taken, -2 for moving
+//  17 tick           microseconds a stamp tick, PULSE_TICK_US
+//  18 crc            CRC-32 of bytes 0-17 and the payload, 32 bit
+//  22 payload
+//
+//A payload varint v is a pulse v-1 ticks after the one before; v = 0 is
+//followed by a varint of stamps lost there, so the interval across them is
+//not one, just as lost in the header breaks the interval from the block
+//before.  A block is written once, when it is full, the motor changes or
+//flush() is called, so a power cut costs at most the stamps not yet
+//written.  open() starts past the last good block.  tools/pulsehist reads
+//the log back.
+
+#ifndef PULSELOG_H
+#define PULSELOG_H
+
+#include <nesi.h>
+
+#define PULSE_BLOCK   512         // one sector
+#define PULSE_HEADER  22
+#define PULSE_PAYLOAD (PULSE_BLOCK - PULSE_HEADER)
+
+typedef struct
+{
+  // find the end of the log filename after a reset, creating it if
+  // missing; returns the number of blocks in it, -1 if the card failed
+  long (*open)(String filename);
+
+  // a pulse at stamp while the servos were at motor, returns 0 if a card
+  // write failed
+  Boolean (*add)(unsigned long stamp, int motor);
+
+  // n stamps lost after the last one added
+  void (*lost)(unsigned int n);
+
+  // write the open block now, even if it is not full
+  Boolean (*flush)(void);
+
+  // blocks written and stamps added since open()
+  unsigned long (*blocks)(void);
+  unsigned long (*stamps)(void);
+} PulseLog;
+
+extern const PulseLog pulseLog;
+
+#endif
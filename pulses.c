@@ -0,0 +1,165 @@
+//Geiger tube pulses counted in hardware, see pulses.h
+
+#include <nesi.h>
+#include "pulses.h"
+#include "config.h"
+
+#define T4CK_INPUT 4          // RPINR4<4:0>
+#define IC1_INPUT  7          // RPINR7<4:0>
+#define ICBNE      0x0008     // IC1CON1 buffer not empty
+
+static unsigned int last;       // counter at the last take()
+static unsigned long counted;
+static float carry;             // fraction of a corrected count
+
+#if PULSE_FRONT == PULSE_CAPTURE
+static volatile unsigned int captured;
+static volatile unsigned int wraps;       // Timer5 overflows
+static volatile Boolean stamping;
+static volatile unsigned long ring[PULSE_RING];
+static volatile unsigned int ringIn, ringOut, ringLost, lostSeen;
+
+void __attribute__((interrupt, no_auto_psv)) _T5Interrupt(void)
+{
+  IFS1bits.T5IF = 0;
+  wraps++;
+}
+
+// IC1 ISR, every capture.  A capture is only as old as this ISR is late,
+// well under one Timer5 period, so its time is now less the ticks since
+// it.  Reading the FIFO empty also clears an overflow, whose pulses are
+// gone.  Once the ring is full nothing goes in until times() has handed
+// out what it holds and the loss, so the gap sits where it happened.
+void __attribute__((interrupt, no_auto_psv)) _IC1Interrupt(void)
+{
+  unsigned int now, high = wraps, at;
+
+  IFS0bits.IC1IF = 0;
+  now = TMR5;
+  if(IFS1bits.T5IF && now < 0x8000) high++;   // its ISR waits behind this one
+  while(IC1CON1 & ICBNE)
+  {
+    at = IC1BUF;
+    captured++;
+    if(!stamping) continue;
+    if(ringLost != lostSeen || ringIn - ringOut == PULSE_RING)
+    {
+      ringLost++;
+      continue;
+    }
+    ring[ringIn % PULSE_RING] = ((unsigned long)high << 16 | now) - ((now - at) & 0xFFFF);
+    ringIn++;
+  }
+}
+#endif
+
+static void init(int rpPin)
+{
+  volatile unsigned int *rpinr = &RPINR0;
+
+  __builtin_write_OSCCONL(OSCCON & 0xBF);   // unlock pin select
+#if PULSE_FRONT == PULSE_CAPTURE
+  rpinr[IC1_INPUT] = (rpinr[IC1_INPUT] & ~0x1F) | (rpPin & 0x1F);
+#else
+  rpinr[T4CK_INPUT] = (rpinr[T4CK_INPUT] & ~0x1F) | (rpPin & 0x1F);
+#endif
+  __builtin_write_OSCCONL(OSCCON | 0x40);   // lock again
+
+  last = 0;
+  counted = 0;
+  carry = 0;
+#if PULSE_FRONT == PULSE_CAPTURE
+  // Timer5 free running at FCY/64 for the stamps, its overflows below
+  // the captures' priority
+  captured = 0;
+  wraps = 0;
+  stamping = 0;
+  ringIn = ringOut = ringLost = lostSeen = 0;
+  T5CON = 0x0000;
+  TMR5 = 0;
+  PR5 = 0xFFFF;
+  IPC7bits.T5IP = 2;
+  IFS1bits.T5IF = 0;
+  IEC1bits.T5IE = 1;
+  T5CON = 0x8020;       // on, 1:64
+
+  IC1CON1 = 0x0000;
+  IC1CON2 = 0x0000;
+  IPC0bits.IC1IP = 3;
+  IFS0bits.IC1IF = 0;
+  IEC0bits.IC1IE = 1;
+  IC1CON1 = 0x0C03;     // Timer5, interrupt every capture, rising edges
+#else
+  // Timer4 counts T4CK edges through its whole range, no interrupt
+  T4CON = 0x0000;
+  TMR4 = 0;
+  PR4 = 0xFFFF;
+  T4CON = 0x8002;       // on, external clock, 1:1
+#endif
+}
+
+static unsigned int take(unsigned long ms)
+{
+  unsigned int now, m;
+  float busy, n;
+
+#if PULSE_FRONT == PULSE_CAPTURE
+  now = captured;       // a 16 bit read, the ISR can not tear it
+#else
+  now = TMR4;
+#endif
+  m = (now - last) & 0xFFFF;      // both count in 16 bits, let a wrap through
+  last = now;
+  counted += m;
+  if(!config.deadTime || !ms) return m;
+
+  // the share of the window the tube was blind, the rest saw every event
+  busy = (float)m*config.deadTime/(ms*1000.0f);
+  if(busy > 0.9f) busy = 0.9f;
+  n = m/(1 - busy) + carry;
+  if(n > 65535) n = 65535;
+  m = (unsigned int)n;
+  carry = n - m;
+  return m;
+}
+
+static unsigned long total(void)
+{
+  return counted;
+}
+
+static void stamp(Boolean on)
+{
+#if PULSE_FRONT == PULSE_CAPTURE
+  stamping = on;
+#else
+  (void)on;
+#endif
+}
+
+static unsigned int times(unsigned long *out, unsigned int max, unsigned int *lost)
+{
+  unsigned int n = 0;
+
+#if PULSE_FRONT == PULSE_CAPTURE
+  unsigned int now = ringLost, in = ringIn;
+
+  // the ISR only moves ringIn and ringLost, this side ringOut and
+  // lostSeen; ringIn stands still from the first loss until it is seen
+  while(n < max && ringOut != in)
+    out[n++] = ring[ringOut++ % PULSE_RING] & 0xFFFFFFFFUL;
+  *lost = 0;
+  if(ringOut == in)
+  {
+    *lost = now - lostSeen;
+    lostSeen = now;
+  }
+#else
+  (void)out;
+  (void)max;
+  *lost = 0;
+#endif
+  return n;
+}
+
+const Pulses pulses = {init, take, total, stamp, times};
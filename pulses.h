@@ -0,0 +1,72 @@
+//Geiger tube pulses counted in hardware
+//
+//The counter board sends a '1' over UART2 for every pulse, which caps the
+//rate at what the baud rate carries and costs a character of polling per
+//pulse.  Wired to the tube's pulse line instead, BORON2 can count them
+//itself; PULSE_FRONT picks how when the firmware is built:
+//
+//  PULSE_UART     the board's UART stream, as before; this module is unused
+//  PULSE_TIMER    Timer4 on its external clock T4CK counts the pulses, no
+//                 CPU at all per pulse
+//  PULSE_CAPTURE  IC1 captures Timer5 at every pulse, an interrupt per
+//                 pulse; slower, but each pulse is seen on its own and
+//                 stamp() keeps its time for times()
+//
+//take() is called once per window and hands out the pulses since the
+//last call.  A tube does not see a second event within its dead time
+//after one, so at high rates it misses a share of them; with
+//config.deadTime set take() scales the count back up by the
+//non-paralysable model, n = m/(1 - m*tau) for m counts a second, carrying
+//the fraction over to the next window.
+//
+//Timer4 has 16 bits, so a window must stay under 65536 pulses: over a
+//second that is close to 4 million CPM.
+//
+//Time stamps are Timer5 ticks of PULSE_TICK_US, 1:64 of FCY, extended to 32
+//bits by counting its overflows, so they wrap every 4.8 hours.  The ISR
+//puts them in a ring of PULSE_RING; what does not fit while the main loop
+//is busy elsewhere is counted as lost.
+
+#ifndef PULSES_H
+#define PULSES_H
+
+#include <nesi.h>
+
+#define PULSE_UART    0
+#define PULSE_TIMER   1
+#define PULSE_CAPTURE 2
+
+#ifndef PULSE_FRONT
+#define PULSE_FRONT PULSE_UART
+#endif
+
+#ifndef PULSE_RP
+#define PULSE_RP 11                 // RPn pin the tube's pulse line is on
+#endif
+
+#define PULSE_TICK_US 4
+#define PULSE_RING    256           // stamps, a power of 2
+
+typedef struct
+{
+  // route remappable pin RPn to T4CK or IC1 and start counting
+  void (*init)(int rpPin);
+
+  // pulses since the last call, which was ms milliseconds ago, corrected
+  // for config.deadTime
+  unsigned int (*take)(unsigned long ms);
+
+  // pulses counted since init, uncorrected
+  unsigned long (*total)(void);
+
+  // start or stop keeping each pulse's time, PULSE_CAPTURE only
+  void (*stamp)(Boolean on);
+
+  // up to max of the times kept, oldest first; once they are all out, in
+  // *lost how many the ring had no room for after them
+  unsigned int (*times)(unsigned long *out, unsigned int max, unsigned int *lost);
+} Pulses;
+
+extern const Pulses pulses;
+
+#endif
@@ -0,0 +1,170 @@
+//Adaptive Geiger sampling, see sampler.h
+
+#include <nesi.h>
+#include <string.h>
+#include "sampler.h"
+#include "config.h"
+
+#define QUEUE 8                 // feed() at most this many seconds at once
+
+static unsigned int pulses;     // in the second under way
+static unsigned int window[SAMPLER_HISTORY];
+static unsigned char windowAt;  // next slot of window
+static unsigned long windowSum;
+static unsigned long seconds;   // quiet ones since reset, in the baseline
+static float rate;              // baseline, counts per second
+static Boolean burst;
+static unsigned int calmFor;    // seconds back within config.calm
+static unsigned long quietCounts;
+static unsigned int quietSeconds;
+
+static Sample queue[QUEUE];
+static unsigned char queueHead, queueCount;
+
+static void reset(void)
+{
+  pulses = 0;
+  memset(window, 0, sizeof(window));
+  windowAt = 0;
+  windowSum = 0;
+  seconds = 0;
+  rate = 0;
+  burst = 0;
+  calmFor = 0;
+  quietCounts = quietSeconds = 0;
+  queueHead = queueCount = 0;
+}
+
+static Sample *push(unsigned char kind, unsigned long counts, unsigned int length)
+{
+  Sample *s;
+
+  if(queueCount == QUEUE) return NULL;    // nobody is reading, drop it
+  s = &queue[(queueHead + queueCount++) % QUEUE];
+  s->kind = kind;
+  s->counts = counts;
+  s->seconds = length;
+  s->historyLength = 0;
+  return s;
+}
+
+static unsigned char windowLength(void)
+{
+  unsigned char n = config.burstWindow;
+
+  return n < 1 ? 1 : n > SAMPLER_HISTORY ? SAMPLER_HISTORY : n;
+}
+
+// is windowSum within tenths/10 standard deviations of the baseline
+static Boolean within(unsigned char tenths)
+{
+  float expected = rate*windowLength(), deviation = windowSum - expected;
+  float limit = tenths/10.0f;
+
+  if(expected < 1) expected = 1;      // no zero width band at low rates
+  return deviation*deviation <= limit*limit*expected;
+}
+
+static void second(unsigned int count)
+{
+  unsigned char n = windowLength(), i;
+  Sample *s;
+
+  windowSum = windowSum + count - window[windowAt % n];
+  window[windowAt % n] = count;
+  windowAt = (windowAt + 1) % n;
+
+  if(burst)
+  {
+    push(SAMPLE_SECOND, count, 1);
+    calmFor = within(config.calm) ? calmFor + 1 : 0;
+    if(calmFor >= config.settle) burst = 0;
+    return;
+  }
+
+  quietCounts += count;
+  quietSeconds++;
+  if(seconds >= n && seconds >= config.summary && !within(config.sigma))
+  {
+    // close the summary short and log the window that tripped the alarm
+    if(quietSeconds > n)
+      push(SAMPLE_SUMMARY, quietCounts - windowSum, quietSeconds - n);
+    s = push(SAMPLE_ONSET, windowSum, n);
+    if(s)
+    {
+      for(i = 0; i < n; i++) s->history[i] = window[(windowAt + i) % n];
+      s->historyLength = n;
+    }
+    quietCounts = quietSeconds = 0;
+    burst = 1;
+    calmFor = 0;
+    return;
+  }
+
+  // the baseline learns from quiet seconds only, once they are known to
+  // be quiet, a plain mean to start
+  seconds++;
+  if(seconds < config.baseline)
+    rate += (count - rate)/seconds;
+  else
+    rate += (count - rate)/config.baseline;
+
+  if(quietSeconds >= config.summary)
+  {
+    push(SAMPLE_SUMMARY, quietCounts, quietSeconds);
+    quietCounts = quietSeconds = 0;
+  }
+}
+
+static void feed(const char *data, int length)
+{
+  while(length--)
+  {
+    if(*data == '1')
+      pulses++;
+    else if(*data == '0')
+    {
+      second(pulses);
+      pulses = 0;
+    }
+    data++;
+  }
+}
+
+static Boolean next(Sample *sample)
+{
+  if(!queueCount) return 0;
+  *sample = queue[queueHead];
+  queueHead = (queueHead + 1) % QUEUE;
+  queueCount--;
+  return 1;
+}
+
+static Boolean inBurst(void)
+{
+  return burst;
+}
+
+static void baseline(float *r, unsigned long *s)
+{
+  *r = rate;
+  *s = seconds;
+}
+
+// the window starts out full of what the baseline expects, or the empty
+// one would trip the alarm before it filled
+static void resume(float r, unsigned long s)
+{
+  unsigned char i;
+
+  reset();
+  rate = r;
+  seconds = s;
+  for(i = 0; i < SAMPLER_HISTORY; i++)
+  {
+    window[i] = (unsigned int)(r + 0.5f);
+    if(i < windowLength()) windowSum += window[i];
+  }
+}
+
+const Sampler sampler = {reset, feed, second, next, inBurst, baseline, resume};
@@ -0,0 +1,66 @@
+//Adaptive Geiger sampling
+//
+//The counter sends a '1' per pulse and a '0' every second.  feed() splits
+//that stream into seconds, or second() takes a second counted elsewhere
+//(pulses.h), and decides what is worth logging:
+//
+//  quiet  while the last config.burstWindow seconds hold about the counts
+//         the baseline rate predicts, one summary per config.summary
+//         seconds is enough
+//  burst  once they are off by more than config.sigma standard deviations
+//         (Poisson, so sqrt of the expected count) every second is logged,
+//         starting with the window that tripped it, until they have been
+//         back within config.calm deviations for config.settle seconds
+//
+//The baseline is a running average over about config.baseline seconds and
+//is only fed quiet seconds, so a burst does not raise its own threshold.
+//Thresholds are in tenths of a standard deviation, see config.h.
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <nesi.h>
+
+#define SAMPLER_HISTORY 16      // longest config.burstWindow
+
+#define SAMPLE_SUMMARY 0        // counts over seconds, quiet
+#define SAMPLE_ONSET   1        // a burst began, history holds its window
+#define SAMPLE_SECOND  2        // counts in one second of a burst
+
+typedef struct
+{
+  unsigned char kind;
+  unsigned long counts;
+  unsigned int seconds;
+  unsigned int history[SAMPLER_HISTORY];    // SAMPLE_ONSET, oldest first
+  unsigned char historyLength;
+} Sample;
+
+typedef struct
+{
+  // forget the baseline and any partial summary
+  void (*reset)(void);
+
+  // take characters from the Geiger UART; a second queues up to two
+  // samples and only 8 are kept, so empty next() at least every 4
+  // seconds fed
+  void (*feed)(const char *data, int length);
+
+  // one second's counts from a front end that counts them itself, the
+  // same need for next() between seconds
+  void (*second)(unsigned int counts);
+
+  // the next sample to log, 0 if there is none
+  Boolean (*next)(Sample *sample);
+
+  Boolean (*inBurst)(void);
+
+  // the baseline and the quiet seconds it was learnt from, to carry it
+  // over a reset with resume(), which takes it back in place of reset()
+  void (*baseline)(float *rate, unsigned long *seconds);
+  void (*resume)(float rate, unsigned long seconds);
+} Sampler;
+
+extern const Sampler sampler;
+
+#endif
@@ -0,0 +1,180 @@
+//Hardware PWM servo driver, see servo.h
+
+#include <nesi.h>
+#include "servo.h"
+
+// Timer2 runs at FCY/8, 2 ticks per microsecond on the 16 MHz NESI+ clock
+#define SERVO_TICKS_PER_US  (FCY/8000000UL)
+#define SERVO_PERIOD_TICKS  (SERVO_PERIOD_US*SERVO_TICKS_PER_US)
+
+// the OCx register blocks are laid out back to back, 5 words per module:
+// OCxCON1, OCxCON2, OCxRS, OCxR, OCxTMR
+#define OC_CON1(n) ((&OC1CON1)[5*(n)])
+#define OC_CON2(n) ((&OC1CON1)[5*(n) + 1])
+#define OC_RS(n)   ((&OC1CON1)[5*(n) + 2])
+#define OC_R(n)    ((&OC1CON1)[5*(n) + 3])
+
+// peripheral pin select output function numbers for OC1..OC9
+static const unsigned char ocFunction[SERVO_CHANNELS] =
+  {18, 19, 20, 21, 22, 23, 24, 25, 35};
+
+typedef struct
+{
+  volatile unsigned int now;      // pulse width being output, in ticks
+  volatile unsigned int target;   // where a ramp is heading
+  volatile unsigned int step;     // ticks per 20 ms frame
+  volatile Boolean moving;
+} ServoChannel;
+
+static ServoChannel channels[SERVO_CHANNELS];
+
+static Boolean valid(int channel)
+{
+  return channel >= 0 && channel < SERVO_CHANNELS;
+}
+
+static unsigned int toTicks(unsigned int us)
+{
+  if(us < SERVO_MIN_US) us = SERVO_MIN_US;
+  if(us > SERVO_MAX_US) us = SERVO_MAX_US;
+  return us*SERVO_TICKS_PER_US;
+}
+
+// Timer2 ISR, only enabled while a ramp is in progress
+void __attribute__((interrupt, no_auto_psv)) _T2Interrupt(void)
+{
+  ServoChannel *c;
+  Boolean busy = 0;
+  int n;
+
+  IFS0bits.T2IF = 0;
+
+  for(n = 0; n < SERVO_CHANNELS; n++)
+  {
+    c = &channels[n];
+    if(!c->moving) continue;
+
+    if(c->now < c->target)
+      c->now = (c->target - c->now > c->step) ? c->now + c->step : c->target;
+    else
+      c->now = (c->now - c->target > c->step) ? c->now - c->step : c->target;
+
+    OC_R(n) = c->now;   // latched by the OC module at the next period
+
+    if(c->now == c->target)
+      c->moving = 0;
+    else
+      busy = 1;
+  }
+
+  // every servo is holding, the OC modules carry on without us
+  if(!busy)
+    IEC0bits.T2IE = 0;
+}
+
+static void init(void)
+{
+  int n;
+
+  // Timer2: 1:8 prescale, 20 ms period, interrupt off until a ramp starts
+  T2CON = 0x0000;
+  TMR2 = 0;
+  PR2 = SERVO_PERIOD_TICKS - 1;
+  IPC1bits.T2IP = 2;
+  IFS0bits.T2IF = 0;
+  IEC0bits.T2IE = 0;
+
+  for(n = 0; n < SERVO_CHANNELS; n++)
+  {
+    channels[n].now = channels[n].target = 0;
+    channels[n].moving = 0;
+
+    OC_CON1(n) = 0x0000;                  // disable for configuring
+    OC_CON2(n) = 0x001F;                  // sync to own OCxRS period
+    OC_RS(n) = SERVO_PERIOD_TICKS - 1;    // 50 Hz
+    OC_R(n) = 0;                          // no pulse, output low
+    OC_CON1(n) = 0x0006;                  // Timer2 clock, edge aligned PWM
+  }
+
+  T2CON = 0x8010;   // on, 1:8
+}
+
+static void attach(int channel, int rpPin)
+{
+  volatile unsigned int *rpor = &RPOR0;
+  int shift = (rpPin & 1) ? 8 : 0;
+
+  if(!valid(channel) || rpPin < 0 || rpPin > 31) return;
+
+  __builtin_write_OSCCONL(OSCCON & 0xBF);   // unlock pin select
+  rpor[rpPin/2] = (rpor[rpPin/2] & ~(0x3F << shift)) |
+                  (ocFunction[channel] << shift);
+  __builtin_write_OSCCONL(OSCCON | 0x40);   // lock again
+}
+
+static void pulse(int channel, unsigned int us)
+{
+  ServoChannel *c;
+  Boolean ramping;
+
+  if(!valid(channel)) return;
+  c = &channels[channel];
+
+  ramping = IEC0bits.T2IE;
+  IEC0bits.T2IE = 0;    // keep the ISR off this channel while we change it
+  c->now = c->target = toTicks(us);
+  c->moving = 0;
+  OC_R(channel) = c->now;
+  IEC0bits.T2IE = ramping;
+}
+
+static void moveTo(int channel, unsigned int us, unsigned int ms)
+{
+  ServoChannel *c;
+  unsigned int frames, distance;
+
+  if(!valid(channel)) return;
+  c = &channels[channel];
+
+  // from a released channel the servo position is unknown, just go there
+  if(!c->now || ms < SERVO_PERIOD_US/1000)
+  {
+    pulse(channel, us);
+    return;
+  }
+
+  IEC0bits.T2IE = 0;
+  c->target = toTicks(us);
+  distance = c->now > c->target ? c->now - c->target : c->target - c->now;
+  frames = ms/(SERVO_PERIOD_US/1000);
+  c->step = distance/frames ? distance/frames : 1;
+  c->moving = c->now != c->target;
+  IFS0bits.T2IF = 0;
+  IEC0bits.T2IE = 1;
+}
+
+static Boolean isMoving(int channel)
+{
+  return valid(channel) && channels[channel].moving;
+}
+
+static unsigned int position(int channel)
+{
+  return valid(channel) ? channels[channel].now/SERVO_TICKS_PER_US : 0;
+}
+
+static void release(int channel)
+{
+  Boolean ramping;
+
+  if(!valid(channel)) return;
+
+  ramping = IEC0bits.T2IE;
+  IEC0bits.T2IE = 0;
+  channels[channel].now = channels[channel].target = 0;
+  channels[channel].moving = 0;
+  OC_R(channel) = 0;
+  IEC0bits.T2IE = ramping;
+}
+
+const Servo servo = {init, attach, pulse, moveTo, isMoving, position, release};
@@ -0,0 +1,49 @@
+//Hardware PWM servo driver for NESI+ using the PIC24 output compare modules
+//
+//Channel n is output compare module OC(n+1), all clocked from Timer2 at FCY/8
+//with a 20 ms (50 Hz) period.  Pulse widths are written straight to OCxR so
+//the pulses are generated entirely in hardware; a Timer2 interrupt only runs
+//while some channel is ramping to a new position and switches itself off
+//afterwards, so a servo holding position costs no CPU at all.
+//
+//Channels 0 and 1 (OC1/OC2) drive the red/blue LED pins NESI+ already routes,
+//so ledR/ledB.dutycycle must not be used together with them.  Other channels
+//need servo.attach() to route them to a remappable RPn pin first.
+
+#ifndef SERVO_H
+#define SERVO_H
+
+#include <nesi.h>
+
+#define SERVO_CHANNELS    9         // OC1..OC9
+#define SERVO_PERIOD_US   20000     // 50 Hz frame
+#define SERVO_MIN_US      500
+#define SERVO_MAX_US      2500
+
+typedef struct
+{
+  // Timer2 and every output compare module set up for 50 Hz, outputs low
+  void (*init)(void);
+
+  // route channel's OC output to remappable pin RPn (needed for ch >= 2)
+  void (*attach)(int channel, int rpPin);
+
+  // jump to a pulse width in microseconds, takes effect next frame
+  void (*pulse)(int channel, unsigned int us);
+
+  // ramp from the current pulse width to us over ms milliseconds
+  void (*moveTo)(int channel, unsigned int us, unsigned int ms);
+
+  // true while a ramp started by moveTo is still running
+  Boolean (*isMoving)(int channel);
+
+  // pulse width currently being output, 0 if the channel is released
+  unsigned int (*position)(int channel);
+
+  // stop generating pulses on the channel (output held low)
+  void (*release)(int channel);
+} Servo;
+
+extern const Servo servo;
+
+#endif
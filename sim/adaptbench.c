@@ -0,0 +1,385 @@
+//Adaptive sampling against the fixed window on the same Geiger recording
+//
+//Build:  cc -O2 -Isim -Dmain=boron2_main -c -o boron2.o "BORON2 (2016_10_28 22_55_52 UTC).c"
+//        cc -O2 -Isim -I. -o adaptbench sim/adaptbench.c boron2.o servo.c logexport.c
+//          telemetry.c journal.c packlog.c dircache.c format.c config.c sampler.c
+//          pulses.c pulselog.c timebase.c snapshot.c bustrace.c bytes.c sim/nesi_sim.c -lm
+//
+//  adaptbench [-d days] [-c cpm] [-w capture] [-r capture] [-s sd-dir]
+//
+//A recording of the counter's UART bytes, a '1' per pulse and a '0' per
+//second, is replayed into BORON2 once with adapt=0 (a record per 30
+//characters, as before) and once with adapt=1 (sampler.c).  Without -r the
+//recording is made up: Poisson pulses at cpm with an event every three
+//hours, in turn a 60 s spike to 10x, 5 min at 3x, 15 min at 1.5x and a
+//2 min dropout.  -w saves it, and -r replays a saved one; its leading
+//"# event start seconds factor" lines say where the events are.
+//
+//For each run the journal is turned back into a count per second: a
+//summary spreads its CPM over the seconds it covers and per second
+//records give them exactly.  Printed per run: SD bytes written per day,
+//records per day, and per kind of event the counts and the peak 10 s rate
+//the log shows against the recording, plus bursts logged outside events.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#define wait host_wait            // NESI's wait(ms) takes the name
+#include <sys/wait.h>
+#undef wait
+#include "sim.h"
+#include "journal.h"
+
+#define RTC_BASE 1432629300L      // the simulated DS1307's time at sim start
+#define EVENTS_MAX 1024
+#define PEAK 10                   // seconds the peak rate is taken over
+
+int boron2_main(void);
+
+typedef struct
+{
+  long start, length;
+  double factor;
+} Event;
+
+static unsigned char *counts;     // the recording, pulses per second
+static long seconds;
+static Event events[EVENTS_MAX];
+static int eventCount;
+
+static uint32_t rng = 12345;
+
+static double uniform(void)
+{
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return (rng + 1.0)/4294967297.0;
+}
+
+static int poisson(double mean)
+{
+  double limit = exp(-mean), p = uniform();
+  int k = 0;
+
+  while(p > limit && k < 255)
+  {
+    p *= uniform();
+    k++;
+  }
+  return k;
+}
+
+static void makeRecording(double days, double cpm)
+{
+  static const Event kinds[4] = {{0, 60, 10}, {0, 300, 3}, {0, 900, 1.5}, {0, 120, 0}};
+  double factor;
+  long s, at;
+  int e;
+
+  seconds = (long)(days*86400);
+  counts = malloc(seconds);
+  for(at = 3600; at + 900 < seconds && eventCount < EVENTS_MAX; at += 3*3600)
+  {
+    events[eventCount] = kinds[eventCount % 4];
+    events[eventCount].start = at;
+    eventCount++;
+  }
+  for(s = 0; s < seconds; s++)
+  {
+    factor = 1;
+    for(e = 0; e < eventCount; e++)
+      if(s >= events[e].start && s < events[e].start + events[e].length)
+        factor = events[e].factor;
+    counts[s] = poisson(cpm/60*factor);
+  }
+}
+
+static int loadRecording(const char *path)
+{
+  FILE *f = fopen(path, "rb");
+  char line[128];
+  long size = 1 << 16;
+  int c, pulses = 0;
+
+  if(!f) return 0;
+  while((c = fgetc(f)) == '#')
+  {
+    if(!fgets(line, sizeof(line), f)) break;
+    if(eventCount < EVENTS_MAX && sscanf(line, " event %ld %ld %lf", &events[eventCount].start,
+                                         &events[eventCount].length, &events[eventCount].factor) == 3)
+      eventCount++;
+  }
+  counts = malloc(size);
+  for(; c != EOF; c = fgetc(f))
+  {
+    if(c == '1') pulses++;
+    if(c != '0') continue;
+    if(seconds == size) counts = realloc(counts, size *= 2);
+    counts[seconds++] = pulses > 255 ? 255 : pulses;
+    pulses = 0;
+  }
+  fclose(f);
+  return seconds > 0;
+}
+
+static int saveRecording(const char *path)
+{
+  FILE *f = fopen(path, "wb");
+  long s;
+  int e, k;
+
+  if(!f) return 0;
+  for(e = 0; e < eventCount; e++)
+    fprintf(f, "# event %ld %ld %g\n", events[e].start, events[e].length, events[e].factor);
+  for(s = 0; s < seconds; s++)
+  {
+    for(k = 0; k < counts[s]; k++) fputc('1', f);
+    fputc('0', f);
+  }
+  return fclose(f) == 0;
+}
+
+// UART source playing the recording back: second s's pulses evenly
+// spread through it, its '0' at its end
+static long playSecond;
+static int playPulse;
+
+static uint64_t playNext(void *ctx)
+{
+  if(playSecond >= seconds) return SIM_FOREVER;
+  return playSecond*SIM_SECOND + (playPulse + 1)*SIM_SECOND/(counts[playSecond] + 1);
+}
+
+static unsigned char playEmit(void *ctx)
+{
+  if(playPulse < counts[playSecond])
+  {
+    playPulse++;
+    return '1';
+  }
+  playSecond++;
+  playPulse = 0;
+  return '0';
+}
+
+// one BORON2 run in its own process, the firmware keeps its state in globals
+static int run(const char *dir, int adapt, uint64_t *bytes)
+{
+  SimSource src = {playNext, playEmit, NULL};
+  char path[4200];
+  int fds[2], status;
+  FILE *f;
+  pid_t child;
+
+  if(pipe(fds)) return 0;
+  child = fork();
+  if(child == 0)
+  {
+    close(fds[0]);
+    sim_sd_root(dir);
+    snprintf(path, sizeof(path), "%s/DATALOG.JNL", dir);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/START.TXT", dir);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/SITE.CFG", dir);
+    mkdir(dir, 0777);
+    f = fopen(path, "w");
+    if(!f) _exit(1);
+    fprintf(f, "adapt=%d\n", adapt);
+    fclose(f);
+
+    sim_uart2_source(&src);
+    sim_run(boron2_main, seconds*SIM_SECOND);
+    if(write(fds[1], &sim_stats.sd_bytes_written, sizeof(uint64_t)) != sizeof(uint64_t)) _exit(1);
+    _exit(0);
+  }
+  close(fds[1]);
+  if(read(fds[0], bytes, sizeof(uint64_t)) != sizeof(uint64_t)) *bytes = 0;
+  close(fds[0]);
+  waitpid(child, &status, 0);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static long stampSeconds(const char *stamp)
+{
+  static const char *months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  char month[4];
+  struct tm tm;
+  const char *m;
+
+  memset(&tm, 0, sizeof(tm));
+  if(sscanf(stamp, "%*3s %3s %d %d:%d:%d %d", month, &tm.tm_mday, &tm.tm_hour,
+            &tm.tm_min, &tm.tm_sec, &tm.tm_year) != 6)
+    return -1;
+  m = strstr(months, month);
+  if(!m) return -1;
+  tm.tm_mon = (m - months)/3;
+  tm.tm_year -= 1900;
+  return (long)(timegm(&tm) - RTC_BASE);
+}
+
+// fill est[] from the journal in dir, returns records read
+static long replayLog(const char *dir, double *est, long *bursts, long *falseBursts)
+{
+  unsigned char b[JOURNAL_BLOCK];
+  char text[JOURNAL_PAYLOAD + 1], path[4200], *p;
+  double *exact = malloc(seconds*sizeof(double));
+  long records = 0, n = 0, t, last = 0, s, from, secs;
+  int length, cpm, e, inside;
+  FILE *f;
+
+  for(s = 0; s < seconds; s++) est[s] = exact[s] = -1;
+  *bursts = *falseBursts = 0;
+  snprintf(path, sizeof(path), "%s/DATALOG.JNL", dir);
+  f = fopen(path, "rb");
+  while(f && fread(b, 1, JOURNAL_BLOCK, f) == JOURNAL_BLOCK)
+  {
+    length = b[2] | b[3] << 8;
+    if(b[0] != 'J' || b[1] != 'L' || length > JOURNAL_PAYLOAD ||
+       (b[4] | b[5] << 8 | b[6] << 16 | (long)b[7] << 24) != n++)
+      break;
+    memcpy(text, b + JOURNAL_HEADER, length);
+    text[length] = 0;
+    if(strncmp(text, "\nTime,", 6) || (t = stampSeconds(text + 6)) < 0) continue;
+    p = text + 6 + 24;
+    if(t > seconds) t = seconds;
+
+    if(sscanf(p, ",CPM,%d,Secs,%ld", &cpm, &secs) == 2 || sscanf(p, ",CPM,%d", &cpm) == 1)
+    {
+      // a summary covers the Secs before it, or back to the last one
+      from = strstr(p, ",Secs,") ? t - secs : last;
+      for(s = from < 0 ? 0 : from; s < t; s++) est[s] = cpm/60.0;
+      last = t;
+      records++;
+    }
+    else if(!strncmp(p, ",Counts,", 8))
+    {
+      if(t > 0) exact[t - 1] = atoi(p + 8);
+      last = t;
+      records++;
+    }
+    else if(!strncmp(p, ",Burst,", 7))
+    {
+      for(secs = 1, s = 7; p[s] && p[s] != '\t'; s++) secs += p[s] == ';';
+      for(p += 7, s = t - secs; *p && *p != '\t'; s++)
+      {
+        if(s >= 0) exact[s] = strtol(p, &p, 10);
+        if(*p == ';') p++;
+      }
+      last = t;
+      records++;
+      inside = 0;
+      for(e = 0; e < eventCount; e++)
+        if(t >= events[e].start && t <= events[e].start + events[e].length + 16) inside = 1;
+      if(inside) (*bursts)++;
+      else (*falseBursts)++;
+    }
+  }
+  if(f) fclose(f);
+
+  for(s = 0; s < seconds; s++)
+    if(exact[s] >= 0) est[s] = exact[s];
+  free(exact);
+  return records;
+}
+
+static double sum(const double *est, long from, long to)
+{
+  double total = 0;
+
+  for(; from < to; from++) total += est[from] < 0 ? 0 : est[from];
+  return total;
+}
+
+static double peak(const double *est, long from, long to)
+{
+  double best = 0, now;
+  long s;
+
+  for(s = from; s + PEAK <= to; s++)
+    if((now = sum(est, s, s + PEAK)) > best) best = now;
+  return best*60.0/PEAK;
+}
+
+int main(int argc, char **argv)
+{
+  static const char *names[2] = {"fixed", "adaptive"};
+  const char *replay = NULL, *save = NULL, *dir = "adaptbench.sd";
+  double days = 2, cpm = 30, mean, *est, *truth, err, peakErr, truePeak, logPeak;
+  char sd[4096];
+  long records, bursts, falseBursts, s;
+  uint64_t bytes;
+  int mode, opt, e, k, kinds;
+
+  while((opt = getopt(argc, argv, "d:c:w:r:s:")) != -1)
+  {
+    switch(opt)
+    {
+      case 'd': days = atof(optarg); break;
+      case 'c': cpm = atof(optarg); break;
+      case 'w': save = optarg; break;
+      case 'r': replay = optarg; break;
+      case 's': dir = optarg; break;
+      default:
+        fprintf(stderr, "usage: adaptbench [-d days] [-c cpm] [-w capture] [-r capture] [-s sd-dir]\n");
+        return 2;
+    }
+  }
+
+  if(replay ? !loadRecording(replay) : (makeRecording(days, cpm), 0))
+  {
+    fprintf(stderr, "adaptbench: can't read %s\n", replay);
+    return 1;
+  }
+  if(save && !saveRecording(save))
+  {
+    fprintf(stderr, "adaptbench: can't write %s\n", save);
+    return 1;
+  }
+  days = seconds/86400.0;
+  truth = malloc(seconds*sizeof(double));
+  est = malloc(seconds*sizeof(double));
+  for(s = 0; s < seconds; s++) truth[s] = counts[s];
+  mean = sum(truth, 0, seconds)*60/seconds;
+  printf("%.2f days, %.1f CPM mean, %d events\n", days, mean, eventCount);
+
+  for(mode = 0; mode < 2; mode++)
+  {
+    snprintf(sd, sizeof(sd), "%s/%s", dir, names[mode]);
+    mkdir(dir, 0777);
+    if(!run(sd, mode, &bytes))
+    {
+      fprintf(stderr, "adaptbench: %s run failed\n", names[mode]);
+      return 1;
+    }
+    records = replayLog(sd, est, &bursts, &falseBursts);
+    printf("\n%s: %.0f KB written per day, %.0f records per day, %ld bursts in events, "
+           "%.1f outside per day\n", names[mode], bytes/days/1024, records/days, bursts, falseBursts/days);
+    printf("  %-11s %7s %10s %10s %9s %9s\n", "event", "events", "count err", "peak CPM", "logged", "peak err");
+
+    // the kinds of event in the recording, by factor and length
+    for(kinds = 0; kinds < eventCount && kinds < 4; kinds++)
+    {
+      err = peakErr = truePeak = logPeak = 0;
+      for(e = kinds, k = 0; e < eventCount; e += 4, k++)
+      {
+        long a = events[e].start, z = a + events[e].length;
+        double t = sum(truth, a, z), p = peak(truth, a, z), q = peak(est, a, z);
+        double base = (z - a)*mean/60;    // a dropout is measured against what it hid
+
+        err += fabs(sum(est, a, z) - t)/(t > base ? t : base);
+        peakErr += fabs(q - p)/(p > mean ? p : mean);
+        truePeak += p;
+        logPeak += q;
+      }
+      printf("  %4.1fx %4lds %7d %9.1f%% %10.0f %9.0f %8.1f%%\n", events[kinds].factor,
+             events[kinds].length, k, 100*err/k, truePeak/k, logPeak/k, 100*peakErr/k);
+    }
+  }
+  return 0;
+}
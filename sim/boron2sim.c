@@ -0,0 +1,117 @@
+//Runs BORON2 on the host simulator
+//
+//Build:  cc -O2 -Isim -Dmain=boron2_main -c -o boron2.o "BORON2 (2016_10_28 22_55_52 UTC).c"
+//        cc -O2 -Isim -o boron2sim sim/boron2sim.c boron2.o servo.c logexport.c
+//          telemetry.c journal.c packlog.c dircache.c format.c config.c sampler.c
+//          pulses.c pulselog.c timebase.c snapshot.c bustrace.c bytes.c sim/nesi_sim.c -lm
+//
+//  boron2sim [-s sd-dir] [-d days] [-c cpm] [-p ppm] [-k rtc-file] [-u] [-t]
+//
+//Runs the experiment for days of virtual time (default 25, long enough to
+//reach the end of the experiment) against a Geiger counter clicking at cpm
+//(default 30), with the SD card in sd-dir (default ./sd).  -p runs the MCU
+//oscillator ppm parts per million fast, or slow if negative, against the
+//RTC.  -k keeps the RTC's registers in rtc-file: read before the run if it
+//is there, written after, so the next run boots like after a reset with
+//the RTC and the card as this one left them, e.g.
+//
+//  boron2sim -d 1 -k rtc.bin && boron2sim -d 2 -k rtc.bin
+//
+//With -u the USB port is stdin/stdout so a host tool can be attached, e.g.
+//
+//  logpull -e "boron2sim -u" -o DATALOG.JNL && jnlcat DATALOG.JNL
+//
+//-t presses the button 30 s in, once setup is done, starting live telemetry:
+//
+//  telview -e "boron2sim -u -t -d 1"
+//
+//The run ends at the deadline or when the USB host hangs up; counters go
+//to stderr.
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sim.h"
+
+int boron2_main(void);
+
+static void press(void *ctx)
+{
+  sim_button(ctx != NULL);
+}
+
+int main(int argc, char **argv)
+{
+  const char *sd = "sd", *rtcFile = NULL;
+  unsigned char regs[SIM_RTC_REGS];
+  FILE *f;
+  double days = 25, cpm = 30;
+  int usbPort = 0, telemetry = 0, opt, stopped;
+  long ppm = 0;
+  double span;
+
+  while((opt = getopt(argc, argv, "s:d:c:p:k:ut")) != -1)
+  {
+    switch(opt)
+    {
+      case 's': sd = optarg; break;
+      case 'd': days = atof(optarg); break;
+      case 'c': cpm = atof(optarg); break;
+      case 'p': ppm = atol(optarg); break;
+      case 'k': rtcFile = optarg; break;
+      case 'u': usbPort = 1; break;
+      case 't': telemetry = 1; break;
+      default:
+        fprintf(stderr, "usage: boron2sim [-s sd-dir] [-d days] [-c cpm] [-p ppm] [-k rtc-file] [-u] [-t]\n");
+        return 2;
+    }
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+  sim_sd_root(sd);
+  sim_geiger(cpm, 1);
+  sim_mcu_ppm(ppm);
+  if(rtcFile && (f = fopen(rtcFile, "rb")))
+  {
+    if(fread(regs, 1, sizeof(regs), f) == sizeof(regs)) sim_rtc_regs(regs, 1);
+    fclose(f);
+  }
+  if(usbPort) sim_usb_fds(0, 1);
+  if(telemetry)
+  {
+    sim_at(30*SIM_SECOND, press, "down");
+    sim_at(30*SIM_SECOND + 200000, press, NULL);
+  }
+
+  stopped = sim_run(boron2_main, (uint64_t)(days*SIM_DAY));
+
+  fprintf(stderr, "boron2sim: %s after %.3f days\n", stopped ? "deadline" : "stopped",
+          sim_now_us()/(double)SIM_DAY);
+  if(rtcFile)
+  {
+    sim_rtc_regs(regs, 0);
+    if(!(f = fopen(rtcFile, "wb")) || fwrite(regs, 1, sizeof(regs), f) != sizeof(regs))
+      perror(rtcFile);
+    if(f) fclose(f);
+  }
+  fprintf(stderr, "  uart2    %llu bytes, %llu dropped, %llu over the line rate, deepest backlog %llu\n",
+          (unsigned long long)sim_stats.uart_rx_bytes, (unsigned long long)sim_stats.uart_rx_dropped,
+          (unsigned long long)sim_stats.uart_line_dropped, (unsigned long long)sim_stats.uart_max_backlog);
+  fprintf(stderr, "           longest wait in the buffer %.1f ms, between polls %.1f ms\n",
+          sim_stats.uart_max_wait_us/1e3, sim_stats.uart_max_gap_us/1e3);
+  fprintf(stderr, "  i2c2     %llu bytes, %.3f s on the bus\n",
+          (unsigned long long)sim_stats.i2c_bytes, sim_stats.i2c_bus_us/1e6);
+  fprintf(stderr, "  sd       %llu opens, %llu sector reads, %llu sector writes, %llu bytes written\n",
+          (unsigned long long)sim_stats.sd_opens, (unsigned long long)sim_stats.sd_sector_reads,
+          (unsigned long long)sim_stats.sd_sector_writes, (unsigned long long)sim_stats.sd_bytes_written);
+  if(sim_stats.usb_bytes_out)
+  {
+    span = (sim_stats.usb_last_us - sim_stats.usb_first_us)/1e6;
+    fprintf(stderr, "  usb      %llu bytes in %.3f s device time, %.3f MB/s\n",
+            (unsigned long long)sim_stats.usb_bytes_out, span,
+            span > 0 ? sim_stats.usb_bytes_out/span/1e6 : 0);
+  }
+  return 0;
+}
@@ -0,0 +1,437 @@
+//A fleet of BORON2 nodes on the host simulator, on all cores
+//
+//Build:  cc -O2 -fPIC -Isim -Dmain=boron2_main -c -o boron2.o "BORON2 (2016_10_28 22_55_52 UTC).c"
+//        cc -O2 -fPIC -shared -Wl,-Bsymbolic -Isim -o boron2node.so boron2.o servo.c
+//          logexport.c telemetry.c journal.c packlog.c dircache.c format.c config.c
+//          sampler.c pulses.c pulselog.c timebase.c snapshot.c bustrace.c bytes.c
+//          sim/nesi_sim.c -lm
+//        cc -O2 -pthread -Isim -Itools -I. -DBYTES_CRC_BYTEWISE=1 -o fleetsim sim/fleetsim.c
+//          tools/fleetlog.c bytes.c -ldl -lm
+//
+//  fleetsim [-n nodes] [-d days] [-r cpm[-cpm]] [-j threads,...] [-c key=value]...
+//           [-l boron2node.so] [-s fleet-dir] [-v]
+//
+//Runs -n nodes (default 16) for -d days of virtual time each (default 25,
+//the whole schedule) and reports node-days simulated per wall second.
+//Each node has its own RTC, a start a minute after the last node's, its
+//own Geiger counter seeded by its number and clicking at a rate spread
+//evenly over -r (default 20-60 CPM), and its own SD card in
+//fleet-dir/nodeNNN (default fleet.sd).  -c adds SITE.CFG lines for all.
+//Built as above with gcc 12 on a 1-CPU Xeon VM, one thread runs about
+//0.24 node-days/s at the default rates, some 20000 times real time; -n 4
+//-d 3 took 49 s and -n 16 -d 1 65 s.
+//
+//The firmware and simulator keep their state in statics, so a node needs
+//its own copy of them: each worker thread copies boron2node.so to a file
+//of its own and loads it afresh, RTLD_LOCAL, for every node it runs.
+//Nodes are tasks on a work-stealing pool: each worker starts with a
+//contiguous share of them, runs its own newest first and, once out,
+//takes the oldest from a random other worker.  A share of fast nodes
+//leaves its worker idle early, so the slow ones get spread out.
+//
+//Afterwards all journals are read back with fleet_ingest and each node's
+//records and mean CPM are put against its counter's rate; a record that
+//does not parse, rate or other, fails the run.  -v prints a line per
+//node.  With a list for -j the fleet is run once per thread count, each
+//time from fresh cards, and the speedup over the first is printed.  The journals stay behind for fleetdb, e.g.
+//
+//  fleetdb build fleet.col fleet.sd/node*/DATALOG.JNL
+
+#include <dlfcn.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "sim.h"
+#include "fleetlog.h"
+
+#define THREADS_MAX   64
+#define SETTINGS_MAX  16
+#define COUNTS_MAX    16          // thread counts of a -j sweep
+
+// the simulator's harness calls, looked up in each copy
+typedef struct
+{
+  void *handle;
+  int (*entry)(void);
+  int (*run)(int (*entry)(void), uint64_t until_us);
+  void (*sdRoot)(const char *dir);
+  void (*rtcSet)(DateAndTime now);
+  void (*geiger)(double cpm, uint32_t seed);
+  SimStats *stats;
+} Node;
+
+typedef struct
+{
+  double cpm;
+  char dir[4200];
+  SimStats stats;
+  int worker, ok;
+  double seconds;               // wall time of the run
+} NodeRun;
+
+// one worker's tasks: the owner takes from the bottom, thieves from the top
+typedef struct
+{
+  pthread_mutex_t lock;
+  int *tasks;
+  int top, bottom;
+  pthread_t thread;
+  int id;
+  unsigned int rng;
+  char library[4200];           // this worker's copy of the .so
+  int ran, stole;
+} Worker;
+
+static Worker workers[THREADS_MAX];
+static int nworkers;
+static NodeRun *nodes;
+static int nnodes;
+static pthread_mutex_t doneLock = PTHREAD_MUTEX_INITIALIZER;
+static int remaining;           // tasks not yet taken by anyone
+
+static const char *library = "./boron2node.so";
+static const char *settings[SETTINGS_MAX];
+static int settingCount;
+static double days = 25;
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+static int copyFile(const char *from, const char *to)
+{
+  char buf[65536];
+  size_t n;
+  FILE *in = fopen(from, "rb"), *out = in ? fopen(to, "wb") : NULL;
+  int ok = in && out;
+
+  while(ok && (n = fread(buf, 1, sizeof(buf), in)) > 0)
+    ok = fwrite(buf, 1, n, out) == n;
+  if(in) fclose(in);
+  if(out && fclose(out)) ok = 0;
+  return ok;
+}
+
+static int load(Node *node, const char *path)
+{
+  node->handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if(!node->handle)
+  {
+    fprintf(stderr, "fleetsim: %s\n", dlerror());
+    return 0;
+  }
+  node->entry = (int (*)(void))dlsym(node->handle, "boron2_main");
+  node->run = (int (*)(int (*)(void), uint64_t))dlsym(node->handle, "sim_run");
+  node->sdRoot = (void (*)(const char *))dlsym(node->handle, "sim_sd_root");
+  node->rtcSet = (void (*)(DateAndTime))dlsym(node->handle, "sim_rtc_set");
+  node->geiger = (void (*)(double, uint32_t))dlsym(node->handle, "sim_geiger");
+  node->stats = (SimStats *)dlsym(node->handle, "sim_stats");
+  if(node->entry && node->run && node->sdRoot && node->rtcSet && node->geiger && node->stats)
+    return 1;
+  fprintf(stderr, "fleetsim: %s is not a BORON2 node library\n", path);
+  dlclose(node->handle);
+  return 0;
+}
+
+// a fresh card with SITE.CFG and nothing else
+static int prepare(const NodeRun *run)
+{
+  static const char *files[] = {"DATALOG.JNL", "DATALOG.PKL", "PULSES.BIN", "START.TXT", "TIME.TXT"};
+  char path[4300];
+  FILE *f;
+  int i;
+
+  mkdir(run->dir, 0777);
+  for(i = 0; i < (int)(sizeof(files)/sizeof(files[0])); i++)
+  {
+    snprintf(path, sizeof(path), "%s/%s", run->dir, files[i]);
+    unlink(path);
+  }
+  snprintf(path, sizeof(path), "%s/SITE.CFG", run->dir);
+  f = fopen(path, "w");
+  if(!f) return 0;
+  for(i = 0; i < settingCount; i++) fprintf(f, "%s\n", settings[i]);
+  return !fclose(f);
+}
+
+// node n on worker w, in a copy of the library loaded for it alone
+static void runNode(Worker *w, int n)
+{
+  NodeRun *run = &nodes[n];
+  DateAndTime start = {0, 35, 8, 2, 26, 5, 15};     // 08:35 Tue May 26 2015
+  int minutes = 8*60 + 35 + n % 900;
+  double t0 = now();
+  Node node;
+
+  start.hour = minutes/60;
+  start.minute = minutes % 60;
+  run->worker = w->id;
+  if(!prepare(run) || !load(&node, w->library)) return;
+  node.sdRoot(run->dir);
+  node.rtcSet(start);
+  node.geiger(run->cpm, n + 1);
+  node.run(node.entry, (uint64_t)(days*SIM_DAY));
+  run->stats = *node.stats;
+  run->ok = 1;
+  dlclose(node.handle);
+  run->seconds = now() - t0;
+}
+
+// the newest of w's own tasks, -1 if it has none
+static int pop(Worker *w)
+{
+  int n = -1;
+
+  pthread_mutex_lock(&w->lock);
+  if(w->bottom > w->top) n = w->tasks[--w->bottom];
+  pthread_mutex_unlock(&w->lock);
+  return n;
+}
+
+// the oldest task of another worker, tried from a random one around
+static int steal(Worker *w)
+{
+  int i, n = -1;
+  Worker *v;
+
+  w->rng = w->rng*1103515245u + 12345u;
+  for(i = 0; i < nworkers && n < 0; i++)
+  {
+    v = &workers[(w->rng/65536 + i) % nworkers];
+    if(v == w) continue;
+    pthread_mutex_lock(&v->lock);
+    if(v->bottom > v->top) n = v->tasks[v->top++];
+    pthread_mutex_unlock(&v->lock);
+  }
+  return n;
+}
+
+static void *work(void *arg)
+{
+  Worker *w = arg;
+  int n, stolen;
+
+  for(;;)
+  {
+    stolen = 0;
+    n = pop(w);
+    if(n < 0)
+    {
+      n = steal(w);
+      stolen = 1;
+    }
+    if(n < 0)
+    {
+      // nothing left to take anywhere: the rest is running elsewhere
+      pthread_mutex_lock(&doneLock);
+      n = remaining;
+      pthread_mutex_unlock(&doneLock);
+      if(!n) break;
+      sched_yield();
+      continue;
+    }
+    pthread_mutex_lock(&doneLock);
+    remaining--;
+    pthread_mutex_unlock(&doneLock);
+    w->ran++;
+    w->stole += stolen;
+    runNode(w, n);
+  }
+  return NULL;
+}
+
+// the whole fleet on threads workers, returns the wall time or -1
+static double runFleet(const char *dir, int threads)
+{
+  double t0 = now();
+  int i, n, ok = 1;
+
+  nworkers = threads;
+  remaining = nnodes;
+  for(i = 0; i < threads; i++)
+  {
+    Worker *w = &workers[i];
+
+    pthread_mutex_init(&w->lock, NULL);
+    w->id = i;
+    w->rng = i + 1;
+    w->ran = w->stole = 0;
+    w->top = 0;
+    w->bottom = 0;
+    w->tasks = malloc(nnodes*sizeof(int));
+    for(n = (long)nnodes*i/threads; n < (long)nnodes*(i + 1)/threads; n++)
+      w->tasks[w->bottom++] = n;
+    snprintf(w->library, sizeof(w->library), "%s/.worker%d.so", dir, i);
+    if(!copyFile(library, w->library))
+    {
+      fprintf(stderr, "fleetsim: can not copy %s to %s\n", library, w->library);
+      ok = 0;
+    }
+  }
+  for(i = 0; ok && i < threads; i++)
+    if(pthread_create(&workers[i].thread, NULL, work, &workers[i]))
+    {
+      fprintf(stderr, "fleetsim: can not start worker %d\n", i);
+      threads = i;
+      ok = 0;
+      pthread_mutex_lock(&doneLock);
+      remaining = 0;          // the ones started finish what they hold
+      pthread_mutex_unlock(&doneLock);
+    }
+  for(i = 0; i < threads; i++)
+    pthread_join(workers[i].thread, NULL);
+  for(i = 0; i < nworkers; i++)
+  {
+    unlink(workers[i].library);
+    free(workers[i].tasks);
+    pthread_mutex_destroy(&workers[i].lock);
+  }
+  for(n = 0; n < nnodes; n++)
+    ok &= nodes[n].ok;
+  return ok ? now() - t0 : -1;
+}
+
+// records and mean CPM of each node's journal against its counter
+static int report(int verbose)
+{
+  const char **paths = malloc(nnodes*sizeof(char *));
+  char (*names)[4300] = malloc(nnodes*sizeof(*names));
+  double *sum = calloc(nnodes, sizeof(double)), *weight = calloc(nnodes, sizeof(double));
+  size_t *records = calloc(nnodes, sizeof(size_t)), r, total = 0;
+  uint64_t dropped = 0, written = 0;
+  double err, worst = 0;
+  FleetLog log;
+  int n, failed;
+
+  for(n = 0; n < nnodes; n++)
+  {
+    snprintf(names[n], sizeof(names[n]), "%s/DATALOG.JNL", nodes[n].dir);
+    paths[n] = names[n];
+  }
+  failed = fleet_ingest((const char *const *)paths, nnodes, nworkers, &log);
+  if(!failed)
+  {
+    // a summary covers its Secs, a window record the minute or so before it
+    for(r = 0; r < log.count; r++)
+    {
+      n = log.records[r].node;
+      records[n]++;
+      sum[n] += (double)log.records[r].cpm*(log.records[r].secs ? log.records[r].secs : 1);
+      weight[n] += log.records[r].secs ? log.records[r].secs : 1;
+    }
+    if(verbose)
+      printf("%-8s %8s %10s %10s %8s %9s %10s %8s\n", "node", "cpm", "records", "mean cpm",
+             "error", "uart lost", "sd MB", "wall s");
+    for(n = 0; n < nnodes; n++)
+    {
+      err = weight[n] > 0 ? 100*(sum[n]/weight[n] - nodes[n].cpm)/nodes[n].cpm : -100;
+      if(fabs(err) > fabs(worst)) worst = err;
+      total += records[n];
+      dropped += nodes[n].stats.uart_rx_dropped + nodes[n].stats.uart_line_dropped;
+      written += nodes[n].stats.sd_bytes_written;
+      if(verbose)
+        printf("node%03d  %8.1f %10zu %10.2f %7.1f%% %9llu %10.2f %8.2f\n", n, nodes[n].cpm,
+               records[n], weight[n] > 0 ? sum[n]/weight[n] : 0, err,
+               (unsigned long long)(nodes[n].stats.uart_rx_dropped + nodes[n].stats.uart_line_dropped),
+               nodes[n].stats.sd_bytes_written/1e6, nodes[n].seconds);
+    }
+    printf("%d nodes: %zu records, %llu other, %llu damaged, %llu UART bytes lost, "
+           "%.1f MB to the cards, worst mean %+.1f%%\n", nnodes, total,
+           (unsigned long long)log.counts.other, (unsigned long long)log.counts.damaged,
+           (unsigned long long)dropped, written/1e6, worst);
+    // every record the firmware writes parses, Boot and Servo ones as other
+    failed = log.counts.damaged > 0;
+    fleet_free(&log);
+  }
+  free(paths);
+  free(names);
+  free(sum);
+  free(weight);
+  free(records);
+  return failed;
+}
+
+static int parseCounts(const char *s, int *counts)
+{
+  int n = 0;
+  char *end;
+
+  while(n < COUNTS_MAX)
+  {
+    counts[n] = strtol(s, &end, 10);
+    if(end == s || counts[n] < 1 || counts[n] > THREADS_MAX) return 0;
+    n++;
+    if(*end != ',') break;
+    s = end + 1;
+  }
+  return *end ? 0 : n;
+}
+
+int main(int argc, char **argv)
+{
+  const char *dir = "fleet.sd";
+  double low = 20, high = 60, wall, base = 0;
+  int counts[COUNTS_MAX], ncounts = 1, opt, n, i, verbose = 0, bad = 0, stolen;
+  char *end;
+
+  counts[0] = sysconf(_SC_NPROCESSORS_ONLN);
+  if(counts[0] > THREADS_MAX) counts[0] = THREADS_MAX;
+  nnodes = 16;
+  while((opt = getopt(argc, argv, "n:d:r:j:c:l:s:v")) != -1)
+  {
+    switch(opt)
+    {
+      case 'n': nnodes = atoi(optarg); break;
+      case 'd': days = atof(optarg); break;
+      case 'r':
+        low = high = strtod(optarg, &end);
+        if(*end == '-') high = strtod(end + 1, &end);
+        bad |= *end || low <= 0 || high < low;
+        break;
+      case 'j': bad |= !(ncounts = parseCounts(optarg, counts)); break;
+      case 'c': if(settingCount < SETTINGS_MAX) settings[settingCount++] = optarg; break;
+      case 'l': library = optarg; break;
+      case 's': dir = optarg; break;
+      case 'v': verbose = 1; break;
+      default: bad = 1; break;
+    }
+  }
+  if(bad || nnodes < 1 || days <= 0 || optind != argc)
+  {
+    fprintf(stderr, "usage: fleetsim [-n nodes] [-d days] [-r cpm[-cpm]] [-j threads,...] [-c key=value]...\n"
+                    "                [-l boron2node.so] [-s fleet-dir] [-v]\n");
+    return 2;
+  }
+
+  mkdir(dir, 0777);
+  nodes = calloc(nnodes, sizeof(NodeRun));
+  for(n = 0; n < nnodes; n++)
+  {
+    nodes[n].cpm = nnodes > 1 ? low + (high - low)*n/(nnodes - 1) : low;
+    snprintf(nodes[n].dir, sizeof(nodes[n].dir), "%s/node%03d", dir, n);
+  }
+
+  printf("%d nodes of %.1f days, %.0f-%.0f CPM\n", nnodes, days, low, high);
+  printf("%8s %10s %12s %8s %8s\n", "threads", "wall s", "node-days/s", "speedup", "stolen");
+  for(i = 0; i < ncounts; i++)
+  {
+    for(n = 0; n < nnodes; n++)
+      nodes[n].ok = 0;
+    wall = runFleet(dir, counts[i]);
+    if(wall < 0) return 1;
+    if(!i) base = wall;
+    for(n = 0, stolen = 0; n < counts[i]; n++)
+      stolen += workers[n].stole;
+    printf("%8d %10.2f %12.2f %7.2fx %8d\n", counts[i], wall, nnodes*days/wall, base/wall, stolen);
+  }
+  return report(verbose) ? 1 : 0;
+}
@@ -0,0 +1,238 @@
+//format.c against sprintf on the records BORON2 logs
+//
+//Build:  cc -O2 -Isim -I. -o formatbench sim/formatbench.c format.c
+//
+//  formatbench [-n records]
+//
+//Each record is built both ways into the same size of buffer, the text
+//has to match byte for byte, and the host time per record is printed.
+//Then the stamp work of one Geiger sample, which needs the time both in
+//its log record and in TIME.TXT: rendered twice with sprintf, twice with
+//format.stamp(), and once through the format.update() cache.
+//Timing is host CPU time, not PIC24 cycles, but both sides run on the
+//same compiler and library so the ratio is what carries over.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "format.h"
+
+static double seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+static const char *stampOf(DateAndTime t)
+{
+  static const char *days[7] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+  static const char *months[12] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                   "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+  static char stamp[32];
+
+  // what dateTime.toStamp() hands sprintf's %s
+  snprintf(stamp, sizeof(stamp), "%s %s %2d %02d:%02d:%02d %04d", days[t.weekday % 7],
+           months[t.month - 1], t.day, t.hour, t.minute, t.second, 2000 + t.year);
+  return stamp;
+}
+
+static DateAndTime timeOf(long n)
+{
+  DateAndTime t;
+
+  t.second = n % 60;
+  t.minute = n/60 % 60;
+  t.hour = n/3600 % 24;
+  t.day = 1 + n/86400 % 28;
+  t.month = 1 + n/2419200 % 12;
+  t.weekday = n/86400 % 7;
+  t.year = 15;
+  return t;
+}
+
+// the three record shapes of BORON2, kind = n % 3
+static int bySprintf(char *out, long n)
+{
+  DateAndTime t = timeOf(n);
+
+  switch(n % 3)
+  {
+    case 0:  return sprintf(out, "\nTime,%s,CPM,%d,Motor,%d\t", stampOf(t), (int)(n % 97), (int)(n % 4) - 1);
+    case 1:  return sprintf(out, "\nTime,%s,Servo,%d,Pulse,%u,Stalled,%d", stampOf(t), (int)(n % 4) + 1,
+                            (unsigned)(1000 + n % 1000), (int)(n % 301) - 150);
+    default: return sprintf(out, "\nBoot,%s,Capture,%lu,Ready,%lu,Log,%lu\t", stampOf(t),
+                            (unsigned long)(n % 7), (unsigned long)(n % 5000), (unsigned long)n);
+  }
+}
+
+static int byFormat(char *out, long n)
+{
+  DateAndTime t = timeOf(n);
+  Line line;
+
+  format.begin(&line, out, 116);
+  switch(n % 3)
+  {
+    case 0:
+      format.text(&line, "\nTime,");
+      format.stamp(&line, t);
+      format.text(&line, ",CPM,");
+      format.integer(&line, n % 97);
+      format.text(&line, ",Motor,");
+      format.integer(&line, n % 4 - 1);
+      format.character(&line, '\t');
+      break;
+    case 1:
+      format.text(&line, "\nTime,");
+      format.stamp(&line, t);
+      format.text(&line, ",Servo,");
+      format.integer(&line, n % 4 + 1);
+      format.text(&line, ",Pulse,");
+      format.number(&line, 1000 + n % 1000);
+      format.text(&line, ",Stalled,");
+      format.integer(&line, n % 301 - 150);
+      break;
+    default:
+      format.text(&line, "\nBoot,");
+      format.stamp(&line, t);
+      format.text(&line, ",Capture,");
+      format.number(&line, n % 7);
+      format.text(&line, ",Ready,");
+      format.number(&line, n % 5000);
+      format.text(&line, ",Log,");
+      format.number(&line, n);
+      format.character(&line, '\t');
+      break;
+  }
+  return line.length;
+}
+
+int main(int argc, char **argv)
+{
+  char a[128], b[128];
+  long records = 3000000, n, bytes = 0;
+  double start, tSprintf, tFormat;
+  int opt;
+  Line line, fileLine;
+  Stamp stamp;
+  char file[32];
+  double tTwice, tCached;
+  long expect;
+
+  while((opt = getopt(argc, argv, "n:")) != -1)
+  {
+    if(opt == 'n') records = atol(optarg);
+    else
+    {
+      fprintf(stderr, "usage: formatbench [-n records]\n");
+      return 2;
+    }
+  }
+
+  for(n = 0; n < records; n += 7919)
+  {
+    if(bySprintf(a, n) != byFormat(b, n) || strcmp(a, b))
+    {
+      fprintf(stderr, "formatbench: record %ld differs\n  %s\n  %s\n", n, a, b);
+      return 1;
+    }
+  }
+
+  // fixed point and cut buffers against what sprintf would have printed
+  format.begin(&line, b, sizeof(b));
+  format.fixed(&line, -1205, 2);
+  format.character(&line, ' ');
+  format.fixed(&line, 7, 3);
+  format.character(&line, ' ');
+  format.integer(&line, -2147483647L - 1);
+  if(strcmp(b, "-12.05 0.007 -2147483648"))
+  {
+    fprintf(stderr, "formatbench: fixed point gave \"%s\"\n", b);
+    return 1;
+  }
+  // the stamp cache across minute, hour, day, month and year rollovers
+  stamp.valid = 0;
+  for(n = 0; n < 40000000L; n += 17 + n % 3601)
+  {
+    format.update(&stamp, timeOf(n));
+    if(strcmp(stamp.text, stampOf(timeOf(n))))
+    {
+      fprintf(stderr, "formatbench: cached stamp at %ld gave \"%s\"\n", n, stamp.text);
+      return 1;
+    }
+  }
+
+  format.begin(&line, b, 8);
+  format.text(&line, "CPM,");
+  format.number(&line, 12345);
+  if(strcmp(b, "CPM,") || !line.cut)
+  {
+    fprintf(stderr, "formatbench: cut number gave \"%s\"\n", b);
+    return 1;
+  }
+
+  start = seconds();
+  for(n = 0; n < records; n++) bytes += bySprintf(a, n);
+  tSprintf = seconds() - start;
+
+  start = seconds();
+  for(n = 0; n < records; n++) bytes -= byFormat(b, n);
+  tFormat = seconds() - start;
+
+  if(bytes)
+  {
+    fprintf(stderr, "formatbench: lengths differ\n");
+    return 1;
+  }
+  printf("%ld records, identical text\n", records);
+  printf("  sprintf  %7.1f ns/record\n", tSprintf*1e9/records);
+  printf("  format   %7.1f ns/record  (%.2fx)\n", tFormat*1e9/records, tSprintf/tFormat);
+
+  // a sample every 20 s, the stamp goes to the record and to TIME.TXT
+  start = seconds();
+  for(n = 0; n < records; n++)
+  {
+    bytes += sprintf(a, "\nTime,%s", stampOf(timeOf(n*20)));
+    bytes += sprintf(file, "%s", stampOf(timeOf(n*20)));
+  }
+  tSprintf = seconds() - start;
+  expect = bytes;
+
+  start = seconds();
+  for(n = 0; n < records; n++)
+  {
+    format.begin(&line, a, 116);
+    format.text(&line, "\nTime,");
+    format.stamp(&line, timeOf(n*20));
+    format.begin(&fileLine, file, sizeof(file));
+    format.stamp(&fileLine, timeOf(n*20));
+    bytes -= line.length + fileLine.length;
+  }
+  tTwice = seconds() - start;
+
+  stamp.valid = 0;
+  start = seconds();
+  for(n = 0; n < records; n++)
+  {
+    format.update(&stamp, timeOf(n*20));
+    format.begin(&line, a, 116);
+    format.text(&line, "\nTime,");
+    format.text(&line, stamp.text);
+    bytes += line.length + strlen(stamp.text);
+  }
+  tCached = seconds() - start;
+
+  printf("%ld samples, stamp in the record and TIME.TXT\n", records);
+  printf("  sprintf twice        %7.1f ns/sample\n", tSprintf*1e9/records);
+  printf("  format.stamp twice   %7.1f ns/sample  (%.2fx)\n", tTwice*1e9/records, tSprintf/tTwice);
+  printf("  format.update once   %7.1f ns/sample  (%.2fx)\n", tCached*1e9/records, tSprintf/tCached);
+  if(bytes != expect)
+  {
+    fprintf(stderr, "formatbench: stamp lengths differ\n");
+    return 1;
+  }
+  return 0;
+}
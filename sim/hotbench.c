@@ -0,0 +1,448 @@
+//Cost of the firmware's hot paths on the host simulator, against a baseline
+//
+//Build:  cc -O2 -Isim -Dmain=boron2_main -c -o boron2.o "BORON2 (2016_10_28 22_55_52 UTC).c"
+//        cc -O2 -Isim -I. -Dmain=temperature_main -c -o temperature.o
+//          "main-temperature_UART (2016_10_28 22_55_52 UTC).c"
+//        cc -O2 -Isim -I. -o hotbench sim/hotbench.c boron2.o temperature.o servo.c
+//          logexport.c telemetry.c journal.c packlog.c dircache.c format.c config.c
+//          sampler.c pulses.c pulselog.c timebase.c snapshot.c bustrace.c bytes.c
+//          sim/nesi_sim.c -lm
+//
+//  hotbench [-n iterations] [-s sd-dir] [-b baseline.json] [-t percent] [-h percent]
+//
+//Boots BORON2 as far as its main loop would (RTC, square wave, card, log)
+//and then calls, -n times each (default 100):
+//
+//  read_time         the DS1307's clock over I2C2
+//  set_time          setting it, a second on each time
+//  BCD_to_Dec        the conversion alone
+//  getCount          one config.window of Geiger characters, the old way
+//  logSample         one CPM record into DATALOG.JNL, every checkpoint'th
+//                    with TIME.TXT and every progress'th with the RTC RAM
+//                    snapshot; what logdata() did in the older programs
+//  putTimeToFile     TIME.TXT rewritten
+//  readTemperature   the TMP36 read on RSQ4 and its line, from
+//                    main-temperature_UART
+//
+//Per call it measures the virtual time the simulator charged, the time on
+//the I2C bus and its bytes, SD opens, sector reads and writes and bytes
+//written, and host ns.  The simulator charges the bus, the card, waits
+//and library calls but not plain C, so for an op that is plain C alone,
+//like BCD_to_Dec, it also counts the host instructions a call takes, loop
+//included, by single stepping a child process under ptrace; the other ops
+//show -1 there.  Every figure but host ns comes out the same on every
+//run, the instruction count for a given build of hotbench, so the gate
+//does not depend on how busy the host is.  getCount() would mostly measure waiting for the counter to send
+//its window, so each call finds a fixed window already received; that is
+//put there untimed, and such ops are timed call by call.
+//
+//The results go to stdout as JSON, one op a line; sim/hotbench.json is
+//the stored baseline, refreshed by redirecting a run into it.  With -b
+//each op is compared with the baseline's: a figure more than -t percent
+//(default 1) above it is a regression, host ns only with -h, and so is an
+//instruction count the host would not let it take.  Both runs need the
+//same -n, and for the instruction counts the same compiler and flags.
+//The comparison goes to stderr and the exit status is 1 on any
+//regression, so a build script fails on it:
+//
+//  hotbench -b sim/hotbench.json > /dev/null
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/ptrace.h>
+#include <sys/stat.h>
+#include "sim.h"
+#include "uart2.h"
+#include "config.h"
+#include "sampler.h"
+#include "timebase.h"
+#include "bustrace.h"
+
+#define BOOT_DONE 5               // BORON2's bootStage once the log is open
+
+// from BORON2
+void i2c_init(void);
+DateAndTime read_time(void);
+Boolean set_time(DateAndTime now);
+DateAndTime BCD_to_Dec(DateAndTime temp);
+int getCount(void);
+void putTimeToFile(String filename, DateAndTime Time);
+void logSample(Sample *sample, int motor);
+Boolean rtc_squareWave(void);
+void bootStep(DateAndTime *CurrentTime, DateAndTime *StartTime);
+extern int bootStage;
+extern Boolean rtcOk, snapshotReady;
+
+// from main-temperature_UART
+int readTemperature(char *message, int size);
+
+// sys/wait.h would clash with NESI's wait(), stdlib.h has the W macros
+pid_t waitpid(pid_t pid, int *status, int options);
+
+enum {SIM_US, I2C_US, I2C_BYTES, SD_OPENS, SD_READS, SD_WRITES, SD_BYTES, INSTRUCTIONS,
+      HOST_NS, FIGURES};
+
+static const char *figures[FIGURES] =
+  {"sim_us", "i2c_us", "i2c_bytes", "sd_opens", "sd_reads", "sd_writes", "sd_bytes",
+   "instructions", "host_ns"};
+
+typedef struct
+{
+  const char *name;
+  void (*prepare)(long i);        // untimed, before each call, or NULL
+  void (*run)(long i);
+  Boolean plain;                  // plain C, count its instructions
+  double figure[FIGURES];         // a call
+} Op;
+
+static long iterations = 100;
+static DateAndTime start;
+static volatile int sink;         // keeps pure calls from being dropped
+
+static void readTime(long i)
+{
+  (void)i;
+  sink += read_time().second;
+}
+
+static void setTime(long i)
+{
+  DateAndTime t = start;
+
+  t.second = i % 60;
+  t.minute = i/60 % 60;
+  sink += set_time(t);
+}
+
+static void bcdToDec(long i)
+{
+  DateAndTime t = start;
+
+  t.second = (i % 6) << 4 | i % 10;
+  t.minute = t.second;
+  sink += BCD_to_Dec(t).second;
+}
+
+// a window of Geiger characters, a pulse in every fourth
+static long windowLeft;
+
+static uint64_t windowNext(void *ctx)
+{
+  (void)ctx;
+  return windowLeft > 0 ? sim_now_us() : SIM_FOREVER;
+}
+
+static unsigned char windowEmit(void *ctx)
+{
+  (void)ctx;
+  return windowLeft-- % 4 ? '0' : '1';
+}
+
+static void fillWindow(long i)
+{
+  SimSource window = {windowNext, windowEmit, NULL};
+
+  (void)i;
+  windowLeft = config.window;
+  sim_uart2_source(&window);
+  while(uart2.size() < (int)config.window) sim_advance_us(1000);
+}
+
+static void count(long i)
+{
+  (void)i;
+  sink += getCount();
+}
+
+static void sample(long i)
+{
+  Sample s;
+
+  memset(&s, 0, sizeof(s));
+  s.kind = SAMPLE_SUMMARY;
+  s.counts = 5 + i % 7;
+  s.seconds = 10;
+  logSample(&s, i % 4);
+}
+
+static void timeFile(long i)
+{
+  DateAndTime t = start;
+
+  t.second = i % 60;
+  putTimeToFile("TIME.TXT", t);
+}
+
+static void temperature(long i)
+{
+  char message[80];
+
+  (void)i;
+  sink += readTemperature(message, sizeof(message));
+}
+
+static Op ops[] =
+{
+  {"read_time", NULL, readTime, 0, {0}},
+  {"set_time", NULL, setTime, 0, {0}},
+  {"BCD_to_Dec", NULL, bcdToDec, 1, {0}},
+  {"getCount", fillWindow, count, 0, {0}},
+  {"logSample", NULL, sample, 0, {0}},
+  {"putTimeToFile", NULL, timeFile, 0, {0}},
+  {"readTemperature", NULL, temperature, 0, {0}},
+};
+
+#define OPS ((int)(sizeof(ops)/sizeof(ops[0])))
+
+static double seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+// 25.0 degrees: 0.75 V of 3.3 V
+static int tmp36(void *ctx)
+{
+  (void)ctx;
+  return 233;
+}
+
+// what was charged since s, us and host were taken, added to sum
+static void charged(double *sum, const SimStats *s, uint64_t us, double host)
+{
+  sum[HOST_NS] += (seconds() - host)*1e9;
+  sum[SIM_US] += sim_now_us() - us;
+  sum[I2C_US] += sim_stats.i2c_bus_us - s->i2c_bus_us;
+  sum[I2C_BYTES] += sim_stats.i2c_bytes - s->i2c_bytes;
+  sum[SD_OPENS] += sim_stats.sd_opens - s->sd_opens;
+  sum[SD_READS] += sim_stats.sd_sector_reads - s->sd_sector_reads;
+  sum[SD_WRITES] += sim_stats.sd_sector_writes - s->sd_sector_writes;
+  sum[SD_BYTES] += sim_stats.sd_bytes_written - s->sd_bytes_written;
+}
+
+// host instructions in calls calls of op, stepped one by one in a child
+// between the two stops it makes; -1 if it cannot be traced
+static double instructions(const Op *op, long calls)
+{
+  pid_t child;
+  int status;
+  long i, steps = 0;
+
+  child = fork();
+  if(child < 0) return -1;
+  if(!child)
+  {
+    if(ptrace(PTRACE_TRACEME, 0, NULL, NULL)) _exit(1);
+    raise(SIGSTOP);
+    for(i = 0; i < calls; i++) op->run(i);
+    raise(SIGSTOP);
+    _exit(0);
+  }
+
+  if(waitpid(child, &status, 0) != child || !WIFSTOPPED(status)) return -1;
+  while(!ptrace(PTRACE_SINGLESTEP, child, NULL, NULL) && waitpid(child, &status, 0) == child &&
+        WIFSTOPPED(status) && WSTOPSIG(status) == SIGTRAP)
+    steps++;
+  kill(child, SIGKILL);
+  waitpid(child, &status, 0);
+  return steps;
+}
+
+static void measure(Op *op)
+{
+  double sum[FIGURES] = {0}, host;
+  SimStats s;
+  uint64_t us;
+  long i;
+  int f;
+
+  if(op->prepare)
+  {
+    for(i = 0; i < iterations; i++)
+    {
+      op->prepare(i);
+      s = sim_stats;
+      us = sim_now_us();
+      host = seconds();
+      op->run(i);
+      charged(sum, &s, us, host);
+    }
+  }
+  else
+  {
+    // in one go, so reading the clocks stays out of host ns
+    s = sim_stats;
+    us = sim_now_us();
+    host = seconds();
+    for(i = 0; i < iterations; i++) op->run(i);
+    charged(sum, &s, us, host);
+  }
+  for(f = 0; f < FIGURES; f++) op->figure[f] = sum[f]/iterations;
+
+  // less the stops and the loop's setup, which a run of no calls has too
+  op->figure[INSTRUCTIONS] = -1;
+  if(op->plain)
+  {
+    host = instructions(op, iterations);
+    if(host >= 0) op->figure[INSTRUCTIONS] = (host - instructions(op, 0))/iterations;
+  }
+}
+
+// BORON2's start up, then every op
+static int bench(void)
+{
+  DateAndTime now, begun;
+  int i;
+
+  nesi.init();
+  timebase.init();
+#if BUS_TRACE
+  busTrace.init();
+#endif
+  uart2.init();
+  i2c_init();
+  rtcOk = rtc_squareWave() && timebase.sync(read_time, RTC_SQW_RP);
+  now = begun = timebase.now();
+  while(bootStage != BOOT_DONE) bootStep(&now, &begun);
+  snapshotReady = 1;              // as the main loop's first pass leaves it
+
+  for(i = 0; i < OPS; i++) measure(&ops[i]);
+  return 0;
+}
+
+// the figures of op in a baseline line, 0 if it is not that op's
+static int baseline(const char *line, const char *op, double *figure)
+{
+  char key[48];
+  const char *p;
+  int f;
+
+  snprintf(key, sizeof(key), "\"op\": \"%s\"", op);
+  if(!strstr(line, key)) return 0;
+  for(f = 0; f < FIGURES; f++)
+  {
+    snprintf(key, sizeof(key), "\"%s\": ", figures[f]);
+    p = strstr(line, key);
+    figure[f] = p ? atof(p + strlen(key)) : -1;
+  }
+  return 1;
+}
+
+// op against the baseline, returns the figures that regressed
+static int compare(const Op *op, const char *path, double tolerance, double hostTolerance)
+{
+  char line[1024];
+  double base[FIGURES], limit;
+  int f, found = 0, regressed = 0;
+  FILE *b = fopen(path, "r");
+
+  if(!b) return 0;
+  while(!found && fgets(line, sizeof(line), b)) found = baseline(line, op->name, base);
+  fclose(b);
+  if(!found)
+  {
+    fprintf(stderr, "%-16s not in the baseline\n", op->name);
+    return 0;
+  }
+
+  for(f = 0; f < FIGURES; f++)
+  {
+    if(base[f] < 0 || (f == HOST_NS && hostTolerance < 0)) continue;
+    limit = base[f]*(1 + (f == HOST_NS ? hostTolerance : tolerance)/100) + 0.005;
+    if(op->figure[f] < 0)
+    {
+      // a host that will not let it trace can not check the count
+      fprintf(stderr, "%-16s %-10s %12.2f -> not counted here\n", op->name, figures[f], base[f]);
+      regressed++;
+    }
+    else if(op->figure[f] > limit)
+    {
+      fprintf(stderr, "%-16s %-10s %12.2f -> %12.2f  regressed\n", op->name, figures[f],
+              base[f], op->figure[f]);
+      regressed++;
+    }
+    else if(op->figure[f] < base[f]*(1 - tolerance/100) - 0.005 && f != HOST_NS)
+      fprintf(stderr, "%-16s %-10s %12.2f -> %12.2f  better, refresh the baseline\n",
+              op->name, figures[f], base[f], op->figure[f]);
+  }
+  return regressed;
+}
+
+int main(int argc, char **argv)
+{
+  const char *dir = "hotbench.sd", *basePath = NULL;
+  const char *files[] = {"DATALOG.JNL", "DATALOG.PKL", "PULSES.BIN", "TIME.TXT",
+                         "START.TXT", "SITE.CFG"};
+  double tolerance = 1, hostTolerance = -1;
+  char path[512];
+  const char *p;
+  int opt, i, f, regressed = 0;
+  FILE *b;
+
+  while((opt = getopt(argc, argv, "n:s:b:t:h:")) != -1)
+  {
+    switch(opt)
+    {
+      case 'n': iterations = atol(optarg); break;
+      case 's': dir = optarg; break;
+      case 'b': basePath = optarg; break;
+      case 't': tolerance = atof(optarg); break;
+      case 'h': hostTolerance = atof(optarg); break;
+      default: iterations = 0; break;
+    }
+  }
+  if(iterations < 1 || tolerance < 0 || optind != argc)
+  {
+    fprintf(stderr, "usage: hotbench [-n iterations] [-s sd-dir] [-b baseline.json] [-t percent] [-h percent]\n");
+    return 2;
+  }
+  if(basePath)
+  {
+    // averages over a different count are not comparable, logSample's
+    // share of fresh log blocks and TIME.TXT rewrites differs
+    if(!(b = fopen(basePath, "r")))
+    {
+      perror(basePath);
+      return 2;
+    }
+    if(!fgets(path, sizeof(path), b) || !(p = strstr(path, "\"iterations\": ")) ||
+       atol(p + 14) != iterations)
+    {
+      fprintf(stderr, "hotbench: %s is not a baseline of %ld iterations\n", basePath, iterations);
+      return 2;
+    }
+    fclose(b);
+  }
+
+  // a fresh card, the log and the experiment start from nothing
+  mkdir(dir, 0777);
+  for(i = 0; i < (int)(sizeof(files)/sizeof(files[0])); i++)
+  {
+    snprintf(path, sizeof(path), "%s/%s", dir, files[i]);
+    unlink(path);
+  }
+  sim_sd_root(dir);
+  start = dateTime.new(16, 10, 28, 12, 0, 0);
+  sim_rtc_set(start);
+  sim_adc(4, tmp36, NULL);
+  sim_run(bench, SIM_FOREVER);
+
+  printf("{\"bench\": \"hotbench\", \"iterations\": %ld, \"ops\": [\n", iterations);
+  for(i = 0; i < OPS; i++)
+  {
+    printf("  {\"op\": \"%s\"", ops[i].name);
+    for(f = 0; f < FIGURES; f++) printf(", \"%s\": %.2f", figures[f], ops[i].figure[f]);
+    printf("}%s\n", i < OPS - 1 ? "," : "");
+  }
+  printf("]}\n");
+
+  if(!basePath) return 0;
+  for(i = 0; i < OPS; i++) regressed += compare(&ops[i], basePath, tolerance, hostTolerance);
+  fprintf(stderr, "hotbench: %d figures regressed against %s\n", regressed, basePath);
+  return regressed > 0;
+}
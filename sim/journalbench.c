@@ -0,0 +1,137 @@
+//Boot recovery time of the journaled log against its size
+//
+//Build:  cc -O2 -Isim -I. -o journalbench sim/journalbench.c journal.c dircache.c bytes.c sim/nesi_sim.c -lm
+//
+//  journalbench [-s sd-dir]
+//
+//For each log size the log is written through journal.append(), the power
+//is cut halfway through one more append, and the card is then recovered
+//with journal.open() (binary search) and, for comparison, with a linear
+//scan of every block.  Sector reads and device time come from the
+//simulated card; both must find the same end of the log.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "sim.h"
+#include "journal.h"
+#include "bytes.h"
+
+#define LOG_NAME "DATALOG.JNL"
+
+static long target, found, scanned;
+
+static double seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+static int fill(void)
+{
+  char record[64];
+  long n;
+
+  journal.open(LOG_NAME);
+  for(n = journal.blocks(); n < target; n++)
+  {
+    sprintf(record, "\nTime,Tue May 26 08:35:00 2015,CPM,%ld,Motor,0\t", n % 40);
+    journal.append(record);
+  }
+  return 0;
+}
+
+static int tear(void)
+{
+  journal.open(LOG_NAME);
+  sim_sd_power_fail(JOURNAL_HEADER + 4);   // inside the record text
+  journal.append("\nTime,torn");
+  return 0;
+}
+
+static int recover(void)
+{
+  found = journal.open(LOG_NAME);
+  return 0;
+}
+
+// what a boot without the binary search would do
+static int linear(void)
+{
+  unsigned char b[JOURNAL_BLOCK];
+  FSFILE *file = FSfopen(LOG_NAME, FS_READ);
+  int length;
+
+  scanned = 0;
+  while(FSfread(b, 1, JOURNAL_BLOCK, file) == JOURNAL_BLOCK)
+  {
+    length = bytes.get16(b + 2);
+    if(b[0] != 'J' || b[1] != 'L' || length > JOURNAL_PAYLOAD || (long)bytes.get32(b + 4) != scanned ||
+       bytes.get32(b + 8) != bytes.crc32(b + JOURNAL_HEADER, length, bytes.crc32(b, 8, 0)))
+      break;
+    scanned++;
+  }
+  FSfclose(file);
+  return 0;
+}
+
+// run fn, returning sector reads, device and host time
+static void measure(int (*fn)(void), uint64_t *reads, double *device, double *host)
+{
+  uint64_t t = sim_now_us();
+  double h = seconds();
+
+  sim_reset_stats();
+  sim_run(fn, SIM_FOREVER);
+  *reads = sim_stats.sd_sector_reads;
+  *device = (sim_now_us() - t)/1e3;
+  *host = (seconds() - h)*1e6;
+}
+
+int main(int argc, char **argv)
+{
+  static const long sizes[] = {1000, 10000, 100000, 400000};
+  const char *dir = "journalbench.sd";
+  char path[4200];
+  uint64_t reads, linReads;
+  double device, host, linDevice, linHost;
+  int n, opt;
+
+  while((opt = getopt(argc, argv, "s:")) != -1)
+  {
+    if(opt != 's')
+    {
+      fprintf(stderr, "usage: journalbench [-s sd-dir]\n");
+      return 2;
+    }
+    dir = optarg;
+  }
+  snprintf(path, sizeof(path), "%s/%s", dir, LOG_NAME);
+  unlink(path);
+  sim_sd_root(dir);
+
+  printf("%8s %9s | %6s %7s %10s %9s | %7s %10s %9s\n", "blocks", "MB", "probes",
+         "sectors", "device ms", "host us", "sectors", "device ms", "host us");
+  for(n = 0; n < (int)(sizeof(sizes)/sizeof(sizes[0])); n++)
+  {
+    target = sizes[n];
+    sim_run(fill, SIM_FOREVER);
+    sim_run(tear, SIM_FOREVER);
+
+    measure(recover, &reads, &device, &host);
+    measure(linear, &linReads, &linDevice, &linHost);
+    if(found != target || scanned != target)
+    {
+      fprintf(stderr, "journalbench: %ld blocks written, recovery found %ld, scan %ld\n",
+              target, found, scanned);
+      return 1;
+    }
+    printf("%8ld %9.2f | %6u %7llu %10.1f %9.0f | %7llu %10.1f %9.0f\n", target,
+           (target + 1)*JOURNAL_BLOCK/1e6, journal.probes(), (unsigned long long)reads,
+           device, host, (unsigned long long)linReads, linDevice, linHost);
+  }
+  return 0;
+}
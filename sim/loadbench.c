@@ -0,0 +1,461 @@
+//Geiger load against BORON2's acquisition loop, for where it saturates
+//
+//Build:  cc -O2 -Isim -Dmain=boron2_main -c -o boron2.o "BORON2 (2016_10_28 22_55_52 UTC).c"
+//        cc -O2 -Isim -I. -o loadbench sim/loadbench.c boron2.o servo.c logexport.c
+//          telemetry.c journal.c packlog.c dircache.c format.c config.c sampler.c
+//          pulses.c pulselog.c timebase.c snapshot.c bustrace.c bytes.c sim/nesi_sim.c -lm
+//
+//        with -DPULSE_FRONT=PULSE_TIMER or PULSE_CAPTURE on both lines for
+//        the hardware pulse counter, see pulses.h
+//
+//  loadbench [-p constant|poisson|burst] [-r cpm,...] [-b baud,...] [-t seconds]
+//            [-d dead-us] [-i uart|tube] [-c key=value]... [-e percent] [-g cpm]
+//            [-s sd-dir]
+//
+//Drives UART2 with a counter's byte stream, a '1' per pulse and a '0' every
+//second, at each rate of -r (default 30 to 300000 CPM) and each baud rate of
+//-b (default 1200, 9600 and 115200), one fresh BORON2 run of -t seconds
+//(default 300) per point.  The events come evenly spaced (constant),
+//Poisson (the default) or Poisson with a 10 s burst to ten times the rate
+//every minute (burst).  With -d the tube misses events within that many
+//microseconds of its last pulse, as a real one does.  -i tube puts the
+//pulses on the tube line for a firmware built with a hardware counter and
+//leaves UART2 silent.  The clock starts at 23:58 with moves=1,2,3,4 so a
+//servo move blocks the loop two minutes in, on top of the SD writes; -c
+//adds SITE.CFG lines after those, e.g. -c adapt=0 for the old window or
+//-c dead=190 to correct for the tube, or on a PULSE_CAPTURE build -c
+//times=1 to keep every pulse's time in PULSES.BIN.
+//
+//Per point it prints the line's load, bytes lost because the line could not
+//carry them (or pulses lost to a full IC1 FIFO on the tube line) and
+//because the NESI+ receive buffer was full, the deepest backlog, the
+//longest a byte waited in the buffer, the longest the main loop went
+//without polling UART2, and the counts DATALOG.JNL holds against the
+//events over the seconds its records cover.  With times=1 it adds the
+//pulse times PULSES.BIN holds and those the ring lost.  A point saturates
+//when it loses a byte or a time, or its count is off by more than -e
+//percent (default 2); the
+//lowest rate that does is printed per baud rate.  With -g the exit status
+//is 1 if any baud rate saturates at or below that CPM, so the sweep can
+//gate changes to the acquisition path.  Runs are seeded, the same firmware
+//gives the same table.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#define wait host_wait            // NESI's wait(ms) takes the name
+#include <sys/wait.h>
+#undef wait
+#include "sim.h"
+#include "journal.h"
+#include "pulselog.h"
+
+#define POINTS_MAX  32
+#define SETTINGS_MAX 16
+#define BURST_EVERY 60            // seconds between bursts with -p burst
+#define BURST_SECS  10
+#define BURST_FACTOR 10
+
+int boron2_main(void);
+
+enum { CONSTANT, POISSON, BURST };
+
+// the counter: events at rate, of which the tube passes those outside its
+// dead time after the last pulse, a heartbeat every second, and how many
+// events each second held for the truth
+typedef struct
+{
+  int pattern;
+  double rate;              // events per microsecond, the burst rate for BURST
+  uint32_t rng;
+  uint64_t event, pulse, beat;
+  uint64_t sent;            // events so far, for CONSTANT spacing
+  unsigned int dead;        // microseconds
+  uint32_t *truth;
+  long seconds;
+} Load;
+
+static Load load, tube;
+
+static double uniform(Load *l)
+{
+  l->rng ^= l->rng << 13;
+  l->rng ^= l->rng >> 17;
+  l->rng ^= l->rng << 5;
+  return (l->rng + 1.0)/4294967297.0;
+}
+
+static int bursting(uint64_t t)
+{
+  return t/SIM_SECOND % BURST_EVERY >= BURST_EVERY - BURST_SECS;
+}
+
+static void nextEvent(Load *l)
+{
+  if(l->pattern == CONSTANT)
+  {
+    l->event = (uint64_t)(++l->sent/l->rate);
+    return;
+  }
+  // a burst is thinned out of Poisson events at its own rate
+  do
+    l->event += (uint64_t)(-log(uniform(l))/l->rate) + 1;
+  while(l->pattern == BURST && !bursting(l->event) && uniform(l)*BURST_FACTOR > 1);
+}
+
+static void nextPulse(Load *l)
+{
+  uint64_t last = l->pulse;
+
+  do
+  {
+    nextEvent(l);
+    if(l->event/SIM_SECOND < (uint64_t)l->seconds) l->truth[l->event/SIM_SECOND]++;
+  }
+  while(last && l->event - last < l->dead);
+  l->pulse = l->event;
+}
+
+static uint64_t loadNext(void *ctx)
+{
+  Load *l = ctx;
+  return l->pulse < l->beat ? l->pulse : l->beat;
+}
+
+static unsigned char loadEmit(void *ctx)
+{
+  Load *l = ctx;
+
+  if(l->beat <= l->pulse)
+  {
+    l->beat += SIM_SECOND;
+    return '0';
+  }
+  nextPulse(l);
+  return '1';
+}
+
+static uint64_t tubeNext(void *ctx)
+{
+  return ((Load *)ctx)->pulse;
+}
+
+static unsigned char tubeEmit(void *ctx)
+{
+  nextPulse(ctx);
+  return 1;
+}
+
+static const char *settings[SETTINGS_MAX];
+static int settingCount, onTube, timing;
+
+// one BORON2 run in its own process, its counters and the truth come back
+// through a pipe
+static int run(const char *dir, long baud, SimStats *stats)
+{
+  SimSource src = {loadNext, loadEmit, &load}, edges = {tubeNext, tubeEmit, &tube};
+  DateAndTime start = {0, 58, 23, 2, 26, 5, 15};
+  char path[4200];
+  int fds[2], status, i;
+  size_t got, want;
+  ssize_t n;
+  FILE *f;
+  pid_t child;
+
+  if(pipe(fds)) return 0;
+  child = fork();
+  if(child == 0)
+  {
+    close(fds[0]);
+    sim_sd_root(dir);
+    mkdir(dir, 0777);
+    snprintf(path, sizeof(path), "%s/DATALOG.JNL", dir);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/DATALOG.PKL", dir);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/PULSES.BIN", dir);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/START.TXT", dir);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/TIME.TXT", dir);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/SITE.CFG", dir);
+    f = fopen(path, "w");
+    if(!f) _exit(1);
+    fprintf(f, "baud=%ld\nmoves=1,2,3,4\n", baud);
+    for(i = 0; i < settingCount; i++) fprintf(f, "%s\n", settings[i]);
+    fclose(f);
+
+    sim_rtc_set(start);
+    if(onTube)
+    {
+      // the firmware's time base still runs, only the counter is moved
+      sim_tube(&edges);
+      sim_uart2_source(NULL);
+    }
+    else
+      sim_uart2_source(&src);
+    sim_run(boron2_main, load.seconds*SIM_SECOND);
+    if(write(fds[1], &sim_stats, sizeof(sim_stats)) != sizeof(sim_stats) ||
+       write(fds[1], load.truth, load.seconds*sizeof(uint32_t)) != (ssize_t)(load.seconds*sizeof(uint32_t)))
+      _exit(1);
+    _exit(0);
+  }
+  close(fds[1]);
+  want = sizeof(*stats) + load.seconds*sizeof(uint32_t);
+  for(got = 0; got < want; got += n)
+  {
+    if(got < sizeof(*stats)) n = read(fds[0], (char *)stats + got, sizeof(*stats) - got);
+    else n = read(fds[0], (char *)load.truth + got - sizeof(*stats), want - got);
+    if(n <= 0) break;
+  }
+  close(fds[0]);
+  waitpid(child, &status, 0);
+  return got == want && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// seconds since the run started for a record's time stamp
+static long stampSeconds(const char *stamp)
+{
+  static const char *months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  char month[4];
+  struct tm tm;
+  const char *m;
+
+  memset(&tm, 0, sizeof(tm));
+  if(sscanf(stamp, "%*3s %3s %d %d:%d:%d %d", month, &tm.tm_mday, &tm.tm_hour,
+            &tm.tm_min, &tm.tm_sec, &tm.tm_year) != 6)
+    return -1;
+  m = strstr(months, month);
+  if(!m) return -1;
+  tm.tm_mon = (m - months)/3;
+  tm.tm_year -= 1900;
+  return (long)(timegm(&tm) - 1432684680L);    // 23:58:00 May 26 2015
+}
+
+// the counts the journal in dir puts on each second, -1 where no record
+// covers it; returns the second after the last record, 0 if there is none.
+// A burst's window repeats seconds the summary before it already counted,
+// so what the window holds comes off the rest of that summary.
+static long replayLog(const char *dir, double *est)
+{
+  unsigned char b[JOURNAL_BLOCK];
+  char text[JOURNAL_PAYLOAD + 1], path[4200], *p;
+  long n = 0, t, last = 0, end = 0, secs, s, from, summaryFrom = 0, summaryTo = 0;
+  double summary = 0;
+  int length, cpm;
+  FILE *f;
+
+  for(s = 0; s < load.seconds; s++) est[s] = -1;
+  snprintf(path, sizeof(path), "%s/DATALOG.JNL", dir);
+  f = fopen(path, "rb");
+  while(f && fread(b, 1, JOURNAL_BLOCK, f) == JOURNAL_BLOCK)
+  {
+    length = b[2] | b[3] << 8;
+    if(b[0] != 'J' || b[1] != 'L' || length > JOURNAL_PAYLOAD ||
+       (b[4] | b[5] << 8 | b[6] << 16 | (long)b[7] << 24) != n++)
+      break;
+    memcpy(text, b + JOURNAL_HEADER, length);
+    text[length] = 0;
+    if(strncmp(text, "\nTime,", 6) || (t = stampSeconds(text + 6)) < 0) continue;
+    p = text + 6 + 24;
+    if(t > load.seconds) t = load.seconds;
+
+    if(sscanf(p, ",CPM,%d,Secs,%ld", &cpm, &secs) == 2 || sscanf(p, ",CPM,%d", &cpm) == 1)
+    {
+      // a summary covers the Secs before it, or back to the last record
+      from = strstr(p, ",Secs,") ? t - secs : last;
+      for(s = from < 0 ? 0 : from; s < t; s++) est[s] = cpm/60.0;
+      summaryFrom = from < 0 ? 0 : from;
+      summaryTo = t;
+      summary = cpm/60.0*(t - from);
+    }
+    else if(!strncmp(p, ",Counts,", 8))
+    {
+      if(t > 0) est[t - 1] = atoi(p + 8);
+    }
+    else if(!strncmp(p, ",Burst,", 7))
+    {
+      // the window that tripped it, ending with the record's own second
+      for(secs = 1, s = 7; p[s] && p[s] != '\t'; s++) secs += p[s] == ';';
+      for(p += 7, s = from = t - secs; *p && *p != '\t'; s++)
+      {
+        if(s >= 0) est[s] = strtol(p, &p, 10);
+        if(s >= summaryFrom && s < summaryTo) summary -= est[s];
+        if(*p == ';') p++;
+      }
+      for(s = summaryFrom; s < from && s < summaryTo; s++)
+        est[s] = summary > 0 ? summary/(from - summaryFrom) : 0;
+      summaryFrom = summaryTo = 0;
+    }
+    else
+      continue;
+    last = end = t;
+  }
+  if(f) fclose(f);
+  return end;
+}
+
+// pulse times in dir's PULSES.BIN and those lost, in the header or marked
+// in the payload
+static void countStamps(const char *dir, unsigned long *stamps, unsigned long *lost)
+{
+  unsigned char b[PULSE_BLOCK];
+  char path[4200];
+  unsigned long v;
+  int i, length, shift, marker;
+  FILE *f;
+
+  *stamps = *lost = 0;
+  snprintf(path, sizeof(path), "%s/PULSES.BIN", dir);
+  f = fopen(path, "rb");
+  while(f && fread(b, 1, PULSE_BLOCK, f) == PULSE_BLOCK)
+  {
+    length = b[2] | b[3] << 8;
+    if(b[0] != 'P' || b[1] != 'T' || length > PULSE_PAYLOAD) break;
+    *stamps += b[12] | b[13] << 8;
+    *lost += b[14] | b[15] << 8;
+    for(i = PULSE_HEADER, marker = 0; i < PULSE_HEADER + length; )
+    {
+      for(v = 0, shift = 0; i < PULSE_HEADER + length; shift += 7)
+      {
+        v |= (unsigned long)(b[i] & 0x7F) << shift;
+        if(!(b[i++] & 0x80)) break;
+      }
+      if(marker) *lost += v;
+      marker = !marker && !v;
+    }
+  }
+  if(f) fclose(f);
+}
+
+static int parseList(const char *s, double *list)
+{
+  int n = 0;
+  char *end;
+
+  while(n < POINTS_MAX)
+  {
+    list[n] = strtod(s, &end);
+    if(end == s || list[n] <= 0) return 0;
+    n++;
+    if(*end != ',') break;
+    s = end + 1;
+  }
+  return *end ? 0 : n;
+}
+
+int main(int argc, char **argv)
+{
+  static const char *patterns[3] = {"constant", "poisson", "burst"};
+  double rates[POINTS_MAX] = {30, 100, 300, 1000, 3000, 10000, 30000, 100000, 300000};
+  double bauds[POINTS_MAX] = {1200, 9600, 115200};
+  double tolerance = 2, gate = 0, sent, logged, err, saturated, line, *est;
+  const char *dir = "loadbench.sd";
+  int nrates = 9, nbauds = 3, opt, r, b, failed = 0, lost;
+  long s, end;
+  unsigned long stamps, stampsLost;
+  SimStats stats;
+
+  load.pattern = POISSON;
+  load.seconds = 300;
+  while((opt = getopt(argc, argv, "p:r:b:t:c:e:g:s:d:i:")) != -1)
+  {
+    switch(opt)
+    {
+      case 'p':
+        for(load.pattern = 2; load.pattern >= 0 && strcmp(optarg, patterns[load.pattern]); load.pattern--);
+        if(load.pattern < 0) nrates = 0;
+        break;
+      case 'r': nrates = parseList(optarg, rates); break;
+      case 'b': nbauds = parseList(optarg, bauds); break;
+      case 't': load.seconds = atol(optarg); break;
+      case 'c':
+        if(settingCount < SETTINGS_MAX) settings[settingCount++] = optarg;
+        if(!strcmp(optarg, "times=1")) timing = 1;
+        else if(!strncmp(optarg, "times=", 6)) timing = 0;
+        break;
+      case 'e': tolerance = atof(optarg); break;
+      case 'g': gate = atof(optarg); break;
+      case 's': dir = optarg; break;
+      case 'd': load.dead = atoi(optarg); break;
+      case 'i':
+        onTube = !strcmp(optarg, "tube");
+        if(!onTube && strcmp(optarg, "uart")) nrates = 0;
+        break;
+      default: nrates = 0; break;
+    }
+  }
+  if(!nrates || !nbauds || load.seconds < 10 || optind != argc)
+  {
+    fprintf(stderr, "usage: loadbench [-p constant|poisson|burst] [-r cpm,...] [-b baud,...] [-t seconds]\n"
+                    "                 [-d dead-us] [-i uart|tube] [-c key=value]... [-e percent] [-g cpm]\n"
+                    "                 [-s sd-dir]\n");
+    return 2;
+  }
+  load.truth = malloc(load.seconds*sizeof(uint32_t));
+  est = malloc(load.seconds*sizeof(double));
+
+  printf("%s events, %u us dead time, %ld s a point, on the %s\n", patterns[load.pattern],
+         load.dead, load.seconds, onTube ? "tube line" : "UART");
+  printf("%7s %8s %6s %9s %9s %8s %9s %9s ", "baud", "cpm", "line", onTube ? "ic lost" : "line lost",
+         "buf lost", "backlog", "wait ms", "gap ms");
+  if(timing) printf("%9s %9s ", "times", "time lost");
+  printf("%9s\n", "count err");
+  for(b = 0; b < nbauds; b++)
+  {
+    saturated = 0;
+    for(r = 0; r < nrates; r++)
+    {
+      memset(load.truth, 0, load.seconds*sizeof(uint32_t));
+      load.rate = rates[r]/60e6*(load.pattern == BURST ? BURST_FACTOR : 1);
+      load.rng = 12345;
+      load.sent = 0;
+      load.beat = SIM_SECOND;
+      load.event = load.pulse = 0;
+      nextPulse(&load);
+      tube = load;      // the same pulses, whichever input is used
+
+      mkdir(dir, 0777);
+      if(!run(dir, (long)bauds[b], &stats))
+      {
+        fprintf(stderr, "loadbench: run at %.0f CPM, %.0f baud failed\n", rates[r], bauds[b]);
+        return 1;
+      }
+      // a second no record covers counts as nothing logged
+      end = replayLog(dir, est);
+      for(s = 0, sent = logged = 0; s < end; s++)
+      {
+        sent += load.truth[s];
+        logged += est[s] < 0 ? 0 : est[s];
+      }
+      err = sent > 0 ? 100*(logged - sent)/sent : logged > 0 ? 100 : 0;
+      line = onTube ? 0 : 100*(stats.uart_rx_bytes + stats.uart_rx_dropped)*10/bauds[b]/load.seconds;
+      if(onTube) stats.uart_line_dropped = stats.ic_overflows;
+      countStamps(dir, &stamps, &stampsLost);
+      lost = stats.uart_line_dropped || stats.uart_rx_dropped || !end || fabs(err) > tolerance ||
+             (timing && stampsLost);
+      if(lost && !saturated) saturated = rates[r];
+
+      printf("%7.0f %8.0f %5.0f%% %9llu %9llu %8llu %9.1f %9.1f ", bauds[b], rates[r], line,
+             (unsigned long long)stats.uart_line_dropped, (unsigned long long)stats.uart_rx_dropped,
+             (unsigned long long)stats.uart_max_backlog, stats.uart_max_wait_us/1e3,
+             stats.uart_max_gap_us/1e3);
+      if(timing) printf("%9lu %9lu ", stamps, stampsLost);
+      if(!end) printf("%9s%s\n", "no log", lost ? " *" : "");
+      else printf("%8.1f%%%s\n", err, lost ? " *" : "");
+    }
+    if(saturated)
+      printf("%7.0f saturates at %.0f CPM\n", bauds[b], saturated);
+    else
+      printf("%7.0f holds to %.0f CPM\n", bauds[b], rates[nrates - 1]);
+    if(gate && saturated && saturated <= gate) failed = 1;
+  }
+  free(load.truth);
+  free(est);
+  return failed;
+}
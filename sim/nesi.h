@@ -0,0 +1,264 @@
+//Host stand-in for the NESI+ library (nesi.h) used by the simulator
+//
+//Lets the firmware programs compile and run on Linux unchanged: the NESI+
+//objects are implemented in nesi_sim.c against a virtual clock, an SD card
+//kept in a host directory, a DS1307 on I2C2, a Geiger stream on UART2 and a
+//USB CDC channel on a pipe.  Only what the programs in this repo use (plus
+//the SFRs they poke directly) is provided.  See sim.h for the harness side.
+
+#ifndef NESI_H
+#define NESI_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+
+// XC16 defines NULL as a plain 0, the firmware compares integers against it
+#undef NULL
+#define NULL 0
+
+#define FCY 16000000UL
+
+typedef unsigned char Boolean;
+typedef char* String;
+
+typedef struct
+{
+  unsigned char second;
+  unsigned char minute;
+  unsigned char hour;
+  unsigned char weekday;    // 0 is Sunday
+  unsigned char day;
+  unsigned char month;
+  unsigned char year;       // years since 2000
+} DateAndTime;
+
+// NESI+ objects --------------------------------------------------------------
+
+typedef struct
+{
+  void (*init)(void);
+} NESI;
+
+typedef struct
+{
+  void (*dutycycle)(int percent);
+  void (*on)(void);
+  void (*off)(void);
+} LED;
+
+typedef struct
+{
+  void (*on)(void);
+  void (*off)(void);
+} PowerDriver;
+
+typedef struct
+{
+  Boolean (*isPressed)(void);
+} Button;
+
+typedef struct
+{
+  void (*connect)(void);
+  void (*disconnect)(void);
+  Boolean (*isConnected)(void);
+  void (*process)(void);
+  int (*printf)(const char *format, ...);
+  int (*print)(String str);
+  int (*read)(char *data, int length);
+  int (*write)(const char *data, int length);
+} USB;
+
+typedef struct
+{
+  void (*add)(String str, char terminator);
+} DataLog;
+
+typedef struct
+{
+  DateAndTime (*new)(int year, int month, int day, int hour, int minute, int second);
+  DateAndTime (*parseStamp)(String stamp);
+  String (*toStamp)(DateAndTime time);
+  String (*getStamp)(void);
+  void (*set)(DateAndTime time);
+  DateAndTime (*get)(void);
+} DateTime;
+
+typedef struct
+{
+  int (*getQ1)(int samples, int spacing);
+  int (*getQ2)(int samples, int spacing);
+  int (*getQ3)(int samples, int spacing);
+  int (*getQ4)(int samples, int spacing);
+} ResistiveSensors;
+
+extern const NESI nesi;
+extern const LED ledR, ledB;
+extern const PowerDriver powerDriverA, powerDriverB;
+extern const Button button;
+extern const USB usb;
+extern const DataLog dataLog;
+extern const DateTime dateTime;
+extern const ResistiveSensors resistiveSensors;
+
+void delay(unsigned long ms);
+void delay_us(unsigned long us);
+void wait(unsigned long ms);
+
+// SD card (Microchip MDD file system API) ------------------------------------
+
+// MDD's FSFILE has entry, the directory entry the file was opened from,
+// and cluster, its first cluster; the rest is the simulator's
+typedef struct SimFile
+{
+  unsigned int entry;
+  unsigned long cluster;
+  int fd;
+  long pos, size;
+  long sector;                // sector held in the buffer, -1 for none
+  Boolean dirty, write, append;
+  unsigned long clusters;
+} FSFILE;
+
+#define FS_READ      "r"
+#define FS_WRITE     "w"
+#define FS_APPEND    "a"
+#define FS_READPLUS  "r+"
+#define FS_WRITEPLUS "w+"
+#define FS_APPENDPLUS "a+"
+
+#define SEEK_SET_FS 0
+
+FSFILE *FSfopen(const char *fileName, const char *mode);
+int FSfclose(FSFILE *fo);
+size_t FSfread(void *ptr, size_t size, size_t n, FSFILE *stream);
+size_t FSfwrite(const void *ptr, size_t size, size_t n, FSFILE *stream);
+int FSfprintf(FSFILE *fptr, const char *fmt, ...);
+int FSfseek(FSFILE *stream, long offset, int whence);
+long FSftell(FSFILE *fo);
+int FSfeof(FSFILE *stream);
+int FSremove(const char *fileName);
+int FSrename(const char *fileName, FSFILE *fo);
+
+#define ATTR_ARCHIVE 0x20
+#define ATTR_MASK    0x3F
+
+typedef struct
+{
+  char filename[13];
+  unsigned char attributes;
+  unsigned long filesize;
+  unsigned long timestamp;
+  unsigned int entry;
+} SearchRec;
+
+int FindFirst(const char *fileName, unsigned int attr, SearchRec *rec);
+int FindNext(SearchRec *rec);
+
+// PIC24FJ256GB106 special function registers ----------------------------------
+//
+// Plain registers are variables.  The I2C2 registers are reached through
+// accessors that first let the bus model catch up with what the firmware
+// wrote, so busy-wait loops on SEN/RCEN/TBF terminate like on hardware.
+
+typedef struct
+{
+  unsigned SEN:1, RSEN:1, PEN:1, RCEN:1, ACKEN:1, ACKDT:1, STREN:1, GCEN:1;
+  unsigned SMEN:1, DISSLW:1, A10M:1, IPMIEN:1, SCLREL:1, I2CSIDL:1, :1, I2CEN:1;
+} I2CCONBITS;
+
+typedef struct
+{
+  unsigned TBF:1, RBF:1, R_W:1, S:1, P:1, D_A:1, I2COV:1, IWCOL:1;
+  unsigned ADD10:1, GCSTAT:1, BCL:1, :3, TRSTAT:1, ACKSTAT:1;
+} I2CSTATBITS;
+
+typedef struct { unsigned :1, SI2C2IF:1, MI2C2IF:1, :13; } IFS3BITS;
+typedef struct { unsigned INT0IF:1, IC1IF:1, OC1IF:1, T1IF:1, :1, IC2IF:1, OC2IF:1, T2IF:1, T3IF:1, :2, U1RXIF:1, U1TXIF:1, AD1IF:1, :2; } IFS0BITS;
+typedef struct { unsigned INT0IE:1, IC1IE:1, OC1IE:1, T1IE:1, :1, IC2IE:1, OC2IE:1, T2IE:1, T3IE:1, :2, U1RXIE:1, U1TXIE:1, AD1IE:1, :2; } IEC0BITS;
+typedef struct { unsigned :4, INT1IF:1, :6, T4IF:1, T5IF:1, INT2IF:1, U2RXIF:1, U2TXIF:1; } IFS1BITS;
+typedef struct { unsigned :4, INT1IE:1, :6, T4IE:1, T5IE:1, INT2IE:1, U2RXIE:1, U2TXIE:1; } IEC1BITS;
+typedef struct { unsigned INT0IP:3, :1, IC1IP:3, :1, OC1IP:3, :1, T1IP:3, :1; } IPC0BITS;
+typedef struct { unsigned :4, IC2IP:3, :1, OC2IP:3, :1, T2IP:3, :1; } IPC1BITS;
+typedef struct { unsigned :12, T3IP:3, :1; } IPC2BITS;
+typedef struct { unsigned INT1IP:3, :13; } IPC5BITS;
+typedef struct { unsigned T5IP:3, :1, INT2IP:3, :1, U2RXIP:3, :1, U2TXIP:3, :1; } IPC7BITS;
+
+I2CCONBITS *sim_i2c2con(void);
+I2CSTATBITS *sim_i2c2stat(void);
+IFS3BITS *sim_ifs3(void);
+volatile unsigned int *sim_i2c2trn(void);
+volatile unsigned int *sim_i2c2rcv(void);
+
+#define I2C2CONbits  (*sim_i2c2con())
+#define I2C2STATbits (*sim_i2c2stat())
+#define IFS3bits     (*sim_ifs3())
+#define I2C2TRN      (*sim_i2c2trn())
+#define I2C2RCV      (*sim_i2c2rcv())
+extern volatile unsigned int I2C2BRG;
+
+extern volatile IFS0BITS IFS0bits;
+extern volatile IEC0BITS IEC0bits;
+extern volatile IFS1BITS IFS1bits;
+extern volatile IEC1BITS IEC1bits;
+extern volatile IPC0BITS IPC0bits;
+extern volatile IPC1BITS IPC1bits;
+extern volatile IPC2BITS IPC2bits;
+extern volatile IPC5BITS IPC5bits;
+extern volatile IPC7BITS IPC7bits;
+extern volatile unsigned int INTCON2;   // INT1EP is bit 1
+
+// timers 1-5: TxCON, TMRx, PRx (TMR/PR of Timer1 first)
+extern volatile unsigned int sim_timer[5][3];
+#define T1CON sim_timer[0][0]
+#define TMR1  sim_timer[0][1]
+#define PR1   sim_timer[0][2]
+#define T2CON sim_timer[1][0]
+#define TMR2  sim_timer[1][1]
+#define PR2   sim_timer[1][2]
+#define T3CON sim_timer[2][0]
+#define TMR3  sim_timer[2][1]
+#define PR3   sim_timer[2][2]
+#define T4CON sim_timer[3][0]
+#define TMR4  sim_timer[3][1]
+#define PR4   sim_timer[3][2]
+#define T5CON sim_timer[4][0]
+#define TMR5  sim_timer[4][1]
+#define PR5   sim_timer[4][2]
+
+// output compare modules, 5 consecutive words each like on the part
+extern volatile unsigned int sim_oc[9*5];
+#define OC1CON1 sim_oc[0]
+#define OC1CON2 sim_oc[1]
+#define OC1RS   sim_oc[2]
+#define OC1R    sim_oc[3]
+#define OC2CON1 sim_oc[5]
+#define OC2CON2 sim_oc[6]
+#define OC2RS   sim_oc[7]
+#define OC2R    sim_oc[8]
+
+// input capture 1: reading IC1BUF pops its 4 deep FIFO, IC1CON1 shows
+// ICBNE and ICOV as they stand
+volatile unsigned int *sim_ic1con1(void);
+volatile unsigned int *sim_ic1buf(void);
+extern volatile unsigned int IC1CON2;
+#define IC1CON1 (*sim_ic1con1())
+#define IC1BUF  (*sim_ic1buf())
+
+// peripheral pin select
+extern volatile unsigned int sim_rpor[16];
+extern volatile unsigned int sim_rpinr[48];
+extern volatile unsigned int OSCCON;
+#define RPOR0 sim_rpor[0]
+#define RPINR0 sim_rpinr[0]
+#define __builtin_write_OSCCONL(v) (OSCCON = (OSCCON & 0xFF00) | ((v) & 0xFF))
+
+// XC16 interrupt attributes mean nothing on the host
+#define interrupt
+#define no_auto_psv
+#define shadow
+
+#endif
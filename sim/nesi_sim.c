@@ -0,0 +1,1823 @@
+//NESI+ host simulator, see nesi.h and sim.h
+//
+//Everything runs on one thread against a virtual microsecond clock.  Firmware
+//calls charge a few microseconds each; delays, SD sectors, I2C bytes and USB
+//packets charge what they would take on the board.  Moving the clock runs
+//a small event loop: UART bytes come off the wire, timers count, the RTC's
+//square wave ticks and their interrupt routines are called when enabled.
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <math.h>
+#include <poll.h>
+#include <setjmp.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "nesi.h"
+#include "uart2.h"
+#include "sim.h"
+#include "../fsentry.h"
+
+#define SIM_CALL_US       5       // cost of an ordinary library call
+#define SIM_IDLE_POLLS    8       // unchanged polls before skipping ahead
+#define SIM_UART2_BUFFER  128     // NESI+ UART2 receive buffer
+#define SIM_WIRE_QUEUE    4096    // bytes a source may have in flight
+#define SIM_SD_SECTOR_US  700     // one 512 byte sector over SPI
+#define SIM_SD_CLUSTER    8       // sectors per cluster
+#define SIM_SD_ENTRIES    1024    // root directory entries
+#define SIM_SD_FILES      8
+#define SIM_USB_PACKET_US 53      // 64 byte bulk packet at ~1.2 MB/s
+#define SIM_USB_TXBUF     1024    // CDC IN endpoint buffer
+#define SIM_CALLS         32      // pending sim_at() callbacks
+
+SimStats sim_stats;
+
+// SFRs -----------------------------------------------------------------------
+
+volatile unsigned int I2C2BRG;
+volatile IFS0BITS IFS0bits;
+volatile IEC0BITS IEC0bits;
+volatile IFS1BITS IFS1bits;
+volatile IEC1BITS IEC1bits;
+volatile IPC0BITS IPC0bits;
+volatile IPC1BITS IPC1bits;
+volatile IPC2BITS IPC2bits;
+volatile IPC5BITS IPC5bits;
+volatile IPC7BITS IPC7bits;
+volatile unsigned int INTCON2;
+volatile unsigned int sim_timer[5][3];
+volatile unsigned int sim_oc[9*5];
+volatile unsigned int sim_rpor[16];
+volatile unsigned int sim_rpinr[48];
+volatile unsigned int OSCCON;
+
+// interrupt routines the firmware may or may not define
+extern void _T1Interrupt(void) __attribute__((weak));
+extern void _T2Interrupt(void) __attribute__((weak));
+extern void _T3Interrupt(void) __attribute__((weak));
+extern void _T4Interrupt(void) __attribute__((weak));
+extern void _T5Interrupt(void) __attribute__((weak));
+extern void _IC1Interrupt(void) __attribute__((weak));
+extern void _INT1Interrupt(void) __attribute__((weak));
+
+// Clock and run control ------------------------------------------------------
+
+static uint64_t now;
+static uint64_t deadline = SIM_FOREVER;
+static jmp_buf stopJump;
+static Boolean running, inIsr;
+static unsigned long activity;    // bumped by every call that changes state
+
+static void timers_sync(void);
+static uint64_t timers_next(void);
+static void timers_fire(void);
+static uint64_t wire_next(void);
+static void wire_run(void);
+static uint64_t tube_next(void);
+static void tube_run(void);
+static void capture_fire(void);
+static uint64_t sqw_next(void);
+static void sqw_run(void);
+static void sqw_fire(void);
+static void files_power_loss(void);
+static uint64_t usb_next(void);
+static void usb_run(void);
+static Boolean usb_waiting(void);
+
+uint64_t sim_now_us(void)
+{
+  return now;
+}
+
+// harness callbacks waiting for their time, see sim_at()
+static struct { uint64_t at; void (*fn)(void *ctx); void *ctx; } calls[SIM_CALLS];
+static int ncalls;
+
+void sim_at(uint64_t at, void (*fn)(void *ctx), void *ctx)
+{
+  if(ncalls == SIM_CALLS) return;
+  calls[ncalls].at = at;
+  calls[ncalls].fn = fn;
+  calls[ncalls].ctx = ctx;
+  ncalls++;
+}
+
+static uint64_t calls_next(void)
+{
+  uint64_t t = SIM_FOREVER;
+  int n;
+
+  for(n = 0; n < ncalls; n++)
+    if(calls[n].at < t) t = calls[n].at;
+  return t;
+}
+
+static void calls_run(void)
+{
+  void (*fn)(void *ctx);
+  void *ctx;
+  int n;
+
+  for(n = 0; n < ncalls; n++)
+  {
+    if(calls[n].at > now) continue;
+    fn = calls[n].fn;
+    ctx = calls[n].ctx;
+    calls[n] = calls[--ncalls];
+    n = -1;         // the callback may schedule more, start over
+    activity++;
+    fn(ctx);
+  }
+}
+
+static uint64_t next_event(void)
+{
+  uint64_t t = wire_next(), u = timers_next(), v = usb_next(), w = calls_next();
+  uint64_t x = tube_next(), y = sqw_next();
+  if(u < t) t = u;
+  if(y < t) t = y;
+  if(w < t) t = w;
+  if(x < t) t = x;
+  return v < t ? v : t;
+}
+
+// move the clock to target, handling every event due on the way
+static void advance_to(uint64_t target)
+{
+  uint64_t t;
+
+  if(inIsr) return;   // interrupt routines run in zero time
+
+  if(target > deadline) target = deadline;
+  while(now < target)
+  {
+    t = next_event();
+    if(t > target) t = target;
+    if(t < now) t = now;
+    now = t;
+    timers_sync();
+    wire_run();
+    tube_run();
+    sqw_run();
+    usb_run();
+    calls_run();
+    timers_fire();
+    capture_fire();
+    sqw_fire();
+  }
+  if(running && now >= deadline)
+    longjmp(stopJump, 1);
+}
+
+void sim_advance_us(uint64_t us)
+{
+  advance_to(now + us);
+}
+
+static void charge(uint64_t us)
+{
+  sim_advance_us(us);
+}
+
+// the firmware is spinning on something: after a few polls that saw no
+// change jump straight to the next thing that can happen.  Each kind of
+// poll keeps its own last state since a loop usually checks several.
+enum {POLL_UART, POLL_CLOCK, POLL_USB, POLL_USB_LINK, POLL_BUTTON, POLL_KINDS};
+
+static void poll_idle(int kind, unsigned long state)
+{
+  static unsigned long lastState[POLL_KINDS], lastActivity, idle;
+  static unsigned int polled;     // kinds seen since the last change
+  uint64_t t;
+
+  charge(SIM_CALL_US);
+  polled |= 1 << kind;
+  if(state != lastState[kind] || activity != lastActivity)
+  {
+    lastState[kind] = state;
+    lastActivity = activity;
+    idle = 0;
+    polled = 0;
+    return;
+  }
+  if(++idle < SIM_IDLE_POLLS) return;
+  idle = 0;
+
+  // spinning on nothing but USB means waiting for the host
+  if(!(polled & ~(1 << POLL_USB | 1 << POLL_USB_LINK | 1 << POLL_CLOCK)) && usb_waiting())
+    return;
+  polled = 0;
+
+  t = next_event();
+  if(t > now + SIM_SECOND - now%SIM_SECOND)   // wake on each second tick too
+    t = now + SIM_SECOND - now%SIM_SECOND;
+  advance_to(t);
+}
+
+int sim_run(int (*entry)(void), uint64_t until_us)
+{
+  int stopped;
+
+  deadline = until_us;
+  running = 1;
+  stopped = setjmp(stopJump);
+  if(!stopped)
+    entry();
+  running = 0;
+  deadline = SIM_FOREVER;
+  files_power_loss();
+  return stopped == 1;
+}
+
+void sim_stop(void)
+{
+  if(running)
+    longjmp(stopJump, 2);
+}
+
+void sim_reset_stats(void)
+{
+  memset(&sim_stats, 0, sizeof(sim_stats));
+}
+
+void delay(unsigned long ms)
+{
+  charge((uint64_t)ms*1000);
+}
+
+void wait(unsigned long ms)
+{
+  charge((uint64_t)ms*1000);
+}
+
+void delay_us(unsigned long us)
+{
+  charge(us);
+}
+
+// Timers ---------------------------------------------------------------------
+
+typedef struct
+{
+  volatile unsigned int *ifs, *iec;
+  unsigned int bit;
+  void (*isr)(void);
+} TimerIrq;
+
+#define T_CON(n) sim_timer[n][0]
+#define T_TMR(n) sim_timer[n][1]
+#define T_PR(n)  sim_timer[n][2]
+
+static uint64_t timerCycles[5];   // cycle count the timer was last synced at
+static uint64_t fcy = FCY;        // what the oscillator really runs at
+
+void sim_mcu_ppm(long ppm)
+{
+  fcy = (uint64_t)((int64_t)FCY + (int64_t)FCY*ppm/1000000);
+}
+
+// instruction cycles since reset at us, and the first us at cycles
+static uint64_t cycles_at(uint64_t us)
+{
+  return us/SIM_SECOND*fcy + us%SIM_SECOND*fcy/SIM_SECOND;
+}
+
+static uint64_t us_at(uint64_t cycles)
+{
+  return cycles/fcy*SIM_SECOND + (cycles%fcy*SIM_SECOND + fcy - 1)/fcy;
+}
+
+static TimerIrq timer_irq(int n)
+{
+  static const unsigned char bits[5] = {3, 7, 8, 11, 12};
+  TimerIrq irq;
+
+  irq.ifs = (volatile unsigned int *)(n < 3 ? (void *)&IFS0bits : (void *)&IFS1bits);
+  irq.iec = (volatile unsigned int *)(n < 3 ? (void *)&IEC0bits : (void *)&IEC1bits);
+  irq.bit = 1u << bits[n];
+  irq.isr = n == 0 ? _T1Interrupt : n == 1 ? _T2Interrupt : n == 2 ? _T3Interrupt :
+            n == 3 ? _T4Interrupt : _T5Interrupt;
+  return irq;
+}
+
+static unsigned int prescale(unsigned int con)
+{
+  static const unsigned int ps[4] = {1, 8, 64, 256};
+  return ps[(con >> 4) & 3];
+}
+
+static Boolean timer_counting(int n)
+{
+  return (T_CON(n) & 0x8000) && !(T_CON(n) & 0x0002) && T_PR(n);
+}
+
+// count the timers up to the current time, flagging period matches
+static void timers_sync(void)
+{
+  uint64_t cycles = cycles_at(now), ticks;
+  unsigned int ps, period;
+  int n;
+
+  for(n = 0; n < 5; n++)
+  {
+    if(!timer_counting(n))
+    {
+      timerCycles[n] = cycles;
+      continue;
+    }
+    ps = prescale(T_CON(n));
+    period = T_PR(n) + 1;
+    ticks = (cycles - timerCycles[n])/ps;
+    timerCycles[n] += ticks*ps;
+    if(T_TMR(n) + ticks >= period)
+    {
+      *timer_irq(n).ifs |= timer_irq(n).bit;
+      ticks = (T_TMR(n) + ticks) % period;
+    }
+    else
+      ticks += T_TMR(n);
+    T_TMR(n) = ticks;
+  }
+}
+
+static uint64_t timers_next(void)
+{
+  uint64_t next = SIM_FOREVER, t, cycles;
+  unsigned int ps;
+  int n;
+
+  for(n = 0; n < 5; n++)
+  {
+    if(!timer_counting(n) || !(*timer_irq(n).iec & timer_irq(n).bit)) continue;
+    ps = prescale(T_CON(n));
+    cycles = timerCycles[n] + (uint64_t)(T_PR(n) + 1 - T_TMR(n))*ps;
+    t = us_at(cycles);
+    if(t < next) next = t;
+  }
+  return next;
+}
+
+static void servos_track(void);
+
+static void timers_fire(void)
+{
+  TimerIrq irq;
+  int n;
+
+  for(n = 0; n < 5; n++)
+  {
+    irq = timer_irq(n);
+    if(!(*irq.ifs & irq.bit) || !(*irq.iec & irq.bit) || !irq.isr) continue;
+    if(n == 1) servos_track();    // Timer2's routine ramps the servo pulses
+    inIsr = 1;
+    irq.isr();    // the routine clears its own flag
+    inIsr = 0;
+    sim_stats.isr_calls++;
+    if(*irq.ifs & irq.bit && *irq.iec & irq.bit)
+      *irq.ifs &= ~irq.bit;   // don't spin on a routine that forgot
+  }
+}
+
+// Tube pulse line and input capture ------------------------------------------
+//
+// The pin select inputs are not modelled: every rising edge of the tube
+// source clocks each timer running on its external clock (TCS) and is seen
+// by IC1.  IC1 captures the timer ICTSEL picks into its 4 deep FIFO.
+
+#define IC_ICBNE 0x0008
+#define IC_ICOV  0x0010
+
+static SimSource tube;
+static unsigned int tubeEdges[5];     // towards the prescaler of each timer
+static volatile unsigned int ic1Con1, ic1Read;
+volatile unsigned int IC1CON2;
+static unsigned int icFifo[4], icHead, icCount, icEdges;
+
+static int tube_listened(void)
+{
+  int n;
+
+  for(n = 0; n < 5; n++)
+    if((T_CON(n) & 0x8002) == 0x8002) return 1;
+  return (ic1Con1 & 7) >= 3 && (ic1Con1 & 7) <= 5;
+}
+
+static uint64_t tube_next(void)
+{
+  return tube.next && tube_listened() ? tube.next(tube.ctx) : SIM_FOREVER;
+}
+
+static void capture(void)
+{
+  static const int timers[8] = {2, 1, 3, 4, 0, -1, -1, -1};   // ICTSEL 000 is Timer3
+  static const unsigned int every[6] = {0, 0, 0, 1, 4, 16};    // ICM 3, 4 and 5
+  int mode = ic1Con1 & 7, timer = timers[(ic1Con1 >> 10) & 7];
+
+  if(mode < 3 || mode > 5 || ++icEdges < every[mode]) return;
+  icEdges = 0;
+  if(icCount == 4 || ic1Con1 & IC_ICOV)
+  {
+    ic1Con1 |= IC_ICOV;     // no captures until the FIFO is read empty
+    sim_stats.ic_overflows++;
+    return;
+  }
+  icFifo[(icHead + icCount++) % 4] = timer < 0 ? (unsigned int)cycles_at(now) : T_TMR(timer);
+  if(icCount % (((ic1Con1 >> 5) & 3) + 1) == 0)
+    IFS0bits.IC1IF = 1;
+}
+
+static void tube_run(void)
+{
+  unsigned int ps;
+  int n;
+
+  while(tube.next && tube.next(tube.ctx) <= now)
+  {
+    tube.emit(tube.ctx);
+    if(!tube_listened()) continue;    // the edges before anyone counts are gone
+    sim_stats.tube_pulses++;
+    for(n = 0; n < 5; n++)
+    {
+      if((T_CON(n) & 0x8002) != 0x8002) continue;
+      ps = prescale(T_CON(n));
+      if(++tubeEdges[n] < ps) continue;
+      tubeEdges[n] = 0;
+      if(T_TMR(n) >= T_PR(n))
+      {
+        T_TMR(n) = 0;
+        *timer_irq(n).ifs |= timer_irq(n).bit;
+      }
+      else
+        T_TMR(n)++;
+    }
+    capture();
+  }
+}
+
+static void capture_fire(void)
+{
+  if(!IFS0bits.IC1IF || !IEC0bits.IC1IE || !_IC1Interrupt) return;
+  inIsr = 1;
+  _IC1Interrupt();
+  inIsr = 0;
+  sim_stats.isr_calls++;
+  if(IFS0bits.IC1IF && IEC0bits.IC1IE)
+    IFS0bits.IC1IF = 0;
+}
+
+void sim_tube(const SimSource *src)
+{
+  if(src)
+    tube = *src;
+  else
+    memset(&tube, 0, sizeof(tube));
+}
+
+volatile unsigned int *sim_ic1con1(void)
+{
+  if((ic1Con1 & 7) == 0)      // turned off, the FIFO and overflow clear
+  {
+    icCount = icEdges = 0;
+    ic1Con1 &= ~IC_ICOV;
+  }
+  ic1Con1 = (ic1Con1 & ~IC_ICBNE) | (icCount ? IC_ICBNE : 0);
+  return &ic1Con1;
+}
+
+volatile unsigned int *sim_ic1buf(void)
+{
+  if(icCount)
+  {
+    ic1Read = icFifo[icHead];
+    icHead = (icHead + 1) % 4;
+    if(!--icCount) ic1Con1 &= ~IC_ICOV;
+  }
+  ic1Con1 = (ic1Con1 & ~IC_ICBNE) | (icCount ? IC_ICBNE : 0);
+  return &ic1Read;
+}
+
+// UART2 ----------------------------------------------------------------------
+
+static SimSource source;
+static long baud = 9600;
+
+static struct { uint64_t at; unsigned char byte; } wire[SIM_WIRE_QUEUE];
+static unsigned int wireHead, wireCount;
+static uint64_t wireFree;   // when the line finishes its current byte
+
+static unsigned char rxBuf[SIM_UART2_BUFFER];
+static uint64_t rxAt[SIM_UART2_BUFFER];   // when each byte landed
+static unsigned int rxHead, rxCount;
+static uint64_t lastPoll = SIM_FOREVER;
+
+static uint64_t byte_time(void)
+{
+  return (10*SIM_SECOND + baud - 1)/baud;
+}
+
+static uint64_t wire_next(void)
+{
+  uint64_t t = wireCount ? wire[wireHead].at : SIM_FOREVER;
+  uint64_t s = source.next ? source.next(source.ctx) : SIM_FOREVER;
+  return s < t ? s : t;
+}
+
+static void wire_run(void)
+{
+  unsigned char c;
+  uint64_t start;
+
+  // take whatever the source has due and put it on the line
+  while(source.next && source.next(source.ctx) <= now)
+  {
+    start = source.next(source.ctx);
+    c = source.emit(source.ctx);
+    if(wireCount == SIM_WIRE_QUEUE)
+    {
+      sim_stats.uart_line_dropped++;
+      continue;
+    }
+    if(wireFree > start) start = wireFree;
+    wireFree = start + byte_time();
+    wire[(wireHead + wireCount) % SIM_WIRE_QUEUE].at = wireFree;
+    wire[(wireHead + wireCount) % SIM_WIRE_QUEUE].byte = c;
+    wireCount++;
+  }
+
+  // bytes whose stop bit has passed land in the receive buffer
+  while(wireCount && wire[wireHead].at <= now)
+  {
+    c = wire[wireHead].byte;
+    start = wire[wireHead].at;
+    wireHead = (wireHead + 1) % SIM_WIRE_QUEUE;
+    wireCount--;
+    if(rxCount == SIM_UART2_BUFFER)
+    {
+      sim_stats.uart_rx_dropped++;
+      continue;
+    }
+    rxBuf[(rxHead + rxCount) % SIM_UART2_BUFFER] = c;
+    rxAt[(rxHead + rxCount) % SIM_UART2_BUFFER] = start;
+    rxCount++;
+    sim_stats.uart_rx_bytes++;
+    if(rxCount > sim_stats.uart_max_backlog)
+      sim_stats.uart_max_backlog = rxCount;
+  }
+}
+
+void sim_uart2_source(const SimSource *src)
+{
+  if(src)
+    source = *src;
+  else
+    memset(&source, 0, sizeof(source));
+  wireHead = wireCount = 0;
+  wireFree = now;
+}
+
+typedef struct
+{
+  double rate;      // pulses per microsecond
+  uint32_t rng;
+  uint64_t pulse, beat;
+} Geiger;
+
+static Geiger geiger, geigerTube;    // the same pulses, on UART2 and the tube line
+
+static double geiger_uniform(Geiger *g)
+{
+  g->rng ^= g->rng << 13;
+  g->rng ^= g->rng >> 17;
+  g->rng ^= g->rng << 5;
+  return (g->rng + 1.0)/4294967297.0;
+}
+
+static uint64_t geiger_next(void *ctx)
+{
+  Geiger *g = ctx;
+  return g->pulse < g->beat ? g->pulse : g->beat;
+}
+
+static unsigned char geiger_emit(void *ctx)
+{
+  Geiger *g = ctx;
+
+  if(g->beat <= g->pulse)
+  {
+    g->beat += SIM_SECOND;
+    return '0';
+  }
+  g->pulse += (uint64_t)(-log(geiger_uniform(g))/g->rate) + 1;
+  return '1';
+}
+
+static uint64_t geiger_pulse(void *ctx)
+{
+  return ((Geiger *)ctx)->pulse;
+}
+
+static unsigned char geiger_edge(void *ctx)
+{
+  Geiger *g = ctx;
+
+  g->pulse += (uint64_t)(-log(geiger_uniform(g))/g->rate) + 1;
+  return 1;
+}
+
+void sim_geiger(double cpm, uint32_t seed)
+{
+  SimSource src = {geiger_next, geiger_emit, &geiger};
+  SimSource edges = {geiger_pulse, geiger_edge, &geigerTube};
+
+  geiger.rate = cpm/60e6;
+  geiger.rng = seed ? seed : 1;
+  geiger.beat = now + SIM_SECOND;
+  geiger.pulse = cpm > 0 ? now + (uint64_t)(-log(geiger_uniform(&geiger))/geiger.rate) : SIM_FOREVER;
+  geigerTube = geiger;
+  sim_uart2_source(&src);
+  sim_tube(&edges);
+}
+
+// the main loop's latency as the Geiger stream sees it, a poll that idles
+// until the next byte does not count as the firmware being busy
+static void poll_gap(void)
+{
+  if(lastPoll != SIM_FOREVER && now - lastPoll > sim_stats.uart_max_gap_us)
+    sim_stats.uart_max_gap_us = now - lastPoll;
+}
+
+static void uart2_init(void)
+{
+  activity++;
+  baud = 9600;
+  rxHead = rxCount = 0;
+  lastPoll = SIM_FOREVER;
+  charge(SIM_CALL_US);
+}
+
+static void uart2_baudrate(long rate)
+{
+  activity++;
+  baud = rate > 0 ? rate : 9600;
+  charge(SIM_CALL_US);
+}
+
+static int uart2_size(void)
+{
+  poll_gap();
+  poll_idle(POLL_UART, rxCount);
+  lastPoll = now;
+  return rxCount;
+}
+
+static int uart2_receive(char *data, int length)
+{
+  int n = 0;
+
+  poll_gap();
+  activity++;
+  charge(SIM_CALL_US);
+  while(n < length && rxCount)
+  {
+    if(now - rxAt[rxHead] > sim_stats.uart_max_wait_us)
+      sim_stats.uart_max_wait_us = now - rxAt[rxHead];
+    data[n++] = rxBuf[rxHead];
+    rxHead = (rxHead + 1) % SIM_UART2_BUFFER;
+    rxCount--;
+  }
+  lastPoll = now;
+  return n;
+}
+
+static int uart2_send(const char *data, int length)
+{
+  activity++;
+  charge(length*byte_time());
+  return length;
+}
+
+const UART2 uart2 = {uart2_init, uart2_baudrate, uart2_size, uart2_receive, uart2_send};
+
+// I2C2 and the DS1307 ----------------------------------------------------------
+//
+// The firmware sets a control bit and spins until hardware clears it.  Every
+// access to an I2C2 register first finishes whatever was started, so those
+// loops end after one pass, and charges the bus time it took.
+
+static I2CCONBITS i2cCon;
+static I2CSTATBITS i2cStat;
+static IFS3BITS ifs3;
+static volatile unsigned int i2cTrn, i2cRcv;
+static Boolean trnTouched;
+
+static struct
+{
+  Boolean absent;
+  time_t base;            // clock value at baseAt
+  uint64_t baseAt;
+  unsigned char reg[64];  // 0-7 clock and control, 8-63 battery backed RAM
+  unsigned char ptr;
+  enum {RTC_IDLE, RTC_ADDRESS, RTC_POINTER, RTC_WRITE, RTC_READ} state;
+  Boolean timeWritten;
+} rtc = {.base = 1432629300};   // Tue May 26 08:35:00 2015, like BORON2 expects
+
+static unsigned char bcd(int v)
+{
+  return (unsigned char)((v/10 << 4) | v%10);
+}
+
+static int unbcd(unsigned char v)
+{
+  return (v >> 4)*10 + (v & 15);
+}
+
+// the DS1307 copies its counters to the user registers on a START
+static void rtc_latch(void)
+{
+  time_t t = rtc.base + (time_t)((now - rtc.baseAt)/SIM_SECOND);
+  struct tm tm;
+
+  gmtime_r(&t, &tm);
+  rtc.reg[0] = bcd(tm.tm_sec);
+  rtc.reg[1] = bcd(tm.tm_min);
+  rtc.reg[2] = bcd(tm.tm_hour);
+  rtc.reg[3] = (unsigned char)tm.tm_wday;
+  rtc.reg[4] = bcd(tm.tm_mday);
+  rtc.reg[5] = bcd(tm.tm_mon + 1);
+  rtc.reg[6] = bcd(tm.tm_year - 100);
+}
+
+static void rtc_commit(void)
+{
+  struct tm tm = {0};
+
+  tm.tm_sec = unbcd(rtc.reg[0] & 0x7F);
+  tm.tm_min = unbcd(rtc.reg[1]);
+  tm.tm_hour = unbcd(rtc.reg[2] & 0x3F);
+  tm.tm_mday = unbcd(rtc.reg[4]);
+  tm.tm_mon = unbcd(rtc.reg[5]) - 1;
+  tm.tm_year = unbcd(rtc.reg[6]) + 100;
+  rtc.base = timegm(&tm);
+  rtc.baseAt = now;
+}
+
+void sim_rtc_set(DateAndTime t)
+{
+  struct tm tm = {0};
+
+  tm.tm_sec = t.second;
+  tm.tm_min = t.minute;
+  tm.tm_hour = t.hour;
+  tm.tm_mday = t.day;
+  tm.tm_mon = t.month - 1;
+  tm.tm_year = t.year + 100;
+  rtc.base = timegm(&tm);
+  rtc.baseAt = now;
+}
+
+void sim_rtc_absent(Boolean absent)
+{
+  rtc.absent = absent;
+}
+
+void sim_rtc_regs(unsigned char *regs, Boolean write)
+{
+  if(write)
+  {
+    memcpy(rtc.reg, regs, SIM_RTC_REGS);
+    rtc_commit();
+  }
+  else
+  {
+    rtc_latch();
+    memcpy(regs, rtc.reg, SIM_RTC_REGS);
+  }
+}
+
+// SQW/OUT at 1 Hz falls as the counters roll over; INT1EP picks that edge
+// or the rising one half a second on.  Edges before sqwSeen were flagged.
+static uint64_t sqwSeen;
+
+static uint64_t sqw_edge(void)
+{
+  uint64_t first;
+
+  if(rtc.absent || (rtc.reg[7] & 0x13) != 0x10) return SIM_FOREVER;
+  first = rtc.baseAt + (INTCON2 & 2 ? SIM_SECOND : SIM_SECOND/2);
+  if(sqwSeen < first) return first;
+  return first + ((sqwSeen - first)/SIM_SECOND + 1)*SIM_SECOND;
+}
+
+static uint64_t sqw_next(void)
+{
+  return IEC1bits.INT1IE ? sqw_edge() : SIM_FOREVER;
+}
+
+static void sqw_run(void)
+{
+  uint64_t t;
+
+  if(sqw_edge() == SIM_FOREVER)
+  {
+    sqwSeen = now;      // a wave started later has no edges before that
+    return;
+  }
+  while((t = sqw_edge()) <= now)
+  {
+    sqwSeen = t;
+    IFS1bits.INT1IF = 1;
+  }
+}
+
+static void sqw_fire(void)
+{
+  if(!IFS1bits.INT1IF || !IEC1bits.INT1IE || !_INT1Interrupt) return;
+  inIsr = 1;
+  _INT1Interrupt();
+  inIsr = 0;
+  sim_stats.isr_calls++;
+  IFS1bits.INT1IF = 0;
+}
+
+static uint64_t i2c_bits(int bits)
+{
+  uint64_t hz = FCY/(I2C2BRG + 1 + FCY/10000000UL);
+  uint64_t us = (bits*SIM_SECOND + hz - 1)/hz;
+
+  sim_stats.i2c_bus_us += us;
+  return us;
+}
+
+// master sent a byte, returns the ACK bit the slave drives
+static int rtc_write(unsigned char byte)
+{
+  if(rtc.absent) return 1;
+
+  switch(rtc.state)
+  {
+    case RTC_ADDRESS:
+      if((byte & 0xFE) != 0xD0)
+      {
+        rtc.state = RTC_IDLE;
+        return 1;
+      }
+      rtc.state = (byte & 1) ? RTC_READ : RTC_POINTER;
+      return 0;
+    case RTC_POINTER:
+      rtc.ptr = byte & 63;
+      rtc.state = RTC_WRITE;
+      return 0;
+    case RTC_WRITE:
+      rtc.reg[rtc.ptr] = byte;
+      if(rtc.ptr < 7) rtc.timeWritten = 1;
+      rtc.ptr = (rtc.ptr + 1) & 63;
+      return 0;
+    default:
+      return 1;
+  }
+}
+
+static void i2c_step(void)
+{
+  if(trnTouched)
+  {
+    trnTouched = 0;
+    charge(i2c_bits(9));
+    i2cStat.ACKSTAT = rtc_write((unsigned char)i2cTrn);
+    i2cStat.TBF = 0;
+    ifs3.MI2C2IF = 1;
+    sim_stats.i2c_bytes++;
+  }
+  if(i2cCon.SEN || i2cCon.RSEN)
+  {
+    charge(i2c_bits(1));
+    if(!rtc.absent)
+    {
+      if(rtc.timeWritten) rtc_commit();
+      rtc.timeWritten = 0;
+      rtc_latch();
+      rtc.state = RTC_ADDRESS;
+    }
+    i2cCon.SEN = i2cCon.RSEN = 0;
+    i2cStat.S = 1;
+    i2cStat.P = 0;
+    ifs3.MI2C2IF = 1;
+  }
+  if(i2cCon.RCEN)
+  {
+    charge(i2c_bits(8));
+    if(rtc.absent || rtc.state != RTC_READ)
+      i2cRcv = 0xFF;    // nobody drives SDA
+    else
+    {
+      i2cRcv = rtc.reg[rtc.ptr];
+      rtc.ptr = (rtc.ptr + 1) & 63;
+    }
+    if(i2cStat.RBF) i2cStat.I2COV = 1;
+    i2cStat.RBF = 1;
+    i2cCon.RCEN = 0;
+    ifs3.MI2C2IF = 1;
+    sim_stats.i2c_bytes++;
+  }
+  if(i2cCon.ACKEN)
+  {
+    charge(i2c_bits(1));
+    i2cCon.ACKEN = 0;
+    ifs3.MI2C2IF = 1;
+  }
+  if(i2cCon.PEN)
+  {
+    charge(i2c_bits(1));
+    if(rtc.timeWritten) rtc_commit();
+    rtc.timeWritten = 0;
+    rtc.state = RTC_IDLE;
+    i2cCon.PEN = 0;
+    i2cStat.S = 0;
+    i2cStat.P = 1;
+    ifs3.MI2C2IF = 1;
+  }
+}
+
+I2CCONBITS *sim_i2c2con(void)
+{
+  i2c_step();
+  return &i2cCon;
+}
+
+I2CSTATBITS *sim_i2c2stat(void)
+{
+  i2c_step();
+  return &i2cStat;
+}
+
+IFS3BITS *sim_ifs3(void)
+{
+  i2c_step();
+  return &ifs3;
+}
+
+volatile unsigned int *sim_i2c2trn(void)
+{
+  i2c_step();
+  activity++;
+  trnTouched = 1;       // the firmware only ever writes TRN
+  i2cStat.TBF = 1;
+  return &i2cTrn;
+}
+
+volatile unsigned int *sim_i2c2rcv(void)
+{
+  i2c_step();
+  i2cStat.RBF = 0;
+  return &i2cRcv;
+}
+
+// SD card ----------------------------------------------------------------------
+//
+// Files live in a host directory.  The root directory is kept as a FAT style
+// table of 32 byte entries so lookups cost the sectors a real scan would
+// read; file data costs one sector per 512 bytes touched plus a FAT sector
+// per cluster.  Like MDD, a file's size in its directory entry only changes
+// when it is closed, so anything open when the run stops is cut back to that
+// size as if the power had gone.
+
+typedef struct
+{
+  char name[13];
+  unsigned long size;         // size as recorded in the directory entry
+  unsigned long cluster;
+  Boolean used;
+} SimDirEntry;
+
+static char sdRoot[4096] = "sd";
+static SimDirEntry sdDir[SIM_SD_ENTRIES];
+static int sdEntries;
+static Boolean sdMounted;
+static unsigned long sdNextCluster = 2;
+static struct SimFile sdFiles[SIM_SD_FILES];
+static uint64_t sdFailAt = SIM_FOREVER;   // sd_bytes_written at which power fails
+
+void sim_sd_power_fail(uint64_t afterBytes)
+{
+  sdFailAt = sim_stats.sd_bytes_written + afterBytes;
+}
+
+static void sd_tear(struct SimFile *f, const void *ptr, long len);
+static void sd_walk(long from, long to);
+
+static void sd_sectors(uint64_t reads, uint64_t writes)
+{
+  sim_stats.sd_sector_reads += reads;
+  sim_stats.sd_sector_writes += writes;
+  charge((reads + writes)*SIM_SD_SECTOR_US);
+}
+
+static unsigned long clusters_for(unsigned long size)
+{
+  return (size + SIM_SD_CLUSTER*512 - 1)/(SIM_SD_CLUSTER*512);
+}
+
+static int name_cmp(const void *a, const void *b)
+{
+  return strcasecmp(((const SimDirEntry *)a)->name, ((const SimDirEntry *)b)->name);
+}
+
+static void sd_mount(void)
+{
+  DIR *d;
+  struct dirent *e;
+  struct stat st;
+  char path[4400];
+  int n;
+
+  if(sdMounted) return;
+  sdMounted = 1;
+  mkdir(sdRoot, 0777);
+
+  sdEntries = 0;
+  d = opendir(sdRoot);
+  while(d && (e = readdir(d)) && sdEntries < SIM_SD_ENTRIES)
+  {
+    snprintf(path, sizeof(path), "%s/%s", sdRoot, e->d_name);
+    if(e->d_name[0] == '.' || strlen(e->d_name) > 12 || stat(path, &st) || !S_ISREG(st.st_mode))
+      continue;
+    strcpy(sdDir[sdEntries].name, e->d_name);
+    sdDir[sdEntries].size = st.st_size;
+    sdDir[sdEntries].used = 1;
+    sdEntries++;
+  }
+  if(d) closedir(d);
+
+  // a card written by the firmware would list in creation order, sorting
+  // at least makes runs repeatable
+  qsort(sdDir, sdEntries, sizeof(SimDirEntry), name_cmp);
+  for(n = 0; n < sdEntries; n++)
+  {
+    sdDir[n].cluster = sdNextCluster;
+    sdNextCluster += clusters_for(sdDir[n].size) + 1;
+  }
+}
+
+void sim_sd_root(const char *dir)
+{
+  snprintf(sdRoot, sizeof(sdRoot), "%s", dir);
+  sdMounted = 0;
+  sdNextCluster = 2;
+}
+
+static void host_path(char *path, const char *name)
+{
+  char lower[13];
+  int n;
+
+  for(n = 0; name[n] && n < 12; n++)
+    lower[n] = name[n];
+  lower[n] = 0;
+  snprintf(path, 4200, "%s/%s", sdRoot, lower);
+}
+
+// scan the directory for name, charging the sectors read on the way
+static int sd_find(const char *name, int *freeSlot)
+{
+  int n, found = -1;
+
+  sd_mount();
+  if(freeSlot) *freeSlot = -1;
+  for(n = 0; n < sdEntries; n++)
+  {
+    if(!sdDir[n].used)
+    {
+      if(freeSlot && *freeSlot < 0) *freeSlot = n;
+      continue;
+    }
+    if(!strcasecmp(sdDir[n].name, name))
+    {
+      found = n;
+      break;
+    }
+  }
+  sd_sectors((found < 0 ? sdEntries : found)/16 + 1, 0);
+  if(freeSlot && *freeSlot < 0 && sdEntries < SIM_SD_ENTRIES) *freeSlot = sdEntries;
+  return found;
+}
+
+// open the file in directory entry, or create it in slot when entry is -1
+static FSFILE *sd_open(const char *fileName, int entry, int slot, const char *mode)
+{
+  struct SimFile *f = NULL;
+  char path[4200];
+  int n, flags;
+
+  for(n = 0; n < SIM_SD_FILES && !f; n++)
+    if(!sdFiles[n].fd) f = &sdFiles[n];
+  if(!f) return NULL;
+
+  if(entry < 0 && mode[0] == 'r') return NULL;
+  if(entry < 0)
+  {
+    if(slot < 0) return NULL;
+    entry = slot;
+    if(slot == sdEntries) sdEntries++;
+    memset(&sdDir[entry], 0, sizeof(SimDirEntry));
+    strcpy(sdDir[entry].name, fileName);
+    sdDir[entry].used = 1;
+    sdDir[entry].cluster = sdNextCluster++;
+    sd_sectors(0, 1);   // new directory entry
+  }
+
+  flags = mode[1] == '+' || mode[0] != 'r' ? O_RDWR | O_CREAT : O_RDONLY;
+  host_path(path, sdDir[entry].name);
+  f->fd = open(path, flags, 0666);
+  if(f->fd < 0)
+  {
+    f->fd = 0;
+    return NULL;
+  }
+  f->entry = entry;
+  f->cluster = sdDir[entry].cluster;
+  f->size = sdDir[entry].size;
+  f->write = mode[0] != 'r' || mode[1] == '+';
+  f->append = mode[0] == 'a';
+  f->sector = -1;
+  f->dirty = 0;
+  f->clusters = clusters_for(f->size);
+  if(mode[0] == 'w' && f->size)
+  {
+    f->size = 0;
+    sd_sectors(0, 1);   // free the cluster chain
+  }
+  if(ftruncate(f->fd, f->size)) {}
+  f->pos = 0;
+  if(f->append)
+  {
+    sd_walk(0, f->size);    // MDD seeks to the end through the FAT
+    f->pos = f->size;
+  }
+  return f;
+}
+
+FSFILE *FSfopen(const char *fileName, const char *mode)
+{
+  int entry, slot;
+
+  activity++;
+  charge(SIM_CALL_US);
+  sim_stats.sd_opens++;
+  if(!fileName || strlen(fileName) > 12) return NULL;
+
+  entry = sd_find(fileName, &slot);
+  return sd_open(fileName, entry, slot, mode);
+}
+
+// the firmware's fsentry.c fills MDD's FSFILE from what the caller says; here
+// the caller has to be right about the card, no directory sector is read
+FSFILE *FSfopenEntry(const char *fileName, unsigned int entry, unsigned long cluster,
+                     unsigned long size, const char *mode)
+{
+  activity++;
+  charge(SIM_CALL_US);
+  if(mode[0] != 'r' || !cluster) return NULL;
+  sim_stats.sd_opens++;
+  sd_mount();
+  if(!fileName || entry >= (unsigned int)sdEntries || !sdDir[entry].used ||
+     strcasecmp(sdDir[entry].name, fileName) || sdDir[entry].cluster != cluster ||
+     sdDir[entry].size != size)
+    return NULL;
+
+  return sd_open(fileName, entry, -1, mode);
+}
+
+// move the sector buffer to the one holding byte pos
+static void sd_buffer(struct SimFile *f, long pos, Boolean forWrite)
+{
+  long sector = pos/512;
+
+  if(sector == f->sector) return;
+  if(f->dirty) sd_sectors(0, 1);
+  f->dirty = 0;
+  // a write that covers a whole new sector needs no read first
+  if(!forWrite || pos < f->size)
+    sd_sectors(1, 0);
+  if(sector/SIM_SD_CLUSTER != f->sector/SIM_SD_CLUSTER && sector % SIM_SD_CLUSTER == 0 && sector)
+    sd_sectors(1, 0);   // follow the FAT chain
+  f->sector = sector;
+}
+
+int FSfclose(FSFILE *f)
+{
+  activity++;
+  charge(SIM_CALL_US);
+  if(!f || !f->fd) return -1;
+
+  if(f->dirty) sd_sectors(0, 1);
+  if(f->write)
+  {
+    if(clusters_for(f->size) != f->clusters) sd_sectors(0, 1);   // FAT
+    sd_sectors(1, 1);   // directory entry
+    sdDir[f->entry].size = f->size;
+  }
+  close(f->fd);
+  memset(f, 0, sizeof(*f));
+  return 0;
+}
+
+size_t FSfread(void *ptr, size_t size, size_t n, FSFILE *f)
+{
+  long len = (long)(size*n), got, p;
+
+  activity++;
+  charge(SIM_CALL_US);
+  if(!f || !f->fd || !size) return 0;
+  if(f->pos + len > f->size) len = f->size - f->pos;
+  if(len <= 0) return 0;
+
+  for(p = f->pos; p < f->pos + len; p = (p/512 + 1)*512)
+    sd_buffer(f, p, 0);
+  got = pread(f->fd, ptr, len, f->pos);
+  if(got < 0) got = 0;
+  f->pos += got;
+  return got/size;
+}
+
+size_t FSfwrite(const void *ptr, size_t size, size_t n, FSFILE *f)
+{
+  long len = (long)(size*n), put, p;
+
+  activity++;
+  charge(SIM_CALL_US);
+  if(!f || !f->fd || !f->write || !len) return 0;
+  if(f->append) f->pos = f->size;
+
+  for(p = f->pos; p < f->pos + len; p = (p/512 + 1)*512)
+  {
+    sd_buffer(f, p, 1);
+    f->dirty = 1;
+  }
+  if(sim_stats.sd_bytes_written + len > sdFailAt)
+    sd_tear(f, ptr, len);
+  put = pwrite(f->fd, ptr, len, f->pos);
+  if(put < 0) put = 0;
+  f->pos += put;
+  if(f->pos > f->size) f->size = f->pos;
+  sim_stats.sd_bytes_written += put;
+  return put/size;
+}
+
+// the power goes partway through a write: the start of the data lands, the
+// rest reads back as erased flash, and the directory already has the new
+// size, the worst case for whoever reads the file next
+static void sd_tear(struct SimFile *f, const void *ptr, long len)
+{
+  long keep = sdFailAt > sim_stats.sd_bytes_written ? sdFailAt - sim_stats.sd_bytes_written : 0;
+  char erased[512];
+
+  if(keep > len) keep = len;
+  memset(erased, 0xFF, sizeof(erased));
+  if(pwrite(f->fd, ptr, keep, f->pos) < 0) {}
+  for(; keep < len; keep += sizeof(erased))
+    if(pwrite(f->fd, erased, len - keep < (long)sizeof(erased) ? len - keep : (long)sizeof(erased), f->pos + keep) < 0) {}
+  if(f->pos + len > f->size) f->size = f->pos + len;
+  sdDir[f->entry].size = f->size;
+  sdFailAt = SIM_FOREVER;
+  sim_stop();
+}
+
+int FSfprintf(FSFILE *f, const char *fmt, ...)
+{
+  char buf[1024];
+  va_list ap;
+  int len;
+
+  va_start(ap, fmt);
+  len = vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  if(len >= (int)sizeof(buf)) len = sizeof(buf) - 1;
+  return len < 0 ? -1 : (int)FSfwrite(buf, 1, len, f);
+}
+
+// MDD follows the cluster chain to seek, forwards from where the file is
+// or from its start when going back; 128 FAT entries per sector
+static void sd_walk(long from, long to)
+{
+  long here = from/(SIM_SD_CLUSTER*512), there = to/(SIM_SD_CLUSTER*512);
+  long steps = there >= here ? there - here : there;
+
+  if(steps) sd_sectors(steps/128 + 1, 0);
+}
+
+int FSfseek(FSFILE *f, long offset, int whence)
+{
+  long to;
+
+  activity++;
+  charge(SIM_CALL_US);
+  if(!f || !f->fd) return -1;
+  to = whence == SEEK_CUR ? f->pos + offset : whence == SEEK_END ? f->size + offset : offset;
+  if(to < 0 || to > f->size) return -1;
+  sd_walk(f->pos, to);
+  f->pos = to;
+  return 0;
+}
+
+long FSftell(FSFILE *f)
+{
+  return f ? f->pos : -1;
+}
+
+int FSfeof(FSFILE *f)
+{
+  return !f || f->pos >= f->size;
+}
+
+int FSremove(const char *fileName)
+{
+  char path[4200];
+  int entry;
+
+  activity++;
+  charge(SIM_CALL_US);
+  entry = sd_find(fileName, NULL);
+  if(entry < 0) return -1;
+  host_path(path, sdDir[entry].name);
+  unlink(path);
+  sdDir[entry].used = 0;
+  sd_sectors(0, 2);   // directory entry and FAT
+  return 0;
+}
+
+int FSrename(const char *fileName, FSFILE *f)
+{
+  char from[4200], to[4200];
+
+  activity++;
+  charge(SIM_CALL_US);
+  if(!f || !f->fd || strlen(fileName) > 12 || sd_find(fileName, NULL) >= 0) return -1;
+  host_path(from, sdDir[f->entry].name);
+  strcpy(sdDir[f->entry].name, fileName);
+  host_path(to, fileName);
+  rename(from, to);
+  sd_sectors(1, 1);
+  return 0;
+}
+
+static char findPattern[13];
+
+static int find_from(int n, SearchRec *rec)
+{
+  int start = n;
+
+  for(; n < sdEntries; n++)
+  {
+    if(!sdDir[n].used) continue;
+    if(strcmp(findPattern, "*.*") && fnmatch(findPattern, sdDir[n].name, FNM_CASEFOLD))
+      continue;
+    sd_sectors(n/16 - start/16 + 1, 0);
+    strcpy(rec->filename, sdDir[n].name);
+    rec->attributes = ATTR_ARCHIVE;
+    rec->filesize = sdDir[n].size;
+    rec->timestamp = 0;
+    rec->entry = n;
+    return 0;
+  }
+  sd_sectors(n/16 - start/16 + 1, 0);
+  return -1;
+}
+
+int FindFirst(const char *fileName, unsigned int attr, SearchRec *rec)
+{
+  activity++;
+  charge(SIM_CALL_US);
+  sd_mount();
+  snprintf(findPattern, sizeof(findPattern), "%s", fileName);
+  return find_from(0, rec);
+}
+
+int FindNext(SearchRec *rec)
+{
+  charge(SIM_CALL_US);
+  return find_from(rec->entry + 1, rec);
+}
+
+static void files_power_loss(void)
+{
+  char path[4200];
+  int n;
+
+  for(n = 0; n < SIM_SD_FILES; n++)
+  {
+    if(!sdFiles[n].fd) continue;
+    close(sdFiles[n].fd);
+    host_path(path, sdDir[sdFiles[n].entry].name);
+    if(truncate(path, sdDir[sdFiles[n].entry].size)) {}
+    memset(&sdFiles[n], 0, sizeof(sdFiles[n]));
+  }
+}
+
+// DateTime ---------------------------------------------------------------------
+
+static const char *dayNames[7] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+static const char *monthNames[12] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                     "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+static DateAndTime clockSet;
+static uint64_t clockSetAt;
+
+static time_t to_time(DateAndTime t)
+{
+  struct tm tm = {0};
+
+  tm.tm_sec = t.second;
+  tm.tm_min = t.minute;
+  tm.tm_hour = t.hour;
+  tm.tm_mday = t.day ? t.day : 1;
+  tm.tm_mon = t.month ? t.month - 1 : 0;
+  tm.tm_year = t.year + 100;
+  return timegm(&tm);
+}
+
+static DateAndTime from_time(time_t s)
+{
+  DateAndTime t;
+  struct tm tm;
+
+  gmtime_r(&s, &tm);
+  t.second = tm.tm_sec;
+  t.minute = tm.tm_min;
+  t.hour = tm.tm_hour;
+  t.weekday = tm.tm_wday;
+  t.day = tm.tm_mday;
+  t.month = tm.tm_mon + 1;
+  t.year = tm.tm_year - 100;
+  return t;
+}
+
+static DateAndTime dt_new(int year, int month, int day, int hour, int minute, int second)
+{
+  DateAndTime t = {second, minute, hour, 0, day, month, year};
+  return t;
+}
+
+// "Tue May 26 08:35:00 2015"
+static DateAndTime dt_parseStamp(String stamp)
+{
+  char day[4], month[4];
+  int d, h, mi, s, y, m;
+  DateAndTime t = dt_new(0, 0, 0, 0, 0, 0);
+
+  charge(SIM_CALL_US);
+  if(sscanf(stamp, "%3s %3s %d %d:%d:%d %d", day, month, &d, &h, &mi, &s, &y) != 7)
+    return t;
+  for(m = 0; m < 12 && strcmp(month, monthNames[m]); m++);
+  t = dt_new(y - 2000, m + 1, d, h, mi, s);
+  for(d = 0; d < 7; d++)
+    if(!strcmp(day, dayNames[d])) t.weekday = d;
+  return t;
+}
+
+static String dt_toStamp(DateAndTime t)
+{
+  static char stamp[32];
+
+  charge(SIM_CALL_US);
+  snprintf(stamp, sizeof(stamp), "%s %s %2d %02d:%02d:%02d %04d",
+           dayNames[t.weekday % 7], monthNames[t.month >= 1 && t.month <= 12 ? t.month - 1 : 0],
+           t.day, t.hour, t.minute, t.second, 2000 + t.year);
+  return stamp;
+}
+
+static void dt_set(DateAndTime t)
+{
+  activity++;
+  charge(SIM_CALL_US);
+  clockSet = t;
+  clockSetAt = now;
+}
+
+static DateAndTime dt_get(void)
+{
+  poll_idle(POLL_CLOCK, 0);
+  return from_time(to_time(clockSet) + (time_t)((now - clockSetAt)/SIM_SECOND));
+}
+
+static String dt_getStamp(void)
+{
+  return dt_toStamp(dt_get());
+}
+
+const DateTime dateTime = {dt_new, dt_parseStamp, dt_toStamp, dt_getStamp, dt_set, dt_get};
+
+// USB CDC ----------------------------------------------------------------------
+//
+// write() queues what fits in the IN endpoint buffer and returns the count,
+// like the Microchip CDC driver; the buffer drains one 64 byte packet per
+// SIM_USB_PACKET_US in the background.  When the firmware idles on USB the
+// sim waits for the host in real time, and the host closing its end of the
+// pipe ends the run.
+
+static int usbIn = -1, usbOut = -1;
+static Boolean usbConnected;
+static char usbTx[SIM_USB_TXBUF];
+static unsigned int usbTxHead, usbTxCount;
+static uint64_t usbTxNext = SIM_FOREVER;
+
+void sim_usb_fds(int in, int out)
+{
+  usbIn = in;
+  usbOut = out;
+}
+
+static uint64_t usb_next(void)
+{
+  return usbTxNext;
+}
+
+// hand the packets whose time has come to the host
+static void usb_run(void)
+{
+  unsigned int len;
+  int n;
+
+  while(usbTxCount && usbTxNext <= now)
+  {
+    len = usbTxCount < 64 ? usbTxCount : 64;
+    if(usbTxHead + len > SIM_USB_TXBUF) len = SIM_USB_TXBUF - usbTxHead;
+    while(usbConnected && len)
+    {
+      n = write(usbOut, usbTx + usbTxHead, len);
+      if(n < 0 && errno == EINTR) continue;
+      if(n <= 0)
+      {
+        usbConnected = 0;   // host went away
+        break;
+      }
+      if(!sim_stats.usb_bytes_out) sim_stats.usb_first_us = now;
+      sim_stats.usb_bytes_out += n;
+      sim_stats.usb_last_us = now;
+      usbTxHead = (usbTxHead + n) % SIM_USB_TXBUF;
+      usbTxCount -= n;
+      len -= n;
+    }
+    if(!usbConnected) usbTxCount = 0;
+    usbTxNext += SIM_USB_PACKET_US;
+  }
+  if(!usbTxCount) usbTxNext = SIM_FOREVER;
+}
+
+static void usb_connect(void)
+{
+  activity++;
+  charge(SIM_CALL_US);
+  usbConnected = usbOut >= 0;
+}
+
+static void usb_disconnect(void)
+{
+  activity++;
+  charge(SIM_CALL_US);
+  usbConnected = 0;
+  usbTxCount = 0;
+  usbTxNext = SIM_FOREVER;
+}
+
+static Boolean usb_isConnected(void)
+{
+  poll_idle(POLL_USB_LINK, usbConnected);
+  return usbConnected;
+}
+
+// wait up to ms of real time for the host, stop the run if it hung up
+static Boolean usb_readable(int ms)
+{
+  struct pollfd p = {usbIn, POLLIN, 0};
+  char c;
+
+  if(usbIn < 0 || poll(&p, 1, ms) <= 0) return 0;
+  if(p.revents & POLLIN) return 1;
+  if(p.revents & (POLLHUP | POLLERR) && read(usbIn, &c, 1) <= 0)
+  {
+    usbIn = -1;
+    usbConnected = 0;
+    sim_stop();
+  }
+  return 0;
+}
+
+static Boolean usb_waiting(void)
+{
+  return usbConnected && !usbTxCount && usb_readable(100);
+}
+
+static void usb_process(void)
+{
+  poll_idle(POLL_USB, usb_readable(0) + usbTxCount);
+}
+
+static int usb_write(const char *data, int length)
+{
+  int n = 0;
+
+  activity++;
+  charge(SIM_CALL_US);
+  if(!usbConnected) return 0;
+  if(!usbTxCount) usbTxNext = now + SIM_USB_PACKET_US;
+  while(n < length && usbTxCount < SIM_USB_TXBUF)
+  {
+    usbTx[(usbTxHead + usbTxCount) % SIM_USB_TXBUF] = data[n++];
+    usbTxCount++;
+  }
+  return n;
+}
+
+// print and printf block until everything is queued
+static int usb_send(const char *data, int length)
+{
+  int done = 0;
+
+  while(done < length && usbConnected)
+  {
+    done += usb_write(data + done, length - done);
+    if(done < length) advance_to(usbTxNext);
+  }
+  return done;
+}
+
+static int usb_print(String str)
+{
+  return usb_send(str, strlen(str));
+}
+
+static int usb_printf(const char *format, ...)
+{
+  char buf[512];
+  va_list ap;
+  int len;
+
+  va_start(ap, format);
+  len = vsnprintf(buf, sizeof(buf), format, ap);
+  va_end(ap);
+  if(len >= (int)sizeof(buf)) len = sizeof(buf) - 1;
+  return len < 0 ? -1 : usb_send(buf, len);
+}
+
+static int usb_read(char *data, int length)
+{
+  int n;
+
+  charge(SIM_CALL_US);
+  if(!usbConnected || !usb_readable(0)) return 0;
+  n = read(usbIn, data, length);
+  if(n <= 0) return 0;
+  activity++;
+  return n;
+}
+
+const USB usb = {usb_connect, usb_disconnect, usb_isConnected, usb_process,
+                 usb_printf, usb_print, usb_read, usb_write};
+
+// Everything else ------------------------------------------------------------------
+
+static Boolean buttonDown;
+
+void sim_button(Boolean pressed)
+{
+  buttonDown = pressed;
+}
+
+static Boolean button_isPressed(void)
+{
+  poll_idle(POLL_BUTTON, buttonDown);
+  return buttonDown;
+}
+
+const Button button = {button_isPressed};
+
+static void nesi_init(void)
+{
+  activity++;
+  charge(SIM_CALL_US);
+  OSCCON = 0x0040;    // pin select locked after reset
+}
+
+const NESI nesi = {nesi_init};
+
+static void led_dutycycle(int percent) { activity++; charge(SIM_CALL_US); }
+static void led_on(void) { activity++; charge(SIM_CALL_US); }
+static void led_off(void) { activity++; charge(SIM_CALL_US); }
+
+const LED ledR = {led_dutycycle, led_on, led_off};
+const LED ledB = {led_dutycycle, led_on, led_off};
+
+// Servo shield: servo n takes its pulses from OC1 (1, 3) or OC2 (2, 4) and
+// its power from driver A (1, 4) or B (2, 3), and its wiper reads on RSQn
+// from SERVO_FB_1000 at 1000 us to SERVO_FB_2000 at 2000 us.  A powered
+// servo slews toward the pulse width it is sent; unpowered, without pulses
+// or stalled it stays where it is.
+#define SERVO_FB_1000 205
+#define SERVO_FB_2000 818
+#define SERVO_SLEW    4.0         // us of pulse width a ms, 0.15 s/60 degrees
+
+static const unsigned char servoLine[4] = {0, 1, 0, 1};
+static const unsigned char servoDriver[4] = {0, 1, 1, 0};
+static double servoUs[4] = {1500, 1500, 1500, 1500};
+static Boolean servoStalled[4], driverOn[2];
+static uint64_t servoAt;
+
+void sim_servo_stall(int num, Boolean stalled)
+{
+  if(num < 1 || num > 4) return;
+  servos_track();
+  servoStalled[num - 1] = stalled;
+}
+
+// move the servos from servoAt up to now, on the pulses being sent
+static void servos_track(void)
+{
+  double reach = (now - servoAt)/1000.0*SERVO_SLEW, target;
+  int n, line;
+
+  servoAt = now;
+  for(n = 0; n < 4; n++)
+  {
+    line = servoLine[n];
+    if(!driverOn[servoDriver[n]] || servoStalled[n] || !(sim_oc[5*line] & 7) ||
+       !(T_CON(1) & 0x8000) || !sim_oc[5*line + 3])
+      continue;
+    target = sim_oc[5*line + 3]/(FCY/8000000.0);   // OCxR in Timer2 ticks
+    if(target > servoUs[n] + reach) servoUs[n] += reach;
+    else if(target < servoUs[n] - reach) servoUs[n] -= reach;
+    else servoUs[n] = target;
+  }
+}
+
+static int servo_feedback(int channel)
+{
+  servos_track();
+  return SERVO_FB_1000 + (int)((servoUs[channel] - 1000)*(SERVO_FB_2000 - SERVO_FB_1000)/1000);
+}
+
+static void driver_set(int driver, Boolean on)
+{
+  activity++;
+  charge(SIM_CALL_US);
+  servos_track();
+  driverOn[driver] = on;
+}
+
+static void driverA_on(void) { driver_set(0, 1); }
+static void driverA_off(void) { driver_set(0, 0); }
+static void driverB_on(void) { driver_set(1, 1); }
+static void driverB_off(void) { driver_set(1, 0); }
+
+const PowerDriver powerDriverA = {driverA_on, driverA_off};
+const PowerDriver powerDriverB = {driverB_on, driverB_off};
+
+static void dataLog_add(String str, char terminator)
+{
+  FSFILE *f = FSfopen("log.txt", FS_APPEND);
+
+  if(!f) return;
+  FSfwrite(str, 1, strlen(str), f);
+  if(terminator) FSfwrite(&terminator, 1, 1, f);
+  FSfclose(f);
+}
+
+const DataLog dataLog = {dataLog_add};
+
+static struct { int (*read)(void *ctx); void *ctx; } adc[4];
+
+void sim_adc(int channel, int (*read)(void *ctx), void *ctx)
+{
+  if(channel < 1 || channel > 4) return;
+  adc[channel - 1].read = read;
+  adc[channel - 1].ctx = ctx;
+}
+
+// samples conversions spacing microseconds apart, averaged; a channel
+// without a source reads its servo's wiper
+static int adc_get(int channel, int samples, int spacing)
+{
+  long sum = 0;
+  int n;
+
+  activity++;
+  if(samples < 1) samples = 1;
+  for(n = 0; n < samples; n++)
+  {
+    charge(spacing > 0 ? spacing : 1);
+    sum += adc[channel].read ? adc[channel].read(adc[channel].ctx) : servo_feedback(channel);
+  }
+  return (int)(sum/samples);
+}
+
+static int getQ1(int samples, int spacing) { return adc_get(0, samples, spacing); }
+static int getQ2(int samples, int spacing) { return adc_get(1, samples, spacing); }
+static int getQ3(int samples, int spacing) { return adc_get(2, samples, spacing); }
+static int getQ4(int samples, int spacing) { return adc_get(3, samples, spacing); }
+
+const ResistiveSensors resistiveSensors = {getQ1, getQ2, getQ3, getQ4};
@@ -0,0 +1,170 @@
+//Compression and CPU cost of packlog.c on the records of a real log
+//
+//Build:  cc -O2 -Isim -I. -o packbench sim/packbench.c packlog.c journal.c format.c bytes.c
+//
+//  packbench [-n passes] <DATALOG.JNL>
+//
+//Every record of the journal (see jnlcat) is fed to packLog.append() and,
+//for comparison, to journal.append(), with a card that refuses to open so
+//only the encoding, LZ and CRC work is timed.  Printed are the bytes each
+//way, what the zigzag/varint stage alone gives, and the host time per
+//record, mean and worst.  That is host CPU time, not PIC24 cycles; both
+//logs run on the same compiler, so the ratio is what carries over.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "journal.h"
+#include "packlog.h"
+#include "dircache.h"
+#include "bytes.h"
+
+// no card: both logs do all their work up to the write and stop there
+static int load(void) { return 0; }
+static Boolean exists(String filename) { (void)filename; return 0; }
+static long size(String filename) { (void)filename; return -1; }
+static FSFILE *openFile(String filename, const char *mode) { (void)filename; (void)mode; return NULL; }
+static int closeFile(FSFILE *file) { (void)file; return 0; }
+const DirCache dirCache = {load, exists, size, openFile, closeFile};
+
+int FSfseek(FSFILE *f, long offset, int whence) { (void)f; (void)offset; (void)whence; return -1; }
+long FSftell(FSFILE *f) { (void)f; return 0; }
+size_t FSfread(void *p, size_t s, size_t n, FSFILE *f) { (void)p; (void)s; (void)n; (void)f; return 0; }
+size_t FSfwrite(const void *p, size_t s, size_t n, FSFILE *f) { (void)p; (void)s; (void)n; (void)f; return 0; }
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+static char (*records)[JOURNAL_PAYLOAD + 1];
+static long count;
+
+static void readJournal(const char *path)
+{
+  unsigned char b[JOURNAL_BLOCK];
+  long room = 0;
+  int length;
+  FILE *f = fopen(path, "rb");
+
+  if(!f)
+  {
+    fprintf(stderr, "packbench: cannot open %s\n", path);
+    exit(2);
+  }
+  while(fread(b, 1, JOURNAL_BLOCK, f) == JOURNAL_BLOCK && b[0] == 'J' && b[1] == 'L' &&
+        bytes.get32(b + 4) == (uint32_t)count)
+  {
+    length = b[2] | b[3] << 8;
+    if(length > JOURNAL_PAYLOAD) break;
+    if(count == room)
+    {
+      room = room ? 2*room : 4096;
+      records = realloc(records, room*sizeof(*records));
+    }
+    memcpy(records[count], b + JOURNAL_HEADER, length);
+    records[count][length] = 0;
+    count++;
+  }
+  fclose(f);
+}
+
+// mean and worst ns per record of fn over all records; each pass starts
+// the log over with reset, and a record's worst is its best pass so the
+// host's own interruptions drop out
+static void timeAll(void (*reset)(void), void (*fn)(char *record), int passes,
+                    double *mean, double *worst)
+{
+  static double *best;
+  double t, total = 0, one;
+  long n;
+  int pass;
+
+  best = realloc(best, count*sizeof(*best));
+  for(pass = 0; pass < passes; pass++)
+  {
+    reset();
+    for(n = 0; n < count; n++)
+    {
+      t = now();
+      fn(records[n]);
+      one = now() - t;
+      total += one;
+      if(!pass || one < best[n]) best[n] = one;
+    }
+  }
+  *mean = total/passes/count*1e9;
+  *worst = 0;
+  for(n = 0; n < count; n++)
+    if(best[n] > *worst) *worst = best[n];
+  *worst *= 1e9;
+}
+
+static void packReset(void)
+{
+  packLog.open("DATALOG.PKL");
+}
+
+static void journalReset(void)
+{
+  journal.open("DATALOG.JNL");
+}
+
+static void packOne(char *record)
+{
+  packLog.append(record, strlen(record));
+}
+
+static void journalOne(char *record)
+{
+  journal.append(record);
+}
+
+int main(int argc, char **argv)
+{
+  double packMean, packWorst, journalMean, journalWorst;
+  unsigned long text, raw, blocks;
+  int passes = 5, opt;
+
+  while((opt = getopt(argc, argv, "n:")) != -1)
+  {
+    if(opt != 'n') passes = 0;
+    else passes = atoi(optarg);
+  }
+  if(passes < 1 || optind != argc - 1)
+  {
+    fprintf(stderr, "usage: packbench [-n passes] <DATALOG.JNL>\n");
+    return 2;
+  }
+  readJournal(argv[optind]);
+  if(!count)
+  {
+    fprintf(stderr, "packbench: no records in %s\n", argv[optind]);
+    return 1;
+  }
+
+  // bytes from one pass, then the timing passes
+  timeAll(packReset, packOne, 1, &packMean, &packWorst);
+  text = packLog.textBytes();
+  raw = packLog.rawBytes();
+  blocks = packLog.blocks();
+
+  timeAll(packReset, packOne, passes, &packMean, &packWorst);
+  timeAll(journalReset, journalOne, passes, &journalMean, &journalWorst);
+
+  printf("%ld records, %lu bytes of text, %.1f bytes a record\n", count, text, (double)text/count);
+  printf("%-22s %10s %7s %8s %8s\n", "", "bytes", "ratio", "ns mean", "ns worst");
+  printf("%-22s %10lu %6.1fx %8.0f %8.0f\n", "journal blocks", (unsigned long)count*JOURNAL_BLOCK,
+         (double)text/(count*JOURNAL_BLOCK), journalMean, journalWorst);
+  printf("%-22s %10lu %6.1fx\n", "shapes, zigzag varints", raw, (double)text/raw);
+  printf("%-22s %10lu %6.1fx %8.0f %8.0f\n", "packed blocks", blocks*PACK_BLOCK,
+         (double)text/(blocks*PACK_BLOCK), packMean, packWorst);
+  printf("%.1f records a block, %.2f bytes a record on the card\n",
+         (double)count/blocks, (double)blocks*PACK_BLOCK/count);
+  return 0;
+}
@@ -0,0 +1,229 @@
+//Checks BORON2's servo moves against the simulator's servo shield, and its
+//count of a Geiger window
+//
+//Build:  cc -O2 -Isim -Dmain=boron2_main -c -o boron2.o "BORON2 (2016_10_28 22_55_52 UTC).c"
+//        cc -O2 -Isim -I. -o servotest sim/servotest.c boron2.o servo.c logexport.c
+//          telemetry.c journal.c packlog.c dircache.c format.c config.c sampler.c
+//          pulses.c pulselog.c timebase.c snapshot.c bustrace.c bytes.c sim/nesi_sim.c -lm
+//
+//  servotest [-s sd-dir]
+//
+//Boots BORON2 as far as its main loop would and calls moveServo() as the
+//increments do:
+//
+//  settle   servo 1 to 1800 us: the Servo record says Settle before
+//           config.servoHold, the wiper reads within FB_TOLERANCE of
+//           1800 us, servo 3 on the same pulse line and servo 4 on the
+//           same driver stay put, and servo 1 holds once the power is off
+//  stall    servo 2 jammed, to 1800 us: the record says Stalled with the
+//           wiper still at 1500 us, after the whole config.servoHold
+//  window   for window 20, 30 and 45, two windows of characters queued
+//           at once, a '1' every 5th in the first and every 3rd in the
+//           second: getCount() gives 12 CPM, then 21, 20 and 20, and
+//           leaves nothing queued
+//
+//Each check prints a line; the exit status is 1 if any failed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "sim.h"
+#include "uart2.h"
+#include "config.h"
+#include "journal.h"
+#include "servo.h"
+#include "timebase.h"
+#include "bustrace.h"
+#include "bytes.h"
+
+#define BOOT_DONE 5               // BORON2's bootStage once the log is open
+
+// BORON2's feedback calibration
+#define FB_1000 205
+#define FB_2000 818
+#define FB_TOLERANCE 8
+#define FB(us) (FB_1000 + ((us) - 1000)*(FB_2000 - FB_1000)/1000)
+
+// from BORON2
+void i2c_init(void);
+DateAndTime read_time(void);
+Boolean rtc_squareWave(void);
+void bootStep(DateAndTime *CurrentTime, DateAndTime *StartTime);
+void moveServo(int num, unsigned int us);
+int getCount(void);
+extern int bootStage;
+extern Boolean rtcOk;
+
+static const char *dir = "servotest.sd";
+static int failed;
+
+static void check(const char *what, int ok)
+{
+  printf("%-52s %s\n", what, ok ? "ok" : "FAILED");
+  if(!ok) failed++;
+}
+
+// the payload of the last block in the log
+static void lastRecord(char *text)
+{
+  unsigned char block[JOURNAL_BLOCK];
+  char path[512];
+  unsigned length;
+  FILE *f;
+
+  text[0] = 0;
+  snprintf(path, sizeof(path), "%s/DATALOG.JNL", dir);
+  if(!(f = fopen(path, "rb"))) return;
+  while(fread(block, 1, JOURNAL_BLOCK, f) == JOURNAL_BLOCK)
+  {
+    length = bytes.get16(block + 2);
+    if(block[0] != 'J' || block[1] != 'L' || length > JOURNAL_PAYLOAD) break;
+    memcpy(text, block + JOURNAL_HEADER, length);
+    text[length] = 0;
+  }
+  fclose(f);
+}
+
+// two windows of Geiger characters, see the header
+static int windowLeft, windowSize;
+
+static uint64_t windowNext(void *ctx)
+{
+  (void)ctx;
+  return windowLeft ? sim_now_us() : SIM_FOREVER;
+}
+
+static unsigned char windowEmit(void *ctx)
+{
+  int i = 2*windowSize - windowLeft--;
+
+  (void)ctx;
+  if(i < windowSize) return i % 5 ? '0' : '1';
+  return (i - windowSize) % 3 ? '0' : '1';
+}
+
+static void window(int size, int second)
+{
+  SimSource src = {windowNext, windowEmit, NULL};
+  char text[80], scratch[64];
+  int first;
+
+  config.window = size;
+  sim_uart2_source(&src);
+  while(uart2.receive(scratch, sizeof(scratch)) > 0);
+  windowSize = size;
+  windowLeft = 2*size;
+  while(uart2.size() < 2*size) sim_advance_us(1000);
+  first = getCount();
+  snprintf(text, sizeof(text), "window %d: first %d CPM, second %d CPM", size, 12, second);
+  check(text, first == 12 && getCount() == second && uart2.size() == 0);
+}
+
+static Boolean near(int feedback, int us)
+{
+  return feedback >= FB(us) - FB_TOLERANCE && feedback <= FB(us) + FB_TOLERANCE;
+}
+
+// the Settle or Stalled figure of the last Servo record of num to us
+static Boolean servoRecord(int num, unsigned us, const char *outcome, long *figure)
+{
+  char text[JOURNAL_PAYLOAD + 1], key[48];
+  const char *p;
+
+  lastRecord(text);
+  snprintf(key, sizeof(key), ",Servo,%d,Pulse,%u,%s,", num, us, outcome);
+  if(!(p = strstr(text, key)) || text[strlen(text) - 1] != '\t') return 0;
+  *figure = atol(p + strlen(key));
+  return 1;
+}
+
+static int run(void)
+{
+  DateAndTime now, begun;
+  uint64_t at;
+  long figure;
+
+  nesi.init();
+  timebase.init();
+#if BUS_TRACE
+  busTrace.init();
+#endif
+  uart2.init();
+  i2c_init();
+  servo.init();
+  rtcOk = rtc_squareWave() && timebase.sync(read_time, RTC_SQW_RP);
+  now = begun = timebase.now();
+  while(bootStage != BOOT_DONE) bootStep(&now, &begun);
+
+  at = sim_now_us();
+  moveServo(1, 1800);
+  at = sim_now_us() - at;
+  check("settle: record says Settle, ends with a tab",
+        servoRecord(1, 1800, "Settle", &figure));
+  check("settle: settled before servoHold", figure > 0 && figure < config.servoHold);
+  check("settle: returned once settled", at < (config.servoHold + 100)*1000ULL &&
+        at < (uint64_t)(figure + 100)*1000);
+  check("settle: servo 1 wiper at 1800 us", near(resistiveSensors.getQ1(4, 1), 1800));
+  check("settle: servo 3 on the same line stayed at 1500 us",
+        near(resistiveSensors.getQ3(4, 1), 1500));
+  check("settle: servo 4 on the same driver stayed at 1500 us",
+        near(resistiveSensors.getQ4(4, 1), 1500));
+
+  // with its driver off servo 1 stays where it was left
+  servo.pulse(0, 1200);
+  sim_advance_us(SIM_SECOND);
+  check("settle: unpowered servo 1 held its place", near(resistiveSensors.getQ1(4, 1), 1800));
+
+  sim_servo_stall(2, 1);
+  at = sim_now_us();
+  moveServo(2, 1800);
+  at = sim_now_us() - at;
+  check("stall: record says Stalled, ends with a tab",
+        servoRecord(2, 1800, "Stalled", &figure));
+  check("stall: error is the whole 300 us", figure <= FB(1500) - FB(1800) + FB_TOLERANCE &&
+        figure >= FB(1500) - FB(1800) - FB_TOLERANCE);
+  check("stall: waited out servoHold", at >= config.servoHold*1000ULL);
+  sim_servo_stall(2, 0);
+
+  window(20, 21);
+  window(30, 20);
+  window(45, 20);
+  config.window = 30;
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  const char *files[] = {"DATALOG.JNL", "DATALOG.PKL", "PULSES.BIN", "TIME.TXT",
+                         "START.TXT", "SITE.CFG"};
+  char path[512];
+  int opt, i;
+
+  while((opt = getopt(argc, argv, "s:")) != -1)
+  {
+    if(opt != 's') break;
+    dir = optarg;
+  }
+  if(opt != -1 || optind != argc)
+  {
+    fprintf(stderr, "usage: servotest [-s sd-dir]\n");
+    return 2;
+  }
+
+  // a fresh card with the default configuration
+  mkdir(dir, 0777);
+  for(i = 0; i < (int)(sizeof(files)/sizeof(files[0])); i++)
+  {
+    snprintf(path, sizeof(path), "%s/%s", dir, files[i]);
+    unlink(path);
+  }
+  sim_sd_root(dir);
+  sim_rtc_set(dateTime.new(16, 10, 28, 12, 0, 0));
+  sim_geiger(30, 1);
+  sim_run(run, SIM_FOREVER);
+
+  printf("%s\n", failed ? "servotest: FAILED" : "servotest: all passed");
+  return failed > 0;
+}
@@ -0,0 +1,130 @@
+//Harness side of the NESI+ host simulator
+//
+//Time is virtual: it only moves when the firmware waits, polls or talks to a
+//peripheral, and jumps ahead to the next event when the firmware is idle
+//polling, so days of operation run in seconds.  A harness points the
+//simulator at an SD directory, optionally plugs in a UART2 byte source and a
+//USB pipe, then calls sim_run() with the firmware's main renamed, e.g.
+//
+//  cc -Isim -Dmain=boron2_main -c -o boron2.o "BORON2 (...).c"
+//  cc -Isim harness.c boron2.o servo.c sim/nesi_sim.c -lm
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include "nesi.h"
+
+#define SIM_FOREVER   UINT64_MAX
+#define SIM_SECOND    1000000ULL
+#define SIM_DAY       (86400ULL*SIM_SECOND)
+
+// Clock ----------------------------------------------------------------------
+
+uint64_t sim_now_us(void);
+
+// move virtual time forward, running timer ISRs and UART traffic on the way
+void sim_advance_us(uint64_t us);
+
+// run the firmware entry point until it returns or until virtual time
+// reaches until_us; returns 1 if the deadline stopped it, 0 if it returned
+int sim_run(int (*entry)(void), uint64_t until_us);
+
+// abandon the running firmware at once (brown-out, end of test)
+void sim_stop(void);
+
+// call fn(ctx) from the event loop once virtual time reaches at, e.g. to
+// press the button or change the count rate in the middle of a run
+void sim_at(uint64_t at, void (*fn)(void *ctx), void *ctx);
+
+// Peripherals ----------------------------------------------------------------
+
+// host directory that backs the SD card, created if missing
+void sim_sd_root(const char *dir);
+
+// cut the power once afterBytes more bytes have been written: that write
+// is torn (its tail reads back as 0xFF but the file size already covers
+// it) and the run stops as if by sim_stop()
+void sim_sd_power_fail(uint64_t afterBytes);
+
+// DS1307 on I2C2: set its clock, or make it stop answering.  With its
+// control register at 1 Hz (SQWE, RS = 0) SQW/OUT falls as each second
+// starts and rises half way; that edge is seen by INT1, the pin select
+// input is not modelled.  The other rates are not modelled either.
+void sim_rtc_set(DateAndTime now);
+void sim_rtc_absent(Boolean absent);
+
+// all 64 DS1307 registers as they stand, or written over them: the time
+// in BCD, control and the battery backed RAM, to carry it over to the
+// next run like a reset does
+#define SIM_RTC_REGS 64
+void sim_rtc_regs(unsigned char *regs, Boolean write);
+
+// the MCU oscillator off by ppm parts per million, set before sim_run():
+// the timers and input capture count that much fast or slow, the RTC
+// keeps true time
+void sim_mcu_ppm(long ppm);
+
+// UART2 receive side.  A source tells when its next byte is due and hands
+// it over when that time comes; bytes then take 10 bit times on the wire
+// before they land in the NESI+ receive buffer.
+typedef struct
+{
+  uint64_t (*next)(void *ctx);          // time of the next byte, SIM_FOREVER if none
+  unsigned char (*emit)(void *ctx);     // produce that byte
+  void *ctx;
+} SimSource;
+
+void sim_uart2_source(const SimSource *src);
+
+// Geiger tube pulse line: each emit() of the source is one rising edge,
+// counted by timers on their external clock and captured by IC1
+void sim_tube(const SimSource *src);
+
+// built in Geiger counter: Poisson pulses at cpm, a '1' per pulse and a
+// '0' heartbeat every second on UART2, the same pulses on the tube line
+void sim_geiger(double cpm, uint32_t seed);
+
+// analog inputs read through resistiveSensors.getQ1..getQ4 (10 bit); a
+// channel left without a source reads the wiper of the shield's servo on
+// it, which follows the pulses on its OC line while its power driver is on
+void sim_adc(int channel, int (*read)(void *ctx), void *ctx);
+
+// hold servo num (1-4) where it is whatever it is sent, as if jammed
+void sim_servo_stall(int num, Boolean stalled);
+
+// USB CDC endpoint on host file descriptors (-1 to leave unplugged)
+void sim_usb_fds(int in, int out);
+
+void sim_button(Boolean pressed);
+
+// Counters -------------------------------------------------------------------
+
+typedef struct
+{
+  uint64_t uart_rx_bytes;       // bytes that reached the RX buffer
+  uint64_t uart_rx_dropped;     // bytes lost to a full RX buffer
+  uint64_t uart_line_dropped;   // bytes a source sent faster than the baud rate carries
+  uint64_t uart_max_backlog;    // deepest RX buffer fill seen
+  uint64_t uart_max_wait_us;    // longest a byte sat in the RX buffer
+  uint64_t uart_max_gap_us;     // longest the firmware went without polling
+                                // UART2, from its first poll on
+  uint64_t tube_pulses;         // edges on the tube line while something listened
+  uint64_t ic_overflows;        // pulses lost to a full IC1 FIFO
+  uint64_t i2c_bus_us;          // time spent clocking the I2C bus
+  uint64_t i2c_bytes;
+  uint64_t sd_sector_reads;
+  uint64_t sd_sector_writes;
+  uint64_t sd_bytes_written;
+  uint64_t sd_opens;
+  uint64_t usb_bytes_out;
+  uint64_t usb_first_us;        // when the first and last USB packets left
+  uint64_t usb_last_us;
+  uint64_t isr_calls;
+} SimStats;
+
+extern SimStats sim_stats;
+
+void sim_reset_stats(void);
+
+#endif
@@ -0,0 +1,158 @@
+//What TRACE() costs per bus event, see bustrace.h
+//
+//Build:  cc -O2 -Isim -I. -o tracebench sim/tracebench.c bustrace.c bytes.c sim/nesi_sim.c -lm
+//
+//  tracebench [-n transfers]
+//
+//Replays the events of the biggest I2C transfer BORON2 makes, the 28 byte
+//snapshot save (a start, 29 bytes each with their ACK, a stop), into the
+//ring and times busTrace.put() against a call of an empty function the
+//same way, so what is left is the tracing itself.  Once with Timer1 in
+//one period throughout, the usual case, and once with a wrap before every
+//event, which is every event taking the period marker path.  Printed are
+//host ns and TSC cycles per event, and what the tracing adds to the 3 ms
+//the transfer spends on the bus.  That is host CPU time, not PIC24 cycles;
+//what carries over is that the usual path is a handful of loads and stores
+//next to a call, and that the wrap path costs about twice that but comes
+//at most once every 32.8 ms.  The ring is dumped at the end and its last
+//events checked against what was put.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <x86intrin.h>
+#include "bustrace.h"
+#include "bytes.h"
+
+#define SNAPSHOT_BYTES 29         // the RTC's address and 28 of its RAM
+#define SNAPSHOT_US    3000       // on the bus at 100 kHz
+#define EVENTS         (2 + 2*SNAPSHOT_BYTES)
+
+void _T1Interrupt(void);
+
+typedef struct
+{
+  unsigned char kind, data;
+} Step;
+
+static Step steps[EVENTS];
+
+static void nothing(unsigned char kind, unsigned char data)
+{
+  (void)kind;
+  (void)data;
+}
+
+// through a volatile pointer, so neither call is inlined or dropped
+static void (*volatile call)(unsigned char kind, unsigned char data);
+
+static double seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+// ns and cycles an event, out of the best of three runs
+static void run(void (*put)(unsigned char, unsigned char), long transfers, int wrap,
+                double *ns, double *cycles)
+{
+  double t, best = 1e30, bestCycles = 0;
+  uint64_t c;
+  long n;
+  int pass, i;
+
+  call = put;
+  for(pass = 0; pass < 3; pass++)
+  {
+    t = seconds();
+    c = __rdtsc();
+    for(n = 0; n < transfers; n++)
+      for(i = 0; i < EVENTS; i++)
+      {
+        if(wrap) _T1Interrupt();
+        call(steps[i].kind, steps[i].data);
+      }
+    c = __rdtsc() - c;
+    t = seconds() - t;
+    if(t < best)
+    {
+      best = t;
+      bestCycles = c;
+    }
+  }
+  *ns = best*1e9/((double)transfers*EVENTS);
+  *cycles = bestCycles/((double)transfers*EVENTS);
+}
+
+// the dump holds the last events put, in order, and nothing else
+static int check(void)
+{
+  unsigned char image[BUS_TRACE_DUMP];
+  int length = busTrace.dump(image), n, i, k;
+
+  n = bytes.get16(image + 14);
+  if(memcmp(image, "BTRC", 4) || length != BUS_TRACE_HEADER + 4*n || n != BUS_TRACE_EVENTS)
+    return 0;
+  for(i = n - 1, k = EVENTS - 1; i >= 0 && k >= 0; i--)
+  {
+    const unsigned char *e = image + BUS_TRACE_HEADER + 4*i;
+
+    if(e[2] == TRACE_PERIOD) continue;
+    if(e[2] != steps[k].kind || e[3] != steps[k].data) return 0;
+    k--;
+  }
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  long transfers = 200000;
+  double bare, bareCycles, ns, cycles, wrapBare, wrapBareCycles, wrapNs, wrapCycles;
+  int opt, i;
+
+  while((opt = getopt(argc, argv, "n:")) != -1)
+  {
+    if(opt != 'n') transfers = 0;
+    else transfers = atol(optarg);
+  }
+  if(transfers < 1 || optind != argc)
+  {
+    fprintf(stderr, "usage: tracebench [-n transfers]\n");
+    return 2;
+  }
+
+  steps[0].kind = TRACE_START;
+  for(i = 0; i < SNAPSHOT_BYTES; i++)
+  {
+    steps[1 + 2*i].kind = TRACE_WRITE;
+    steps[1 + 2*i].data = i ? 0x5A ^ i : 0xD0;
+    steps[2 + 2*i].kind = TRACE_ACK;
+  }
+  steps[EVENTS - 1].kind = TRACE_STOP;
+
+  busTrace.init();
+  run(nothing, transfers, 0, &bare, &bareCycles);
+  run(busTrace.put, transfers, 0, &ns, &cycles);
+  // the interrupt is in both, it comes out with the call
+  run(nothing, transfers/4 + 1, 1, &wrapBare, &wrapBareCycles);
+  run(busTrace.put, transfers/4 + 1, 1, &wrapNs, &wrapCycles);
+
+  printf("%ld snapshot saves, %d events each\n", transfers, EVENTS);
+  printf("%-26s %8s %8s\n", "", "ns", "cycles");
+  printf("%-26s %8.2f %8.1f\n", "empty call", bare, bareCycles);
+  printf("%-26s %8.2f %8.1f\n", "put(), same period", ns - bare, cycles - bareCycles);
+  printf("%-26s %8.2f %8.1f\n", "put(), new period", wrapNs - wrapBare, wrapCycles - wrapBareCycles);
+  printf("tracing a save: %.2f us of host time next to %d us on the bus\n",
+         (ns - bare)*EVENTS/1e3, SNAPSHOT_US);
+  if(!check())
+  {
+    printf("dump does not hold the last events put\n");
+    return 1;
+  }
+  printf("dump holds the last %d events in order\n", BUS_TRACE_EVENTS);
+  return 0;
+}
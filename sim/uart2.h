@@ -0,0 +1,19 @@
+//Host stand-in for the NESI+ UART2 module (uart2.h), see nesi_sim.c
+
+#ifndef UART2_H
+#define UART2_H
+
+#include "nesi.h"
+
+typedef struct
+{
+  void (*init)(void);
+  void (*baudrate)(long baud);
+  int (*size)(void);                          // bytes waiting in the RX buffer
+  int (*receive)(char *data, int length);     // returns bytes copied
+  int (*send)(const char *data, int length);
+} UART2;
+
+extern const UART2 uart2;
+
+#endif
@@ -0,0 +1,100 @@
+//Experiment progress kept in the RTC's RAM over a reset, see snapshot.h
+
+#include <nesi.h>
+#include <string.h>
+#include "snapshot.h"
+#include "bytes.h"
+
+#define START 21              // offsets in a slot
+#define CRC   26
+
+Snapshot snapshot;
+
+static unsigned char sequence;
+static int older;               // slot save() writes next
+
+static unsigned int crc16(const unsigned char *data, int length)
+{
+  unsigned int crc = 0xFFFF;
+  int bit;
+
+  while(length--)
+  {
+    crc ^= (unsigned int)*data++ << 8;
+    for(bit = 0; bit < 8; bit++)
+      crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc & 0xFFFF;
+}
+
+static Boolean good(const unsigned char *s)
+{
+  return crc16(s, CRC) == ((unsigned int)s[CRC] << 8 | s[CRC + 1]);
+}
+
+static Boolean load(RtcRam read)
+{
+  unsigned char ram[2*SNAPSHOT_SLOT], *s;
+  Boolean a, b;
+  int newer, i;
+
+  if(!read(SNAPSHOT_RAM, ram, sizeof(ram))) return 0;
+  a = good(ram);
+  b = good(ram + SNAPSHOT_SLOT);
+  if(!a && !b) return 0;
+
+  // with both good the newer is one sequence ahead, wrapping
+  newer = a && (!b || (signed char)(ram[0] - ram[SNAPSHOT_SLOT]) > 0) ? 0 : 1;
+  s = ram + newer*SNAPSHOT_SLOT;
+  older = !newer;
+  sequence = s[0];
+  snapshot.logged = bytes.get32(s + 1);
+  snapshot.rate = bytes.get32(s + 5)/256.0f;
+  snapshot.learned = bytes.get16(s + 9);
+  for(i = 0; i < 4; i++) snapshot.servoPos[i] = bytes.get16(s + 11 + 2*i);
+  snapshot.moves = s[19];
+  snapshot.motor = (signed char)s[20];
+  memset(&snapshot.start, 0, sizeof(snapshot.start));
+  snapshot.start.year = s[START];
+  snapshot.start.month = s[START + 1];
+  snapshot.start.day = s[START + 2];
+  snapshot.start.hour = s[START + 3];
+  snapshot.start.minute = s[START + 4];
+  return 1;
+}
+
+static Boolean of(DateAndTime t)
+{
+  DateAndTime *s = &snapshot.start;
+
+  return s->year == t.year && s->month == t.month && s->day == t.day &&
+         s->hour == t.hour && s->minute == t.minute;
+}
+
+static Boolean save(RtcRam write)
+{
+  unsigned char slot[SNAPSHOT_SLOT];
+  unsigned int crc;
+  int i;
+
+  slot[0] = ++sequence;
+  bytes.put32(slot + 1, snapshot.logged);
+  bytes.put32(slot + 5, (unsigned long)(snapshot.rate*256 + 0.5f));
+  bytes.put16(slot + 9, snapshot.learned);
+  for(i = 0; i < 4; i++) bytes.put16(slot + 11 + 2*i, snapshot.servoPos[i]);
+  slot[19] = snapshot.moves;
+  slot[20] = (unsigned char)snapshot.motor;
+  slot[START] = snapshot.start.year;
+  slot[START + 1] = snapshot.start.month;
+  slot[START + 2] = snapshot.start.day;
+  slot[START + 3] = snapshot.start.hour;
+  slot[START + 4] = snapshot.start.minute;
+  crc = crc16(slot, CRC);
+  slot[CRC] = crc >> 8;
+  slot[CRC + 1] = crc & 0xFF;
+  if(!write(SNAPSHOT_RAM + older*SNAPSHOT_SLOT, slot, SNAPSHOT_SLOT)) return 0;
+  older = !older;
+  return 1;
+}
+
+const SnapshotRam snapshotRam = {load, of, save};
@@ -0,0 +1,66 @@
+//Experiment progress kept in the RTC's RAM over a reset
+//
+//Which servo moves were done and where the servos were left lived only in
+//main()'s variables, so a reset ran increment0()'s 12 second sweep again,
+//or replayed the later moves, and the sampler learnt its baseline anew.
+//snapshot holds that progress.  BORON2 saves it after every move and every
+//config.progress samples, and load() takes it back in one I2C read at
+//boot; it is only used if START.TXT shows the same experiment.
+//
+//The DS1307's 56 bytes of battery backed RAM (registers 8-63) hold two
+//slots of SNAPSHOT_SLOT bytes:
+//
+//  0  sequence       one more than the other slot's when it was written
+//  1  logged         32 bit little endian, like the rest
+//  5  rate           in 1/256 counts a second, 32 bit
+//  9  learned        16 bit
+//  11 servoPos       4 times 16 bit
+//  19 moves
+//  20 motor
+//  21 start          year, month, day, hour and minute the experiment began
+//  26 crc            CRC-16/CCITT of bytes 0-25, big endian
+//
+//save() writes the older slot, so a power cut in the middle of it leaves
+//the other one good; load() takes the newer of the good ones.
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <nesi.h>
+
+#define SNAPSHOT_RAM  8             // first RAM register of the RTC
+#define SNAPSHOT_SLOT 28
+
+typedef struct
+{
+  unsigned long logged;             // log blocks when it was saved
+  float rate;                       // sampler baseline, counts a second
+  unsigned int learned;             // seconds behind rate, at most 65535
+  unsigned int servoPos[4];         // pulse each servo was left at, us
+  unsigned char moves;              // bit n set once incrementn() ran
+  signed char motor;                // CurServo
+  DateAndTime start;                // of the experiment, to the minute
+} Snapshot;
+
+extern Snapshot snapshot;
+
+// length bytes of the RTC from register address on, returns 0 if it did
+// not answer
+typedef Boolean (*RtcRam)(unsigned char address, unsigned char *data, int length);
+
+typedef struct
+{
+  // both slots in one read, snapshot gets the newer good one; returns 0
+  // if neither is good and leaves snapshot alone
+  Boolean (*load)(RtcRam read);
+
+  // whether snapshot is of the experiment begun at start
+  Boolean (*of)(DateAndTime start);
+
+  // snapshot over the older slot, returns 0 if the RTC did not answer
+  Boolean (*save)(RtcRam write);
+} SnapshotRam;
+
+extern const SnapshotRam snapshotRam;
+
+#endif
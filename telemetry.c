@@ -0,0 +1,136 @@
+//Live telemetry, see telemetry.h
+
+#include <nesi.h>
+#include "telemetry.h"
+#include "format.h"
+
+static volatile char slot[TELEMETRY_SLOTS][TELEMETRY_RECORD];
+static volatile unsigned int head;      // records pushed, written by push() only
+
+static unsigned long taken;             // records consumed, service() only
+static unsigned long drops, dropsSent;
+static Boolean running;
+
+static char line[TELEMETRY_RECORD + 16];
+static int lineLength, lineSent;
+
+static void push(String record)
+{
+  unsigned int h = head;
+  volatile char *s = slot[h % TELEMETRY_SLOTS];
+  int n = 0;
+
+  for(; *record && n < TELEMETRY_RECORD - 1; record++)
+    if(*record != '\n' && *record != '\r' && *record != '\t')
+      s[n++] = *record;
+  s[n] = 0;
+
+  head = h + 1;   // publish only once the record is complete
+}
+
+// records waiting, with the loss of whatever the producer lapped; the
+// slot of record head is push()'s to write, so at most SLOTS - 1 wait
+static unsigned int pending(void)
+{
+  unsigned int waiting = head - (unsigned int)taken;
+
+  if(waiting >= TELEMETRY_SLOTS)
+  {
+    drops += waiting - (TELEMETRY_SLOTS - 1);
+    taken += waiting - (TELEMETRY_SLOTS - 1);
+    waiting = TELEMETRY_SLOTS - 1;
+  }
+  return waiting;
+}
+
+// format the next record into line, 0 if there is none
+static Boolean next(void)
+{
+  volatile char *s;
+  Line out;
+  int n;
+
+  while(pending())
+  {
+    s = slot[taken % TELEMETRY_SLOTS];
+    format.begin(&out, line, sizeof(line));
+    format.number(&out, taken);
+    format.character(&out, ',');
+    n = out.length;
+    while(*s && n < (int)sizeof(line) - 2) line[n++] = *s++;
+    line[n++] = '\n';
+
+    // head moved on to this slot while copying, so push() wrote into it:
+    // the copy may be torn, it is counted as lost
+    if((unsigned int)(head - (unsigned int)taken) >= TELEMETRY_SLOTS)
+    {
+      drops++;
+      taken++;
+      continue;
+    }
+
+    taken++;
+    lineLength = n;
+    lineSent = 0;
+    return 1;
+  }
+
+  if(drops != dropsSent)
+  {
+    format.begin(&out, line, sizeof(line));
+    format.text(&out, "#dropped,");
+    format.number(&out, drops);
+    format.character(&out, '\n');
+    lineLength = out.length;
+    lineSent = 0;
+    dropsSent = drops;
+    return 1;
+  }
+  return 0;
+}
+
+static void service(void)
+{
+  if(!running) return;
+
+  usb.process();
+  while(usb.isConnected())
+  {
+    if(lineSent == lineLength && !next()) return;
+    lineSent += usb.write(line + lineSent, lineLength - lineSent);
+    if(lineSent < lineLength) return;   // endpoint full, carry on next time
+  }
+}
+
+static void start(void)
+{
+  taken = head;
+  drops = dropsSent = 0;
+  lineLength = lineSent = 0;
+  usb.connect();
+  running = 1;
+}
+
+static void stop(void)
+{
+  running = 0;
+  usb.disconnect();
+}
+
+static Boolean isRunning(void)
+{
+  return running;
+}
+
+static Boolean atLineEnd(void)
+{
+  return lineSent == lineLength;
+}
+
+static unsigned long dropped(void)
+{
+  pending();
+  return drops;
+}
+
+const Telemetry telemetry = {start, stop, isRunning, push, service, atLineEnd, dropped};
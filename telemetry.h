@@ -0,0 +1,51 @@
+//Live telemetry over USB CDC while the experiment keeps logging
+//
+//Every record written to the SD log is also pushed into a ring of
+//TELEMETRY_SLOTS - 1 records.  push() never waits: when the host falls behind
+//it overwrites the oldest record, and the loss is counted and reported to
+//the host instead.  service() sends whatever the USB endpoint will take
+//and returns, so monitoring never holds up sampling.  tools/telview shows
+//the stream.
+//
+//The ring is single producer, single consumer and lock free: only push()
+//writes head, and only service() moves the read position, so push() may
+//also be called from an interrupt.  The slot push() writes next is never
+//read, and service() checks head again once it copied a record out,
+//dropping the copy if push() reached its slot meanwhile.  Each record goes out as one line:
+//
+//  <sequence>,<record>\n   or   #dropped,<total>\n
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <nesi.h>
+
+#define TELEMETRY_SLOTS  16       // power of two
+#define TELEMETRY_RECORD 80       // longest record kept, longer ones are cut
+
+typedef struct
+{
+  // connect USB and stream records pushed from now on
+  void (*start)(void);
+
+  // stop streaming and disconnect USB
+  void (*stop)(void);
+
+  Boolean (*isRunning)(void);
+
+  // queue a record, never blocks; line breaks and tabs are dropped
+  void (*push)(String record);
+
+  // move queued records to USB, call from the main loop
+  void (*service)(void);
+
+  // no line is half way out, so another stream may take the USB
+  Boolean (*atLineEnd)(void);
+
+  // records lost to a full ring since start()
+  unsigned long (*dropped)(void);
+} Telemetry;
+
+extern const Telemetry telemetry;
+
+#endif
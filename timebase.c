@@ -0,0 +1,238 @@
+//Time of day and uptime from the RTC's 1 Hz square wave, see timebase.h
+
+#include <nesi.h>
+#include "timebase.h"
+
+#define TB_TICKS   (FCY/256)    // Timer3 ticks a second, nominal
+#define INT1_INPUT 0            // RPINR0<12:8>
+#define INT1EP     0x0002       // INTCON2, interrupt on falling edges
+
+static volatile unsigned long seconds;    // Timer3 periods since reset
+
+static Boolean synced;
+static DateAndTime current;               // the time once at edges had come
+static unsigned long at;
+
+// written by the INT1 ISR only
+static volatile unsigned long edges;      // RTC seconds since sync()
+static volatile unsigned long edgeSeconds, base;
+static volatile unsigned int edgeTicks;   // Timer3 at the last edge
+static volatile long perSecond;           // ticks an RTC second, times 16
+
+void __attribute__((interrupt, no_auto_psv)) _T3Interrupt(void)
+{
+  IFS0bits.T3IF = 0;
+  seconds++;
+}
+
+// Timer3 ms between two readings of it
+static long ticksMs(unsigned long s, unsigned int t, unsigned long s0, unsigned int t0)
+{
+  return (long)(s - s0)*1000 + ((long)t - (long)t0)*256/(long)(FCY/1000);
+}
+
+// Timer3 ms as the RTC's, by the ticks its seconds last measured
+static unsigned long rtcMs(long ms)
+{
+  return (unsigned long)((float)ms*(16.0f*TB_TICKS)/perSecond);
+}
+
+// seconds and ticks of Timer3 as they stand
+static void timer3(unsigned long *s, unsigned int *t)
+{
+  do
+  {
+    *s = seconds;
+    *t = TMR3;
+  } while(*s != seconds);   // the second rolled over meanwhile
+}
+
+// INT1 ISR, every falling edge of SQW.  Its priority is above Timer3's, so
+// a Timer3 period that just ended may not be counted yet.  millis() moves
+// ahead to the next whole second at the first edge, so its seconds turn
+// with the RTC's from then on.  An edge too
+// soon after the last is noise; one long after counts the seconds Timer3
+// says passed, the RTC kept counting while its edges went missing.
+void __attribute__((interrupt, no_auto_psv)) _INT1Interrupt(void)
+{
+  unsigned long s = seconds, n;
+  unsigned int t = TMR3;
+  long measured = 0;
+
+  IFS1bits.INT1IF = 0;
+  if(IFS0bits.T3IF && t < TB_TICKS/2) s++;
+
+  if(!edges)
+  {
+    base = (ticksMs(s, t, 0, 0) + 999)/1000*1000 - 1000;
+    n = 1;
+  }
+  else if(s - edgeSeconds < 64)
+  {
+    measured = (long)(s - edgeSeconds)*TB_TICKS + (long)t - (long)edgeTicks;
+    n = (measured*16 + perSecond/2)/perSecond;
+  }
+  else
+    n = (rtcMs(ticksMs(s, t, edgeSeconds, edgeTicks)) + 500)/1000;
+  if(!n) return;
+
+  if(n == 1 && edges) perSecond += measured - perSecond/16;
+  edges += n;
+  edgeSeconds = s;
+  edgeTicks = t;
+}
+
+static void init(void)
+{
+  seconds = 0;
+  synced = 0;
+  edges = 0;
+  perSecond = 16L*TB_TICKS;
+
+  // Timer3 counts time since reset: 1:256 prescale, one interrupt a second
+  T3CON = 0x0000;
+  TMR3 = 0;
+  PR3 = TB_TICKS - 1;
+  IPC2bits.T3IP = 1;
+  IFS0bits.T3IF = 0;
+  IEC0bits.T3IE = 1;
+  T3CON = 0x8030;   // on, 1:256
+}
+
+// the RTC answers 0xFF everywhere when it is missing
+static Boolean valid(DateAndTime t)
+{
+  return t.month >= 1 && t.month <= 12 && t.day >= 1 && t.day <= 31 &&
+         t.hour < 24 && t.minute < 60 && t.second < 60;
+}
+
+static Boolean sync(DateAndTime (*readRtc)(void), int rpPin)
+{
+  volatile unsigned int *rpinr = &RPINR0;
+  unsigned long seen, s;
+  unsigned int t;
+  int tries;
+
+  __builtin_write_OSCCONL(OSCCON & 0xBF);   // unlock pin select
+  rpinr[INT1_INPUT] = (rpinr[INT1_INPUT] & ~0x1F00) | (rpPin & 0x1F) << 8;
+  __builtin_write_OSCCONL(OSCCON | 0x40);   // lock again
+
+  // the edges count from the read, the first one stands in until then
+  IEC1bits.INT1IE = 0;
+  synced = 0;
+  edges = 0;
+  timer3(&s, &t);
+  edgeSeconds = s;
+  edgeTicks = t;
+  INTCON2 |= INT1EP;
+  IPC5bits.INT1IP = 2;
+  IFS1bits.INT1IF = 0;
+  IEC1bits.INT1IE = 1;
+
+  // an edge during the read leaves it unclear which second it saw
+  for(tries = 0; tries < 3; tries++)
+  {
+    seen = edges;
+    current = readRtc();
+    if(edges == seen) break;
+  }
+  if(!valid(current))
+  {
+    IEC1bits.INT1IE = 0;
+    return 0;
+  }
+  at = seen;
+  synced = 1;
+  return 1;
+}
+
+// the edges so far and the Timer3 ticks and ms since the last; 0 if that
+// was over two seconds ago
+static Boolean sinceEdge(unsigned long *count, unsigned long *ticks, long *ms)
+{
+  unsigned long e, es, s;
+  unsigned int et, t;
+
+  do
+  {
+    e = edges;
+    es = edgeSeconds;
+    et = edgeTicks;
+  } while(e != edges);
+  timer3(&s, &t);
+
+  *count = e;
+  *ms = ticksMs(s, t, es, et);
+  *ticks = (s - es)*TB_TICKS + t - et;
+  return s - es <= 2 && *ticks < 2*((unsigned long)perSecond/16);
+}
+
+static unsigned long millis(void)
+{
+  unsigned long count, ticks, ms;
+  unsigned int t;
+  long since;
+
+  if(!sinceEdge(&count, &ticks, &since) || !count)
+  {
+    if(count) return base + count*1000 + rtcMs(since);   // Timer3 alone
+    timer3(&ms, &t);
+    return ticksMs(ms, t, 0, 0);
+  }
+
+  // within a second of the edge, in the RTC's milliseconds
+  ms = ticks*16000/perSecond;
+  return base + count*1000 + (ms > 999 ? 999 : ms);
+}
+
+static Boolean locked(void)
+{
+  unsigned long count, ticks;
+  long since;
+
+  return synced && sinceEdge(&count, &ticks, &since);
+}
+
+// one second on, month and leap year carries included (2000-2099)
+static void step(DateAndTime *t)
+{
+  static const unsigned char days[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+  if(++t->second < 60) return;
+  t->second = 0;
+  if(++t->minute < 60) return;
+  t->minute = 0;
+  if(++t->hour < 24) return;
+  t->hour = 0;
+  t->weekday = (t->weekday + 1) % 7;
+  if(++t->day <= days[t->month - 1] + (t->month == 2 && t->year % 4 == 0)) return;
+  t->day = 1;
+  if(++t->month <= 12) return;
+  t->month = 1;
+  t->year++;
+}
+
+static DateAndTime now(void)
+{
+  unsigned long count, ticks;
+  long since;
+
+  if(!synced) return dateTime.get();
+  if(!sinceEdge(&count, &ticks, &since)) count += rtcMs(since)/1000;   // no edges, Timer3 goes on
+  while(at < count)
+  {
+    step(&current);
+    at++;
+  }
+  return current;
+}
+
+static long drift(void)
+{
+  long p;
+
+  do p = perSecond; while(p != perSecond);
+  return (long)((float)(p - 16L*TB_TICKS)*1e6f/(16.0f*TB_TICKS));
+}
+
+const Timebase timebase = {init, sync, millis, now, locked, drift};
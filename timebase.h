@@ -0,0 +1,52 @@
+//Time of day and uptime from the RTC's 1 Hz square wave
+//
+//Reading the DS1307 over I2C for every sample costs a dozen bus transfers
+//and only knows whole seconds.  Instead the RTC is read once at boot and
+//its SQW/OUT pin, set to 1 Hz, is wired to INT1 through pin select: every
+//falling edge is one RTC second, when its counters roll over.  Timer3 runs
+//alongside at FCY/256 and fills in between edges.
+//
+//The MCU oscillator is only good to a few percent, the RTC crystal to
+//tens of ppm, so the Timer3 ticks between edges are measured and averaged
+//and millis() counts RTC seconds, each scaled by that measure.  It carries
+//on from Timer3 alone before the first edge and when the edges stop.
+//
+//now() is the RTC time read at sync() stepped by the edges counted since,
+//so it never touches the bus.  Without an RTC, sync() fails and now() is
+//dateTime.get(), the software clock BORON2 sets from TIME.TXT.
+
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#include <nesi.h>
+
+#ifndef RTC_SQW_RP
+#define RTC_SQW_RP 12               // RPn pin the RTC's SQW/OUT is on
+#endif
+
+typedef struct
+{
+  // start Timer3 counting time since reset
+  void (*init)(void);
+
+  // take the time from readRtc and follow the edges on remappable pin
+  // RPn; readRtc is tried again if an edge fell in the read.  Returns 0
+  // if it does not give a valid time, now() is then dateTime.get()
+  Boolean (*sync)(DateAndTime (*readRtc)(void), int rpPin);
+
+  // milliseconds since reset, in RTC seconds once edges come in
+  unsigned long (*millis)(void);
+
+  // the time of day without asking the RTC
+  DateAndTime (*now)(void);
+
+  // whether an edge came within the last two seconds
+  Boolean (*locked)(void);
+
+  // how fast Timer3 runs against the RTC, parts per million
+  long (*drift)(void);
+} Timebase;
+
+extern const Timebase timebase;
+
+#endif
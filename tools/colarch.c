@@ -0,0 +1,472 @@
+//Columnar archive of fleet records, see colarch.h
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "colarch.h"
+
+static const char magic[8] = "B2COL1";
+
+// Building -------------------------------------------------------------------
+
+static uint32_t bits(uint64_t v)
+{
+  return v ? 64 - __builtin_clzll(v) : 0;
+}
+
+static int64_t value(const FleetRecord *r, int column)
+{
+  switch(column)
+  {
+    case COL_TIME: return r->time;
+    case COL_NODE: return r->node;
+    case COL_CPM: return r->cpm;
+    case COL_SECS: return r->secs;
+    default: return r->motor;
+  }
+}
+
+static int pad(FILE *f)
+{
+  static const char zero[8];
+  long at = ftell(f);
+
+  return at < 0 || fwrite(zero, 1, (8 - at % 8) % 8, f) != (size_t)(8 - at % 8) % 8;
+}
+
+// one column of n records at the end of f
+static int packColumn(FILE *f, const FleetRecord *r, uint32_t n, int column, ColChunk *c)
+{
+  ColColumn *col = &c->column[column];
+  uint64_t *words, v, spread = 0, bit;
+  uint32_t i;
+  int failed;
+
+  c->min[column] = c->max[column] = value(r, column);
+  for(i = 1; i < n; i++)
+  {
+    v = value(&r[i], column);
+    if((int64_t)v < c->min[column]) c->min[column] = v;
+    if((int64_t)v > c->max[column]) c->max[column] = v;
+    if(column == COL_TIME && v - value(&r[i - 1], column) > spread) spread = v - value(&r[i - 1], column);
+  }
+  if(column != COL_TIME) spread = c->max[column] - c->min[column];
+
+  col->base = column == COL_TIME ? value(r, column) : c->min[column];
+  col->width = bits(spread);
+  col->words = ((uint64_t)n*col->width + 63)/64;
+  col->offset = ftell(f);
+  if(!col->words) return 0;
+
+  words = calloc(col->words + 1, sizeof(uint64_t));
+  if(!words) return -1;
+  for(i = 0; i < n; i++)
+  {
+    if(column == COL_TIME)
+      v = i ? value(&r[i], column) - value(&r[i - 1], column) : 0;
+    else
+      v = value(&r[i], column) - col->base;
+    bit = (uint64_t)i*col->width;
+    words[bit/64] |= v << bit % 64;
+    if(bit % 64 + col->width > 64) words[bit/64 + 1] |= v >> (64 - bit % 64);
+  }
+  failed = fwrite(words, sizeof(uint64_t), col->words, f) != col->words;
+  free(words);
+  return failed ? -1 : 0;
+}
+
+static int byNode(const void *a, const void *b)
+{
+  const FleetRecord *x = a, *y = b;
+
+  if(x->node != y->node) return x->node < y->node ? -1 : 1;
+  return x->time < y->time ? -1 : x->time > y->time;
+}
+
+int col_build(const char *path, const FleetLog *log, const char *const *names, int nodes)
+{
+  ColHeader h;
+  ColChunk *chunks = NULL, *grown;
+  ColMark mark;
+  FleetRecord *r;
+  FILE *f = fopen(path, "wb");
+  uint64_t row, start, end;
+  uint32_t c, cap = 0;
+  int i, failed = 0;
+
+  if(!f)
+  {
+    fprintf(stderr, "colarch: cannot create %s\n", path);
+    return -1;
+  }
+  r = malloc((log->count ? log->count : 1)*sizeof(FleetRecord));
+  if(!r)
+  {
+    fprintf(stderr, "colarch: out of memory\n");
+    fclose(f);
+    return -1;
+  }
+  memcpy(r, log->records, log->count*sizeof(FleetRecord));
+  qsort(r, log->count, sizeof(FleetRecord), byNode);
+
+  // chunks end at COL_CHUNK_ROWS or at the next node
+  memset(&h, 0, sizeof(h));
+  for(start = 0; start < log->count; start = end)
+  {
+    for(end = start; end < log->count && end - start < COL_CHUNK_ROWS && r[end].node == r[start].node; end++)
+      ;
+    if(h.chunks == cap)
+    {
+      cap = cap ? 2*cap : 64;
+      grown = realloc(chunks, cap*sizeof(ColChunk));
+      if(!grown)
+      {
+        fprintf(stderr, "colarch: out of memory\n");
+        free(chunks);
+        free(r);
+        fclose(f);
+        return -1;
+      }
+      chunks = grown;
+    }
+    memset(&chunks[h.chunks], 0, sizeof(ColChunk));
+    chunks[h.chunks].firstRow = start;
+    chunks[h.chunks].rows = end - start;
+    chunks[h.chunks].firstMark = h.marks;
+    chunks[h.chunks].marks = (end - start + COL_STRIDE - 1)/COL_STRIDE;
+    h.marks += chunks[h.chunks].marks;
+    h.chunks++;
+  }
+
+  memcpy(h.magic, magic, sizeof(magic));
+  h.rows = log->count;
+  h.nodes = nodes;
+  h.chunkRows = COL_CHUNK_ROWS;
+  h.stride = COL_STRIDE;
+  failed |= fwrite(&h, sizeof(h), 1, f) != 1;
+  h.namesOffset = ftell(f);
+  for(i = 0; i < nodes; i++)
+    failed |= fwrite(names[i], 1, strlen(names[i]) + 1, f) != strlen(names[i]) + 1;
+  failed |= pad(f);
+
+  // the directory goes in once the columns are placed
+  h.chunksOffset = ftell(f);
+  failed |= fwrite(chunks, sizeof(ColChunk), h.chunks, f) != h.chunks;
+  for(c = 0; c < h.chunks && !failed; c++)
+    for(i = 0; i < COL_COLUMNS && !failed; i++)
+      failed |= packColumn(f, r + chunks[c].firstRow, chunks[c].rows, i, &chunks[c]);
+
+  h.indexOffset = ftell(f);
+  for(c = 0; c < h.chunks && !failed; c++)
+    for(row = 0; row < chunks[c].rows; row += COL_STRIDE)
+    {
+      mark.time = r[chunks[c].firstRow + row].time;
+      mark.row = chunks[c].firstRow + row;
+      failed |= fwrite(&mark, sizeof(mark), 1, f) != 1;
+    }
+
+  failed |= fseek(f, 0, SEEK_SET) || fwrite(&h, sizeof(h), 1, f) != 1;
+  failed |= fseek(f, h.chunksOffset, SEEK_SET) || fwrite(chunks, sizeof(ColChunk), h.chunks, f) != h.chunks;
+  failed |= fclose(f) != 0;
+  free(chunks);
+  free(r);
+  if(failed) fprintf(stderr, "colarch: cannot write %s\n", path);
+  return failed ? -1 : 0;
+}
+
+// Reading --------------------------------------------------------------------
+
+int col_open(const char *path, ColArchive *a)
+{
+  struct stat st;
+  const char *p;
+  uint32_t i;
+  int fd = open(path, O_RDONLY);
+
+  memset(a, 0, sizeof(*a));
+  if(fd < 0 || fstat(fd, &st) || (size_t)st.st_size < sizeof(ColHeader))
+  {
+    fprintf(stderr, "colarch: cannot open %s\n", path);
+    if(fd >= 0) close(fd);
+    return -1;
+  }
+  a->size = st.st_size;
+  a->map = mmap(NULL, a->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(a->map == MAP_FAILED)
+  {
+    fprintf(stderr, "colarch: cannot map %s\n", path);
+    a->map = NULL;
+    return -1;
+  }
+
+  a->header = (const ColHeader *)a->map;
+  if(memcmp(a->header->magic, magic, sizeof(magic)) || a->header->chunkRows != COL_CHUNK_ROWS ||
+     a->header->stride != COL_STRIDE ||
+     a->header->chunksOffset + (uint64_t)a->header->chunks*sizeof(ColChunk) > a->size ||
+     a->header->indexOffset + a->header->marks*sizeof(ColMark) > a->size)
+  {
+    fprintf(stderr, "colarch: %s is not an archive\n", path);
+    col_close(a);
+    return -1;
+  }
+  a->chunks = (const ColChunk *)(a->map + a->header->chunksOffset);
+  a->marks = (const ColMark *)(a->map + a->header->indexOffset);
+
+  a->names = calloc(a->header->nodes + 1, sizeof(char *));
+  p = (const char *)a->map + a->header->namesOffset;
+  for(i = 0; i < a->header->nodes; i++)
+  {
+    a->names[i] = p;
+    p += strnlen(p, (const char *)a->map + a->size - p) + 1;
+  }
+  return 0;
+}
+
+void col_close(ColArchive *a)
+{
+  if(a->map) munmap((void *)a->map, a->size);
+  free(a->names);
+  memset(a, 0, sizeof(*a));
+}
+
+static uint64_t unpack(const uint64_t *words, uint32_t width, uint64_t i)
+{
+  uint64_t bit = i*width, v;
+  uint32_t shift = bit % 64;
+
+  if(!width) return 0;
+  v = words[bit/64] >> shift;
+  if(shift + width > 64) v |= words[bit/64 + 1] << (64 - shift);
+  return width == 64 ? v : v & ((1ULL << width) - 1);
+}
+
+// Grouping -------------------------------------------------------------------
+
+typedef struct
+{
+  ColResult *r;
+  uint32_t *slots;      // index + 1 into r->groups, 0 if free
+  size_t size, cap;
+  size_t last;          // index + 1 of the group found last, runs of
+                        // records mostly fall in one
+} Groups;
+
+static uint64_t hash(int64_t key)
+{
+  return (uint64_t)key*0x9E3779B97F4A7C15ULL;
+}
+
+static ColGroup *group(Groups *g, int64_t key)
+{
+  size_t i, mask = g->size - 1;
+  uint32_t *old;
+  size_t oldSize, k;
+  ColGroup *n;
+
+  if(g->last && g->r->groups[g->last - 1].key == key) return &g->r->groups[g->last - 1];
+  for(i = hash(key) >> 40 & mask; g->slots[i]; i = (i + 1) & mask)
+    if(g->r->groups[g->slots[i] - 1].key == key)
+    {
+      g->last = g->slots[i];
+      return &g->r->groups[g->last - 1];
+    }
+
+  if(g->r->count == g->cap)
+  {
+    g->cap *= 2;
+    g->r->groups = realloc(g->r->groups, g->cap*sizeof(ColGroup));
+  }
+  n = &g->r->groups[g->r->count++];
+  memset(n, 0, sizeof(*n));
+  n->key = key;
+  n->min = UINT32_MAX;
+  g->slots[i] = g->last = g->r->count;
+
+  if(2*g->r->count > g->size)
+  {
+    old = g->slots;
+    oldSize = g->size;
+    g->size *= 2;
+    g->slots = calloc(g->size, sizeof(uint32_t));
+    mask = g->size - 1;
+    for(k = 0; k < oldSize; k++)
+      if(old[k])
+      {
+        for(i = hash(g->r->groups[old[k] - 1].key) >> 40 & mask; g->slots[i]; i = (i + 1) & mask)
+          ;
+        g->slots[i] = old[k];
+      }
+    free(old);
+  }
+  return n;
+}
+
+static void add(ColGroup *c, uint32_t cpm, uint32_t secs)
+{
+  double w = secs ? secs : 1;
+
+  c->records++;
+  c->weight += w;
+  c->sum += cpm*w;
+  if(cpm < c->min) c->min = cpm;
+  if(cpm > c->max) c->max = cpm;
+}
+
+static void begin(Groups *g, ColResult *r)
+{
+  memset(r, 0, sizeof(*r));
+  g->r = r;
+  g->size = 64;
+  g->cap = 32;
+  g->last = 0;
+  g->slots = calloc(g->size, sizeof(uint32_t));
+  r->groups = malloc(g->cap*sizeof(ColGroup));
+}
+
+static int byKey(const void *a, const void *b)
+{
+  int64_t x = ((const ColGroup *)a)->key, y = ((const ColGroup *)b)->key;
+
+  return x < y ? -1 : x > y;
+}
+
+static void end(Groups *g)
+{
+  free(g->slots);
+  qsort(g->r->groups, g->r->count, sizeof(ColGroup), byKey);
+}
+
+static int64_t day(int64_t t)
+{
+  return t >= 0 ? t/86400 : (t - 86399)/86400;
+}
+
+static int64_t keyOf(int by, int64_t time, int64_t node, int64_t motor)
+{
+  switch(by)
+  {
+    case COL_BY_MOTOR: return motor;
+    case COL_BY_DAY: return day(time);
+    case COL_BY_NODE: return node;
+    default: return 0;
+  }
+}
+
+// Queries --------------------------------------------------------------------
+
+// rows of chunk c before the first one at from or later can be skipped from
+// the mark at or before it; sets the row to start at and its time
+static uint64_t startRow(const ColArchive *a, const ColChunk *c, int64_t from, int64_t *time)
+{
+  uint64_t lo = c->firstMark, hi = c->firstMark + c->marks, mid;
+
+  // first mark at from or later, the one before it is still before from
+  while(lo < hi)
+  {
+    mid = lo + (hi - lo)/2;
+    if(a->marks[mid].time < from) lo = mid + 1;
+    else hi = mid;
+  }
+  if(lo > c->firstMark + 1)
+  {
+    *time = a->marks[lo - 1].time;
+    return a->marks[lo - 1].row - c->firstRow;
+  }
+  *time = c->column[COL_TIME].base;
+  return 0;
+}
+
+int col_query(const ColArchive *a, const ColQuery *q, ColResult *r)
+{
+  const ColChunk *c;
+  const uint64_t *w[COL_COLUMNS];
+  uint64_t lo, j, first;
+  int64_t t, node = 0, motor = 0;
+  uint32_t i, cpm, secs;
+  int used[COL_COLUMNS];
+  Groups g;
+
+  begin(&g, r);
+
+  // the columns this query reads, the others stay unmapped
+  used[COL_TIME] = used[COL_CPM] = used[COL_SECS] = 1;
+  used[COL_NODE] = q->node >= 0 || q->by == COL_BY_NODE;
+  used[COL_MOTOR] = q->motor != FLEET_NO_MOTOR || q->by == COL_BY_MOTOR;
+
+  for(lo = 0; lo < a->header->chunks; lo++)
+  {
+    c = &a->chunks[lo];
+    if(c->max[COL_TIME] < q->from || c->min[COL_TIME] >= q->to ||
+       (q->node >= 0 && (q->node < c->min[COL_NODE] || q->node > c->max[COL_NODE])) ||
+       (q->motor != FLEET_NO_MOTOR && (q->motor < c->min[COL_MOTOR] || q->motor > c->max[COL_MOTOR])))
+    {
+      r->chunksSkipped++;
+      continue;
+    }
+    r->chunksRead++;
+    for(i = 0; i < COL_COLUMNS; i++)
+      w[i] = (const uint64_t *)(a->map + c->column[i].offset);
+
+    first = startRow(a, c, q->from, &t);
+    for(j = first; j < c->rows; j++)
+    {
+      if(j > first) t += unpack(w[COL_TIME], c->column[COL_TIME].width, j);
+      if(t < q->from) continue;
+      if(t >= q->to) break;
+      r->rows++;
+      if(used[COL_NODE])
+      {
+        node = c->column[COL_NODE].base + unpack(w[COL_NODE], c->column[COL_NODE].width, j);
+        if(q->node >= 0 && node != q->node) continue;
+      }
+      if(used[COL_MOTOR])
+      {
+        motor = c->column[COL_MOTOR].base + unpack(w[COL_MOTOR], c->column[COL_MOTOR].width, j);
+        if(q->motor != FLEET_NO_MOTOR && motor != q->motor) continue;
+      }
+      cpm = c->column[COL_CPM].base + unpack(w[COL_CPM], c->column[COL_CPM].width, j);
+      secs = c->column[COL_SECS].base + unpack(w[COL_SECS], c->column[COL_SECS].width, j);
+      add(group(&g, keyOf(q->by, t, node, motor)), cpm, secs);
+    }
+    for(i = 0; i < COL_COLUMNS; i++)
+      if(used[i]) r->bytes += ((j - first)*c->column[i].width + 7)/8;
+  }
+  end(&g);
+  return 0;
+}
+
+int col_query_records(const FleetRecord *records, size_t count, const ColQuery *q, ColResult *r)
+{
+  size_t lo = 0, hi = count, mid;
+  const FleetRecord *p;
+  Groups g;
+
+  begin(&g, r);
+  while(lo < hi)
+  {
+    mid = lo + (hi - lo)/2;
+    if(records[mid].time < q->from) lo = mid + 1;
+    else hi = mid;
+  }
+  for(p = records + lo; p < records + count && p->time < q->to; p++)
+  {
+    r->rows++;
+    if(q->node >= 0 && p->node != q->node) continue;
+    if(q->motor != FLEET_NO_MOTOR && p->motor != q->motor) continue;
+    add(group(&g, keyOf(q->by, p->time, p->node, p->motor)), p->cpm, p->secs);
+  }
+  r->bytes = (p - records - lo)*sizeof(FleetRecord);
+  end(&g);
+  return 0;
+}
+
+void col_result_free(ColResult *r)
+{
+  free(r->groups);
+  memset(r, 0, sizeof(*r));
+}
@@ -0,0 +1,131 @@
+//Columnar archive of fleet records, for queries that do not re-read logs
+//
+//fleetlog.h turns a fleet's logs into one time ordered stream of
+//(time, node, cpm, secs, motor) records.  An archive keeps them node by
+//node, each node's in time order, as columns in chunks of at most
+//COL_CHUNK_ROWS records that never span two nodes:
+//
+//  time    first value, then the gaps to the record before, bit packed
+//  others  the chunk's minimum, then each value less it, bit packed
+//
+//every column at the narrowest width its chunk needs, so a chunk whose
+//motor never moved spends no bits on it.  Each chunk's directory entry holds
+//the min and max of every column (its zone map) and where its columns
+//are; a sparse time index holds the time of every COL_STRIDE'th record of
+//each chunk.
+//
+//The file is made to be mapped: a query skips every chunk whose zone
+//maps rule out its time range, node or motor, which with chunks cut by
+//node and time leaves few, binary searches the time index of the rest
+//for where its range starts, and unpacks only the columns it needs from
+//there.  Pages of columns it does not use are never touched.
+//
+//  0   header       magic "B2COL1\0\0", counts and section offsets
+//      names        node names, 0 terminated, one after the other
+//      chunks       ColChunk directory, then the column words of each chunk
+//      index        ColMark every COL_STRIDE records of each chunk
+//
+//Everything is little endian and 8 byte aligned; the tools only run on
+//little endian hosts.
+
+#ifndef COLARCH_H
+#define COLARCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "fleetlog.h"
+
+#define COL_CHUNK_ROWS  65536
+#define COL_STRIDE      1024
+#define COL_COLUMNS     5
+
+enum { COL_TIME, COL_NODE, COL_CPM, COL_SECS, COL_MOTOR };
+
+typedef struct
+{
+  uint64_t offset;      // of the first 64 bit word in the file
+  uint32_t words;
+  uint32_t width;       // bits a value, 0 if all equal the base
+  int64_t base;         // first time, or minimum of the column
+} ColColumn;
+
+typedef struct
+{
+  uint64_t firstRow;
+  uint32_t rows;
+  uint32_t marks;               // its part of the time index
+  uint64_t firstMark;
+  int64_t min[COL_COLUMNS];     // zone map
+  int64_t max[COL_COLUMNS];
+  ColColumn column[COL_COLUMNS];
+} ColChunk;
+
+typedef struct
+{
+  int64_t time;
+  uint64_t row;
+} ColMark;
+
+typedef struct
+{
+  char magic[8];
+  uint64_t rows;
+  uint32_t chunks, nodes;
+  uint32_t chunkRows, stride;
+  uint64_t namesOffset, chunksOffset, indexOffset, marks;
+} ColHeader;
+
+typedef struct
+{
+  const unsigned char *map;
+  size_t size;
+  const ColHeader *header;
+  const ColChunk *chunks;
+  const ColMark *marks;
+  const char **names;   // node names
+} ColArchive;
+
+enum { COL_BY_ALL, COL_BY_MOTOR, COL_BY_DAY, COL_BY_NODE };
+
+typedef struct
+{
+  int64_t from, to;     // time range [from, to)
+  int64_t node;         // -1 for all
+  int32_t motor;        // FLEET_NO_MOTOR for all
+  int by;               // COL_BY_...
+} ColQuery;
+
+// one group of a query's result; the mean weighs records by their secs
+// (1 if they have none), so summaries count for the time they cover
+typedef struct
+{
+  int64_t key;          // motor, day since 1970 or node
+  uint64_t records;
+  double weight, sum;   // mean cpm is sum/weight
+  uint32_t min, max;
+} ColGroup;
+
+typedef struct
+{
+  ColGroup *groups;     // sorted by key
+  size_t count;
+  uint64_t rows;        // records unpacked
+  uint32_t chunksRead, chunksSkipped;
+  uint64_t bytes;       // column bytes the query had to look at
+} ColResult;
+
+// write log's records to path with the nodes' names, 0 or -1
+int col_build(const char *path, const FleetLog *log, const char *const *names, int nodes);
+
+// map an archive, 0 or -1 with a message on stderr
+int col_open(const char *path, ColArchive *a);
+void col_close(ColArchive *a);
+
+int col_query(const ColArchive *a, const ColQuery *q, ColResult *r);
+
+// the same query straight over records in memory, to compare against
+int col_query_records(const FleetRecord *records, size_t count, const ColQuery *q, ColResult *r);
+
+void col_result_free(ColResult *r);
+
+#endif
@@ -0,0 +1,117 @@
+//Merges the BORON2 logs of a fleet into one time ordered CSV, see fleetlog.h
+//
+//Build:  cc -O2 -pthread -I.. -DBYTES_CRC_BYTEWISE=1 -o fleetcat fleetcat.c fleetlog.c ../bytes.c
+//
+//  fleetcat [-j threads] [-q] <log>...         CSV on stdout
+//  fleetcat -b [-j threads] <log>...           ingestion rate, 1 to threads
+//
+//Each log is one node, numbered in the order given: dataLog.txt files,
+//jnlcat output or DATALOG.JNL journals.  The CSV has one line per rate
+//record, "time,node,cpm,secs,motor", the motor left empty until the node
+//has logged one.  Counts go to stderr.  -j defaults to the number of CPUs.
+//-b ingests the logs with 1, 2, 4... threads up to -j and prints records a
+//second overall and per thread; the parse is what runs in parallel, the
+//merge after it does not.  It states the CPUs online first and marks the
+//rows with more threads than that, which share cores and show the cost of
+//the threads rather than any scaling.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "fleetlog.h"
+
+static void printTime(int64_t t)
+{
+  int64_t days = t >= 0 ? t/86400 : (t - 86399)/86400, secs = t - days*86400;
+  int64_t z = days + 719468, era = (z >= 0 ? z : z - 146096)/146097;
+  int64_t doe = z - era*146097, yoe = (doe - doe/1460 + doe/36524 - doe/146096)/365;
+  int64_t doy = doe - (365*yoe + yoe/4 - yoe/100), mp = (5*doy + 2)/153;
+  int day = doy - (153*mp + 2)/5 + 1, month = mp < 10 ? mp + 3 : mp - 9;
+  int64_t year = yoe + era*400 + (month <= 2);
+
+  printf("%04lld-%02d-%02dT%02d:%02d:%02d", (long long)year, month, day,
+         (int)(secs/3600), (int)(secs/60%60), (int)(secs%60));
+}
+
+static void report(const FleetLog *log)
+{
+  fprintf(stderr, "fleetcat: %.1f MB, %llu records, %llu other, %llu damaged, "
+          "parse %.3f s, merge %.3f s\n", log->counts.bytes/1e6,
+          (unsigned long long)log->counts.records, (unsigned long long)log->counts.other,
+          (unsigned long long)log->counts.damaged, log->counts.parseSeconds,
+          log->counts.mergeSeconds);
+}
+
+static int bench(const char *const *paths, int nfiles, int threads)
+{
+  FleetLog log;
+  double best, base = 0, rate;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int t, run;
+
+  printf("%ld CPUs online\n", cpus);
+  printf("%7s %10s %12s %12s %8s %9s\n", "threads", "parse s", "records/s", "per thread",
+         "speedup", "merge s");
+  for(t = 1; t <= threads; t = t < threads && 2*t > threads ? threads : 2*t)
+  {
+    best = 0;
+    for(run = 0; run < 3; run++)
+    {
+      if(fleet_ingest(paths, nfiles, t, &log)) return 2;
+      if(!run || log.counts.parseSeconds < best) best = log.counts.parseSeconds;
+      if(run < 2) fleet_free(&log);
+    }
+    rate = log.counts.records/best;
+    if(t == 1) base = rate;
+    printf("%7d %10.3f %12.0f %12.0f %7.2fx %9.3f%s\n", t, best, rate, rate/t, rate/base,
+           log.counts.mergeSeconds, t > cpus ? "  more threads than CPUs" : "");
+    if(t == threads) report(&log);
+    fleet_free(&log);
+    if(t == threads) break;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  FleetLog log;
+  size_t i;
+  int threads = sysconf(_SC_NPROCESSORS_ONLN), quiet = 0, benchmark = 0, opt, f;
+
+  while((opt = getopt(argc, argv, "j:qb")) != -1)
+  {
+    switch(opt)
+    {
+      case 'j': threads = atoi(optarg); break;
+      case 'q': quiet = 1; break;
+      case 'b': benchmark = 1; break;
+      default: threads = 0; break;
+    }
+  }
+  if(threads < 1 || optind == argc)
+  {
+    fprintf(stderr, "usage: fleetcat [-j threads] [-q] <log>...\n"
+                    "       fleetcat -b [-j threads] <log>...\n");
+    return 2;
+  }
+  if(benchmark)
+    return bench((const char *const *)argv + optind, argc - optind, threads);
+
+  if(fleet_ingest((const char *const *)argv + optind, argc - optind, threads, &log)) return 2;
+  for(f = optind; f < argc; f++)
+    fprintf(stderr, "fleetcat: node %d is %s\n", f - optind, argv[f]);
+  if(!quiet)
+  {
+    printf("time,node,cpm,secs,motor\n");
+    for(i = 0; i < log.count; i++)
+    {
+      printTime(log.records[i].time);
+      printf(",%u,%u,%u,", log.records[i].node, log.records[i].cpm, log.records[i].secs);
+      if(log.records[i].motor != FLEET_NO_MOTOR) printf("%d", log.records[i].motor);
+      putchar('\n');
+    }
+  }
+  report(&log);
+  fleet_free(&log);
+  return 0;
+}
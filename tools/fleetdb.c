@@ -0,0 +1,274 @@
+//Builds and queries columnar archives of fleet logs, see colarch.h
+//
+//Build:  cc -O2 -pthread -I.. -DBYTES_CRC_BYTEWISE=1 -o fleetdb fleetdb.c colarch.c fleetlog.c ../bytes.c -lm
+//
+//  fleetdb build [-j threads] <archive> <log>...    ingest logs (fleetcat's
+//                                                   inputs), write an archive
+//  fleetdb query [filters] [-g motor|day|node] <archive>
+//  fleetdb bench [-j threads] <archive> <log>...    the same queries on the
+//                                                   logs and on the archive
+//
+//Filters: -f and -t bound the time as YYYY-MM-DD[THH:MM:SS] (to is
+//exclusive), -n keeps one node, -m one motor position.  A query prints a
+//line per group with its records and the mean, min and max CPM, the mean
+//weighted by the seconds each record covers.  bench runs a fixed set of
+//queries both ways, the logs parsed again each time as the old scripts
+//did, and prints the time and the bytes each one had to look at.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "colarch.h"
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+// YYYY-MM-DD[THH:MM:SS] to seconds since 1970, 0 if it does not parse
+static int parseTime(const char *s, int64_t *t)
+{
+  int year, month, day, hour = 0, minute = 0, second = 0, n = 0;
+  int64_t y, era, yoe, doy, doe;
+
+  if(sscanf(s, "%d-%d-%d%n", &year, &month, &day, &n) != 3) return 0;
+  if(s[n] == 'T' || s[n] == ' ')
+  {
+    if(sscanf(s + n + 1, "%d:%d:%d", &hour, &minute, &second) != 3) return 0;
+  }
+  else if(s[n])
+    return 0;
+  if(month < 1 || month > 12 || day < 1 || day > 31) return 0;
+  y = year - (month <= 2);
+  era = (y >= 0 ? y : y - 399)/400;
+  yoe = y - era*400;
+  doy = (153*(month + (month > 2 ? -3 : 9)) + 2)/5 + day - 1;
+  doe = yoe*365 + yoe/4 - yoe/100 + doy;
+  *t = (era*146097 + doe - 719468)*86400 + hour*3600 + minute*60 + second;
+  return 1;
+}
+
+static void printDay(int64_t days)
+{
+  int64_t z = days + 719468, era = (z >= 0 ? z : z - 146096)/146097;
+  int64_t doe = z - era*146097, yoe = (doe - doe/1460 + doe/36524 - doe/146096)/365;
+  int64_t doy = doe - (365*yoe + yoe/4 - yoe/100), mp = (5*doy + 2)/153;
+  int month = mp < 10 ? mp + 3 : mp - 9;
+
+  printf("%04lld-%02d-%02d", (long long)(yoe + era*400 + (month <= 2)), month,
+         (int)(doy - (153*mp + 2)/5 + 1));
+}
+
+static void print(const ColResult *r, int by, const char **names)
+{
+  size_t i;
+
+  for(i = 0; i < r->count; i++)
+  {
+    switch(by)
+    {
+      case COL_BY_MOTOR:
+        if(r->groups[i].key == FLEET_NO_MOTOR) printf("%-24s", "motor ?");
+        else printf("motor %-18lld", (long long)r->groups[i].key);
+        break;
+      case COL_BY_DAY: printDay(r->groups[i].key); printf("%14s", ""); break;
+      case COL_BY_NODE: printf("%-24s", names ? names[r->groups[i].key] : "?"); break;
+      default: printf("%-24s", "all"); break;
+    }
+    printf(" %10llu records  cpm %8.2f mean %6u min %6u max\n",
+           (unsigned long long)r->groups[i].records, r->groups[i].sum/r->groups[i].weight,
+           r->groups[i].min, r->groups[i].max);
+  }
+}
+
+static int build(int argc, char **argv, int threads)
+{
+  FleetLog log;
+  double t0 = now();
+  int failed;
+
+  if(fleet_ingest((const char *const *)argv + 1, argc - 1, threads, &log)) return 2;
+  failed = col_build(argv[0], &log, (const char *const *)argv + 1, argc - 1);
+  if(!failed)
+    fprintf(stderr, "fleetdb: %llu records from %.1f MB into %s, %llu other, %llu damaged, %.2f s\n",
+            (unsigned long long)log.count, log.counts.bytes/1e6, argv[0],
+            (unsigned long long)log.counts.other, (unsigned long long)log.counts.damaged,
+            now() - t0);
+  fleet_free(&log);
+  return failed ? 1 : 0;
+}
+
+static int query(const char *path, const ColQuery *q)
+{
+  ColArchive a;
+  ColResult r;
+
+  if(col_open(path, &a)) return 2;
+  col_query(&a, q, &r);
+  print(&r, q->by, a.names);
+  fprintf(stderr, "fleetdb: %llu records unpacked, %u chunks read, %u skipped, %.1f KB of columns\n",
+          (unsigned long long)r.rows, r.chunksRead, r.chunksSkipped, r.bytes/1e3);
+  col_result_free(&r);
+  col_close(&a);
+  return 0;
+}
+
+// the archive holds the records in another order, so sums may round apart
+static int same(const ColResult *a, const ColResult *b)
+{
+  size_t i;
+
+  if(a->count != b->count) return 0;
+  for(i = 0; i < a->count; i++)
+    if(a->groups[i].key != b->groups[i].key || a->groups[i].records != b->groups[i].records ||
+       a->groups[i].min != b->groups[i].min || a->groups[i].max != b->groups[i].max ||
+       fabs(a->groups[i].sum - b->groups[i].sum) > 1e-9*fabs(b->groups[i].sum) ||
+       fabs(a->groups[i].weight - b->groups[i].weight) > 1e-9*b->groups[i].weight)
+      return 0;
+  return 1;
+}
+
+static int bench(int argc, char **argv, int threads)
+{
+  struct
+  {
+    const char *what;
+    ColQuery q;
+  } queries[] =
+  {
+    {"all by motor",         {INT64_MIN, INT64_MAX, -1, FLEET_NO_MOTOR, COL_BY_MOTOR}},
+    {"all by day",           {INT64_MIN, INT64_MAX, -1, FLEET_NO_MOTOR, COL_BY_DAY}},
+    {"node 0 by motor",      {INT64_MIN, INT64_MAX, 0, FLEET_NO_MOTOR, COL_BY_MOTOR}},
+    {"one motor by node",    {INT64_MIN, INT64_MAX, -1, 0, COL_BY_NODE}},
+    {"one day by node",      {0, 0, -1, FLEET_NO_MOTOR, COL_BY_NODE}},
+    {"one hour, one node",   {0, 0, 0, FLEET_NO_MOTOR, COL_BY_ALL}},
+  };
+  int n = sizeof(queries)/sizeof(queries[0]), i, run;
+  ColArchive a;
+  ColResult r, check;
+  FleetLog log;
+  struct stat st;
+  double t, text, archive;
+  uint64_t logBytes = 0;
+  int64_t middle;
+  size_t k;
+
+  if(fleet_ingest((const char *const *)argv + 1, argc - 1, threads, &log)) return 2;
+  if(col_build(argv[0], &log, (const char *const *)argv + 1, argc - 1) || col_open(argv[0], &a))
+    return 2;
+  logBytes = log.counts.bytes;
+
+  // the narrow queries take the day in the middle of the data, however
+  // long it runs, and the hour and node of the first record from there;
+  // the motor is the last one the fleet reached, on a short run 0
+  if(log.count)
+  {
+    if(log.records[log.count - 1].motor != FLEET_NO_MOTOR)
+      queries[3].q.motor = log.records[log.count - 1].motor;
+    middle = log.records[0].time + (log.records[log.count - 1].time - log.records[0].time)/2;
+    for(k = 0; k < log.count - 1 && log.records[k].time < middle; k++)
+      ;
+    queries[4].q.from = middle - middle % 86400;
+    queries[4].q.to = queries[4].q.from + 86400;
+    queries[5].q.node = log.records[k].node;
+    queries[5].q.from = log.records[k].time - log.records[k].time % 3600;
+    queries[5].q.to = queries[5].q.from + 3600;
+  }
+  fleet_free(&log);
+  stat(argv[0], &st);
+  printf("%.1f MB of logs, %.1f MB archive (%.1fx), %llu records\n", logBytes/1e6,
+         st.st_size/1e6, (double)logBytes/st.st_size, (unsigned long long)a.header->rows);
+  printf("%-18s %10s %10s %8s | %10s %11s %7s\n", "query", "logs ms", "archive ms", "speedup",
+         "records", "column KB", "chunks");
+
+  for(i = 0; i < n; i++)
+  {
+    // logs: parse them again, then the same grouping over the records
+    text = 0;
+    for(run = 0; run < 3; run++)
+    {
+      t = now();
+      fleet_ingest((const char *const *)argv + 1, argc - 1, threads, &log);
+      col_query_records(log.records, log.count, &queries[i].q, &check);
+      t = now() - t;
+      if(!run || t < text) text = t;
+      fleet_free(&log);
+      if(run < 2) col_result_free(&check);
+    }
+    archive = 0;
+    for(run = 0; run < 20; run++)
+    {
+      t = now();
+      col_query(&a, &queries[i].q, &r);
+      t = now() - t;
+      if(!run || t < archive) archive = t;
+      if(run < 19) col_result_free(&r);
+    }
+    if(!same(&r, &check))
+    {
+      fprintf(stderr, "fleetdb: %s: the archive and the logs disagree\n", queries[i].what);
+      return 1;
+    }
+    printf("%-18s %10.1f %10.3f %7.0fx | %10llu %11.1f %3u of %u\n", queries[i].what,
+           text*1e3, archive*1e3, text/archive, (unsigned long long)r.rows, r.bytes/1e3,
+           r.chunksRead, r.chunksRead + r.chunksSkipped);
+    col_result_free(&r);
+    col_result_free(&check);
+  }
+  col_close(&a);
+  return 0;
+}
+
+static void usage(void)
+{
+  fprintf(stderr, "usage: fleetdb build [-j threads] <archive> <log>...\n"
+                  "       fleetdb query [-f from] [-t to] [-n node] [-m motor] [-g motor|day|node] <archive>\n"
+                  "       fleetdb bench [-j threads] <archive> <log>...\n");
+}
+
+int main(int argc, char **argv)
+{
+  ColQuery q = {INT64_MIN, INT64_MAX, -1, FLEET_NO_MOTOR, COL_BY_ALL};
+  int threads = sysconf(_SC_NPROCESSORS_ONLN), opt, bad = 0;
+  const char *command;
+
+  if(argc < 2)
+  {
+    usage();
+    return 2;
+  }
+  command = argv[1];
+  optind = 2;
+  while((opt = getopt(argc, argv, "j:f:t:n:m:g:")) != -1)
+  {
+    switch(opt)
+    {
+      case 'j': threads = atoi(optarg); break;
+      case 'f': bad |= !parseTime(optarg, &q.from); break;
+      case 't': bad |= !parseTime(optarg, &q.to); break;
+      case 'n': q.node = atoi(optarg); break;
+      case 'm': q.motor = atoi(optarg); break;
+      case 'g':
+        if(!strcmp(optarg, "motor")) q.by = COL_BY_MOTOR;
+        else if(!strcmp(optarg, "day")) q.by = COL_BY_DAY;
+        else if(!strcmp(optarg, "node")) q.by = COL_BY_NODE;
+        else bad = 1;
+        break;
+      default: bad = 1; break;
+    }
+  }
+  if(!bad && !strcmp(command, "build") && argc - optind >= 2)
+    return build(argc - optind, argv + optind, threads);
+  if(!bad && !strcmp(command, "query") && argc - optind == 1)
+    return query(argv[optind], &q);
+  if(!bad && !strcmp(command, "bench") && argc - optind >= 2)
+    return bench(argc - optind, argv + optind, threads);
+  usage();
+  return 2;
+}
@@ -0,0 +1,509 @@
+//Parallel BORON2 log ingestion, see fleetlog.h
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "fleetlog.h"
+#include "bytes.h"
+
+// journal.h's layout
+#define JOURNAL_BLOCK    128
+#define JOURNAL_HEADER   12
+#define JOURNAL_PAYLOAD  (JOURNAL_BLOCK - JOURNAL_HEADER)
+
+#define STAMP_LENGTH     24
+
+typedef struct
+{
+  const char *data;
+  size_t size;
+  int journal;
+} Input;
+
+// one work item and what came out of it
+typedef struct
+{
+  uint32_t node;
+  size_t start, end;
+  FleetRecord *records;
+  size_t count, cap;
+  uint64_t other, damaged;
+} Piece;
+
+typedef struct
+{
+  const Input *inputs;
+  Piece *pieces;
+  size_t npieces;
+  size_t next;          // next piece to take, shared by the workers
+} Work;
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+// Scanning -------------------------------------------------------------------
+
+// first byte in [p, end) that is a or b, end if none
+static const char *find2(const char *p, const char *end, char a, char b)
+{
+#ifdef __SSE2__
+  const __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b);
+  __m128i v;
+  int mask;
+
+  for(; end - p >= 16; p += 16)
+  {
+    v = _mm_loadu_si128((const __m128i *)p);
+    mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)));
+    if(mask) return p + __builtin_ctz(mask);
+  }
+#endif
+  for(; p < end; p++)
+    if(*p == a || *p == b) return p;
+  return end;
+}
+
+static int digit(char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+// 1-10 digits at *p, moved past them
+static int number(const char **p, const char *end, uint32_t *value)
+{
+  const char *s = *p;
+  uint64_t v = 0;
+
+  while(s < end && digit(*s) && s - *p < 10) v = v*10 + (*s++ - '0');
+  if(s == *p || v > UINT32_MAX || (s < end && digit(*s))) return 0;
+  *p = s;
+  *value = v;
+  return 1;
+}
+
+static int text(const char **p, const char *end, const char *str)
+{
+  size_t n = strlen(str);
+
+  if((size_t)(end - *p) < n || memcmp(*p, str, n)) return 0;
+  *p += n;
+  return 1;
+}
+
+static int two(const char *p, int spaced)
+{
+  if(!digit(p[1])) return -1;
+  if(spaced && p[0] == ' ') return p[1] - '0';
+  if(!digit(p[0])) return -1;
+  return (p[0] - '0')*10 + p[1] - '0';
+}
+
+int64_t fleet_stamp(const char *p, size_t length)
+{
+  static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  int month, day, hour, minute, second, year, i;
+  int64_t y, era, yoe, doy, doe;
+
+  if(length < STAMP_LENGTH || p[3] != ' ' || p[7] != ' ' || p[10] != ' ' || p[13] != ':' ||
+     p[16] != ':' || p[19] != ' ')
+    return -1;
+  for(month = 0; month < 12; month++)
+    if(!memcmp(p + 4, months + 3*month, 3)) break;
+  day = two(p + 8, 1);
+  hour = two(p + 11, 0);
+  minute = two(p + 14, 0);
+  second = two(p + 17, 0);
+  for(year = 0, i = 20; i < 24; i++)
+  {
+    if(!digit(p[i])) return -1;
+    year = year*10 + p[i] - '0';
+  }
+  if(month == 12 || day < 1 || day > 31 || hour < 0 || hour > 23 || minute < 0 ||
+     minute > 59 || second < 0 || second > 59 || year < 1970)
+    return -1;
+
+  // days from 1970-01-01, counting years from March so leap days come last
+  y = year - (month < 2);
+  era = y/400;
+  yoe = y - era*400;
+  doy = (153*(month + (month < 2 ? 10 : -2)) + 2)/5 + day - 1;
+  doe = yoe*365 + yoe/4 - yoe/100 + doy;
+  return (era*146097 + doe - 719468)*86400 + hour*3600 + minute*60 + second;
+}
+
+static void keep(Piece *piece, const FleetRecord *r)
+{
+  if(piece->count == piece->cap)
+  {
+    piece->cap = piece->cap ? 2*piece->cap : 1024;
+    piece->records = realloc(piece->records, piece->cap*sizeof(FleetRecord));
+    if(!piece->records)
+    {
+      fprintf(stderr, "fleetlog: out of memory\n");
+      exit(1);
+    }
+  }
+  piece->records[piece->count++] = *r;
+}
+
+// the text of one record between its '\n' and '\t'
+static void record(Piece *piece, const char *p, const char *end)
+{
+  FleetRecord r;
+  uint32_t value;
+  const char *key;
+
+  r.node = piece->node;
+  r.secs = 0;
+  r.motor = FLEET_NO_MOTOR;
+  if(!text(&p, end, "Time,"))
+  {
+    if((text(&p, end, "Boot,") || text(&p, end, "End,")) && fleet_stamp(p, end - p) >= 0)
+      piece->other++;
+    else piece->damaged++;
+    return;
+  }
+  r.time = fleet_stamp(p, end - p);
+  p += STAMP_LENGTH;
+  if(r.time < 0 || !text(&p, end, ","))
+  {
+    piece->damaged++;
+    return;
+  }
+
+  if(text(&p, end, "CPM,"))
+  {
+    if(!number(&p, end, &r.cpm)) goto damaged;
+    if(text(&p, end, ",Secs,"))
+    {
+      if(!number(&p, end, &value) || value > UINT16_MAX) goto damaged;
+      r.secs = value;
+    }
+    if(!text(&p, end, ",Motor,")) goto damaged;
+    if(text(&p, end, "-"))
+    {
+      if(!number(&p, end, &value) || value > 32767) goto damaged;
+      r.motor = -(int32_t)value;
+    }
+    else
+    {
+      if(!number(&p, end, &value) || value > 32767) goto damaged;
+      r.motor = value;
+    }
+    if(p != end) goto damaged;
+    keep(piece, &r);
+  }
+  else if(text(&p, end, "Counts,"))
+  {
+    if(!number(&p, end, &value) || p != end || value > UINT32_MAX/60) goto damaged;
+    r.cpm = value*60;
+    r.secs = 1;
+    keep(piece, &r);
+  }
+  else
+  {
+    // some other record kind: a word and a comma
+    for(key = p; p < end && ((*p >= 'A' && *p <= 'Z') || (*p >= 'a' && *p <= 'z')); p++)
+      ;
+    if(p == key || p == end || *p != ',') goto damaged;
+    piece->other++;
+  }
+  return;
+
+damaged:
+  piece->damaged++;
+}
+
+// records whose '\n' lies in data[start, end), reading on to size to
+// finish the last one
+static void scan(Piece *piece, const char *data, size_t size, size_t start, size_t end)
+{
+  const char *p = data + start, *stop = data + end, *last = data + size, *nl, *tab;
+
+  // a text file should begin with '\n'; anything before it is damage
+  if(!start && size && data[0] != '\n') piece->damaged++;
+
+  for(;;)
+  {
+    nl = find2(p, stop, '\n', '\n');
+    if(nl == stop) return;
+    tab = find2(nl + 1, last, '\t', '\n');
+    if(tab == last || *tab == '\n')
+    {
+      piece->damaged++;     // cut short
+      p = tab;
+      if(p >= stop) return;
+      continue;
+    }
+    record(piece, nl + 1, tab);
+    p = tab + 1;
+  }
+}
+
+static void journal(Piece *piece, const Input *in)
+{
+  const unsigned char *b;
+  size_t at, length;
+
+  for(at = piece->start; at < piece->end; at += JOURNAL_BLOCK)
+  {
+    b = (const unsigned char *)in->data + at;
+    if(at + JOURNAL_BLOCK > in->size)
+    {
+      piece->damaged++;
+      return;
+    }
+    length = bytes.get16(b + 2);
+    if(b[0] != 'J' || b[1] != 'L' || length > JOURNAL_PAYLOAD ||
+       bytes.get32(b + 8) != bytes.crc32(b + JOURNAL_HEADER, length, bytes.crc32(b, 8, 0)))
+    {
+      piece->damaged++;
+      continue;
+    }
+    scan(piece, (const char *)b + JOURNAL_HEADER, length, 0, length);
+  }
+}
+
+static void *worker(void *arg)
+{
+  Work *w = arg;
+  Piece *piece;
+  const Input *in;
+  size_t i;
+
+  while((i = __atomic_fetch_add(&w->next, 1, __ATOMIC_RELAXED)) < w->npieces)
+  {
+    piece = &w->pieces[i];
+    in = &w->inputs[piece->node];
+    if(in->journal)
+      journal(piece, in);
+    else
+      scan(piece, in->data, in->size, piece->start, piece->end);
+  }
+  return NULL;
+}
+
+// Ordering -------------------------------------------------------------------
+
+static int before(const FleetRecord *a, const FleetRecord *b)
+{
+  return a->time < b->time || (a->time == b->time && a->node < b->node);
+}
+
+// stable, a reboot with a wrong clock must not shuffle equal times
+static void sort(FleetRecord *r, size_t n)
+{
+  FleetRecord *tmp;
+  size_t width, lo, mid, hi, i, j, k;
+
+  for(i = 1; i < n && !before(&r[i], &r[i - 1]); i++)
+    ;
+  if(i >= n) return;
+
+  tmp = malloc(n*sizeof(*tmp));
+  if(!tmp)
+  {
+    fprintf(stderr, "fleetlog: out of memory\n");
+    exit(1);
+  }
+  for(width = 1; width < n; width *= 2)
+  {
+    for(lo = 0; lo < n; lo += 2*width)
+    {
+      mid = lo + width < n ? lo + width : n;
+      hi = lo + 2*width < n ? lo + 2*width : n;
+      for(i = lo, j = mid, k = lo; k < hi; k++)
+        tmp[k] = j >= hi || (i < mid && !before(&r[j], &r[i])) ? r[i++] : r[j++];
+    }
+    memcpy(r, tmp, n*sizeof(*r));
+  }
+  free(tmp);
+}
+
+typedef struct
+{
+  FleetRecord *at, *end;
+} Cursor;
+
+static void sift(Cursor *heap, size_t n, size_t i)
+{
+  size_t child;
+  Cursor c;
+
+  for(;;)
+  {
+    child = 2*i + 1;
+    if(child >= n) return;
+    if(child + 1 < n && before(heap[child + 1].at, heap[child].at)) child++;
+    if(!before(heap[child].at, heap[i].at)) return;
+    c = heap[i]; heap[i] = heap[child]; heap[child] = c;
+    i = child;
+  }
+}
+
+// Ingestion ------------------------------------------------------------------
+
+static int map(const char *path, Input *in)
+{
+  struct stat st;
+  int fd = open(path, O_RDONLY);
+
+  if(fd < 0 || fstat(fd, &st))
+  {
+    fprintf(stderr, "fleetlog: cannot open %s\n", path);
+    if(fd >= 0) close(fd);
+    return -1;
+  }
+  in->size = st.st_size;
+  in->data = NULL;
+  if(in->size)
+  {
+    in->data = mmap(NULL, in->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(in->data == MAP_FAILED)
+    {
+      fprintf(stderr, "fleetlog: cannot map %s\n", path);
+      close(fd);
+      return -1;
+    }
+    madvise((void *)in->data, in->size, MADV_SEQUENTIAL);
+  }
+  close(fd);
+  in->journal = in->size >= JOURNAL_BLOCK && in->data[0] == 'J' && in->data[1] == 'L';
+  return 0;
+}
+
+int fleet_ingest(const char *const *paths, int nfiles, int threads, FleetLog *log)
+{
+  Input *inputs = calloc(nfiles > 0 ? nfiles : 1, sizeof(Input));
+  FleetRecord **nodes = calloc(nfiles > 0 ? nfiles : 1, sizeof(FleetRecord *));
+  size_t *lengths = calloc(nfiles > 0 ? nfiles : 1, sizeof(size_t));
+  Cursor *heap = calloc(nfiles > 0 ? nfiles : 1, sizeof(Cursor));
+  pthread_t *ids;
+  Work work;
+  Piece *piece;
+  size_t i, at, n, total = 0;
+  int f, t, failed = 0;
+  int16_t motor;
+  double t0;
+
+  memset(log, 0, sizeof(*log));
+
+  // pieces in file order, so a node's pieces follow each other
+  memset(&work, 0, sizeof(work));
+  for(f = 0; f < nfiles && !failed; f++)
+  {
+    if(map(paths[f], &inputs[f]))
+    {
+      failed = 1;
+      break;
+    }
+    log->counts.bytes += inputs[f].size;
+    for(at = 0; at < inputs[f].size; at += FLEET_CHUNK)
+    {
+      work.pieces = realloc(work.pieces, (work.npieces + 1)*sizeof(Piece));
+      piece = &work.pieces[work.npieces++];
+      memset(piece, 0, sizeof(*piece));
+      piece->node = f;
+      piece->start = at;
+      piece->end = at + FLEET_CHUNK < inputs[f].size ? at + FLEET_CHUNK : inputs[f].size;
+    }
+  }
+
+  if(!failed)
+  {
+    t0 = now();
+    work.inputs = inputs;
+    if(threads < 1) threads = 1;
+    if((size_t)threads > work.npieces) threads = work.npieces ? work.npieces : 1;
+    ids = malloc(threads*sizeof(pthread_t));
+    for(t = 1; t < threads; t++)
+      pthread_create(&ids[t], NULL, worker, &work);
+    worker(&work);
+    for(t = 1; t < threads; t++)
+      pthread_join(ids[t], NULL);
+    free(ids);
+    log->counts.parseSeconds = now() - t0;
+
+    // each node on its own, then all of them by time
+    t0 = now();
+    for(i = 0; i < work.npieces; i++)
+    {
+      piece = &work.pieces[i];
+      lengths[piece->node] += piece->count;
+      log->counts.other += piece->other;
+      log->counts.damaged += piece->damaged;
+    }
+    for(f = 0; f < nfiles; f++)
+    {
+      nodes[f] = malloc((lengths[f] ? lengths[f] : 1)*sizeof(FleetRecord));
+      total += lengths[f];
+      lengths[f] = 0;
+    }
+    for(i = 0; i < work.npieces; i++)
+    {
+      piece = &work.pieces[i];
+      memcpy(nodes[piece->node] + lengths[piece->node], piece->records, piece->count*sizeof(FleetRecord));
+      lengths[piece->node] += piece->count;
+      free(piece->records);
+    }
+
+    log->records = malloc((total ? total : 1)*sizeof(FleetRecord));
+    n = 0;
+    for(f = 0; f < nfiles; f++)
+    {
+      sort(nodes[f], lengths[f]);
+      motor = FLEET_NO_MOTOR;
+      for(i = 0; i < lengths[f]; i++)
+      {
+        if(nodes[f][i].motor == FLEET_NO_MOTOR) nodes[f][i].motor = motor;
+        else motor = nodes[f][i].motor;
+      }
+      if(lengths[f])
+      {
+        heap[n].at = nodes[f];
+        heap[n++].end = nodes[f] + lengths[f];
+      }
+    }
+    for(i = n; i-- > 0; )
+      sift(heap, n, i);
+    while(n)
+    {
+      log->records[log->count++] = *heap[0].at++;
+      if(heap[0].at == heap[0].end) heap[0] = heap[--n];
+      sift(heap, n, 0);
+    }
+    log->counts.records = log->count;
+    log->counts.mergeSeconds = now() - t0;
+  }
+
+  for(f = 0; f < nfiles; f++)
+  {
+    if(inputs[f].data) munmap((void *)inputs[f].data, inputs[f].size);
+    free(nodes[f]);
+  }
+  free(work.pieces);
+  free(inputs);
+  free(nodes);
+  free(lengths);
+  free(heap);
+  return failed ? -1 : 0;
+}
+
+void fleet_free(FleetLog *log)
+{
+  free(log->records);
+  memset(log, 0, sizeof(*log));
+}
@@ -0,0 +1,71 @@
+//Parallel ingestion of BORON2 logs from many nodes into one record stream
+//
+//Each input is one node's log, either the old dataLog.txt (or jnlcat's
+//output, the same text) or a DATALOG.JNL journal read directly.  Records
+//are "\n...\t" lines; the ones carrying a rate are kept:
+//
+//  Time,<stamp>,CPM,<n>,Motor,<k>            logdata() before the journal
+//  Time,<stamp>,CPM,<n>,Secs,<s>,Motor,<k>   sampler summaries
+//  Time,<stamp>,Counts,<n>                   one second of a burst
+//
+//The others (Boot, Burst, Servo, End) are counted and passed over, and so is
+//anything that does not parse: torn lines, garbled stamps, journal blocks
+//with a bad CRC.
+//
+//Files are mapped, not read, and cut into FLEET_CHUNK pieces that worker
+//threads take in turn.  A text piece owns the records whose '\n' falls
+//inside it, so a cut mid-record costs nothing; journal pieces are cut at
+//block boundaries.  The delimiters are found 16 bytes at a time with SSE2
+//where the compiler has it.  Afterwards each node's records are put in time
+//order, Counts records take the motor of the record before them, and all
+//nodes are merged by time.
+//
+//It is C with pthreads rather than C++: everything else in tools/ and
+//sim/ is C, and fleetsim and fleetdb link this file as it is.
+
+#ifndef FLEETLOG_H
+#define FLEETLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FLEET_CHUNK     (4u << 20)    // bytes of a file per work item
+#define FLEET_NO_MOTOR  INT16_MIN     // motor not known yet
+
+typedef struct
+{
+  int64_t time;         // seconds since 1970, the RTC's local time
+  uint32_t node;        // index of the file it came from
+  uint32_t cpm;
+  uint16_t secs;        // seconds the rate covers, 0 if the log does not say
+  int16_t motor;
+} FleetRecord;
+
+typedef struct
+{
+  uint64_t bytes;       // of all inputs
+  uint64_t records;     // kept
+  uint64_t other;       // well formed records without a rate
+  uint64_t damaged;     // lines and journal blocks that did not parse
+  double parseSeconds;  // wall time of the threaded part
+  double mergeSeconds;  // wall time of sorting and merging
+} FleetCounts;
+
+typedef struct
+{
+  FleetRecord *records; // all nodes, in time order, ties by node
+  size_t count;
+  FleetCounts counts;
+} FleetLog;
+
+// read nfiles logs on threads workers into log, returns 0 or -1 if a file
+// could not be opened (with a message on stderr)
+int fleet_ingest(const char *const *paths, int nfiles, int threads, FleetLog *log);
+
+void fleet_free(FleetLog *log);
+
+// "Tue May 26 08:35:00 2015" (weekday not checked) to seconds since 1970,
+// -1 if it is not a stamp
+int64_t fleet_stamp(const char *p, size_t length);
+
+#endif
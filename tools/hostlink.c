@@ -0,0 +1,81 @@
+//Host side of the NESI+ USB CDC link, see hostlink.h
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "hostlink.h"
+
+static int open_device(HostLink *link, const char *path)
+{
+  struct termios tio;
+  int fd = open(path, O_RDWR | O_NOCTTY);
+
+  if(fd < 0) return -1;
+  if(!tcgetattr(fd, &tio))
+  {
+    cfmakeraw(&tio);
+    tcsetattr(fd, TCSANOW, &tio);
+  }
+  link->in = link->out = fd;
+  return 0;
+}
+
+// run command with a pipe to its stdin and one from its stdout
+static int open_command(HostLink *link, const char *command)
+{
+  int down[2], up[2];
+
+  if(pipe(down) || pipe(up)) return -1;
+  link->child = fork();
+  if(link->child < 0) return -1;
+  if(!link->child)
+  {
+    dup2(down[0], 0);
+    dup2(up[1], 1);
+    close(down[0]); close(down[1]); close(up[0]); close(up[1]);
+    execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+    _exit(127);
+  }
+  close(down[0]);
+  close(up[1]);
+  link->out = down[1];
+  link->in = up[0];
+  return 0;
+}
+
+int link_open(HostLink *link, const char *device, const char *command)
+{
+  signal(SIGPIPE, SIG_IGN);
+  link->in = link->out = -1;
+  link->child = 0;
+  return command ? open_command(link, command) : open_device(link, device);
+}
+
+void link_close(HostLink *link)
+{
+  if(link->out != link->in) close(link->out);
+  close(link->in);
+  if(link->child > 0) waitpid(link->child, NULL, 0);
+  link->in = link->out = -1;
+  link->child = 0;
+}
+
+int link_line(HostLink *link, char *line, int size)
+{
+  int n = 0;
+  char c;
+
+  while(read(link->in, &c, 1) == 1)
+  {
+    if(c == '\n')
+    {
+      line[n] = 0;
+      return n;
+    }
+    if(n < size - 1) line[n++] = c;
+  }
+  return -1;
+}
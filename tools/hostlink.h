@@ -0,0 +1,23 @@
+//Host side of the NESI+ USB CDC link, shared by logpull and telview
+
+#ifndef HOSTLINK_H
+#define HOSTLINK_H
+
+#include <sys/types.h>
+
+typedef struct
+{
+  int in, out;      // read from / write to the node
+  pid_t child;      // simulator process when opened with a command, else 0
+} HostLink;
+
+// open a serial device, or with command != NULL run it with its
+// stdin/stdout as the node's USB port; returns 0 on success
+int link_open(HostLink *link, const char *device, const char *command);
+
+void link_close(HostLink *link);
+
+// read one '\n' terminated line without reading past it, -1 at end of stream
+int link_line(HostLink *link, char *line, int size);
+
+#endif
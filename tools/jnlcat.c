@@ -0,0 +1,64 @@
+//Prints the records of a journaled NESI+ log as text, see journal.h
+//
+//Build:  cc -O2 -I.. -o jnlcat jnlcat.c ../bytes.c
+//
+//  jnlcat [-q] <DATALOG.JNL>
+//
+//Writes the records in order to stdout, which gives back the text the old
+//dataLog.txt held, and reports on stderr where the good part of the log
+//ends and why.  -q only checks.  Exit status is 0 when every block is
+//good, 1 when the log ends in a torn or foreign block.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "bytes.h"
+
+#define JOURNAL_BLOCK    128
+#define JOURNAL_HEADER   12
+#define JOURNAL_PAYLOAD  (JOURNAL_BLOCK - JOURNAL_HEADER)
+
+int main(int argc, char **argv)
+{
+  unsigned char b[JOURNAL_BLOCK];
+  const char *why = NULL;
+  unsigned long n = 0;
+  int quiet = 0, length, opt;
+  size_t got;
+  FILE *f;
+
+  while((opt = getopt(argc, argv, "q")) != -1)
+    quiet = opt == 'q' ? 1 : -1;
+  if(quiet < 0 || optind != argc - 1)
+  {
+    fprintf(stderr, "usage: jnlcat [-q] <DATALOG.JNL>\n");
+    return 2;
+  }
+  f = fopen(argv[optind], "rb");
+  if(!f)
+  {
+    fprintf(stderr, "jnlcat: cannot open %s\n", argv[optind]);
+    return 2;
+  }
+
+  while((got = fread(b, 1, JOURNAL_BLOCK, f)) > 0)
+  {
+    length = bytes.get16(b + 2);
+    if(got < JOURNAL_BLOCK) why = "short block";
+    else if(b[0] != 'J' || b[1] != 'L') why = "no block header";
+    else if(length > JOURNAL_PAYLOAD) why = "bad length";
+    else if(bytes.get32(b + 4) != n) why = "out of sequence";
+    else if(bytes.get32(b + 8) != bytes.crc32(b + JOURNAL_HEADER, length, bytes.crc32(b, 8, 0))) why = "bad CRC";
+    if(why) break;
+    if(!quiet) fwrite(b + JOURNAL_HEADER, 1, length, stdout);
+    n++;
+  }
+  fclose(f);
+
+  if(why)
+    fprintf(stderr, "jnlcat: %lu good blocks, block %lu: %s\n", n, n, why);
+  else
+    fprintf(stderr, "jnlcat: %lu good blocks\n", n);
+  return why ? 1 : 0;
+}
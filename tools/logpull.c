@@ -0,0 +1,118 @@
+//Pulls a log file off a NESI+ node over USB CDC, see logexport.h
+//
+//Build:  cc -O2 -o logpull logpull.c hostlink.c
+//
+//  logpull [-d /dev/ttyACM0 | -e "command"] [-f DATALOG.JNL] -o out [-n]
+//
+//Talks to the node on a serial device, or with -e to a command run with its
+//stdin/stdout as the USB port (the host simulator, sim/boron2sim -u).  The
+//transfer starts from the size of out, so rerunning after an interrupted
+//pull only fetches the rest; -n starts over.  A node still logging answers
+//once live telemetry is on, see logexport.h.  Prints the sustained rate.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "hostlink.h"
+
+static double seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+int main(int argc, char **argv)
+{
+  const char *device = NULL, *command = NULL, *name = "DATALOG.JNL", *outPath = NULL;
+  char line[128], buf[65536];
+  long offset = 0, start, size, got = 0;
+  int fresh = 0, fd, opt, n;
+  HostLink link;
+  struct stat st;
+  double t0 = 0, t1;
+
+  while((opt = getopt(argc, argv, "d:e:f:o:n")) != -1)
+  {
+    switch(opt)
+    {
+      case 'd': device = optarg; break;
+      case 'e': command = optarg; break;
+      case 'f': name = optarg; break;
+      case 'o': outPath = optarg; break;
+      case 'n': fresh = 1; break;
+      default: outPath = NULL; optind = argc; break;
+    }
+  }
+  if(!outPath || (!device && !command))
+  {
+    fprintf(stderr, "usage: logpull [-d /dev/ttyACM0 | -e \"command\"] [-f DATALOG.JNL] -o out [-n]\n");
+    return 2;
+  }
+
+  fd = open(outPath, O_WRONLY | O_CREAT, 0644);
+  if(fd < 0)
+  {
+    fprintf(stderr, "logpull: cannot open %s: %s\n", outPath, strerror(errno));
+    return 1;
+  }
+  if(!fresh && !fstat(fd, &st)) offset = st.st_size;
+
+  if(link_open(&link, device, command))
+  {
+    fprintf(stderr, "logpull: cannot open %s\n", command ? command : device);
+    return 1;
+  }
+
+  // lines before the answer are live telemetry from a node still logging
+  n = snprintf(line, sizeof(line), "GET %s %ld\n", name, offset);
+  if(write(link.out, line, n) != n)
+    n = -1;
+  while(n >= 0 && (n = link_line(&link, line, sizeof(line))) >= 0 &&
+        strncmp(line, "OK ", 3) && strncmp(line, "ERR ", 4));
+  if(n < 0)
+  {
+    fprintf(stderr, "logpull: no answer from the node\n");
+    return 1;
+  }
+  if(sscanf(line, "OK %ld %ld", &start, &size) != 2)
+  {
+    fprintf(stderr, "logpull: node says: %s\n", line);
+    return 1;
+  }
+
+  // the node may clamp the offset, write from wherever it starts
+  if(ftruncate(fd, start) || lseek(fd, start, SEEK_SET) != start)
+  {
+    fprintf(stderr, "logpull: cannot seek %s\n", outPath);
+    return 1;
+  }
+
+  t1 = t0 = seconds();
+  while(start + got < size)
+  {
+    n = read(link.in, buf, size - start - got < (long)sizeof(buf) ? size - start - got : (long)sizeof(buf));
+    if(n < 0 && errno == EINTR) continue;
+    if(n <= 0) break;
+    if(write(fd, buf, n) != n)
+    {
+      fprintf(stderr, "logpull: write to %s failed\n", outPath);
+      return 1;
+    }
+    got += n;
+    t1 = seconds();
+  }
+  close(fd);
+
+  fprintf(stderr, "logpull: %s %ld..%ld of %ld bytes, %.3f s, %.3f MB/s\n",
+          start + got == size ? "received" : "interrupted at", start, start + got, size,
+          t1 - t0, t1 > t0 ? got/(t1 - t0)/1e6 : 0);
+
+  link_close(&link);
+  return start + got == size ? 0 : 1;
+}
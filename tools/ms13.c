@@ -0,0 +1,275 @@
+//Multisim .ms13 container decoding, see ms13.h
+//The explode decoder follows the PKWare DCL format as documented by
+//Mark Adler's blast.c: a literal mode byte, a dictionary size byte, then an
+//LSB first bit stream of literals and (length, distance) pairs coded with
+//fixed, bit inverted canonical Huffman codes.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ms13.h"
+
+#define MAXBITS 13
+
+// Huffman decoding tables -------------------------------------------------
+
+typedef struct
+{
+  short count[MAXBITS+1];   // number of codes of each length
+  short symbol[256];        // symbols ordered by code length
+} Huffman;
+
+typedef struct
+{
+  const unsigned char *in;
+  size_t inlen, pos;
+  unsigned bitbuf;
+  int bitcnt;
+  int error;
+} BitStream;
+
+// code lengths, each byte is (repeat-1)<<4 | length
+static const unsigned char litlen[] = {
+  11, 124, 8, 7, 28, 7, 188, 13, 76, 4, 10, 8, 12, 10, 12, 10, 8, 23, 8,
+  9, 7, 6, 7, 8, 7, 6, 55, 8, 23, 24, 12, 11, 7, 9, 11, 12, 6, 7, 22, 5,
+  7, 24, 6, 11, 9, 6, 7, 22, 7, 11, 38, 7, 9, 8, 25, 11, 8, 11, 9, 12,
+  8, 12, 5, 38, 5, 38, 5, 11, 7, 5, 6, 21, 6, 10, 53, 8, 7, 24, 10, 27,
+  44, 253, 253, 253, 252, 252, 252, 13, 12, 45, 12, 45, 12, 61, 12, 45,
+  44, 173};
+static const unsigned char lenlen[] = {2, 35, 36, 53, 38, 23};
+static const unsigned char distlen[] = {2, 20, 53, 230, 247, 151, 248};
+
+// base lengths and extra bits for the 16 length codes
+static const short base[16] = {
+  3, 2, 4, 5, 6, 7, 8, 9, 10, 12, 16, 24, 40, 72, 136, 264};
+static const char extra[16] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8};
+
+static Huffman litcode, lencode, distcode;
+static int tables_built = 0;
+
+// expand the compact length list and build canonical decoding tables
+static void construct(Huffman *h, const unsigned char *rep, int n)
+{
+  short length[256], offs[MAXBITS+1];
+  int symbol = 0, len, left;
+
+  while(n--)
+  {
+    len = *rep++;
+    left = (len >> 4) + 1;
+    len &= 15;
+    while(left--)
+      length[symbol++] = len;
+  }
+
+  memset(h->count, 0, sizeof(h->count));
+  for(n = 0; n < symbol; n++)
+    h->count[length[n]]++;
+
+  offs[1] = 0;
+  for(len = 1; len < MAXBITS; len++)
+    offs[len + 1] = offs[len] + h->count[len];
+
+  for(n = 0; n < symbol; n++)
+    if(length[n])
+      h->symbol[offs[length[n]]++] = n;
+}
+
+static void build_tables(void)
+{
+  construct(&litcode, litlen, sizeof(litlen));
+  construct(&lencode, lenlen, sizeof(lenlen));
+  construct(&distcode, distlen, sizeof(distlen));
+  tables_built = 1;
+}
+
+// Bit stream functions ----------------------------------------------------
+
+// pull need bits from the stream, LSB first
+static int bits(BitStream *s, int need)
+{
+  unsigned val = s->bitbuf;
+
+  while(s->bitcnt < need)
+  {
+    if(s->pos == s->inlen)
+    {
+      s->error = 1;   // ran out of input
+      return 0;
+    }
+    val |= (unsigned)s->in[s->pos++] << s->bitcnt;
+    s->bitcnt += 8;
+  }
+
+  s->bitbuf = val >> need;
+  s->bitcnt -= need;
+  return val & ((1U << need) - 1);
+}
+
+// decode one symbol, the stored codes are bit inverted
+static int decode(BitStream *s, const Huffman *h)
+{
+  int len, code = 0, first = 0, index = 0, count;
+
+  for(len = 1; len <= MAXBITS; len++)
+  {
+    code |= bits(s, 1) ^ 1;
+    count = h->count[len];
+    if(code < first + count)
+      return h->symbol[index + (code - first)];
+    index += count;
+    first += count;
+    first <<= 1;
+    code <<= 1;
+  }
+
+  s->error = 1;   // ran out of codes
+  return 0;
+}
+
+// Container functions -----------------------------------------------------
+
+long ms13_explode(const unsigned char *in, size_t inlen,
+                  unsigned char *out, size_t outlen)
+{
+  BitStream s = {in, inlen, 0, 0, 0, 0};
+  size_t next = 0;
+  int lit, dict, symbol, len;
+  size_t dist;
+
+  if(!tables_built)
+    build_tables();
+
+  lit = bits(&s, 8);
+  dict = bits(&s, 8);
+  if(s.error || lit > 1 || dict < 4 || dict > 6)
+    return -1;
+
+  while(!s.error)
+  {
+    if(bits(&s, 1))
+    {
+      // match: length then distance
+      symbol = decode(&s, &lencode);
+      len = base[symbol] + bits(&s, extra[symbol]);
+      if(len == 519)
+        return s.error ? -1 : (long)next;   // end of stream code
+
+      symbol = len == 2 ? 2 : dict;
+      dist = (size_t)decode(&s, &distcode) << symbol;
+      dist += bits(&s, symbol);
+      dist++;
+
+      if(s.error || dist > next || next + len > outlen)
+        return -1;
+      while(len--)
+      {
+        out[next] = out[next - dist];
+        next++;
+      }
+    }
+    else
+    {
+      // literal byte, Huffman coded in ASCII mode
+      symbol = lit ? decode(&s, &litcode) : bits(&s, 8);
+      if(s.error || next == outlen)
+        return -1;
+      out[next++] = symbol;
+    }
+  }
+
+  return -1;
+}
+
+static unsigned long get32(const unsigned char *p)
+{
+  return p[0] | (p[1] << 8) | ((unsigned long)p[2] << 16) |
+         ((unsigned long)p[3] << 24);
+}
+
+int ms13_decode(const char *path, ms13_sink sink, void *ctx)
+{
+  unsigned char head[MS13_MAGIC_LEN + 8], size[8];
+  unsigned char *in = NULL, *out = NULL;
+  unsigned long raw, comp;
+  size_t incap = 0;
+  int result = -1;
+  FILE *file = fopen(path, "rb");
+
+  if(!file) return -1;
+
+  if(fread(head, 1, sizeof(head), file) != sizeof(head) ||
+     memcmp(head, MS13_MAGIC, MS13_MAGIC_LEN))
+    goto done;
+
+  out = malloc(MS13_MAX_CHUNK);
+  if(!out) goto done;
+
+  while(fread(size, 1, 8, file) == 8)
+  {
+    raw = get32(size);
+    comp = get32(size + 4);
+    if(raw > MS13_MAX_CHUNK)
+      goto done;
+
+    if(comp > incap)
+    {
+      free(in);
+      incap = comp;
+      in = malloc(incap);
+      if(!in) goto done;
+    }
+    if(fread(in, 1, comp, file) != comp)
+      goto done;
+
+    if(ms13_explode(in, comp, out, raw) != (long)raw)
+      goto done;
+    if(sink(ctx, (const char *)out, raw))
+      break;
+  }
+  result = ferror(file) ? -1 : 0;
+
+done:
+  free(in);
+  free(out);
+  fclose(file);
+  return result;
+}
+
+typedef struct
+{
+  char *buf;
+  size_t len, cap;
+} Collect;
+
+static int collect(void *ctx, const char *data, size_t len)
+{
+  Collect *c = ctx;
+  char *grown;
+
+  if(c->len + len + 1 > c->cap)
+  {
+    c->cap = (c->len + len + 1) * 2;
+    grown = realloc(c->buf, c->cap);
+    if(!grown) return 1;
+    c->buf = grown;
+  }
+  memcpy(c->buf + c->len, data, len);
+  c->len += len;
+  c->buf[c->len] = 0;
+  return 0;
+}
+
+char *ms13_load(const char *path, size_t *len)
+{
+  Collect c = {NULL, 0, 0};
+
+  if(ms13_decode(path, collect, &c) || !c.buf)
+  {
+    free(c.buf);
+    return NULL;
+  }
+  if(len) *len = c.len;
+  return c.buf;
+}
@@ -0,0 +1,31 @@
+//Multisim .ms13 container decoding for the Linux host tools
+//
+//An .ms13 file is the 36 byte magic "MSMCompressedElectronicsWorkbenchXML",
+//a 64 bit little endian size of the whole XML document, then a run of
+//chunks.  Each chunk is a 32 bit raw length, a 32 bit compressed length and
+//that many bytes of PKWare DCL "implode" data (at most 900000 bytes raw).
+
+#ifndef MS13_H
+#define MS13_H
+
+#include <stddef.h>
+
+#define MS13_MAGIC     "MSMCompressedElectronicsWorkbenchXML"
+#define MS13_MAGIC_LEN 36
+#define MS13_MAX_CHUNK 900000
+
+// called once per decoded chunk, return nonzero to stop decoding
+typedef int (*ms13_sink)(void *ctx, const char *data, size_t len);
+
+// decode one imploded chunk into out, returns bytes written or -1 on bad data
+long ms13_explode(const unsigned char *in, size_t inlen,
+                  unsigned char *out, size_t outlen);
+
+// stream the XML of an .ms13 file chunk by chunk into sink
+// returns 0 on success, -1 if the file could not be read or is not .ms13
+int ms13_decode(const char *path, ms13_sink sink, void *ctx);
+
+// decode the whole XML document into a malloc'd buffer (NUL terminated)
+char *ms13_load(const char *path, size_t *len);
+
+#endif
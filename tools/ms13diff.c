@@ -0,0 +1,433 @@
+//Structural diff between two revisions of a Multisim .ms13 design
+//
+//Build:  cc -O2 -o ms13diff ms13diff.c netlist.c ms13.c
+//
+//  ms13diff <old.ms13> <new.ms13>
+//
+//Both files are decoded and reduced to a canonical netlist: net numbers are
+//renumbered freely by Multisim, so a net is identified by the sorted set of
+//"REFDES.PIN" terminals on it and compared through a 64 bit hash of that set.
+//Unchanged nets match in one hash lookup, only the leftovers are paired up
+//through a terminal -> net map, so the whole diff stays near linear in the
+//size of the design.  Exit status is 0 if the designs match, 1 if not.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "netlist.h"
+
+typedef uint64_t Hash;
+
+// Hash tables ----------------------------------------------------------------
+
+// open addressing table from a 64 bit key to a chain of values
+typedef struct
+{
+  Hash *keys;
+  uint32_t *heads;            // first value index + 1, 0 = empty slot
+  uint32_t *next;             // value index -> next value index + 1
+  uint32_t cap;
+} HashMap;
+
+static void map_init(HashMap *m, uint32_t values)
+{
+  m->cap = 16;
+  while(m->cap < 2 * values) m->cap *= 2;
+  m->keys = calloc(m->cap, sizeof(Hash));
+  m->heads = calloc(m->cap, sizeof(uint32_t));
+  m->next = calloc(values ? values : 1, sizeof(uint32_t));
+}
+
+static void map_free(HashMap *m)
+{
+  free(m->keys);
+  free(m->heads);
+  free(m->next);
+}
+
+static uint32_t map_slot(const HashMap *m, Hash key)
+{
+  uint32_t slot = (uint32_t)(key ^ key >> 32) & (m->cap - 1);
+  while(m->heads[slot] && m->keys[slot] != key)
+    slot = (slot + 1) & (m->cap - 1);
+  return slot;
+}
+
+static void map_add(HashMap *m, Hash key, uint32_t value)
+{
+  uint32_t slot = map_slot(m, key);
+  m->keys[slot] = key;
+  m->next[value] = m->heads[slot];
+  m->heads[slot] = value + 1;
+}
+
+// first value stored under key, NL_NONE if none; follow with map_next()
+static uint32_t map_find(const HashMap *m, Hash key)
+{
+  return m->heads[map_slot(m, key)] - 1;
+}
+
+static uint32_t map_next(const HashMap *m, uint32_t value)
+{
+  return m->next[value] - 1;
+}
+
+static Hash hash_bytes(Hash h, const char *s)
+{
+  while(*s) h = (h ^ (unsigned char)*s++) * 1099511628211ull;
+  return (h ^ 0xff) * 1099511628211ull;   // separator so "a","bc" != "ab","c"
+}
+
+#define HASH_SEED 14695981039346656037ull
+
+// Canonical design -----------------------------------------------------------
+
+typedef struct
+{
+  Netlist nl;
+  const NlDesign *d;
+  char **term;                // "REFDES.PIN" per pin of the design
+  Hash *termhash;
+  Hash *netsig;               // hash of the sorted terminal set per net
+  Hash *compsig;              // hash of family, part and pin names per comp
+  uint32_t **netterms;        // sorted terminal indices per net
+  int *matched;               // per net / per component match flags
+  int *compmatched;
+} Design;
+
+static Design *sorting;
+
+static int cmp_term(const void *a, const void *b)
+{
+  return strcmp(sorting->term[*(const uint32_t *)a],
+                sorting->term[*(const uint32_t *)b]);
+}
+
+static int cmp_str(const void *a, const void *b)
+{
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int load_design(Design *x, const char *path)
+{
+  Netlist *nl = &x->nl;
+  const NlDesign *d;
+  uint32_t i, j, n;
+  char buf[256];
+  char **names;
+
+  memset(x, 0, sizeof(*x));
+  nl_init(nl);
+  if(nl_add_ms13(nl, path) < 0)
+  {
+    fprintf(stderr, "ms13diff: cannot decode %s\n", path);
+    return -1;
+  }
+  d = x->d = &nl->designs[0];
+
+  x->term = malloc(d->npins * sizeof(char *) + 1);
+  x->termhash = malloc(d->npins * sizeof(Hash) + 1);
+  for(i = 0; i < d->npins; i++)
+  {
+    const NlPin *p = &nl->pins[d->pins + i];
+    // connector symbols have a single unnamed pin
+    snprintf(buf, sizeof(buf), *NL_STR(nl, p->name) ? "%s.%s" : "%s",
+             NL_STR(nl, nl->comps[p->comp].refdes), NL_STR(nl, p->name));
+    x->term[i] = strdup(buf);
+    x->termhash[i] = hash_bytes(HASH_SEED, buf);
+  }
+
+  // net signature: hash over the sorted member terminals
+  sorting = x;
+  x->netsig = malloc(d->nnets * sizeof(Hash) + 1);
+  x->netterms = malloc(d->nnets * sizeof(uint32_t *) + 1);
+  x->matched = calloc(d->nnets + 1, sizeof(int));
+  for(i = 0; i < d->nnets; i++)
+  {
+    const NlNet *net = &nl->nets[d->nets + i];
+    n = net->nmembers;
+    x->netterms[i] = malloc((n + 1) * sizeof(uint32_t));
+    for(j = 0; j < n; j++)
+      x->netterms[i][j] = nl->members[net->members + j] - d->pins;
+    qsort(x->netterms[i], n, sizeof(uint32_t), cmp_term);
+
+    x->netsig[i] = HASH_SEED;
+    for(j = 0; j < n; j++)
+      x->netsig[i] = hash_bytes(x->netsig[i], x->term[x->netterms[i][j]]);
+  }
+
+  // component signature: what it is and which pins it has
+  x->compsig = malloc(d->ncomps * sizeof(Hash) + 1);
+  x->compmatched = calloc(d->ncomps + 1, sizeof(int));
+  for(i = 0; i < d->ncomps; i++)
+  {
+    const NlComp *c = &nl->comps[d->comps + i];
+    Hash h = HASH_SEED;
+    h = hash_bytes(h, NL_STR(nl, c->family));
+    h = hash_bytes(h, NL_STR(nl, c->part));
+    h = hash_bytes(h, NL_STR(nl, c->desc));
+
+    names = malloc((c->npins + 1) * sizeof(char *));
+    for(j = 0; j < c->npins; j++)
+      names[j] = NL_STR(nl, nl->pins[c->pins + j].name);
+    qsort(names, c->npins, sizeof(char *), cmp_str);
+    for(j = 0; j < c->npins; j++)
+      h = hash_bytes(h, names[j]);
+    free(names);
+    x->compsig[i] = h;
+  }
+  return 0;
+}
+
+static void free_design(Design *x)
+{
+  uint32_t i;
+
+  if(!x->d)
+    return;
+  for(i = 0; i < x->d->npins; i++)
+    free(x->term[i]);
+  for(i = 0; i < x->d->nnets; i++)
+    free(x->netterms[i]);
+  free(x->term);
+  free(x->termhash);
+  free(x->netsig);
+  free(x->netterms);
+  free(x->matched);
+  free(x->compsig);
+  free(x->compmatched);
+  nl_free(&x->nl);
+}
+
+#define COMP(x, i) (&(x)->nl.comps[(x)->d->comps + (i)])
+#define CSTR(x, off) NL_STR(&(x)->nl, off)
+
+// Component diff --------------------------------------------------------------
+
+static void print_pin_changes(Design *a, uint32_t ca, Design *b, uint32_t cb)
+{
+  const NlComp *x = COMP(a, ca), *y = COMP(b, cb);
+  uint32_t i, j;
+
+  for(i = 0; i < x->npins; i++)
+  {
+    const char *name = CSTR(a, a->nl.pins[x->pins + i].name);
+    for(j = 0; j < y->npins; j++)
+      if(!strcmp(name, CSTR(b, b->nl.pins[y->pins + j].name)))
+        break;
+    if(j == y->npins) printf("      pin -%s\n", name);
+  }
+  for(j = 0; j < y->npins; j++)
+  {
+    const char *name = CSTR(b, b->nl.pins[y->pins + j].name);
+    for(i = 0; i < x->npins; i++)
+      if(!strcmp(name, CSTR(a, a->nl.pins[x->pins + i].name)))
+        break;
+    if(i == x->npins) printf("      pin +%s\n", name);
+  }
+}
+
+static void print_comp(char mark, Design *x, uint32_t c)
+{
+  const NlComp *comp = COMP(x, c);
+  printf("%c %s %s %s\n", mark, CSTR(x, comp->refdes),
+         *CSTR(x, comp->part) ? CSTR(x, comp->part) : "(connector)",
+         CSTR(x, comp->desc));
+}
+
+// components match by refdes, repeated refdes (grounds, connectors) match
+// as a multiset on their signatures; returns the number of differences
+static int diff_components(Design *a, Design *b)
+{
+  HashMap byname;
+  uint32_t i, j, k;
+  int diffs = 0;
+
+  map_init(&byname, b->d->ncomps);
+  for(j = 0; j < b->d->ncomps; j++)
+    map_add(&byname, hash_bytes(HASH_SEED, CSTR(b, COMP(b, j)->refdes)), j);
+
+  // pass 1: same refdes and same signature
+  for(i = 0; i < a->d->ncomps; i++)
+    for(j = map_find(&byname, hash_bytes(HASH_SEED, CSTR(a, COMP(a, i)->refdes)));
+        j != NL_NONE; j = map_next(&byname, j))
+      if(!b->compmatched[j] && a->compsig[i] == b->compsig[j] &&
+         !strcmp(CSTR(a, COMP(a, i)->refdes), CSTR(b, COMP(b, j)->refdes)))
+      {
+        a->compmatched[i] = b->compmatched[j] = 1;
+        break;
+      }
+
+  // pass 2: same refdes, something about the part changed
+  for(i = 0; i < a->d->ncomps; i++)
+  {
+    if(a->compmatched[i]) continue;
+    for(j = map_find(&byname, hash_bytes(HASH_SEED, CSTR(a, COMP(a, i)->refdes)));
+        j != NL_NONE; j = map_next(&byname, j))
+      if(!b->compmatched[j] &&
+         !strcmp(CSTR(a, COMP(a, i)->refdes), CSTR(b, COMP(b, j)->refdes)))
+        break;
+    if(j == NL_NONE) continue;
+
+    a->compmatched[i] = b->compmatched[j] = 1;
+    printf("~ %s", CSTR(a, COMP(a, i)->refdes));
+    if(strcmp(CSTR(a, COMP(a, i)->part), CSTR(b, COMP(b, j)->part)))
+      printf(" part %s -> %s", CSTR(a, COMP(a, i)->part), CSTR(b, COMP(b, j)->part));
+    if(strcmp(CSTR(a, COMP(a, i)->desc), CSTR(b, COMP(b, j)->desc)))
+      printf(" (%s -> %s)", CSTR(a, COMP(a, i)->desc), CSTR(b, COMP(b, j)->desc));
+    printf("\n");
+    print_pin_changes(a, i, b, j);
+    diffs++;
+  }
+
+  for(i = 0; i < a->d->ncomps; i++)
+    if(!a->compmatched[i]) { print_comp('-', a, i); diffs++; }
+  for(k = 0; k < b->d->ncomps; k++)
+    if(!b->compmatched[k]) { print_comp('+', b, k); diffs++; }
+
+  map_free(&byname);
+  return diffs;
+}
+
+// Net diff -------------------------------------------------------------------
+
+static void print_terms(Design *x, uint32_t net)
+{
+  uint32_t i, n = x->nl.nets[x->d->nets + net].nmembers;
+
+  printf("{");
+  for(i = 0; i < n; i++)
+    printf("%s%s", i ? ", " : "", x->term[x->netterms[net][i]]);
+  printf("}");
+}
+
+// terminals of net in x that are not on net other in y (both sorted)
+static void print_delta(char mark, Design *x, uint32_t net, Design *y, uint32_t other)
+{
+  uint32_t i = 0, j = 0;
+  uint32_t n = x->nl.nets[x->d->nets + net].nmembers;
+  uint32_t m = y->nl.nets[y->d->nets + other].nmembers;
+  int c;
+
+  while(i < n)
+  {
+    c = j < m ? strcmp(x->term[x->netterms[net][i]], y->term[y->netterms[other][j]]) : -1;
+    if(c < 0) printf(" %c%s", mark, x->term[x->netterms[net][i++]]);
+    else if(c > 0) j++;
+    else { i++; j++; }
+  }
+}
+
+static int diff_nets(Design *a, Design *b)
+{
+  HashMap bysig, byterm;
+  uint32_t *tally = calloc(b->d->nnets + 1, sizeof(uint32_t));
+  uint32_t i, j, t, best, same = 0, na = 0, nb = 0;
+  int diffs = 0;
+
+  // nodes with nothing attached are leftovers of deleted wires, skip them
+  for(i = 0; i < a->d->nnets; i++)
+    if(!a->nl.nets[a->d->nets + i].nmembers) a->matched[i] = 1; else na++;
+  for(j = 0; j < b->d->nnets; j++)
+    if(!b->nl.nets[b->d->nets + j].nmembers) b->matched[j] = 1; else nb++;
+
+  // unchanged nets: one signature lookup each
+  map_init(&bysig, b->d->nnets);
+  for(j = 0; j < b->d->nnets; j++)
+    map_add(&bysig, b->netsig[j], j);
+  for(i = 0; i < a->d->nnets; i++)
+    for(j = a->matched[i] ? NL_NONE : map_find(&bysig, a->netsig[i]);
+        j != NL_NONE; j = map_next(&bysig, j))
+      if(!b->matched[j])
+      {
+        a->matched[i] = b->matched[j] = 1;
+        same++;
+        break;
+      }
+
+  // leftovers: pair each old net with the new net sharing most terminals
+  map_init(&byterm, b->d->npins);
+  for(t = 0; t < b->d->npins; t++)
+    if(b->nl.pins[b->d->pins + t].net != NL_NONE)
+      map_add(&byterm, b->termhash[t], t);
+
+  for(i = 0; i < a->d->nnets; i++)
+  {
+    const NlNet *net = &a->nl.nets[a->d->nets + i];
+    if(a->matched[i]) continue;
+
+    best = NL_NONE;
+    for(t = 0; t < net->nmembers; t++)
+      for(j = map_find(&byterm, a->termhash[a->netterms[i][t]]); j != NL_NONE;
+          j = map_next(&byterm, j))
+      {
+        uint32_t bn = b->nl.pins[b->d->pins + j].net - b->d->nets;
+        if(b->matched[bn]) continue;
+        tally[bn]++;
+        if(best == NL_NONE || tally[bn] > tally[best]) best = bn;
+      }
+    for(t = 0; t < net->nmembers; t++)
+      for(j = map_find(&byterm, a->termhash[a->netterms[i][t]]); j != NL_NONE;
+          j = map_next(&byterm, j))
+        tally[b->nl.pins[b->d->pins + j].net - b->d->nets] = 0;
+
+    diffs++;
+    if(best == NL_NONE)
+    {
+      printf("- net ");
+      print_terms(a, i);
+      printf("\n");
+      continue;
+    }
+    b->matched[best] = 1;
+    printf("~ net ");
+    print_terms(a, i);
+    printf(" ->");
+    print_delta('+', b, best, a, i);
+    print_delta('-', a, i, b, best);
+    printf("\n");
+  }
+
+  for(j = 0; j < b->d->nnets; j++)
+    if(!b->matched[j])
+    {
+      printf("+ net ");
+      print_terms(b, j);
+      printf("\n");
+      diffs++;
+    }
+
+  printf("nets: %u -> %u, %u unchanged\n", na, nb, same);
+  map_free(&bysig);
+  map_free(&byterm);
+  free(tally);
+  return diffs;
+}
+
+/*****************************  MAIN  *****************************/
+
+int main(int argc, char **argv)
+{
+  Design a, b;
+  int diffs;
+
+  if(argc != 3)
+  {
+    fprintf(stderr, "usage: ms13diff <old.ms13> <new.ms13>\n");
+    return 2;
+  }
+  if(load_design(&a, argv[1]) || load_design(&b, argv[2]))
+  {
+    free_design(&a);
+    return 2;
+  }
+
+  printf("--- %s\n+++ %s\n", CSTR(&a, a.d->name), CSTR(&b, b.d->name));
+  printf("components: %u -> %u\n", a.d->ncomps, b.d->ncomps);
+  diffs = diff_components(&a, &b);
+  diffs += diff_nets(&a, &b);
+
+  free_design(&a);
+  free_design(&b);
+  return diffs != 0;
+}
@@ -0,0 +1,282 @@
+//Indexed component and net search across Multisim .ms13 designs
+//
+//Build:  cc -O2 -o ms13index ms13index.c netlist.c ms13.c
+//
+//  ms13index build <index> <design.ms13>...   decode once, write the index
+//  ms13index find <index> <text>              components whose refdes, family,
+//                                             part or description contain text
+//  ms13index net <index> <design> <pin>       everything on the same net as
+//                                             pins matching REFDES.PIN
+//  ms13index bench <design.ms13>...           index build time, query latency
+//
+//Queries only map the index file, the designs are never decoded again.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "ms13.h"
+#include "netlist.h"
+
+// case insensitive substring test
+static int contains(const char *hay, const char *needle)
+{
+  size_t i, n = strlen(needle);
+
+  for(; *hay; hay++)
+  {
+    for(i = 0; i < n; i++)
+      if(tolower((unsigned char)hay[i]) != tolower((unsigned char)needle[i]))
+        break;
+    if(i == n) return 1;
+  }
+  return !n;
+}
+
+// Queries --------------------------------------------------------------------
+
+typedef void (*comp_hit)(const Netlist *nl, uint32_t comp, void *ctx);
+typedef void (*pin_hit)(const Netlist *nl, uint32_t pin, void *ctx);
+
+static int find_components(const Netlist *nl, const char *text,
+                           comp_hit hit, void *ctx)
+{
+  uint32_t i;
+  int found = 0;
+
+  for(i = 0; i < nl->ncomps; i++)
+  {
+    const NlComp *c = &nl->comps[i];
+    if(contains(NL_STR(nl, c->refdes), text) ||
+       contains(NL_STR(nl, c->family), text) ||
+       contains(NL_STR(nl, c->part), text) ||
+       contains(NL_STR(nl, c->desc), text))
+    {
+      if(hit) hit(nl, i, ctx);
+      found++;
+    }
+  }
+  return found;
+}
+
+// every pin sharing a net with a pin that matches "refdes.pin"
+static int find_connected(const Netlist *nl, const char *design,
+                          const char *pin, pin_hit hit, void *ctx)
+{
+  char full[256];
+  uint32_t d, i, m;
+  int found = 0;
+
+  for(d = 0; d < nl->ndesigns; d++)
+  {
+    const NlDesign *des = &nl->designs[d];
+    if(!contains(NL_STR(nl, des->name), design))
+      continue;
+
+    for(i = des->pins; i < des->pins + des->npins; i++)
+    {
+      const NlPin *p = &nl->pins[i];
+      snprintf(full, sizeof(full), "%s.%s",
+               NL_STR(nl, nl->comps[p->comp].refdes), NL_STR(nl, p->name));
+      if(!contains(full, pin))
+        continue;
+
+      found++;
+      if(!hit) continue;
+      hit(nl, i, ctx);
+      if(p->net == NL_NONE) continue;
+      for(m = 0; m < nl->nets[p->net].nmembers; m++)
+        if(nl->members[nl->nets[p->net].members + m] != i)
+          hit(nl, nl->members[nl->nets[p->net].members + m], ctx);
+    }
+  }
+  return found;
+}
+
+static void print_comp(const Netlist *nl, uint32_t comp, void *ctx)
+{
+  const NlComp *c = &nl->comps[comp];
+
+  (void)ctx;
+  printf("%s: %s %s %s (%s)\n", NL_STR(nl, nl->designs[c->design].name),
+         NL_STR(nl, c->refdes), NL_STR(nl, c->family), NL_STR(nl, c->part),
+         NL_STR(nl, c->desc));
+}
+
+static void print_pin(const Netlist *nl, uint32_t pin, void *ctx)
+{
+  const NlPin *p = &nl->pins[pin];
+  const NlComp *c = &nl->comps[p->comp];
+  uint32_t *matched = ctx;
+
+  // the matched pin heads its group, its connections are indented
+  if(*matched != p->net || p->net == NL_NONE)
+  {
+    printf("%s: %s.%s net %s\n", NL_STR(nl, nl->designs[c->design].name),
+           NL_STR(nl, c->refdes), NL_STR(nl, p->name),
+           p->net == NL_NONE ? "(none)" : NL_STR(nl, nl->nets[p->net].name));
+    *matched = p->net;
+  }
+  else
+    printf("    %s.%s %s\n", NL_STR(nl, c->refdes), NL_STR(nl, p->name),
+           NL_STR(nl, c->part));
+}
+
+// Benchmark ------------------------------------------------------------------
+
+static double now_us(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e6 + t.tv_nsec / 1e3;
+}
+
+static int null_sink(void *ctx, const char *data, size_t len)
+{
+  *(size_t *)ctx += len;
+  (void)data;
+  return 0;
+}
+
+static void count_hit(const Netlist *nl, uint32_t i, void *ctx)
+{
+  (void)nl; (void)i;
+  ++*(int *)ctx;
+}
+
+static int bench(int argc, char **argv)
+{
+  const char *tmp = "/tmp/ms13index.bench";
+  const char *queries[] = {"DS1307", "OPA227", "Resistor", "Bluetooth"};
+  const int reps = 20, qreps = 20000;
+  Netlist nl;
+  double t, decode, build, load, total = 0;
+  size_t xml;
+  int i, r, hits = 0;
+
+  for(i = 0; i < argc; i++)
+  {
+    decode = build = 1e30;
+    for(r = 0; r < reps; r++)
+    {
+      xml = 0;
+      t = now_us();
+      if(ms13_decode(argv[i], null_sink, &xml))
+      {
+        fprintf(stderr, "ms13index: cannot decode %s\n", argv[i]);
+        return 1;
+      }
+      t = now_us() - t;
+      if(t < decode) decode = t;
+
+      nl_init(&nl);
+      t = now_us();
+      nl_add_ms13(&nl, argv[i]);
+      t = now_us() - t;
+      if(t < build) build = t;
+      if(r < reps - 1) nl_free(&nl);
+    }
+    printf("%-28.28s %8zu B xml  decode %8.0f us  index %8.0f us  "
+           "(%u comps %u pins %u nets)\n", NL_STR(&nl, nl.designs[0].name),
+           xml, decode, build, nl.ncomps, nl.npins, nl.nnets);
+    total += build;
+    nl_free(&nl);
+  }
+  printf("all designs: index build %.0f us\n", total);
+
+  // build one index for everything and time the lookups against it
+  nl_init(&nl);
+  for(i = 0; i < argc; i++)
+    nl_add_ms13(&nl, argv[i]);
+  nl_save(&nl, tmp);
+  nl_free(&nl);
+
+  t = now_us();
+  for(r = 0; r < reps; r++)
+  {
+    nl_load(&nl, tmp);
+    if(r < reps - 1) nl_free(&nl);
+  }
+  load = (now_us() - t) / reps;
+  printf("index load %.1f us\n", load);
+
+  for(i = 0; i < (int)(sizeof(queries) / sizeof(queries[0])); i++)
+  {
+    t = now_us();
+    for(r = 0; r < qreps; r++)
+      find_components(&nl, queries[i], count_hit, &hits);
+    printf("find %-10s %6.2f us/query (%d hits)\n", queries[i],
+           (now_us() - t) / qreps, find_components(&nl, queries[i], NULL, NULL));
+  }
+  t = now_us();
+  for(r = 0; r < qreps; r++)
+    find_connected(&nl, "Hexbot", "HB1.TX", count_hit, &hits);
+  printf("net  %-10s %6.2f us/query\n", "HB1.TX", (now_us() - t) / qreps);
+
+  nl_free(&nl);
+  remove(tmp);
+  return hits < 0;
+}
+
+/*****************************  MAIN  *****************************/
+
+static int usage(void)
+{
+  fprintf(stderr,
+          "usage: ms13index build <index> <design.ms13>...\n"
+          "       ms13index find <index> <text>\n"
+          "       ms13index net <index> <design> <refdes.pin>\n"
+          "       ms13index bench <design.ms13>...\n");
+  return 2;
+}
+
+int main(int argc, char **argv)
+{
+  Netlist nl;
+  uint32_t matched = NL_NONE;
+  int i, found;
+
+  if(argc < 3) return usage();
+
+  if(!strcmp(argv[1], "bench"))
+    return bench(argc - 2, argv + 2);
+
+  if(!strcmp(argv[1], "build") && argc > 3)
+  {
+    nl_init(&nl);
+    for(i = 3; i < argc; i++)
+      if(nl_add_ms13(&nl, argv[i]) < 0)
+        fprintf(stderr, "ms13index: skipping %s, not a readable .ms13\n", argv[i]);
+    if(nl_save(&nl, argv[2]))
+    {
+      fprintf(stderr, "ms13index: cannot write %s\n", argv[2]);
+      return 1;
+    }
+    printf("%u designs, %u components, %u pins, %u nets\n",
+           nl.ndesigns, nl.ncomps, nl.npins, nl.nnets);
+    nl_free(&nl);
+    return 0;
+  }
+
+  if(nl_load(&nl, argv[2]))
+  {
+    fprintf(stderr, "ms13index: %s is not an index, run build first\n", argv[2]);
+    return 1;
+  }
+
+  if(!strcmp(argv[1], "find") && argc == 4)
+    found = find_components(&nl, argv[3], print_comp, NULL);
+  else if(!strcmp(argv[1], "net") && argc == 5)
+    found = find_connected(&nl, argv[3], argv[4], print_pin, &matched);
+  else
+  {
+    nl_free(&nl);
+    return usage();
+  }
+
+  if(!found)
+    printf("no match\n");
+  nl_free(&nl);
+  return !found;
+}
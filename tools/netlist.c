@@ -0,0 +1,676 @@
+//Netlist extraction and binary index, see netlist.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ms13.h"
+#include "netlist.h"
+
+#define NL_MAGIC   "NLIDX01"
+#define MAX_ATTRS  128
+
+// SAX parser ------------------------------------------------------------------
+
+void sax_init(SaxParser *p, sax_start start, sax_end end, void *ctx)
+{
+  memset(p, 0, sizeof(*p));
+  p->start = start;
+  p->end = end;
+  p->ctx = ctx;
+}
+
+void sax_free(SaxParser *p)
+{
+  free(p->buf);
+  p->buf = NULL;
+  p->len = p->cap = 0;
+}
+
+const char *sax_attr(char **attrs, int nattrs, const char *name)
+{
+  int i;
+
+  for(i = 0; i < nattrs; i++)
+    if(!strcmp(attrs[2*i], name))
+      return attrs[2*i + 1];
+  return NULL;
+}
+
+// decode the predefined and numeric entities in place
+static void unescape(char *s)
+{
+  char *out = s;
+  unsigned long code;
+
+  while(*s)
+  {
+    if(*s != '&')
+    {
+      *out++ = *s++;
+      continue;
+    }
+    if(!strncmp(s, "&amp;", 5))       { *out++ = '&';  s += 5; }
+    else if(!strncmp(s, "&lt;", 4))   { *out++ = '<';  s += 4; }
+    else if(!strncmp(s, "&gt;", 4))   { *out++ = '>';  s += 4; }
+    else if(!strncmp(s, "&quot;", 6)) { *out++ = '"';  s += 6; }
+    else if(!strncmp(s, "&apos;", 6)) { *out++ = '\''; s += 6; }
+    else if(s[1] == '#' && strchr(s, ';'))
+    {
+      code = s[2] == 'x' ? strtoul(s + 3, NULL, 16) : strtoul(s + 2, NULL, 10);
+      *out++ = code < 256 ? (char)code : '?';
+      s = strchr(s, ';') + 1;
+    }
+    else
+      *out++ = *s++;
+  }
+  *out = 0;
+}
+
+// split one complete tag held in p->buf and raise the events
+static void sax_tag(SaxParser *p)
+{
+  char *attrs[2*MAX_ATTRS];
+  char *s = p->buf, *tag, *name;
+  int nattrs = 0, selfclose = 0;
+  char quote;
+
+  if(*s == '?' || *s == '!')
+    return;   // declaration or comment
+
+  if(*s == '/')
+  {
+    tag = ++s;
+    while(*s && *s != ' ' && *s != '\t' && *s != '\r' && *s != '\n') s++;
+    *s = 0;
+    if(p->end) p->end(p->ctx, tag);
+    return;
+  }
+
+  tag = s;
+  while(*s && *s != ' ' && *s != '\t' && *s != '\r' && *s != '\n' && *s != '/')
+    s++;
+
+  while(*s)
+  {
+    if(*s == '/') { selfclose = 1; *s++ = 0; continue; }
+    if(*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n') { *s++ = 0; continue; }
+
+    name = s;
+    while(*s && *s != '=' && *s != ' ') s++;
+    if(*s != '=') break;
+    *s++ = 0;
+    quote = *s;
+    if(quote != '"' && quote != '\'') break;
+    attrs[2*nattrs + 1] = ++s;
+    while(*s && *s != quote) s++;
+    if(!*s) break;
+    *s++ = 0;
+
+    if(nattrs < MAX_ATTRS)
+    {
+      attrs[2*nattrs] = name;
+      unescape(attrs[2*nattrs + 1]);
+      nattrs++;
+    }
+  }
+
+  if(p->start) p->start(p->ctx, tag, attrs, nattrs);
+  if(selfclose && p->end) p->end(p->ctx, tag);
+}
+
+static int sax_append(SaxParser *p, const char *data, size_t len)
+{
+  char *grown;
+
+  if(p->len + len + 1 > p->cap)
+  {
+    p->cap = (p->len + len + 1) * 2;
+    grown = realloc(p->buf, p->cap);
+    if(!grown) return -1;
+    p->buf = grown;
+  }
+  memcpy(p->buf + p->len, data, len);
+  p->len += len;
+  p->buf[p->len] = 0;
+  return 0;
+}
+
+// feed the next piece of the document, tags may straddle calls
+int sax_feed(SaxParser *p, const char *data, size_t len)
+{
+  size_t i = 0, start;
+  const char *open;
+  char c;
+
+  while(i < len)
+  {
+    if(!p->intag)
+    {
+      // text content is never needed, jump to the next tag
+      open = memchr(data + i, '<', len - i);
+      if(!open) return 0;
+      i = open - data + 1;
+      p->intag = 1;
+      p->quote = 0;
+      p->len = 0;
+      continue;
+    }
+
+    start = i;
+    while(i < len)
+    {
+      c = data[i];
+      if(p->quote)
+      {
+        if(c == p->quote) p->quote = 0;
+      }
+      else if(c == '"' || c == '\'')
+        p->quote = c;
+      else if(c == '>')
+        break;
+      i++;
+    }
+
+    if(sax_append(p, data + start, i - start))
+      return -1;
+    if(i == len)
+      return 0;   // tag continues in the next piece
+
+    i++;
+    p->intag = 0;
+    sax_tag(p);
+  }
+  return 0;
+}
+
+// Netlist building -----------------------------------------------------------
+
+enum { OBJ_NONE, OBJ_COMP, OBJ_PORT, OBJ_NODE };
+
+typedef struct { uint32_t id, refdes, family, part, desc; } RawComp;
+typedef struct { uint32_t id, name, comp, node; } RawPort;
+typedef struct { uint32_t id, name; } RawNode;
+typedef struct { uint32_t id, index; } IdMap;
+
+typedef struct
+{
+  uint32_t *hash;             // string pool dedupe, offset+1 per slot
+  uint32_t hashcap, hashused;
+  uint32_t capstrings, capdesigns, capcomps, cappins, capnets, capmembers;
+
+  // per design scratch, raw CiIDs as read
+  RawComp *rc; uint32_t nrc, caprc;
+  RawPort *rp; uint32_t nrp, caprp;
+  RawNode *rn; uint32_t nrn, caprn;
+
+  // SAX state
+  Netlist *nl;
+  uint32_t pending, design_name;
+  int obj, objdepth, depth;
+  int collseen, incoll, collindex, innodes;
+  RawComp comp;
+  RawPort port;
+  RawNode node;
+} Build;
+
+// grow a flat array so that one more element fits
+static void *grow(void *arr, uint32_t count, uint32_t *cap, size_t size)
+{
+  void *grown;
+
+  if(count < *cap) return arr;
+  *cap = *cap ? *cap * 2 : 64;
+  grown = realloc(arr, (size_t)*cap * size);
+  if(!grown)
+  {
+    fprintf(stderr, "netlist: out of memory\n");
+    exit(1);
+  }
+  return grown;
+}
+
+#define PUSH(arr, n, cap) \
+  ((arr) = grow((arr), (n), &(cap), sizeof(*(arr))), &(arr)[(n)++])
+
+static uint32_t hash_str(const char *s)
+{
+  uint32_t h = 2166136261u;
+  while(*s) h = (h ^ (unsigned char)*s++) * 16777619u;
+  return h;
+}
+
+// add a string to the pool once, returns its offset
+static uint32_t intern(Build *b, const char *s)
+{
+  Netlist *nl = b->nl;
+  uint32_t h, slot, off, i, len;
+  uint32_t *old;
+
+  if(2 * (b->hashused + 1) > b->hashcap)
+  {
+    old = b->hash;
+    i = b->hashcap;
+    b->hashcap = b->hashcap ? b->hashcap * 2 : 1024;
+    b->hash = calloc(b->hashcap, sizeof(uint32_t));
+    while(i--)
+      if(old[i])
+      {
+        slot = hash_str(nl->strings + old[i] - 1) & (b->hashcap - 1);
+        while(b->hash[slot]) slot = (slot + 1) & (b->hashcap - 1);
+        b->hash[slot] = old[i];
+      }
+    free(old);
+  }
+
+  h = hash_str(s);
+  for(slot = h & (b->hashcap - 1); b->hash[slot];
+      slot = (slot + 1) & (b->hashcap - 1))
+    if(!strcmp(nl->strings + b->hash[slot] - 1, s))
+      return b->hash[slot] - 1;
+
+  len = strlen(s) + 1;
+  while(nl->nstrings + len > b->capstrings)
+  {
+    b->capstrings = b->capstrings ? b->capstrings * 2 : 4096;
+    nl->strings = realloc(nl->strings, b->capstrings);
+  }
+  off = nl->nstrings;
+  memcpy(nl->strings + off, s, len);
+  nl->nstrings += len;
+
+  b->hash[slot] = off + 1;
+  b->hashused++;
+  return off;
+}
+
+// Multisim prefixes its ASCII strings with "&ASC"
+static uint32_t intern_value(Build *b, const char *s)
+{
+  if(!s) return intern(b, "");
+  if(!strncmp(s, "&ASC", 4)) s += 4;
+  return intern(b, s);
+}
+
+static uint32_t parse_id(const char *s)
+{
+  return s ? (uint32_t)strtoul(s, NULL, 10) : NL_NONE;
+}
+
+static void on_start(void *ctx, const char *tag, char **attrs, int nattrs)
+{
+  Build *b = ctx;
+  const char *v;
+
+  b->depth++;
+
+  if(!strcmp(tag, "Item"))
+  {
+    v = sax_attr(attrs, nattrs, "CiID");
+    if(v && sax_attr(attrs, nattrs, "Class"))
+      b->pending = parse_id(v);           // wrapper of a new object
+    else if(v && b->obj == OBJ_PORT && b->innodes && b->port.node == NL_NONE)
+      b->port.node = parse_id(v);         // first node of this port
+    else if(b->obj == OBJ_COMP && b->incoll &&
+            (v = sax_attr(attrs, nattrs, "Value")))
+    {
+      // family, model and description in the first string collection
+      if(b->collindex == 0) b->comp.family = intern_value(b, v);
+      if(b->collindex == 1) b->comp.part = intern_value(b, v);
+      if(b->collindex == 20) b->comp.desc = intern_value(b, v);
+      b->collindex++;
+    }
+    return;
+  }
+
+  if(b->obj == OBJ_NONE)
+  {
+    if(!strcmp(tag, "CiComponent") || !strcmp(tag, "CiInstComponent"))
+    {
+      b->obj = OBJ_COMP;
+      b->comp.id = b->pending;
+      b->comp.refdes = intern_value(b, sax_attr(attrs, nattrs, "LocalName"));
+      b->comp.family = b->comp.part = b->comp.desc = intern(b, "");
+      b->collseen = b->incoll = b->collindex = 0;
+    }
+    else if(!strcmp(tag, "CiPort"))
+    {
+      b->obj = OBJ_PORT;
+      b->port.id = b->pending;
+      b->port.name = intern_value(b, sax_attr(attrs, nattrs, "LocalName"));
+      b->port.comp = parse_id(sax_attr(attrs, nattrs, "Component"));
+      b->port.node = NL_NONE;
+      b->innodes = 0;
+    }
+    else if(!strcmp(tag, "CiNode"))
+    {
+      b->obj = OBJ_NODE;
+      b->node.id = b->pending;
+      b->node.name = intern_value(b, sax_attr(attrs, nattrs, "LocalName"));
+    }
+    else if(!strcmp(tag, "Project") && b->design_name == NL_NONE)
+    {
+      v = sax_attr(attrs, nattrs, "Name");
+      if(v) b->design_name = intern_value(b, v);
+    }
+    if(b->obj != OBJ_NONE)
+      b->objdepth = b->depth;
+    return;
+  }
+
+  if(b->obj == OBJ_COMP && !strcmp(tag, "CiaCollString") && !b->collseen)
+    b->collseen = b->incoll = 1;
+  else if(b->obj == OBJ_PORT && !strcmp(tag, "Nodes"))
+    b->innodes = 1;
+}
+
+static void on_end(void *ctx, const char *tag)
+{
+  Build *b = ctx;
+
+  if(b->obj != OBJ_NONE && b->depth == b->objdepth)
+  {
+    if(b->obj == OBJ_COMP)
+      *PUSH(b->rc, b->nrc, b->caprc) = b->comp;
+    else if(b->obj == OBJ_PORT)
+      *PUSH(b->rp, b->nrp, b->caprp) = b->port;
+    else
+      *PUSH(b->rn, b->nrn, b->caprn) = b->node;
+    b->obj = OBJ_NONE;
+  }
+  else if(b->obj == OBJ_COMP && !strcmp(tag, "CiaCollString"))
+    b->incoll = 0;
+  else if(b->obj == OBJ_PORT && !strcmp(tag, "Nodes"))
+    b->innodes = 0;
+
+  b->depth--;
+}
+
+static int cmp_idmap(const void *a, const void *b)
+{
+  const IdMap *x = a, *y = b;
+  return x->id < y->id ? -1 : x->id > y->id;
+}
+
+static uint32_t find_id(const IdMap *map, uint32_t n, uint32_t id)
+{
+  IdMap key = {id, 0};
+  const IdMap *hit = bsearch(&key, map, n, sizeof(IdMap), cmp_idmap);
+  return hit ? hit->index : NL_NONE;
+}
+
+static IdMap *sorted_ids(const void *recs, uint32_t n, size_t size)
+{
+  IdMap *map = malloc((n ? n : 1) * sizeof(IdMap));
+  uint32_t i;
+
+  for(i = 0; i < n; i++)
+  {
+    map[i].id = *(const uint32_t *)((const char *)recs + i * size);
+    map[i].index = i;
+  }
+  qsort(map, n, sizeof(IdMap), cmp_idmap);
+  return map;
+}
+
+// resolve the raw CiID references of one design into the flat arrays
+static int finish_design(Build *b, const char *path)
+{
+  Netlist *nl = b->nl;
+  NlDesign *d;
+  IdMap *compmap = sorted_ids(b->rc, b->nrc, sizeof(RawComp));
+  IdMap *nodemap = sorted_ids(b->rn, b->nrn, sizeof(RawNode));
+  uint32_t *owner = malloc((b->nrp ? b->nrp : 1) * sizeof(uint32_t));
+  uint32_t *fill;
+  uint32_t i, c, n, index = nl->ndesigns;
+
+  d = PUSH(nl->designs, nl->ndesigns, b->capdesigns);
+  d->name = b->design_name != NL_NONE ? b->design_name : intern(b, path);
+  d->path = intern(b, path);
+  d->comps = nl->ncomps;
+  d->ncomps = b->nrc;
+  d->pins = nl->npins;
+  d->nets = nl->nnets;
+  d->nnets = b->nrn;
+
+  for(i = 0; i < b->nrn; i++)
+  {
+    NlNet *net = PUSH(nl->nets, nl->nnets, b->capnets);
+    net->name = b->rn[i].name;
+    net->design = index;
+    net->members = 0;
+    net->nmembers = 0;
+  }
+
+  // pins grouped by component, file order kept inside each group
+  for(i = 0; i < b->nrp; i++)
+    owner[i] = find_id(compmap, b->nrc, b->rp[i].comp);
+
+  for(c = 0; c < b->nrc; c++)
+  {
+    NlComp *comp = PUSH(nl->comps, nl->ncomps, b->capcomps);
+    comp->refdes = b->rc[c].refdes;
+    comp->family = b->rc[c].family;
+    comp->part = b->rc[c].part;
+    comp->desc = b->rc[c].desc;
+    comp->design = index;
+    comp->pins = nl->npins;
+    comp->npins = 0;
+
+    for(i = 0; i < b->nrp; i++)
+      if(owner[i] == c)
+      {
+        NlPin *pin = PUSH(nl->pins, nl->npins, b->cappins);
+        pin->name = b->rp[i].name;
+        pin->comp = d->comps + c;
+        n = find_id(nodemap, b->nrn, b->rp[i].node);
+        pin->net = n == NL_NONE ? NL_NONE : d->nets + n;
+        comp->npins++;
+        if(n != NL_NONE)
+          nl->nets[d->nets + n].nmembers++;
+      }
+  }
+  d = &nl->designs[index];
+  d->npins = nl->npins - d->pins;
+
+  // members: pin indices grouped by net (counting sort)
+  fill = calloc(b->nrn ? b->nrn : 1, sizeof(uint32_t));
+  for(n = 0; n < b->nrn; n++)
+  {
+    nl->nets[d->nets + n].members = nl->nmembers;
+    for(i = 0; i < nl->nets[d->nets + n].nmembers; i++)
+      *PUSH(nl->members, nl->nmembers, b->capmembers) = NL_NONE;
+  }
+  for(i = d->pins; i < nl->npins; i++)
+    if(nl->pins[i].net != NL_NONE)
+    {
+      n = nl->pins[i].net - d->nets;
+      nl->members[nl->nets[d->nets + n].members + fill[n]++] = i;
+    }
+
+  free(fill);
+  free(owner);
+  free(compmap);
+  free(nodemap);
+  b->nrc = b->nrp = b->nrn = 0;
+  return index;
+}
+
+void nl_init(Netlist *nl)
+{
+  memset(nl, 0, sizeof(*nl));
+}
+
+void nl_free(Netlist *nl)
+{
+  Build *b = nl->build;
+
+  if(nl->mapping)
+    munmap(nl->mapping, nl->maplen);
+  else
+  {
+    free(nl->designs);
+    free(nl->comps);
+    free(nl->pins);
+    free(nl->nets);
+    free(nl->members);
+    free(nl->strings);
+  }
+  if(b)
+  {
+    free(b->hash);
+    free(b->rc);
+    free(b->rp);
+    free(b->rn);
+    free(b);
+  }
+  nl_init(nl);
+}
+
+static Build *builder(Netlist *nl)
+{
+  Build *b = nl->build;
+
+  if(nl->mapping)
+    return NULL;  // loaded indexes are read only
+  if(!b)
+  {
+    b = nl->build = calloc(1, sizeof(Build));
+    b->nl = nl;
+    intern(b, "");
+  }
+  b->pending = NL_NONE;
+  b->design_name = NL_NONE;
+  b->obj = OBJ_NONE;
+  b->depth = 0;
+  return b;
+}
+
+static int feed_sax(void *ctx, const char *data, size_t len)
+{
+  return sax_feed(ctx, data, len);
+}
+
+int nl_add_ms13(Netlist *nl, const char *path)
+{
+  Build *b = builder(nl);
+  SaxParser p;
+  int result;
+
+  if(!b) return -1;
+  sax_init(&p, on_start, on_end, b);
+  result = ms13_decode(path, feed_sax, &p);
+  sax_free(&p);
+  if(result)
+  {
+    b->nrc = b->nrp = b->nrn = 0;
+    return -1;
+  }
+  return finish_design(b, path);
+}
+
+int nl_add_xml(Netlist *nl, const char *path, const char *xml, size_t len)
+{
+  Build *b = builder(nl);
+  SaxParser p;
+  int result;
+
+  if(!b) return -1;
+  sax_init(&p, on_start, on_end, b);
+  result = sax_feed(&p, xml, len);
+  sax_free(&p);
+  if(result)
+  {
+    b->nrc = b->nrp = b->nrn = 0;
+    return -1;
+  }
+  return finish_design(b, path);
+}
+
+// Index file -----------------------------------------------------------------
+//
+// "NLIDX01\0", six uint32 counts (designs, comps, pins, nets, members, string
+// bytes), then each array in that order.  Host byte order, every field is 32
+// bit so the arrays stay aligned when the file is mapped.
+
+typedef struct
+{
+  char magic[8];
+  uint32_t ndesigns, ncomps, npins, nnets, nmembers, nstrings;
+} NlHeader;
+
+int nl_save(const Netlist *nl, const char *path)
+{
+  NlHeader h;
+  FILE *file = fopen(path, "wb");
+  int ok;
+
+  if(!file) return -1;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, NL_MAGIC, sizeof(NL_MAGIC));
+  h.ndesigns = nl->ndesigns;
+  h.ncomps = nl->ncomps;
+  h.npins = nl->npins;
+  h.nnets = nl->nnets;
+  h.nmembers = nl->nmembers;
+  h.nstrings = nl->nstrings;
+
+  ok = fwrite(&h, sizeof(h), 1, file) == 1;
+  ok = ok && fwrite(nl->designs, sizeof(NlDesign), h.ndesigns, file) == h.ndesigns;
+  ok = ok && fwrite(nl->comps, sizeof(NlComp), h.ncomps, file) == h.ncomps;
+  ok = ok && fwrite(nl->pins, sizeof(NlPin), h.npins, file) == h.npins;
+  ok = ok && fwrite(nl->nets, sizeof(NlNet), h.nnets, file) == h.nnets;
+  ok = ok && fwrite(nl->members, sizeof(uint32_t), h.nmembers, file) == h.nmembers;
+  ok = ok && fwrite(nl->strings, 1, h.nstrings, file) == h.nstrings;
+  ok = !fclose(file) && ok;
+  return ok ? 0 : -1;
+}
+
+int nl_load(Netlist *nl, const char *path)
+{
+  struct stat st;
+  const NlHeader *h;
+  char *p;
+  size_t need;
+  int fd = open(path, O_RDONLY);
+
+  nl_init(nl);
+  if(fd < 0) return -1;
+  if(fstat(fd, &st) || (size_t)st.st_size < sizeof(NlHeader))
+  {
+    close(fd);
+    return -1;
+  }
+
+  nl->maplen = st.st_size;
+  nl->mapping = mmap(NULL, nl->maplen, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(nl->mapping == MAP_FAILED)
+  {
+    nl_init(nl);
+    return -1;
+  }
+
+  h = nl->mapping;
+  need = sizeof(NlHeader) + (size_t)h->ndesigns * sizeof(NlDesign) +
+         (size_t)h->ncomps * sizeof(NlComp) + (size_t)h->npins * sizeof(NlPin) +
+         (size_t)h->nnets * sizeof(NlNet) + (size_t)h->nmembers * 4 + h->nstrings;
+  if(memcmp(h->magic, NL_MAGIC, sizeof(NL_MAGIC)) || need != nl->maplen ||
+     !h->nstrings || ((char *)nl->mapping)[nl->maplen - 1])
+  {
+    nl_free(nl);
+    return -1;
+  }
+
+  p = (char *)(h + 1);
+  nl->designs = (NlDesign *)p;  nl->ndesigns = h->ndesigns;  p += h->ndesigns * sizeof(NlDesign);
+  nl->comps = (NlComp *)p;      nl->ncomps = h->ncomps;      p += h->ncomps * sizeof(NlComp);
+  nl->pins = (NlPin *)p;        nl->npins = h->npins;        p += h->npins * sizeof(NlPin);
+  nl->nets = (NlNet *)p;        nl->nnets = h->nnets;        p += h->nnets * sizeof(NlNet);
+  nl->members = (uint32_t *)p;  nl->nmembers = h->nmembers;  p += h->nmembers * 4;
+  nl->strings = p;              nl->nstrings = h->nstrings;
+  return 0;
+}
@@ -0,0 +1,107 @@
+//Netlist extraction from decoded Multisim XML and the compact binary index
+//
+//The electrical side of a Multisim design lives in three object kinds, all
+//wrapped in <Item CiID="..." Class="..."> and cross referenced by CiID:
+//  CiComponent / CiInstComponent  refdes in LocalName, part strings in the
+//                                 first CiaCollString of its Attributes
+//  CiPort                         pin name in LocalName, owner in Component,
+//                                 attached node(s) under <Nodes>
+//  CiNode                         net number in LocalName
+//Everything we need sits in attributes, so a tag level SAX pass is enough.
+//
+//A Netlist keeps all strings in one pool and all records as flat arrays of
+//32 bit fields, so the index file is just those arrays written back to back
+//and loading it is a single read with no parsing.
+
+#ifndef NETLIST_H
+#define NETLIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define NL_NONE 0xFFFFFFFFu
+
+// SAX parser ------------------------------------------------------------------
+
+// attrs holds nattrs name/value pairs, values already entity decoded
+typedef void (*sax_start)(void *ctx, const char *tag,
+                          char **attrs, int nattrs);
+typedef void (*sax_end)(void *ctx, const char *tag);
+
+typedef struct
+{
+  sax_start start;
+  sax_end end;
+  void *ctx;
+  char *buf;          // tag text carried across feed() calls
+  size_t len, cap;
+  int intag, quote;
+} SaxParser;
+
+void sax_init(SaxParser *p, sax_start start, sax_end end, void *ctx);
+int  sax_feed(SaxParser *p, const char *data, size_t len);
+void sax_free(SaxParser *p);
+
+// find an attribute value by name, NULL if absent
+const char *sax_attr(char **attrs, int nattrs, const char *name);
+
+// Netlist model ---------------------------------------------------------------
+
+typedef struct
+{
+  uint32_t name;              // string offsets into Netlist.strings
+  uint32_t path;
+  uint32_t comps, ncomps;     // ranges into the flat arrays below
+  uint32_t pins, npins;
+  uint32_t nets, nnets;
+} NlDesign;
+
+typedef struct
+{
+  uint32_t refdes, family, part, desc;
+  uint32_t design;
+  uint32_t pins, npins;
+} NlComp;
+
+typedef struct
+{
+  uint32_t name;
+  uint32_t comp;
+  uint32_t net;               // NL_NONE when unconnected
+} NlPin;
+
+typedef struct
+{
+  uint32_t name;
+  uint32_t design;
+  uint32_t members, nmembers; // range into Netlist.members (pin indices)
+} NlNet;
+
+typedef struct
+{
+  NlDesign *designs;  uint32_t ndesigns;
+  NlComp   *comps;    uint32_t ncomps;
+  NlPin    *pins;     uint32_t npins;
+  NlNet    *nets;     uint32_t nnets;
+  uint32_t *members;  uint32_t nmembers;
+  char     *strings;  uint32_t nstrings;   // pool size in bytes
+  void     *mapping;  size_t maplen;       // set when loaded from an index
+  void     *build;                         // private state while adding
+} Netlist;
+
+void nl_init(Netlist *nl);
+void nl_free(Netlist *nl);
+
+// decode an .ms13 file and append its netlist, returns design index or -1
+int nl_add_ms13(Netlist *nl, const char *path);
+
+// append the netlist of an already decoded XML document
+int nl_add_xml(Netlist *nl, const char *path, const char *xml, size_t len);
+
+// write/read the binary index, 0 on success
+int nl_save(const Netlist *nl, const char *path);
+int nl_load(Netlist *nl, const char *path);
+
+#define NL_STR(nl, off) ((nl)->strings + (off))
+
+#endif
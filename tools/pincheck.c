@@ -0,0 +1,567 @@
+//Cross-check firmware peripheral usage against a wiring netlist
+//
+//Build:  cc -O2 -o pincheck pincheck.c netlist.c ms13.c
+//
+//  pincheck [-m pinmap] [-c cache | -n] <design.ms13> <program.c>...
+//
+//Every program is scanned for SFR and NESI+ object usage (comments, strings
+//and preprocessor lines skipped), each peripheral is looked up in the pin map
+//(default hexbot.pinmap next to the tool) and the mapped terminals are checked
+//against the decoded netlist.  Flagged:
+//  - peripherals with no documented wiring
+//  - mapped terminals missing from the design or left unconnected
+//  - two peripherals used by one program landing on the same net
+//  - a peripheral whose nets do not reach the part the map expects on it
+//    for that program
+//The parsed netlist is cached as a netlist index and reused while it is
+//newer than the design, so batch runs over all programs skip the decode.
+//Exit status is 1 if any program has errors.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <errno.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include "netlist.h"
+
+#define MAX_PERIPH  64
+#define MAX_TERMS   8
+#define NAME_LEN    32
+
+// Pin map --------------------------------------------------------------------
+
+typedef struct
+{
+  char name[NAME_LEN];
+  char alias[NAME_LEN];       // "@OC1" style entries
+  int onboard;
+  int nterms;
+  char term[MAX_TERMS][64];
+} MapEntry;
+
+// "expect BORON2* UART2 Geiger": programs matching the pattern need a part
+// whose refdes, family, part or description holds the text on that peripheral
+typedef struct
+{
+  char program[64];
+  char name[NAME_LEN];
+  char part[NAME_LEN];
+} Expect;
+
+static MapEntry pinmap[MAX_PERIPH];
+static int npinmap = 0;
+static Expect expects[MAX_PERIPH];
+static int nexpects = 0;
+
+static MapEntry *map_lookup(const char *name)
+{
+  int i;
+  for(i = 0; i < npinmap; i++)
+    if(!strcmp(pinmap[i].name, name))
+      return &pinmap[i];
+  return NULL;
+}
+
+static int load_pinmap(const char *path)
+{
+  char line[512], *tok;
+  FILE *file = fopen(path, "r");
+  MapEntry *e;
+
+  if(!file) return -1;
+  while(fgets(line, sizeof(line), file))
+  {
+    if((tok = strchr(line, '#'))) *tok = 0;
+    tok = strtok(line, " \t\r\n");
+    if(tok && !strcmp(tok, "expect"))
+    {
+      char *program = strtok(NULL, " \t\r\n"), *name = strtok(NULL, " \t\r\n");
+      char *part = strtok(NULL, " \t\r\n");
+
+      if(!part || nexpects == MAX_PERIPH) continue;
+      snprintf(expects[nexpects].program, sizeof(expects[0].program), "%s", program);
+      snprintf(expects[nexpects].name, NAME_LEN, "%s", name);
+      snprintf(expects[nexpects++].part, NAME_LEN, "%s", part);
+      continue;
+    }
+    if(!tok || npinmap == MAX_PERIPH) continue;
+
+    e = &pinmap[npinmap++];
+    memset(e, 0, sizeof(*e));
+    snprintf(e->name, NAME_LEN, "%s", tok);
+    while((tok = strtok(NULL, " \t\r\n")))
+    {
+      if(*tok == '@')
+        snprintf(e->alias, NAME_LEN, "%s", tok + 1);
+      else if(!strcmp(tok, "onboard"))
+        e->onboard = 1;
+      else if(e->nterms < MAX_TERMS)
+        snprintf(e->term[e->nterms++], 64, "%s", tok);
+    }
+  }
+  fclose(file);
+  return 0;
+}
+
+// Source scanning ------------------------------------------------------------
+
+typedef struct
+{
+  char name[NAME_LEN];
+  int line;                   // first use
+} Use;
+
+typedef struct
+{
+  Use use[MAX_PERIPH];
+  int nuse;
+} Usage;
+
+static void add_use(Usage *u, const char *name, int line)
+{
+  int i;
+  for(i = 0; i < u->nuse; i++)
+    if(!strcmp(u->use[i].name, name))
+      return;
+  if(u->nuse == MAX_PERIPH) return;
+  snprintf(u->use[u->nuse].name, NAME_LEN, "%s", name);
+  u->use[u->nuse++].line = line;
+}
+
+// SFR name -> peripheral, e.g. I2C2CONbits -> I2C2, MI2C2IF -> I2C2
+static int classify_sfr(const char *id, char *out)
+{
+  const char *p;
+  int n;
+
+  if(!strncmp(id, "MI2C", 4) || !strncmp(id, "SI2C", 4)) id++;
+  if(!strncmp(id, "I2C", 3) && isdigit((unsigned char)id[3]))
+    return sprintf(out, "I2C%c", id[3]);
+
+  if(id[0] == 'U' && isdigit((unsigned char)id[1]) &&
+     (!strncmp(id + 2, "MODE", 4) || !strncmp(id + 2, "STA", 3) ||
+      !strncmp(id + 2, "BRG", 3) || !strncmp(id + 2, "TXREG", 5) ||
+      !strncmp(id + 2, "RXREG", 5) || !strncmp(id + 2, "RXIF", 4) ||
+      !strncmp(id + 2, "TXIF", 4)))
+    return sprintf(out, "UART%c", id[1]);
+
+  if((id[0] == 'O' || id[0] == 'I') && id[1] == 'C' &&
+     isdigit((unsigned char)id[2]))
+  {
+    n = strtol(id + 2, (char **)&p, 10);
+    if(!strncmp(p, "CON", 3) || !strncmp(p, "RS", 2) || !strcmp(p, "R") ||
+       !strncmp(p, "BUF", 3) || !strncmp(p, "TMR", 3) || !strncmp(p, "IF", 2))
+      return sprintf(out, "%cC%d", id[0], n);
+  }
+
+  if(id[0] == 'T' && isdigit((unsigned char)id[1]) && !strncmp(id + 2, "CON", 3))
+    return sprintf(out, "TMR%c", id[1]);
+  if(!strncmp(id, "TMR", 3) && isdigit((unsigned char)id[3]))
+    return sprintf(out, "TMR%c", id[3]);
+  if(!strncmp(id, "AD1", 3))
+    return sprintf(out, "ADC1");
+  if(!strncmp(id, "INT", 3) && isdigit((unsigned char)id[3]) && id[4] == 'I')
+    return sprintf(out, "INT%c", id[3]);
+  return 0;
+}
+
+// NESI+ object (and member) -> peripheral
+static int classify_object(const char *id, const char *member, char *out)
+{
+  static const char *objects[] = {
+    "ledR", "ledG", "ledB", "powerDriverA", "powerDriverB", "button", "usb"};
+  size_t i;
+
+  if(!strcmp(id, "uart1") || !strcmp(id, "uart2"))
+    return sprintf(out, "UART%c", id[4]);
+  if(!strcmp(id, "resistiveSensors") && !strncmp(member, "getQ", 4))
+    return sprintf(out, "RSQ%s", member + 4);
+  if(!strcmp(id, "dataLog") || !strncmp(id, "FSf", 3))
+    return sprintf(out, "SD");
+  for(i = 0; i < sizeof(objects) / sizeof(objects[0]); i++)
+    if(!strcmp(id, objects[i]))
+      return sprintf(out, "%s", id);
+  return 0;
+}
+
+static int scan_source(const char *path, Usage *u)
+{
+  char prev[NAME_LEN] = "", id[NAME_LEN], found[NAME_LEN];
+  int line = 1, bol = 1, dot = 0, c, n;
+  FILE *file = fopen(path, "r");
+
+  u->nuse = 0;
+  if(!file) return -1;
+
+  while((c = getc(file)) != EOF)
+  {
+    if(c == '\n') { line++; bol = 1; continue; }
+    if(isspace(c)) continue;
+
+    if(bol && c == '#')                   // preprocessor line
+    {
+      while((c = getc(file)) != EOF && c != '\n');
+      line++;
+      continue;
+    }
+    bol = 0;
+
+    if(c == '/')
+    {
+      c = getc(file);
+      if(c == '/')
+      {
+        while((c = getc(file)) != EOF && c != '\n');
+        line++;
+        bol = 1;
+        continue;
+      }
+      if(c == '*')
+      {
+        int last = 0;
+        while((c = getc(file)) != EOF && !(last == '*' && c == '/'))
+        {
+          if(c == '\n') line++;
+          last = c;
+        }
+        continue;
+      }
+      ungetc(c, file);
+      dot = 0;
+      continue;
+    }
+
+    if(c == '"' || c == '\'')
+    {
+      int quote = c;
+      while((c = getc(file)) != EOF && c != quote)
+      {
+        if(c == '\\') c = getc(file);
+        if(c == '\n') line++;
+      }
+      dot = 0;
+      continue;
+    }
+
+    if(isalpha(c) || c == '_')
+    {
+      n = 0;
+      do
+      {
+        if(n < NAME_LEN - 1) id[n++] = c;
+      } while((c = getc(file)) != EOF && (isalnum(c) || c == '_'));
+      id[n] = 0;
+      ungetc(c, file);
+
+      if((dot && classify_object(prev, id, found)) ||
+         (!dot && strcmp(id, "resistiveSensors") && classify_object(id, "", found)) ||
+         classify_sfr(id, found))
+        add_use(u, found, line);
+
+      if(!dot) snprintf(prev, NAME_LEN, "%s", id);
+      dot = 0;
+      continue;
+    }
+
+    dot = c == '.';
+    if(!dot) prev[0] = 0;
+  }
+  fclose(file);
+  return 0;
+}
+
+// Netlist checks -------------------------------------------------------------
+
+// pin index for "REFDES.PIN", NL_NONE if the design has no such terminal
+static uint32_t find_terminal(const Netlist *nl, const char *term)
+{
+  const char *dot = strchr(term, '.');
+  size_t len = dot ? (size_t)(dot - term) : strlen(term);
+  uint32_t i;
+
+  for(i = 0; i < nl->npins; i++)
+  {
+    const char *ref = NL_STR(nl, nl->comps[nl->pins[i].comp].refdes);
+    if(strlen(ref) == len && !strncmp(ref, term, len) &&
+       !strcmp(NL_STR(nl, nl->pins[i].name), dot ? dot + 1 : ""))
+      return i;
+  }
+  return NL_NONE;
+}
+
+// case insensitive substring test
+static int contains(const char *hay, const char *needle)
+{
+  size_t i, n = strlen(needle);
+
+  for(; *hay; hay++)
+  {
+    for(i = 0; i < n; i++)
+      if(tolower((unsigned char)hay[i]) != tolower((unsigned char)needle[i]))
+        break;
+    if(i == n) return 1;
+  }
+  return 0;
+}
+
+// whether a part matching text sits on one of e's nets, the refdes of the
+// parts it does reach go to seen
+static int reaches(const Netlist *nl, const MapEntry *e, const char *text,
+                   char *seen, size_t len)
+{
+  uint32_t pin, net, other, m;
+  const NlComp *c;
+  int t;
+
+  seen[0] = 0;
+  for(t = 0; t < e->nterms; t++)
+  {
+    pin = find_terminal(nl, e->term[t]);
+    if(pin == NL_NONE || (net = nl->pins[pin].net) == NL_NONE) continue;
+    for(m = 0; m < nl->nets[net].nmembers; m++)
+    {
+      other = nl->members[nl->nets[net].members + m];
+      if(nl->pins[other].comp == nl->pins[pin].comp) continue;
+      c = &nl->comps[nl->pins[other].comp];
+      if(contains(NL_STR(nl, c->refdes), text) || contains(NL_STR(nl, c->family), text) ||
+         contains(NL_STR(nl, c->part), text) || contains(NL_STR(nl, c->desc), text))
+        return 1;
+      // unnamed pins are the design's junctions, not parts
+      if(*NL_STR(nl, nl->pins[other].name) && !strstr(seen, NL_STR(nl, c->refdes)) &&
+         strlen(seen) + 16 < len)
+        snprintf(seen + strlen(seen), len - strlen(seen), "%s%s",
+                 *seen ? " " : "", NL_STR(nl, c->refdes));
+    }
+  }
+  return 0;
+}
+
+// follow @aliases to the peripheral that owns the wiring
+static MapEntry *resolve(const char *name)
+{
+  MapEntry *e = map_lookup(name);
+  int hops = 0;
+
+  while(e && *e->alias && hops++ < MAX_PERIPH)
+    e = map_lookup(e->alias);
+  return e;
+}
+
+static int check_program(const Netlist *nl, const char *path, int verbose)
+{
+  Usage u;
+  MapEntry *e;
+  uint32_t pin, net, owner[MAX_PERIPH * MAX_TERMS];
+  const char *ownername[MAX_PERIPH * MAX_TERMS];
+  int nowner = 0, errors = 0, i, t, k;
+  const char *design = NL_STR(nl, nl->designs[0].name);
+  const char *base = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+  char seen[128];
+
+  if(scan_source(path, &u))
+  {
+    printf("%s: cannot read\n", path);
+    return 1;
+  }
+  printf("%s\n", path);
+
+  for(i = 0; i < u.nuse; i++)
+  {
+    const char *name = u.use[i].name;
+    e = resolve(name);
+
+    if(!e)
+    {
+      printf("  ERROR  %-12s line %-4d no wiring for it in %s\n",
+             name, u.use[i].line, design);
+      errors++;
+      continue;
+    }
+    if(e->onboard)
+    {
+      if(verbose)
+        printf("  ok     %-12s line %-4d on board\n", name, u.use[i].line);
+      continue;
+    }
+
+    for(t = 0; t < e->nterms; t++)
+    {
+      pin = find_terminal(nl, e->term[t]);
+      net = pin == NL_NONE ? NL_NONE : nl->pins[pin].net;
+
+      if(pin == NL_NONE)
+      {
+        printf("  ERROR  %-12s line %-4d %s is not in %s\n",
+               name, u.use[i].line, e->term[t], design);
+        errors++;
+        continue;
+      }
+      if(net == NL_NONE || nl->nets[net].nmembers < 2)
+      {
+        printf("  ERROR  %-12s line %-4d %s is not connected to anything\n",
+               name, u.use[i].line, e->term[t]);
+        errors++;
+        continue;
+      }
+
+      // one net, one driver: catch two peripherals wired together
+      for(k = 0; k < nowner; k++)
+        if(owner[k] == net && strcmp(ownername[k], e->name))
+        {
+          printf("  ERROR  %-12s line %-4d shares net %s with %s\n",
+                 name, u.use[i].line, NL_STR(nl, nl->nets[net].name),
+                 ownername[k]);
+          errors++;
+        }
+      if(nowner < MAX_PERIPH * MAX_TERMS)
+      {
+        owner[nowner] = net;
+        ownername[nowner++] = e->name;
+      }
+
+      if(verbose)
+      {
+        uint32_t m, other;
+        printf("  ok     %-12s line %-4d %s net %s:", name, u.use[i].line,
+               e->term[t], NL_STR(nl, nl->nets[net].name));
+        for(m = 0; m < nl->nets[net].nmembers; m++)
+          if((other = nl->members[nl->nets[net].members + m]) != pin)
+            printf(*NL_STR(nl, nl->pins[other].name) ? " %s.%s" : " %s",
+                   NL_STR(nl, nl->comps[nl->pins[other].comp].refdes),
+                   NL_STR(nl, nl->pins[other].name));
+        printf("\n");
+      }
+    }
+
+    for(k = 0; k < nexpects; k++)
+      if(!strcmp(expects[k].name, e->name) && !fnmatch(expects[k].program, base, 0) &&
+         !reaches(nl, e, expects[k].part, seen, sizeof(seen)))
+      {
+        printf("  ERROR  %-12s line %-4d reaches %s, not the %s it needs\n",
+               name, u.use[i].line, *seen ? seen : "nothing", expects[k].part);
+        errors++;
+      }
+  }
+
+  if(!errors)
+    printf("  %d peripherals match the wiring\n", u.nuse);
+  return errors;
+}
+
+// Netlist cache --------------------------------------------------------------
+
+static void default_cache(const char *design, char *out, size_t len)
+{
+  char full[PATH_MAX];
+  const char *base = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+  uint32_t h = 2166136261u;
+  const char *s;
+
+  if(!realpath(design, full))
+    snprintf(full, sizeof(full), "%s", design);
+  for(s = full; *s; s++)
+    h = (h ^ (unsigned char)*s) * 16777619u;
+
+  if(base && *base)
+    snprintf(out, len, "%s", base);
+  else
+    snprintf(out, len, "%s/.cache", home ? home : "/tmp");
+  mkdir(out, 0755);
+  snprintf(out + strlen(out), len - strlen(out), "/pincheck");
+  mkdir(out, 0755);
+  snprintf(out + strlen(out), len - strlen(out), "/%08x.idx", h);
+}
+
+// load the cached netlist if it is newer than the design, else rebuild it
+static int load_netlist(Netlist *nl, const char *design, const char *cache,
+                        int *cached)
+{
+  struct stat src, idx;
+
+  *cached = 0;
+  if(cache && !stat(design, &src) && !stat(cache, &idx) &&
+     idx.st_mtime >= src.st_mtime && !nl_load(nl, cache) && nl->ndesigns == 1)
+  {
+    *cached = 1;
+    return 0;
+  }
+  if(cache && nl->mapping)
+    nl_free(nl);
+
+  nl_init(nl);
+  if(nl_add_ms13(nl, design) < 0)
+    return -1;
+  if(cache && nl_save(nl, cache))
+    fprintf(stderr, "pincheck: cannot write cache %s: %s\n", cache, strerror(errno));
+  return 0;
+}
+
+/*****************************  MAIN  *****************************/
+
+int main(int argc, char **argv)
+{
+  char mapdefault[PATH_MAX], cachedefault[PATH_MAX];
+  const char *mappath = NULL, *cache = NULL;
+  int nocache = 0, verbose = 0, errors = 0, cached, i, opt;
+  struct timespec t0, t1;
+  Netlist nl;
+
+  for(opt = 1; opt < argc && argv[opt][0] == '-'; opt++)
+  {
+    if(!strcmp(argv[opt], "-m") && opt + 1 < argc) mappath = argv[++opt];
+    else if(!strcmp(argv[opt], "-c") && opt + 1 < argc) cache = argv[++opt];
+    else if(!strcmp(argv[opt], "-n")) nocache = 1;
+    else if(!strcmp(argv[opt], "-v")) verbose = 1;
+    else break;
+  }
+  if(argc - opt < 2)
+  {
+    fprintf(stderr, "usage: pincheck [-v] [-m pinmap] [-c cache | -n] "
+                    "<design.ms13> <program.c>...\n");
+    return 2;
+  }
+
+  if(!mappath)
+  {
+    // hexbot.pinmap sits next to the tool sources
+    const char *slash = strrchr(argv[0], '/');
+    snprintf(mapdefault, sizeof(mapdefault), "%.*shexbot.pinmap",
+             slash ? (int)(slash - argv[0] + 1) : 0, argv[0]);
+    mappath = mapdefault;
+  }
+  if(load_pinmap(mappath))
+  {
+    fprintf(stderr, "pincheck: cannot read pin map %s\n", mappath);
+    return 2;
+  }
+
+  if(!cache && !nocache)
+  {
+    default_cache(argv[opt], cachedefault, sizeof(cachedefault));
+    cache = cachedefault;
+  }
+  if(nocache) cache = NULL;
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  if(load_netlist(&nl, argv[opt], cache, &cached))
+  {
+    fprintf(stderr, "pincheck: cannot decode %s\n", argv[opt]);
+    return 2;
+  }
+
+  for(i = opt + 1; i < argc; i++)
+    errors += check_program(&nl, argv[i], verbose) != 0;
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+
+  printf("%d of %d programs with wiring errors, %.2f ms (netlist %s)\n",
+         errors, argc - opt - 1,
+         (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6,
+         cached ? "from cache" : "decoded");
+  nl_free(&nl);
+  return errors != 0;
+}
@@ -0,0 +1,281 @@
+//Prints the records of a compressed NESI+ log as text, see packlog.h
+//
+//Build:  cc -O2 -I.. -o pklcat pklcat.c ../bytes.c
+//
+//  pklcat [-q] <DATALOG.PKL>
+//
+//Writes the records in order to stdout, the same text jnlcat gives for a
+//journal of the same run, and reports on stderr how many blocks and
+//records were good.  Of the two copies a block can have, the one written
+//last wins.  -q only checks.  Exit status is 0 when every block is good,
+//1 when a torn, foreign or undecodable block was skipped.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "bytes.h"
+
+#define PACK_BLOCK    512
+#define PACK_HEADER   18
+#define PACK_PAYLOAD  (PACK_BLOCK - PACK_HEADER)
+#define PACK_RAW      1024
+#define PACK_SHAPES   6
+#define PACK_SHAPE    48
+#define PACK_FIELDS   16
+
+#define PACK_NUMBER   0x01
+#define PACK_STAMP    0x02
+#define PACK_NEW      0x80
+#define PACK_WHOLE    0xFF
+
+#define LZ_MIN        3
+
+static const char dayNames[7][4] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+static const char monthNames[12][4] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                       "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+typedef struct
+{
+  const unsigned char *p, *end;
+  int bad;
+} Reader;
+
+static unsigned byte(Reader *r)
+{
+  if(r->p >= r->end)
+  {
+    r->bad = 1;
+    return 0;
+  }
+  return *r->p++;
+}
+
+static uint32_t varint(Reader *r)
+{
+  uint32_t v = 0;
+  int shift = 0;
+  unsigned b;
+
+  do
+  {
+    b = byte(r);
+    if(shift < 32) v |= (uint32_t)(b & 0x7F) << shift;
+    shift += 7;
+  } while(b & 0x80 && !r->bad);
+  return v;
+}
+
+static uint32_t change(Reader *r, uint32_t from)
+{
+  uint32_t z = varint(r);
+
+  return from + ((z >> 1) ^ -(z & 1));
+}
+
+static void stamp(FILE *out, uint32_t seconds)
+{
+  static const int monthDays[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  uint32_t days = seconds/86400, left = seconds%86400;
+  int year = 0, month = 0, length;
+
+  fprintf(out, "%s ", dayNames[(days + 6) % 7]);
+  for(;;)
+  {
+    length = year % 4 ? 365 : 366;
+    if(days < (uint32_t)length) break;
+    days -= length;
+    year++;
+  }
+  for(;;)
+  {
+    length = monthDays[month] + (month == 1 && year % 4 == 0);
+    if(days < (uint32_t)length) break;
+    days -= length;
+    month++;
+  }
+  fprintf(out, "%s %2u %02u:%02u:%02u %04d", monthNames[month], (unsigned)days + 1,
+          (unsigned)(left/3600), (unsigned)(left/60%60), (unsigned)(left%60), 2000 + year);
+}
+
+// undo the LZ pass, 0 if the payload does not give exactly raw bytes
+static int expand(const unsigned char *in, int length, unsigned char *raw, int rawLength)
+{
+  int i = 0, n = 0, bit, offset, count;
+  unsigned control;
+
+  while(n < rawLength)
+  {
+    if(i >= length) return 0;
+    control = in[i++];
+    for(bit = 0; bit < 8 && n < rawLength; bit++)
+    {
+      if(control & 1 << bit)
+      {
+        if(i + 2 > length) return 0;
+        offset = in[i] | (in[i + 1] & 3) << 8;
+        count = (in[i + 1] >> 2) + LZ_MIN;
+        i += 2;
+        if(offset < 1 || offset > n || n + count > rawLength) return 0;
+        while(count--) raw[n] = raw[n - offset], n++;
+      }
+      else
+      {
+        if(i >= length) return 0;
+        raw[n++] = in[i++];
+      }
+    }
+  }
+  return 1;
+}
+
+// the records of a good block to out, 0 if they do not decode
+static int decode(const unsigned char *b, FILE *out, unsigned long *records)
+{
+  static unsigned char raw[PACK_RAW];
+  struct
+  {
+    unsigned length, fields;
+    unsigned char text[PACK_SHAPE];
+    uint32_t last[PACK_FIELDS];
+  } shapes[PACK_SHAPES];
+  unsigned count = 0, length = bytes.get16(b + 2), rawLength = bytes.get16(b + 4), n, head, k, j, f;
+  uint32_t lastStamp = 0, v;
+  Reader r;
+
+  if(rawLength)
+  {
+    if(rawLength > PACK_RAW || !expand(b + PACK_HEADER, length, raw, rawLength)) return 0;
+    r.p = raw;
+    r.end = raw + rawLength;
+  }
+  else
+  {
+    r.p = b + PACK_HEADER;
+    r.end = r.p + length;
+  }
+  r.bad = 0;
+
+  for(n = 0; n < bytes.get16(b + 6); n++)
+  {
+    head = byte(&r);
+    if(head == PACK_WHOLE)
+    {
+      length = varint(&r);
+      if(r.bad || length > (unsigned)(r.end - r.p)) return 0;
+      if(out) fwrite(r.p, 1, length, out);
+      r.p += length;
+    }
+    else
+    {
+      k = head & ~PACK_NEW;
+      if(head & PACK_NEW)
+      {
+        if(k != count || k >= PACK_SHAPES) return 0;
+        shapes[k].length = varint(&r);
+        if(r.bad || shapes[k].length > PACK_SHAPE || shapes[k].length > (unsigned)(r.end - r.p)) return 0;
+        memcpy(shapes[k].text, r.p, shapes[k].length);
+        r.p += shapes[k].length;
+        shapes[k].fields = 0;
+        for(j = 0; j < shapes[k].length; j++)
+          if(shapes[k].text[j] == PACK_NUMBER || shapes[k].text[j] == PACK_STAMP)
+            shapes[k].last[shapes[k].fields++] = 0;
+        count++;
+      }
+      else if(k >= count)
+        return 0;
+
+      for(j = f = 0; j < shapes[k].length; j++)
+      {
+        if(shapes[k].text[j] == PACK_STAMP)
+        {
+          v = lastStamp = change(&r, lastStamp);
+          f++;
+          if(out) stamp(out, v);
+        }
+        else if(shapes[k].text[j] == PACK_NUMBER)
+        {
+          v = shapes[k].last[f] = change(&r, shapes[k].last[f]);
+          f++;
+          if(out) fprintf(out, "%ld", (long)(int32_t)v);
+        }
+        else if(out)
+          fputc(shapes[k].text[j], out);
+      }
+    }
+    if(r.bad) return 0;
+  }
+  *records += n;
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  unsigned char b[PACK_BLOCK], pending[PACK_BLOCK];
+  unsigned long slot = 0, blocks = 0, records = 0, skipped = 0;
+  int quiet = 0, havePending = 0, opt;
+  size_t got;
+  FILE *f;
+
+  while((opt = getopt(argc, argv, "q")) != -1)
+    quiet = opt == 'q' ? 1 : -1;
+  if(quiet < 0 || optind != argc - 1)
+  {
+    fprintf(stderr, "usage: pklcat [-q] <DATALOG.PKL>\n");
+    return 2;
+  }
+  f = fopen(argv[optind], "rb");
+  if(!f)
+  {
+    fprintf(stderr, "pklcat: cannot open %s\n", argv[optind]);
+    return 2;
+  }
+
+  // copies of one block sit in neighbouring slots, sequence numbers rise
+  for(;; slot++)
+  {
+    got = fread(b, 1, PACK_BLOCK, f);
+    if(got == PACK_BLOCK && b[0] == 'P' && b[1] == 'K' && bytes.get16(b + 2) <= PACK_PAYLOAD &&
+       bytes.get32(b + 14) == bytes.crc32(b + PACK_HEADER, bytes.get16(b + 2), bytes.crc32(b, 14, 0)))
+    {
+      if(havePending && bytes.get32(b + 8) == bytes.get32(pending + 8))
+      {
+        if((uint16_t)(bytes.get16(b + 12) - bytes.get16(pending + 12)) < 0x8000)
+          memcpy(pending, b, PACK_BLOCK);
+        continue;
+      }
+      if(havePending && bytes.get32(b + 8) < bytes.get32(pending + 8))
+      {
+        fprintf(stderr, "pklcat: slot %lu: block %lu out of sequence\n", slot, (unsigned long)bytes.get32(b + 8));
+        skipped++;
+        continue;
+      }
+    }
+    else if(got > 0)
+    {
+      fprintf(stderr, "pklcat: slot %lu: %s\n", slot, got < PACK_BLOCK ? "short block" : "bad block");
+      skipped++;
+      continue;
+    }
+
+    if(havePending)
+    {
+      if(decode(pending, quiet ? NULL : stdout, &records))
+        blocks++;
+      else
+      {
+        fprintf(stderr, "pklcat: block %lu does not decode\n", (unsigned long)bytes.get32(pending + 8));
+        skipped++;
+      }
+    }
+    if(got == 0) break;
+    memcpy(pending, b, PACK_BLOCK);
+    havePending = 1;
+  }
+  fclose(f);
+
+  fprintf(stderr, "pklcat: %lu good blocks, %lu records", blocks, records);
+  if(skipped) fprintf(stderr, ", %lu skipped", skipped);
+  fprintf(stderr, "\n");
+  return skipped ? 1 : 0;
+}
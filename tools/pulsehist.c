@@ -0,0 +1,199 @@
+//Inter-arrival times of the tube pulses in a PULSES.BIN, see pulselog.h
+//
+//Build:  cc -O2 -I.. -o pulsehist pulsehist.c ../bytes.c -lm
+//
+//  pulsehist [-b bins-per-decade] [-m motor] [-c] <PULSES.BIN>
+//
+//Prints, per motor position, the intervals between pulses in log spaced
+//bins (default 10 a decade) next to what a Poisson source of the same mean
+//rate puts in each, and the rate and CPM that mean gives.  A tube's dead
+//time shows as the short bins falling short of the exponential, noise
+//pulses as them running over.  Intervals across lost stamps, a bad block
+//or a motor change are not counted.  -m keeps one position (-2 for while
+//the servos moved), -c prints CSV instead.  Exit status is 0 when every
+//block was good, 1 when one was skipped.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bytes.h"
+
+#define PULSE_BLOCK   512
+#define PULSE_HEADER  22
+#define PULSE_PAYLOAD (PULSE_BLOCK - PULSE_HEADER)
+
+#define MOTORS        8           // -2 to 5, enough for the four servos
+#define BINS_MAX      128
+
+typedef struct
+{
+  uint64_t intervals, stamps, lost;
+  double ticks;                   // sum of the intervals
+  uint64_t bins[BINS_MAX];
+} Motor;
+
+static Motor motors[MOTORS];
+
+// the bin of an interval of ticks, the first bin starts at one tick
+static int bin(uint32_t ticks, int perDecade)
+{
+  int b = ticks ? (int)floor(log10(ticks)*perDecade) : 0;
+  return b < BINS_MAX ? b : BINS_MAX - 1;
+}
+
+static void interval(Motor *m, uint32_t ticks, int perDecade)
+{
+  m->intervals++;
+  m->ticks += ticks;
+  m->bins[bin(ticks, perDecade)]++;
+}
+
+// one good block, intervals from the last stamp before it when that is
+// still *last's; returns 0 if the payload does not decode
+static int block(const unsigned char *b, int perDecade, uint32_t *last, int *lastMotor)
+{
+  int length = bytes.get16(b + 2), motor = (signed char)b[16], i = PULSE_HEADER, shift, marker = 0;
+  unsigned count = bytes.get16(b + 12), seen = 1;
+  uint32_t stamp = bytes.get32(b + 8), v;
+  Motor *m;
+
+  if(motor < -2 || motor >= MOTORS - 2 || !count) return 0;
+  m = &motors[motor + 2];
+  m->stamps += count;
+  m->lost += bytes.get16(b + 14);
+  if(*lastMotor == motor && !bytes.get16(b + 14))
+    interval(m, stamp - *last, perDecade);
+
+  while(i < PULSE_HEADER + length)
+  {
+    for(v = 0, shift = 0; shift < 35; shift += 7)
+    {
+      if(i == PULSE_HEADER + length) return 0;
+      v |= (uint32_t)(b[i] & 0x7F) << shift;
+      if(!(b[i++] & 0x80)) break;
+    }
+    if(marker == 1)
+    {
+      m->lost += v;
+      marker = 2;         // the next interval spans the lost stamps
+    }
+    else if(!v)
+      marker = 1;
+    else
+    {
+      stamp += v - 1;
+      if(marker != 2) interval(m, v - 1, perDecade);
+      marker = 0;
+      seen++;
+    }
+  }
+  if(seen != count) return 0;
+  *last = stamp;
+  *lastMotor = motor;
+  return 1;
+}
+
+// the whole ticks of bin b, [*lo, *hi); both stamps are cut to a tick,
+// so an interval reads as k ticks from half a tick under k to half over
+static void edges(int b, int perDecade, double *lo, double *hi)
+{
+  *lo = b ? ceil(pow(10, (double)b/perDecade) - 1e-9) : 0;
+  *hi = ceil(pow(10, (double)(b + 1)/perDecade) - 1e-9);
+}
+
+static void print(int motor, const Motor *m, int perDecade, int tickUs, int csv)
+{
+  double mean = m->ticks/m->intervals, rate = 1/mean, lo, hi, expected;
+  int b, top = 0;
+
+  for(b = 0; b < BINS_MAX; b++)
+    if(m->bins[b]) top = b;
+  if(!csv)
+  {
+    printf("motor %d: %llu stamps, %llu lost, %llu intervals, mean %.1f us, %.2f/s, %.1f CPM\n",
+           motor, (unsigned long long)m->stamps, (unsigned long long)m->lost,
+           (unsigned long long)m->intervals, mean*tickUs, 1e6/(mean*tickUs), 60e6/(mean*tickUs));
+    printf("%12s %12s %10s %12s %7s\n", "from us", "to us", "intervals", "poisson", "ratio");
+  }
+  for(b = 0; b <= top; b++)
+  {
+    edges(b, perDecade, &lo, &hi);
+    if(lo >= hi) continue;      // no whole tick in it
+    expected = m->intervals*(exp(-(lo ? lo - 0.5 : 0)*rate) - exp(-(hi - 0.5)*rate));
+    if(csv)
+      printf("%d,%.0f,%.0f,%llu,%.1f\n", motor, lo*tickUs, hi*tickUs,
+             (unsigned long long)m->bins[b], expected);
+    else
+      printf("%12.0f %12.0f %10llu %12.1f %7.3f\n", lo*tickUs, hi*tickUs,
+             (unsigned long long)m->bins[b], expected, expected > 0 ? m->bins[b]/expected : 0);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  unsigned char b[PULSE_BLOCK];
+  int perDecade = 10, only = -100, csv = 0, opt, lastMotor = -100, tickUs = 0, motor;
+  uint64_t good = 0, bad = 0;
+  uint32_t last = 0, sequence = 0;
+  FILE *f;
+
+  while((opt = getopt(argc, argv, "b:m:c")) != -1)
+  {
+    switch(opt)
+    {
+      case 'b': perDecade = atoi(optarg); break;
+      case 'm': only = atoi(optarg); break;
+      case 'c': csv = 1; break;
+      default: perDecade = 0; break;
+    }
+  }
+  if(perDecade < 1 || perDecade > 30 || optind != argc - 1)
+  {
+    fprintf(stderr, "usage: pulsehist [-b bins-per-decade] [-m motor] [-c] <PULSES.BIN>\n");
+    return 2;
+  }
+  f = fopen(argv[optind], "rb");
+  if(!f)
+  {
+    perror(argv[optind]);
+    return 2;
+  }
+
+  // blocks are written once each, in order; a bad one breaks the chain
+  while(fread(b, 1, PULSE_BLOCK, f) == PULSE_BLOCK)
+  {
+    if(b[0] != 'P' || b[1] != 'T' || bytes.get16(b + 2) > PULSE_PAYLOAD ||
+       bytes.get32(b + 18) != bytes.crc32(b + PULSE_HEADER, bytes.get16(b + 2), bytes.crc32(b, 18, 0)) ||
+       bytes.get32(b + 4) != sequence)
+    {
+      bad++;
+      lastMotor = -100;
+      sequence++;
+      continue;
+    }
+    sequence++;
+    if(!tickUs) tickUs = b[17];
+    if(block(b, perDecade, &last, &lastMotor))
+      good++;
+    else
+    {
+      bad++;
+      lastMotor = -100;
+    }
+  }
+  fclose(f);
+
+  if(csv) printf("motor,from_us,to_us,intervals,poisson\n");
+  for(motor = -2; motor < MOTORS - 2; motor++)
+  {
+    if((only != -100 && motor != only) || !motors[motor + 2].intervals) continue;
+    print(motor, &motors[motor + 2], perDecade, tickUs, csv);
+    if(!csv) printf("\n");
+  }
+  fprintf(stderr, "pulsehist: %llu blocks good, %llu skipped, %d us a tick\n",
+          (unsigned long long)good, (unsigned long long)bad, tickUs);
+  return bad ? 1 : 0;
+}
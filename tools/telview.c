@@ -0,0 +1,88 @@
+//Live viewer for NESI+ telemetry, see telemetry.h
+//
+//Build:  cc -O2 -o telview telview.c hostlink.c
+//
+//  telview [-d /dev/ttyACM0 | -e "command"] [-q]
+//
+//Prints each record as it arrives with the time it came in, and flags gaps
+//in the sequence numbers where the node's ring overflowed.  Press the
+//node's button to start the stream.  -q only prints the summary at the end
+//of the stream.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "hostlink.h"
+
+static double seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+int main(int argc, char **argv)
+{
+  const char *device = NULL, *command = NULL;
+  char line[256], *text;
+  unsigned long seq, expect = 0, records = 0, missing = 0, dropped = 0;
+  int quiet = 0, opt, started = 0;
+  double t0 = 0, t;
+  HostLink link;
+
+  while((opt = getopt(argc, argv, "d:e:q")) != -1)
+  {
+    switch(opt)
+    {
+      case 'd': device = optarg; break;
+      case 'e': command = optarg; break;
+      case 'q': quiet = 1; break;
+      default: device = command = NULL; optind = argc; break;
+    }
+  }
+  if(!device && !command)
+  {
+    fprintf(stderr, "usage: telview [-d /dev/ttyACM0 | -e \"command\"] [-q]\n");
+    return 2;
+  }
+  if(link_open(&link, device, command))
+  {
+    fprintf(stderr, "telview: cannot open %s\n", command ? command : device);
+    return 1;
+  }
+
+  while(link_line(&link, line, sizeof(line)) >= 0)
+  {
+    t = seconds();
+    if(!started) t0 = t;
+    started = 1;
+
+    if(!strncmp(line, "#dropped,", 9))
+    {
+      dropped = strtoul(line + 9, NULL, 10);
+      if(!quiet) printf("%10.3f  -- node dropped %lu records so far\n", t - t0, dropped);
+      continue;
+    }
+
+    seq = strtoul(line, &text, 10);
+    if(*text != ',')
+      continue;   // not a record, noise from a reconnect
+    if(records && seq > expect)
+    {
+      missing += seq - expect;
+      if(!quiet) printf("%10.3f  -- %lu records missing\n", t - t0, seq - expect);
+    }
+    expect = seq + 1;
+    records++;
+    if(!quiet) printf("%10.3f  %6lu  %s\n", t - t0, seq, text + 1);
+    fflush(stdout);
+  }
+  link_close(&link);
+
+  t = started ? seconds() - t0 : 0;
+  fprintf(stderr, "telview: %lu records in %.3f s, %lu missing, node reports %lu dropped\n",
+          records, t, missing, dropped);
+  return 0;
+}
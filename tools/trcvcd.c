@@ -0,0 +1,181 @@
+//Turns a bus trace, BUS.TRC, into a VCD for GTKWave, see bustrace.h
+//
+//Build:  cc -O2 -I.. -o trcvcd trcvcd.c ../bytes.c
+//
+//  logpull -f BUS.TRC -n -o bus.trc && trcvcd bus.trc > bus.vcd
+//  trcvcd [-l] <BUS.TRC>
+//
+//The trace has the steps of the bus, not its levels, so the VCD shows
+//them as signals of their own: an i2c2 scope with busy from start to
+//stop, the bytes written and read with the answers to them, and events
+//for the conditions and timeouts; a uart2 scope with an event and the
+//length of every burst.  Times are from Timer1's start at boot, in ns.
+//
+//Once the ring has wrapped, the Timer1 period of the oldest events is
+//lost with the event that held it, so they are skipped up to the first
+//period marker.  The markers hold 24 bits of periods, the latest such
+//before the dump is taken, so events from over 6 days before it come out
+//late.  -l prints the events as text instead, one a line.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bytes.h"
+
+#define TRACE_EVENTS 256          // BUS_TRACE_EVENTS
+#define TRACE_HEADER 16
+
+enum {NONE, PERIOD, START, RESTART, WRITE, ACK, READ, ACKOUT, STOP, TIMEOUT, RX, TX, KINDS};
+
+static const char *kinds[KINDS] =
+  {"none", "period", "start", "restart", "write", "ack", "read", "ackout",
+   "stop", "timeout", "rx", "tx"};
+
+// VCD identifiers
+#define BUSY      "!"
+#define EV_START  "\""
+#define EV_RESTRT "#"
+#define EV_STOP   "$"
+#define WRITING   "~"
+#define WRITTEN   "&"
+#define ANSWER    "'"
+#define RECEIVED  "("
+#define ACKED     ")"
+#define EV_TMOUT  "*"
+#define TMOUT     "+"
+#define EV_RX     ","
+#define RX_BYTES  "-"
+#define EV_TX     "."
+#define TX_BYTES  "/"
+
+static void vector(unsigned v, int bits, const char *id)
+{
+  char b[17];
+  int i;
+
+  for(i = 0; i < bits; i++) b[i] = v >> (bits - 1 - i) & 1 ? '1' : '0';
+  b[bits] = 0;
+  printf("b%s %s\n", b, id);
+}
+
+static void header(void)
+{
+  printf("$version trcvcd $end\n$timescale 1ns $end\n");
+  printf("$scope module i2c2 $end\n");
+  printf("$var wire 1 " BUSY " busy $end\n");
+  printf("$var event 1 " EV_START " start $end\n");
+  printf("$var event 1 " EV_RESTRT " restart $end\n");
+  printf("$var event 1 " EV_STOP " stop $end\n");
+  printf("$var wire 1 " WRITING " writing $end\n");
+  printf("$var reg 8 " WRITTEN " write $end\n");
+  printf("$var reg 2 " ANSWER " ack $end\n");
+  printf("$var reg 8 " RECEIVED " read $end\n");
+  printf("$var wire 1 " ACKED " ackout $end\n");
+  printf("$var event 1 " EV_TMOUT " timeout $end\n");
+  printf("$var reg 4 " TMOUT " timeout_in $end\n");
+  printf("$upscope $end\n");
+  printf("$scope module uart2 $end\n");
+  printf("$var event 1 " EV_RX " rx $end\n");
+  printf("$var reg 8 " RX_BYTES " rx_bytes $end\n");
+  printf("$var event 1 " EV_TX " tx $end\n");
+  printf("$var reg 8 " TX_BYTES " tx_bytes $end\n");
+  printf("$upscope $end\n$enddefinitions $end\n");
+  printf("#0\n$dumpvars\n0" BUSY "\n0" WRITING "\nbx " WRITTEN "\nbx " ANSWER "\nbx " RECEIVED
+         "\nx" ACKED "\nbx " TMOUT "\nb0 " RX_BYTES "\nb0 " TX_BYTES "\n$end\n");
+}
+
+static void change(int kind, unsigned data)
+{
+  switch(kind)
+  {
+    case START: printf("1" EV_START "\n1" BUSY "\n"); break;
+    case RESTART: printf("1" EV_RESTRT "\n"); break;
+    case STOP: printf("1" EV_STOP "\n0" BUSY "\n"); break;
+    case WRITE: printf("1" WRITING "\n"); vector(data, 8, WRITTEN); break;
+    case ACK: printf("0" WRITING "\n"); vector(data, 2, ANSWER); break;
+    case READ: vector(data, 8, RECEIVED); break;
+    case ACKOUT: printf("%u" ACKED "\n", data & 1); break;
+    case TIMEOUT: printf("1" EV_TMOUT "\n"); vector(data, 4, TMOUT); break;
+    case RX: printf("1" EV_RX "\n"); vector(data, 8, RX_BYTES); break;
+    case TX: printf("1" EV_TX "\n"); vector(data, 8, TX_BYTES); break;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  unsigned char head[TRACE_HEADER], e[4];
+  int list = 0, opt, kind, known, marked = 0;
+  unsigned n, i, skipped = 0, shown = 0, timeouts = 0, starts = 0;
+  uint32_t rate, now, v, period = 0;
+  uint64_t ticks = 0, first = 0, last = UINT64_MAX, ns, at = UINT64_MAX;
+  FILE *f;
+
+  while((opt = getopt(argc, argv, "l")) != -1)
+  {
+    if(opt != 'l') break;
+    list = 1;
+  }
+  if(opt != -1 || optind != argc - 1)
+  {
+    fprintf(stderr, "usage: trcvcd [-l] <BUS.TRC>\n");
+    return 2;
+  }
+  f = fopen(argv[optind], "rb");
+  if(!f)
+  {
+    perror(argv[optind]);
+    return 2;
+  }
+  if(fread(head, 1, TRACE_HEADER, f) != TRACE_HEADER || memcmp(head, "BTRC", 4) ||
+     !(rate = bytes.get32(head + 4)))
+  {
+    fprintf(stderr, "%s: not a bus trace\n", argv[optind]);
+    return 2;
+  }
+  now = bytes.get32(head + 8);
+  n = bytes.get16(head + 14);
+  known = n < TRACE_EVENTS;     // the ring never wrapped, it starts in period 0
+
+  if(!list) header();
+  for(i = 0; i < n && fread(e, 1, 4, f) == 4; i++)
+  {
+    kind = e[2];
+    if(kind == PERIOD)
+    {
+      // 24 bits of periods: the first is the latest such before the dump,
+      // the next count on across their wrap
+      v = bytes.get16(e) | (uint32_t)e[3] << 16;
+      period = marked ? period + ((v - period) & 0xFFFFFF) : now - ((now - v) & 0xFFFFFF);
+      marked = known = 1;
+      continue;
+    }
+    if(!known || kind <= PERIOD || kind >= KINDS)
+    {
+      skipped++;
+      continue;
+    }
+    ticks = (uint64_t)period << 16 | bytes.get16(e);
+    if(last == UINT64_MAX) first = ticks;
+    last = ticks;
+    shown++;
+    if(kind == START) starts++;
+    if(kind == TIMEOUT) timeouts++;
+
+    if(list)
+      printf("%14.1f %-8s %u\n", ticks*1e6/rate, kinds[kind], e[3]);
+    else
+    {
+      ns = ticks*1000000000ull/rate;
+      if(ns != at) printf("#%llu\n", (unsigned long long)ns);
+      at = ns;
+      change(kind, e[3]);
+    }
+  }
+  if(i < n) fprintf(stderr, "%s: cut short after %u of %u events\n", argv[optind], i, n);
+
+  fprintf(stderr, "%u events over %.3f ms, %u transfers, %u timeouts, %u skipped\n",
+          shown, shown ? (last - first)*1e3/rate : 0.0, starts, timeouts, skipped);
+  return i < n;
+}